@@ -0,0 +1,116 @@
+﻿#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <thread>
+
+#include "Check.h"
+#include "EncodePipeline.h"
+#include "FakeEncoder.h"
+#include "SimulcastEncoder.h"
+#include "SyntheticFrameSource.h"
+
+// Every heap allocation in the test binary goes through these, on any
+// thread, so a test can tell how many a stretch of pipeline work made.
+namespace
+{
+    std::atomic<uint64_t> s_allocations{ 0 };
+
+    void* Allocate(size_t size, size_t alignment)
+    {
+        s_allocations.fetch_add(1, std::memory_order_relaxed);
+        if (size == 0)
+            size = 1;
+        void* memory = alignment > alignof(std::max_align_t)
+            ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+            : std::malloc(size);
+        if (memory == nullptr)
+            throw std::bad_alloc();
+        return memory;
+    }
+}
+
+void* operator new(size_t size) { return Allocate(size, 0); }
+void* operator new[](size_t size) { return Allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return Allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return Allocate(size, static_cast<size_t>(alignment)); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace
+{
+    // Waits, without allocating, until the encoder has made the given
+    // number of frames.
+    bool WaitEncoded(const FakeEncoder& encoder, uint64_t frames)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while (encoder.Encoded() < frames)
+        {
+            if (SecondsSince(start) > 30)
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+}
+
+// A source, the encode and delivery threads and a simulcast layer, run
+// until every pool and queue has been through its deepest state, must not
+// touch the heap again: frames, their release hooks, queue nodes, scaled
+// layers and access units all come from storage set up at start.
+void TestAllocations()
+{
+    constexpr uint64_t WarmUp = 200;
+    constexpr uint64_t Measured = 500;
+
+    SyntheticFrameSource::Config config;
+    config.width = 640;
+    config.height = 360;
+    SyntheticFrameSource source(config);
+
+    FakeEncoder encoder;
+    EncodePipeline::Config pipelineConfig;
+    pipelineConfig.captureQueueCapacity = config.bufferCount;
+    pipelineConfig.captureDropPolicy = DropPolicy::DropOldest;
+    EncodePipeline pipeline(pipelineConfig,
+        [&encoder](BorrowedFrame frame) { return encoder.Encode(std::move(frame)); },
+        [](const EncodedFrameRef&) {});
+
+    SimulcastEncoder::Config layers;
+    layers.layers.push_back({ { 320, 180 }, "low" });
+    SimulcastEncoder simulcast(std::move(layers),
+        []() { return std::make_unique<FakeEncoder>(); },
+        [](const EncodedFrameRef&) {});
+    CHECK(simulcast.Initialize());
+
+    pipeline.Start();
+    simulcast.Start();
+    CHECK(source.Start(
+        [&](BorrowedFrame frame)
+        {
+            simulcast.PostFrame(frame.View(), frame.ArrivalTime());
+            pipeline.PostFrame(std::move(frame));
+        }));
+
+    // The layer must be encoding all along, not starved of buffers.
+    SimulcastEncoder::LayerStats before;
+    SimulcastEncoder::LayerStats after;
+    CHECK(WaitEncoded(encoder, WarmUp));
+    CHECK(simulcast.GetLayerStats(simulcast.FirstLayer(), before));
+    uint64_t allocations = s_allocations.load();
+    CHECK(WaitEncoded(encoder, encoder.Encoded() + Measured));
+    CHECK(s_allocations.load() == allocations);
+    CHECK(simulcast.GetLayerStats(simulcast.FirstLayer(), after));
+    CHECK(after.queues.framesEncoded >= before.queues.framesEncoded + Measured / 2);
+    source.Stop();
+    source.WaitFramesReleased();
+    pipeline.Stop();
+    simulcast.Stop();
+}
@@ -0,0 +1,142 @@
+﻿#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+#include "Check.h"
+
+void TestBufferPool()
+{
+    {
+        BufferPool pool({ { 4096, 2 }, { 100, 3 } });
+        PooledBuffer small = pool.Acquire(64);
+        CHECK(small && small.Capacity() == 128 && small.Size() == 64);
+        CHECK(reinterpret_cast<uintptr_t>(small.Data()) % BufferPool::Alignment == 0);
+
+        // The smallest class that fits, then the next one up once it runs out.
+        PooledBuffer a = pool.Acquire(100);
+        PooledBuffer b = pool.Acquire(100);
+        PooledBuffer c = pool.Acquire(100);
+        CHECK(a.Capacity() == 128 && b.Capacity() == 128 && c.Capacity() == 4096);
+        PooledBuffer d = pool.Acquire(100);
+        PooledBuffer e = pool.Acquire(100);
+        CHECK(d && !e);
+        CHECK(!pool.Acquire(5000));
+
+        BufferPool::Stats stats = pool.GetStats();
+        CHECK(stats.acquired == 5 && stats.misses == 2);
+        CHECK(stats.classes.size() == 2 && stats.classes[0].inUse == 3 && stats.classes[1].inUse == 2);
+        CHECK(stats.reservedBytes == 3 * 128 + 2 * 4096);
+
+        // Moving hands the block over without returning it.
+        PooledBuffer moved = std::move(a);
+        CHECK(!a && moved && pool.GetStats().classes[0].inUse == 3);
+        moved.Reset();
+        small = PooledBuffer();
+        CHECK(pool.GetStats().classes[0].inUse == 1 && pool.GetStats().classes[0].highWater == 3);
+        CHECK(pool.Acquire(10) && pool.Acquire(10));
+        c.SetSize(1 << 20);
+        CHECK(c.Size() == c.Capacity());
+    }
+
+    {
+        BufferPool empty({ { 64, 0 } });
+        CHECK(!empty.Acquire(1) && empty.GetStats().misses == 1);
+    }
+
+    // Threads stamp every block they hold and check nobody else touched it,
+    // so a block handed out twice shows up.
+    const uint32_t blockCount = 16;
+    BufferPool pool({ { 256, blockCount } });
+    std::atomic<uint32_t> corrupted{ 0 };
+    std::atomic<uint64_t> acquired{ 0 };
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t]()
+            {
+                std::vector<PooledBuffer> held;
+                for (uint32_t i = 0; i < 50000; i++)
+                {
+                    PooledBuffer buffer = pool.Acquire(200);
+                    if (buffer)
+                    {
+                        acquired++;
+                        std::memset(buffer.Data(), static_cast<int>(t + 1), buffer.Capacity());
+                        held.push_back(std::move(buffer));
+                    }
+                    if (held.size() > 3 || (!buffer && !held.empty()))
+                    {
+                        const uint8_t* data = held.front().Data();
+                        for (size_t j = 0; j < held.front().Capacity(); j++)
+                        {
+                            if (data[j] != t + 1)
+                            {
+                                corrupted++;
+                                break;
+                            }
+                        }
+                        held.erase(held.begin());
+                    }
+                }
+            });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    BufferPool::Stats stats = pool.GetStats();
+    CHECK(corrupted == 0);
+    CHECK(stats.acquired == acquired && stats.classes[0].inUse == 0 && stats.classes[0].highWater <= blockCount);
+    std::vector<PooledBuffer> all;
+    for (uint32_t i = 0; i < blockCount; i++)
+        all.push_back(pool.Acquire(256));
+    bool distinct = true;
+    for (uint32_t i = 0; i < blockCount; i++)
+    {
+        for (uint32_t j = i + 1; j < blockCount; j++)
+            distinct = distinct && all[i] && all[i].Data() != all[j].Data();
+    }
+    CHECK(distinct && !pool.Acquire(1));
+}
+
+void BenchmarkBufferPool(uint32_t iterations)
+{
+    const size_t size = 1920 * 1080 * 3 / 2;
+    BufferPool pool({ { size, 8 } });
+    std::printf("\nbuffer pool, ns per acquire and release of a 1080p frame\n");
+    for (uint32_t threadCount : { 1u, 4u })
+    {
+        for (bool pooled : { true, false })
+        {
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> threads;
+            for (uint32_t t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back([&]()
+                    {
+                        for (uint32_t i = 0; i < iterations; i++)
+                        {
+                            if (pooled)
+                            {
+                                PooledBuffer buffer = pool.Acquire(size);
+                                if (buffer)
+                                    buffer.Data()[0] = 1;
+                            }
+                            else
+                            {
+                                std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+                                buffer[0] = 1;
+                            }
+                        }
+                    });
+            }
+            for (std::thread& thread : threads)
+                thread.join();
+            double seconds = SecondsSince(start);
+            std::printf("%u thread%s %-8s %10.1f\n", threadCount, threadCount > 1 ? "s" : " ", pooled ? "pool" : "heap",
+                seconds * 1e9 / (static_cast<double>(iterations) * threadCount));
+        }
+    }
+}
@@ -0,0 +1,196 @@
+﻿#include <cmath>
+#include <cstdint>
+
+#include "CaptureClock.h"
+#include "Check.h"
+
+namespace
+{
+    constexpr int64_t Interval = CaptureClock::TicksPerSecond / 30;
+    constexpr int64_t Millisecond = CaptureClock::TicksPerSecond / 1000;
+
+    // Reproducible jitter, uniform in [-range, range].
+    class Jitter
+    {
+    public:
+        explicit Jitter(int64_t range) : m_range(range) {}
+
+        int64_t Next()
+        {
+            m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<int64_t>((m_state >> 33) % static_cast<uint64_t>(2 * m_range + 1)) - m_range;
+        }
+
+    private:
+        int64_t m_range;
+        uint64_t m_state = 1;
+    };
+
+    // Media time and RTP timestamps only go forwards, by at least one RTP
+    // tick, and RTP follows media time at 90 kHz across the wrap.
+    struct TimelineCheck
+    {
+        bool started = false;
+        CaptureClock::Timing last = {};
+        uint32_t backwards = 0;
+        uint32_t rtpMismatches = 0;
+
+        void Next(const CaptureClock::Timing& timing)
+        {
+            if (started)
+            {
+                int32_t rtpStep = static_cast<int32_t>(timing.rtpTimestamp - last.rtpTimestamp);
+                int64_t expected = (timing.mediaTime * 9 / 1000) - (last.mediaTime * 9 / 1000);
+                if (timing.mediaTime <= last.mediaTime || rtpStep <= 0)
+                    backwards++;
+                if (rtpStep != expected)
+                    rtpMismatches++;
+            }
+            started = true;
+            last = timing;
+        }
+    };
+
+    void TestJitter()
+    {
+        // Frames stamped with +-3 ms of scheduling noise come out on an even
+        // 30 fps grid.
+        CaptureClock clock;
+        Jitter jitter(3 * Millisecond);
+        TimelineCheck timeline;
+        double rawError = 0.0;
+        double smoothedError = 0.0;
+        int64_t lastCapture = 0;
+        const int frames = 900;
+        for (int i = 0; i < frames; i++)
+        {
+            int64_t ideal = 5 * CaptureClock::TicksPerSecond + i * Interval;
+            int64_t capture = ideal + jitter.Next();
+            int64_t lastMediaTime = timeline.last.mediaTime;
+            CaptureClock::Timing timing = clock.OnFrame(capture, capture + 4 * Millisecond);
+            timeline.Next(timing);
+            if (i == 0)
+                CHECK(timing.mediaTime == 0);
+            // Frame to frame steps, once the clock has settled.
+            if (i >= frames / 2)
+            {
+                rawError += std::abs(static_cast<double>(capture - lastCapture - Interval));
+                smoothedError += std::abs(static_cast<double>(timing.mediaTime - lastMediaTime - Interval));
+            }
+            lastCapture = capture;
+        }
+        CHECK(timeline.backwards == 0);
+        CHECK(timeline.rtpMismatches == 0);
+        CHECK(clock.Resyncs() == 0);
+        CHECK(std::abs(clock.FrameInterval() - Interval) < Interval * 0.005);
+        CHECK(smoothedError < rawError / 10);
+        CHECK(clock.Jitter() > 0.0 && clock.Jitter() < 3 * Millisecond);
+    }
+
+    void TestDrift()
+    {
+        // The camera's clock runs 300 ppm slow against the system clock;
+        // media time follows the system clock once the drift is measured.
+        CaptureClock clock;
+        TimelineCheck timeline;
+        const double drift = 300e-6;
+        CaptureClock::Timing timing = {};
+        int64_t capture = 0;
+        int64_t arrival = 0;
+        for (int i = 0; i < 30 * 20; i++)
+        {
+            capture = i * Interval;
+            arrival = 1000 * CaptureClock::TicksPerSecond + static_cast<int64_t>(std::llround(capture * (1.0 + drift)));
+            timing = clock.OnFrame(capture, arrival);
+            timeline.Next(timing);
+        }
+        CHECK(timeline.backwards == 0);
+        CHECK(std::abs(clock.DriftPpm() - 300.0) < 5.0);
+        int64_t arrivalElapsed = arrival - 1000 * CaptureClock::TicksPerSecond;
+        CHECK(std::abs(timing.mediaTime - arrivalElapsed) < Millisecond);
+        CHECK(capture < arrivalElapsed - 5 * Millisecond);
+
+        // Drift beyond maxDriftPpm is not believed.
+        CaptureClock clamped;
+        for (int i = 0; i < 30 * 5; i++)
+            timing = clamped.OnFrame(i * Interval, i * Interval * 11 / 10);
+        CHECK(clamped.DriftPpm() <= 1000.0 + 1e-6);
+    }
+
+    void TestWrapAndGaps()
+    {
+        CaptureClock clock;
+        TimelineCheck timeline;
+        int64_t capture = 40 * CaptureClock::TicksPerSecond;
+        int64_t arrival = 7 * CaptureClock::TicksPerSecond;
+        for (int i = 0; i < 60; i++)
+            timeline.Next(clock.OnFrame(capture += Interval, arrival += Interval));
+        int64_t beforeGap = timeline.last.mediaTime;
+
+        // The camera drops two frames; the timeline steps over them.
+        timeline.Next(clock.OnFrame(capture += 3 * Interval, arrival += 3 * Interval));
+        CHECK(std::abs(timeline.last.mediaTime - beforeGap - 3 * Interval) < Millisecond);
+        CHECK(clock.Resyncs() == 0);
+
+        // The capture clock wraps back to near zero, as after a driver
+        // restart; media time carries on one interval later.
+        int64_t beforeWrap = timeline.last.mediaTime;
+        capture = 1000;
+        timeline.Next(clock.OnFrame(capture, arrival += Interval));
+        CHECK(clock.Resyncs() == 1);
+        CHECK(std::abs(timeline.last.mediaTime - beforeWrap - Interval) < Millisecond);
+        for (int i = 0; i < 60; i++)
+            timeline.Next(clock.OnFrame(capture += Interval, arrival += Interval));
+
+        // A stall far longer than jitter restarts the smoothing from raw
+        // time instead of spreading the stall over later frames.
+        int64_t beforeStall = timeline.last.mediaTime;
+        timeline.Next(clock.OnFrame(capture += 500 * Millisecond, arrival += 500 * Millisecond));
+        CHECK(std::abs(timeline.last.mediaTime - beforeStall - 500 * Millisecond) < 2 * Millisecond);
+        for (int i = 0; i < 30; i++)
+            timeline.Next(clock.OnFrame(capture += Interval, arrival += Interval));
+
+        CHECK(timeline.backwards == 0);
+        CHECK(timeline.rtpMismatches == 0);
+    }
+
+    void TestRtpMapping()
+    {
+        CHECK(CaptureClock::ToRtpDuration(CaptureClock::TicksPerSecond) == 90000);
+        CHECK(CaptureClock::ToRtpDuration(Interval) == 2999);
+        CHECK(CaptureClock::ToRtpDuration(CaptureClock::TicksPerSecond / 90000 + 1) == 1);
+
+        // RTP timestamps start at a random offset and wrap modulo 2^32; the
+        // distance between frames is unaffected.
+        CaptureClock::Config config;
+        CaptureClock clock(config, 0xFFFFF000u);
+        CHECK(clock.ToRtpTimestamp(0) == 0xFFFFF000u);
+        CHECK(clock.ToRtpTimestamp(CaptureClock::TicksPerSecond) == 0xFFFFF000u + 90000u);
+        TimelineCheck timeline;
+        uint32_t wraps = 0;
+        for (int i = 0; i < 90; i++)
+        {
+            CaptureClock::Timing timing = clock.OnFrame(i * Interval, i * Interval);
+            if (timeline.started && timing.rtpTimestamp < timeline.last.rtpTimestamp)
+                wraps++;
+            timeline.Next(timing);
+        }
+        CHECK(wraps == 1);
+        CHECK(timeline.backwards == 0);
+        CHECK(timeline.rtpMismatches == 0);
+        CHECK(timeline.last.rtpTimestamp - 0xFFFFF000u == CaptureClock::ToRtpDuration(timeline.last.mediaTime));
+
+        // Far past the 2^32 tick mark, a bit over seven minutes, the
+        // mapping still holds.
+        int64_t hours = 10 * 3600 * CaptureClock::TicksPerSecond;
+        CHECK(clock.ToRtpTimestamp(hours + CaptureClock::TicksPerSecond) - clock.ToRtpTimestamp(hours) == 90000);
+    }
+}
+
+void TestCaptureClock()
+{
+    TestJitter();
+    TestDrift();
+    TestWrapAndGaps();
+    TestRtpMapping();
+}
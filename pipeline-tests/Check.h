@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Expectations for the pipeline tests. A failed one is printed with its
+// place and fails the run, but the test goes on, so one run shows every
+// failure.
+#define CHECK(condition) Check(static_cast<bool>(condition), #condition, __FILE__, __LINE__)
+
+bool Check(bool condition, const char* expression, const char* file, int line);
+uint32_t CheckFailures();
+
+// Seconds since start, for benchmarks.
+inline double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One entry per component in main.cpp.
+void TestBufferPool();
+void TestInPlaceEncode();
+void TestEncodePipeline();
+void TestFrameHandleTracker();
+void TestEncodedFrameRing();
+void TestKeyFrameRequester();
+void TestCaptureClock();
+void TestSessions();
+void TestFragmentedMp4();
+void TestOveruseDetector();
+void TestCpuAdaptation();
+void TestReplayBuffer();
+void TestSimulcastEncoder();
+void TestAllocations();
+
+void BenchmarkBufferPool(uint32_t iterations);
+void BenchmarkEncodedFrameRing(uint32_t iterations);
+void BenchmarkSessions(uint32_t iterations);
@@ -0,0 +1,181 @@
+﻿#include <vector>
+
+#include "CaptureClock.h"
+#include "Check.h"
+#include "CpuAdaptation.h"
+#include "FakeEncoder.h"
+#include "Nv12Scaler.h"
+
+namespace
+{
+    using Clock = OveruseDetector::Clock;
+    using std::chrono::microseconds;
+    using std::chrono::milliseconds;
+
+    constexpr uint32_t Width = 640;
+    constexpr uint32_t Height = 360;
+    constexpr uint32_t FrameRate = 30;
+
+    struct Level
+    {
+        uint32_t level;
+        uint32_t width;
+        uint32_t height;
+        uint32_t frameRate;
+
+        bool operator==(const Level& other) const
+        {
+            return level == other.level && width == other.width && height == other.height && frameRate == other.frameRate;
+        }
+    };
+
+    // Capture, adaptation, scaling and a slow encoder on one thread, the
+    // way a session splits them between its capture and encode threads.
+    // The encoder costs load for a full size frame and less in proportion
+    // to the pixels. It really sleeps, at a hundredth of that, so the test
+    // covers a slow encoder without taking minutes; the fake clock moves
+    // by the whole cost.
+    class AdaptingEncoder
+    {
+    public:
+        static constexpr int64_t TimeScale = 100;
+
+        AdaptingEncoder()
+            : m_adaptation(CpuAdaptation::Config()),
+              m_source(FrameView::PackedSize(FrameFormat::Nv12, Width, Height), 128),
+              m_scaled(m_source.size())
+        {
+            m_settings.width = Width;
+            m_settings.height = Height;
+            m_settings.frameRate = FrameRate;
+            m_encoder.Configure(m_settings);
+            m_adaptation.Reset(m_settings);
+        }
+
+        // Captures for the given number of seconds at the full frame rate.
+        void Run(uint32_t seconds, milliseconds load)
+        {
+            for (uint32_t second = 0; second < seconds; second++)
+            {
+                Level before = Current();
+                uint32_t accepted = 0;
+                for (uint32_t i = 0; i < FrameRate; i++, m_captured++)
+                {
+                    if (CaptureFrame(load))
+                        accepted++;
+                }
+                // Whole seconds at one level pass its frame rate through.
+                if (Current() == before && Adaptations() == m_checkedAdaptations)
+                {
+                    m_pacedSeconds++;
+                    CHECK(accepted >= before.frameRate - 1 && accepted <= before.frameRate + 1);
+                }
+                m_checkedAdaptations = Adaptations();
+            }
+        }
+
+        Level Current() const
+        {
+            CpuAdaptation::Stats stats = m_adaptation.GetStats();
+            return { stats.level, stats.width, stats.height, stats.frameRate };
+        }
+
+        CpuAdaptation::Stats Stats() const { return m_adaptation.GetStats(); }
+        const std::vector<Level>& Levels() const { return m_levels; }
+        const std::vector<Clock::time_point>& Times() const { return m_times; }
+        uint32_t PacedSeconds() const { return m_pacedSeconds; }
+        uint64_t ScaledFrames() const { return m_scaledFrames; }
+
+    private:
+        size_t Adaptations() const { return m_levels.size(); }
+
+        bool CaptureFrame(milliseconds load)
+        {
+            int64_t mediaTime = static_cast<int64_t>(m_captured * CaptureClock::TicksPerSecond / FrameRate);
+            Clock::time_point captured = m_start + microseconds(mediaTime / 10);
+            if (!m_adaptation.AcceptFrame(mediaTime))
+                return false;
+
+            FrameView view = FrameView::Packed(FrameFormat::Nv12, m_source.data(), Width, Height);
+            view.timestamp = mediaTime;
+            if (m_settings.width != Width || m_settings.height != Height)
+            {
+                FrameView scaled = FrameView::Packed(FrameFormat::Nv12, m_scaled.data(), m_settings.width, m_settings.height);
+                scaled.timestamp = mediaTime;
+                CHECK(m_scaler.Configure(Width, Height, m_settings.width, m_settings.height, Nv12Scaler::Config()));
+                CHECK(m_scaler.Scale(view, scaled));
+                view = scaled;
+                m_scaledFrames++;
+            }
+
+            Clock::duration cost = load * (static_cast<uint64_t>(view.width) * view.height) / (static_cast<uint64_t>(Width) * Height);
+            m_encoder.delay = std::chrono::duration_cast<microseconds>(cost) / TimeScale;
+            CHECK(m_encoder.Encode(BorrowedFrame(view, nullptr)));
+
+            Clock::time_point now = captured + cost;
+            VideoEncoderSettings adapted;
+            if (m_adaptation.OnFrameEncoded({ now, cost, Clock::duration::zero(), m_adaptation.FrameInterval() }, adapted))
+            {
+                CHECK(m_encoder.Reconfigure(adapted));
+                m_settings = adapted;
+                m_levels.push_back(Current());
+                m_times.push_back(now);
+            }
+            return true;
+        }
+
+        CpuAdaptation m_adaptation;
+        FakeEncoder m_encoder;
+        Nv12Scaler m_scaler;
+        VideoEncoderSettings m_settings;
+        std::vector<uint8_t> m_source;
+        std::vector<uint8_t> m_scaled;
+        const Clock::time_point m_start = Clock::time_point() + std::chrono::hours(1);
+        uint64_t m_captured = 0;
+        std::vector<Level> m_levels;
+        std::vector<Clock::time_point> m_times;
+        size_t m_checkedAdaptations = 0;
+        uint32_t m_pacedSeconds = 0;
+        uint64_t m_scaledFrames = 0;
+    };
+
+    void TestDegradeAndRestore()
+    {
+        AdaptingEncoder encoder;
+
+        // 60 ms a frame is more than even 15 fps allows at full size: the
+        // frame rate goes first, then the size, until 480x270 at 15 fps
+        // fits. It stays there while the load lasts.
+        encoder.Run(40, milliseconds(60));
+        const std::vector<Level> degraded = {
+            { 1, 640, 360, 20 },
+            { 2, 640, 360, 15 },
+            { 3, 480, 270, 15 },
+        };
+        CHECK(encoder.Levels() == degraded);
+        CHECK(encoder.ScaledFrames() > 0);
+
+        // Once the load drops, quality comes back one step at a time, each
+        // after the restore delay, up to where it started.
+        encoder.Run(60, milliseconds(12));
+        std::vector<Level> expected = degraded;
+        expected.push_back({ 2, 640, 360, 15 });
+        expected.push_back({ 1, 640, 360, 20 });
+        expected.push_back({ 0, 640, 360, 30 });
+        CHECK(encoder.Levels() == expected);
+        const std::vector<Clock::time_point>& times = encoder.Times();
+        for (size_t i = degraded.size(); i < times.size(); i++)
+            CHECK(times[i] - times[i - 1] >= OveruseDetector::Config().restoreDelay);
+
+        CpuAdaptation::Stats stats = encoder.Stats();
+        CHECK(stats.degradations == 3);
+        CHECK(stats.restorations == 3);
+        CHECK(encoder.Current() == (Level{ 0, 640, 360, 30 }));
+        CHECK(encoder.PacedSeconds() >= 80);
+    }
+}
+
+void TestCpuAdaptation()
+{
+    TestDegradeAndRestore();
+}
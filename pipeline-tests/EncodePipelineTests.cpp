@@ -0,0 +1,195 @@
+﻿#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "EncodePipeline.h"
+#include "FakeEncoder.h"
+
+namespace
+{
+    // Holds the encode thread inside a frame until opened.
+    class Gate
+    {
+    public:
+        void Enter()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_entered++;
+            m_changed.notify_all();
+            m_changed.wait(lock, [this]() { return m_open; });
+        }
+
+        void WaitEntered(uint32_t count)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this, count]() { return m_entered >= count; });
+        }
+
+        void Open()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_open = true;
+            m_changed.notify_all();
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        uint32_t m_entered = 0;
+        bool m_open = false;
+    };
+
+    // Frames over one small buffer whose release hooks are counted.
+    struct Frames
+    {
+        uint8_t pixels[16 * 16 * 3 / 2] = {};
+        std::atomic<uint32_t> released{ 0 };
+
+        BorrowedFrame Make(int64_t timestamp)
+        {
+            FrameView view = FrameView::Packed(FrameFormat::Nv12, pixels, 16, 16);
+            view.timestamp = timestamp;
+            return BorrowedFrame(view, [this]() { released++; });
+        }
+    };
+
+    struct Run
+    {
+        std::mutex mutex;
+        std::vector<int64_t> encoded;
+        std::vector<int64_t> delivered;
+        std::thread::id encodeThread;
+        std::thread::id deliveryThread;
+    };
+
+    // Posts frames 1..count while the encoder sits on frame 1, then lets
+    // it go and returns the timestamps that got through.
+    std::vector<int64_t> PostWhileBlocked(const EncodePipeline::Config& config, int64_t count, EncodePipeline::Stats& stats)
+    {
+        Frames frames;
+        Gate gate;
+        Run run;
+        FakeEncoder encoder;
+        {
+            EncodePipeline pipeline(config,
+                [&](BorrowedFrame frame)
+                {
+                    gate.Enter();
+                    std::lock_guard<std::mutex> lock(run.mutex);
+                    run.encoded.push_back(frame.Timestamp());
+                    return encoder.Encode(std::move(frame));
+                },
+                [](const EncodedFrameRef&) {});
+            pipeline.Start();
+            pipeline.PostFrame(frames.Make(1));
+            gate.WaitEntered(1);
+            for (int64_t timestamp = 2; timestamp <= count; timestamp++)
+                pipeline.PostFrame(frames.Make(timestamp));
+            CHECK(pipeline.GetStats().captureQueueDepth == std::min<uint32_t>(config.captureQueueCapacity, static_cast<uint32_t>(count - 1)));
+            gate.Open();
+            while (pipeline.GetStats().framesEncoded + pipeline.GetStats().captureDrops < static_cast<uint64_t>(count))
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            stats = pipeline.GetStats();
+        }
+        // Dropped frames are released as well as encoded ones.
+        CHECK(frames.released == count);
+        return run.encoded;
+    }
+}
+
+void TestEncodePipeline()
+{
+    EncodePipeline::Stats stats;
+    EncodePipeline::Config latest;
+    latest.captureDropPolicy = DropPolicy::LatestOnly;
+    CHECK((PostWhileBlocked(latest, 10, stats) == std::vector<int64_t>{ 1, 10 }));
+    CHECK(stats.framesPosted == 10 && stats.captureDrops == 8 && stats.framesEncoded == 2);
+
+    EncodePipeline::Config oldest;
+    oldest.captureQueueCapacity = 3;
+    oldest.captureDropPolicy = DropPolicy::DropOldest;
+    CHECK((PostWhileBlocked(oldest, 10, stats) == std::vector<int64_t>{ 1, 8, 9, 10 }));
+    CHECK(stats.framesPosted == 10 && stats.captureDrops == 6 && stats.framesEncoded == 4);
+
+    // Stop with frames still queued: the frame inside the encoder finishes,
+    // the queued ones are released unencoded, and later posts are ignored.
+    {
+        Frames frames;
+        Gate gate;
+        FakeEncoder encoder;
+        EncodePipeline pipeline(oldest,
+            [&](BorrowedFrame frame)
+            {
+                gate.Enter();
+                return encoder.Encode(std::move(frame));
+            },
+            [](const EncodedFrameRef&) {});
+        pipeline.Start();
+        for (int64_t timestamp = 1; timestamp <= 4; timestamp++)
+        {
+            pipeline.PostFrame(frames.Make(timestamp));
+            if (timestamp == 1)
+                gate.WaitEntered(1);
+        }
+        std::thread stopper([&]() { pipeline.Stop(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        gate.Open();
+        stopper.join();
+        CHECK(encoder.Encoded() == 1 && frames.released == 4);
+        pipeline.PostFrame(frames.Make(5));
+        CHECK(frames.released == 5 && pipeline.GetStats().framesPosted == 4);
+    }
+
+    // Each stage has a thread of its own; delivery keeps encode order, and a
+    // slow subscriber only costs deliveries, never encodes.
+    {
+        Frames frames;
+        Run run;
+        FakeEncoder encoder;
+        Gate delivery;
+        EncodePipeline::Config config;
+        config.captureQueueCapacity = 64;
+        config.captureDropPolicy = DropPolicy::DropOldest;
+        config.deliveryQueueCapacity = 4;
+        EncodePipeline pipeline(config,
+            [&](BorrowedFrame frame)
+            {
+                run.encodeThread = std::this_thread::get_id();
+                // Odd frames encode to nothing and are not delivered.
+                if (frame.Timestamp() % 2 == 1)
+                    return EncodedFrameRef();
+                return encoder.Encode(std::move(frame));
+            },
+            [&](const EncodedFrameRef& encoded)
+            {
+                delivery.Enter();
+                std::lock_guard<std::mutex> lock(run.mutex);
+                run.deliveryThread = std::this_thread::get_id();
+                run.delivered.push_back(encoded->Timestamp());
+            });
+        pipeline.Start();
+        for (int64_t timestamp = 1; timestamp <= 40; timestamp++)
+        {
+            pipeline.PostFrame(frames.Make(timestamp));
+            if (timestamp == 2)
+                delivery.WaitEntered(1);
+        }
+        while (pipeline.GetStats().framesEncoded < 40)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        delivery.Open();
+        while (pipeline.GetStats().captureDrops == 0 && pipeline.GetStats().framesDelivered + pipeline.GetStats().deliveryDrops < 20)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        pipeline.Stop();
+
+        stats = pipeline.GetStats();
+        CHECK(stats.captureDrops == 0 && stats.framesEncoded == 40);
+        CHECK(stats.deliveryDrops == 20 - 1 - config.deliveryQueueCapacity);
+        CHECK(stats.framesDelivered == 1 + config.deliveryQueueCapacity);
+        CHECK(run.encodeThread != std::this_thread::get_id() && run.deliveryThread != std::this_thread::get_id());
+        CHECK(run.encodeThread != run.deliveryThread);
+        // The first frame was already out; the newest ones were kept.
+        CHECK((run.delivered == std::vector<int64_t>{ 2, 34, 36, 38, 40 }));
+    }
+}
@@ -0,0 +1,169 @@
+﻿#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "EncodedFrameRing.h"
+#include "FrameHandleTracker.h"
+
+namespace
+{
+    EncodedFrameRef MakeFrame(BitstreamArena& arena, int64_t timestamp)
+    {
+        static const uint8_t Payload[64] = {};
+        EncodedFrameRef frame = arena.Allocate(sizeof(Payload));
+        frame->Append(Payload, sizeof(Payload));
+        frame->SetTimestamp(timestamp);
+        return frame;
+    }
+
+    void TestOrderAndDrops()
+    {
+        auto arena = std::make_shared<BitstreamArena>(256, 16);
+        EncodedFrameRing ring(4);
+        for (int64_t i = 0; i < 6; i++)
+            CHECK(ring.Push(MakeFrame(*arena, i)) == (i < 4));
+        CHECK(ring.Depth() == 4);
+        CHECK(ring.Dropped() == 2);
+
+        EncodedFrameRef frames[8];
+        CHECK(ring.PopBatch(frames, 3, std::chrono::milliseconds(0)) == 3);
+        CHECK(frames[0]->Timestamp() == 0 && frames[2]->Timestamp() == 2);
+        CHECK(ring.Push(MakeFrame(*arena, 6)));
+        CHECK(ring.PopBatch(frames, 8, std::chrono::milliseconds(0)) == 2);
+        CHECK(frames[0]->Timestamp() == 3 && frames[1]->Timestamp() == 6);
+        CHECK(ring.PopBatch(frames, 8, std::chrono::milliseconds(0)) == 0);
+        CHECK(ring.Depth() == 0);
+    }
+
+    void TestWakeups()
+    {
+        auto arena = std::make_shared<BitstreamArena>(256, 16);
+        EncodedFrameRing ring(8);
+        EncodedFrameRef frames[8];
+
+        // A consumer asleep on an empty ring is woken by the first push.
+        std::thread consumer([&]()
+            {
+                CHECK(ring.PopBatch(frames, 8, std::chrono::milliseconds(10000)) == 1);
+            });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(ring.Push(MakeFrame(*arena, 0)));
+        consumer.join();
+        CHECK(ring.Wakeups() == 1);
+
+        // Interrupt ends a wait with nothing to return.
+        EncodedFrameRef drained[8];
+        ring.PopBatch(drained, 8, std::chrono::milliseconds(0));
+        std::thread waiter([&]()
+            {
+                auto start = std::chrono::steady_clock::now();
+                CHECK(ring.PopBatch(drained, 8, std::chrono::milliseconds(10000)) == 0);
+                CHECK(SecondsSince(start) < 5);
+            });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ring.Interrupt();
+        waiter.join();
+    }
+
+    void TestProducerConsumer()
+    {
+        const int64_t count = 20000;
+        auto arena = std::make_shared<BitstreamArena>(256, 64);
+        EncodedFrameRing ring(32);
+        std::atomic<bool> done{ false };
+        std::thread producer([&]()
+            {
+                for (int64_t i = 0; i < count; i++)
+                {
+                    while (ring.Depth() >= 32)
+                        std::this_thread::yield();
+                    CHECK(ring.Push(MakeFrame(*arena, i)));
+                }
+                done = true;
+            });
+
+        int64_t expected = 0;
+        EncodedFrameRef frames[16];
+        while (expected < count)
+        {
+            uint32_t popped = ring.PopBatch(frames, 16, std::chrono::milliseconds(100));
+            for (uint32_t i = 0; i < popped; i++)
+            {
+                CHECK(frames[i]->Timestamp() == expected++);
+                frames[i].Reset();
+            }
+            if (popped == 0 && done && ring.Depth() == 0)
+                break;
+        }
+        producer.join();
+        CHECK(expected == count);
+        CHECK(ring.Dropped() == 0);
+    }
+}
+
+void TestEncodedFrameRing()
+{
+    TestOrderAndDrops();
+    TestWakeups();
+    TestProducerConsumer();
+}
+
+// Per-frame cost of handing encoded frames to the app, the way the DLL does
+// it: push lends a handle to a callback for every frame; pull queues frames
+// on the ring and the app takes them in batches, one call per batch. Both
+// run on one thread so that thread handoffs don't swamp the difference. On
+// Windows each call is also a native to managed transition, which this
+// leaves out.
+void BenchmarkEncodedFrameRing(uint32_t iterations)
+{
+    std::printf("\npush vs pull delivery, ns per frame\n");
+    auto arena = std::make_shared<BitstreamArena>(256, 64);
+    uint64_t bytes = 0;
+    {
+        FrameHandleTracker handles;
+        auto callback = [&](void* handle)
+        {
+            bytes += handles.Find(handle)->Size();
+        };
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i++)
+        {
+            EncodedFrameRef frame = MakeFrame(*arena, i);
+            FrameHandleTracker::Loan loan(handles, frame.Get(), nullptr);
+            callback(loan.Handle());
+        }
+        double seconds = SecondsSince(start);
+        std::printf("push     %9.1f  %u calls\n", seconds * 1e9 / iterations, iterations);
+    }
+
+    for (uint32_t batchSize : { 1u, 8u, 32u })
+    {
+        FrameHandleTracker handles;
+        EncodedFrameRing ring(32);
+        EncodedFrameRef batch[32];
+        void* pulled[32];
+        uint64_t calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < iterations; i += batchSize)
+        {
+            for (uint32_t j = 0; j < batchSize; j++)
+                ring.Push(MakeFrame(*arena, i + j));
+
+            uint32_t count = ring.PopBatch(batch, batchSize, std::chrono::milliseconds(0));
+            calls++;
+            for (uint32_t j = 0; j < count; j++)
+                pulled[j] = handles.Adopt(std::move(batch[j]), nullptr);
+            for (uint32_t j = 0; j < count; j++)
+            {
+                bytes += handles.Find(pulled[j])->Size();
+                handles.Release(pulled[j]);
+            }
+        }
+        double seconds = SecondsSince(start);
+        std::printf("pull %-3u %9.1f  %llu calls\n", batchSize, seconds * 1e9 / (calls * batchSize),
+            static_cast<unsigned long long>(calls));
+    }
+    if (bytes == 0)
+        std::printf("no frames delivered\n");
+}
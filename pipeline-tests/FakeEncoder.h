@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "VideoEncoderBackend.h"
+
+// Stands in for an H.264 encoder. It reads every pixel of the frame, as a
+// real encoder would, and writes a small access unit holding the frame's
+// checksum. Key frames come first and on request. A delay makes it a slow
+// encoder.
+class FakeEncoder : public IVideoEncoderBackend
+{
+public:
+    static constexpr size_t AccessUnitSize = 64;
+
+    static uint64_t Checksum(const FrameView& view)
+    {
+        uint64_t hash = 1469598103934665603ull;
+        for (uint32_t plane = 0; plane < view.PlaneCount(); plane++)
+        {
+            for (uint32_t row = 0; row < view.PlaneRows(plane); row++)
+            {
+                const uint8_t* data = view.planes[plane].data + static_cast<size_t>(row) * view.planes[plane].stride;
+                for (uint32_t i = 0; i < view.PlaneRowBytes(plane); i++)
+                    hash = (hash ^ data[i]) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    // The checksum an access unit from Encode carries.
+    static uint64_t Checksum(const EncodedFrameRef& frame)
+    {
+        uint64_t checksum = 0;
+        if (frame && frame->Size() >= sizeof(checksum))
+            std::memcpy(&checksum, frame->Data(), sizeof(checksum));
+        return checksum;
+    }
+
+    std::chrono::microseconds delay{ 0 };
+
+    const char* Name() const override { return "fake"; }
+
+    bool Configure(const VideoEncoderSettings& settings) override
+    {
+        m_settings = settings;
+        m_keyFrameRequested = true;
+        return true;
+    }
+
+    EncodedFrameRef Encode(BorrowedFrame frame) override
+    {
+        if (!frame)
+            return EncodedFrameRef();
+        uint8_t unit[AccessUnitSize] = {};
+        uint64_t checksum = Checksum(frame.View());
+        std::memcpy(unit, &checksum, sizeof(checksum));
+        if (delay.count() > 0)
+            std::this_thread::sleep_for(delay);
+
+        EncodedFrameRef encoded = m_arena->Allocate(sizeof(unit));
+        encoded->Append(unit, sizeof(unit));
+        encoded->SetTimestamp(frame.Timestamp());
+        encoded->SetKeyFrame(m_keyFrameRequested.exchange(false));
+        m_encoded.fetch_add(1, std::memory_order_relaxed);
+        return encoded;
+    }
+
+    void RequestKeyFrame() override { m_keyFrameRequested = true; }
+    bool SetRate(uint32_t, uint32_t) override { return true; }
+
+    bool Reconfigure(const VideoEncoderSettings& settings) override
+    {
+        if (settings.NeedsRestart(m_settings))
+            m_keyFrameRequested = true;
+        m_settings = settings;
+        return true;
+    }
+
+    std::vector<EncodedFrameRef> Flush() override { return {}; }
+    void Shutdown() override {}
+    BitstreamArena::Stats GetBitstreamStats() const override { return m_arena->GetStats(); }
+
+    uint64_t Encoded() const { return m_encoded.load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<BitstreamArena> m_arena = std::make_shared<BitstreamArena>(AccessUnitSize, 64);
+    VideoEncoderSettings m_settings;
+    std::atomic<bool> m_keyFrameRequested{ true };
+    std::atomic<uint64_t> m_encoded{ 0 };
+};
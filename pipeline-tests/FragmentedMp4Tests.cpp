@@ -0,0 +1,126 @@
+﻿#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "Check.h"
+#include "FragmentedMp4Muxer.h"
+#include "FragmentedMp4Verifier.h"
+
+namespace
+{
+    // 30 fps in 100 ns units.
+    constexpr int64_t FrameInterval = 333333;
+
+    void AppendNal(std::vector<uint8_t>& unit, std::initializer_list<uint8_t> header, size_t payload)
+    {
+        static const uint8_t StartCode[] = { 0, 0, 0, 1 };
+        unit.insert(unit.end(), StartCode, StartCode + sizeof(StartCode));
+        unit.insert(unit.end(), header);
+        for (size_t i = 0; i < payload; i++)
+            unit.push_back(static_cast<uint8_t>(0x80 | (i * 7)));
+    }
+
+    // Annex B access units as an encoder hands them out: key frames carry
+    // SPS and PPS ahead of the IDR slice.
+    std::vector<uint8_t> AccessUnit(bool keyFrame, size_t index)
+    {
+        std::vector<uint8_t> unit;
+        if (keyFrame)
+        {
+            AppendNal(unit, { 0x67, 0x42, 0xC0, 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5 }, 0);
+            AppendNal(unit, { 0x68, 0xCE, 0x3C, 0x80 }, 0);
+            AppendNal(unit, { 0x65, 0x88 }, 2000 + index % 13);
+        }
+        else
+        {
+            AppendNal(unit, { 0x41, 0x9A }, 300 + index % 17);
+        }
+        return unit;
+    }
+
+    // Muxes GOPs of the given lengths and finishes the file.
+    std::vector<uint8_t> Mux(std::initializer_list<size_t> gops)
+    {
+        FragmentedMp4Muxer muxer;
+        std::vector<uint8_t> file;
+        size_t index = 0;
+        for (size_t gop : gops)
+        {
+            for (size_t i = 0; i < gop; i++, index++)
+            {
+                std::vector<uint8_t> unit = AccessUnit(i == 0, index);
+                muxer.AddFrame(unit.data(), unit.size(), 1000000 + static_cast<int64_t>(index) * FrameInterval, i == 0, file);
+            }
+        }
+        muxer.Finish(file);
+        return file;
+    }
+
+    size_t FindBox(const std::vector<uint8_t>& file, const char* type, size_t from = 0)
+    {
+        auto found = std::search(file.begin() + from, file.end(), type, type + 4);
+        return found != file.end() ? static_cast<size_t>(found - file.begin()) - 4 : file.size();
+    }
+
+    bool Verifies(const std::vector<uint8_t>& file)
+    {
+        FragmentedMp4Verifier::Result result;
+        return FragmentedMp4Verifier::Verify(file.data(), file.size(), result);
+    }
+
+    void TestMuxedFile()
+    {
+        // The 90-frame GOP is cut at the two second fragment limit, so one
+        // fragment starts without a key frame and has no index entry.
+        std::vector<uint8_t> file = Mux({ 30, 30, 90, 15 });
+        FragmentedMp4Verifier::Result result;
+        CHECK(FragmentedMp4Verifier::Verify(file.data(), file.size(), result));
+        CHECK(result.error.empty());
+        CHECK(result.fragments == 5);
+        CHECK(result.samples == 165);
+        CHECK(result.keyFrames == 4);
+        CHECK(result.indexEntries == 4);
+        CHECK(result.duration >= 165 * 2999 && result.duration <= 165 * 3001);
+    }
+
+    void TestDamagedFiles()
+    {
+        const std::vector<uint8_t> file = Mux({ 30, 30 });
+        CHECK(Verifies(file));
+        size_t trun = FindBox(file, "trun");
+        CHECK(trun < file.size());
+
+        // The data offset, the first sample's size and its flags.
+        std::vector<uint8_t> damaged = file;
+        damaged[trun + 19]++;
+        CHECK(!Verifies(damaged));
+        damaged = file;
+        damaged[trun + 27]++;
+        CHECK(!Verifies(damaged));
+        damaged = file;
+        damaged[trun + 29] = 0x01;
+        CHECK(!Verifies(damaged));
+
+        // A fragment sequence number out of order.
+        damaged = file;
+        damaged[FindBox(file, "mfhd") + 15] = 3;
+        CHECK(!Verifies(damaged));
+
+        // An index entry pointing at the wrong moof.
+        damaged = file;
+        damaged[FindBox(file, "tfra") + 35]++;
+        CHECK(!Verifies(damaged));
+
+        // A file cut short, before or inside the index.
+        damaged.assign(file.begin(), file.begin() + FindBox(file, "mfra"));
+        CHECK(!Verifies(damaged));
+        damaged.assign(file.begin(), file.end() - 4);
+        CHECK(!Verifies(damaged));
+    }
+}
+
+void TestFragmentedMp4()
+{
+    TestMuxedFile();
+    TestDamagedFiles();
+}
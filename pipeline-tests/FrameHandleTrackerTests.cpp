@@ -0,0 +1,222 @@
+﻿#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FrameHandleTracker.h"
+
+namespace
+{
+    // Stands in for a session's encoder output.
+    std::shared_ptr<BitstreamArena> MakeArena(uint32_t frameCount = 4)
+    {
+        return std::make_shared<BitstreamArena>(256, frameCount);
+    }
+
+    EncodedFrameRef MakeFrame(BitstreamArena& arena, int64_t timestamp)
+    {
+        static const uint8_t Payload[16] = {};
+        EncodedFrameRef frame = arena.Allocate(sizeof(Payload));
+        if (frame)
+        {
+            frame->Append(Payload, sizeof(Payload));
+            frame->SetTimestamp(timestamp);
+        }
+        return frame;
+    }
+
+    // Frames of the arena not yet back in it.
+    uint32_t InUse(const BitstreamArena& arena)
+    {
+        uint32_t inUse = 0;
+        for (const BufferPool::SizeClassStats& sizeClass : arena.GetStats().pool.classes)
+            inUse += sizeClass.inUse;
+        return inUse;
+    }
+
+    int SessionA;
+    int SessionB;
+
+    void TestLentHandles()
+    {
+        FrameHandleTracker tracker;
+        auto arena = MakeArena();
+        EncodedFrameRef frame = MakeFrame(*arena, 1);
+
+        void* kept;
+        void* lentOnly;
+        {
+            FrameHandleTracker::Loan loan(tracker, frame.Get(), &SessionA);
+            kept = loan.Handle();
+            CHECK(kept != nullptr);
+            CHECK(kept != static_cast<void*>(frame.Get()));
+            CHECK(tracker.Find(kept).Get() == frame.Get());
+            CHECK(tracker.Acquire(kept));
+            CHECK(tracker.Outstanding() == 1);
+        }
+        {
+            FrameHandleTracker::Loan loan(tracker, frame.Get(), &SessionA);
+            lentOnly = loan.Handle();
+            CHECK(lentOnly != kept);
+        }
+
+        // A handle nobody acquired dies with its loan; an acquired one lives
+        // on, even after every other reference to the frame is gone.
+        frame.Reset();
+        CHECK(!tracker.Find(lentOnly));
+        CHECK(!tracker.Acquire(lentOnly));
+        CHECK(tracker.Find(kept) && tracker.Find(kept)->Timestamp() == 1);
+        CHECK(tracker.Release(kept));
+        CHECK(tracker.Outstanding() == 0);
+        CHECK(InUse(*arena) == 0);
+    }
+
+    void TestDoubleRelease()
+    {
+        FrameHandleTracker tracker;
+        auto arena = MakeArena();
+        void* handle = tracker.Adopt(MakeFrame(*arena, 2), &SessionA);
+        CHECK(tracker.Acquire(handle));
+        CHECK(tracker.Outstanding() == 2);
+
+        CHECK(tracker.Release(handle));
+        CHECK(tracker.Find(handle));
+        CHECK(tracker.Release(handle));
+        CHECK(InUse(*arena) == 0);
+        CHECK(!tracker.Release(handle));
+        CHECK(!tracker.Release(handle));
+        CHECK(tracker.Outstanding() == 0);
+        CHECK(tracker.Rejected() == 2);
+        CHECK(tracker.Acquired() == 2);
+    }
+
+    void TestStaleAndInvalidHandles()
+    {
+        FrameHandleTracker tracker;
+        auto arena = MakeArena(1);
+
+        CHECK(!tracker.Acquire(nullptr));
+        CHECK(!tracker.Release(nullptr));
+        CHECK(!tracker.Find(nullptr));
+        void* madeUp = reinterpret_cast<void*>(uintptr_t{ 0xdead });
+        CHECK(!tracker.Acquire(madeUp));
+        CHECK(!tracker.Release(madeUp));
+        CHECK(tracker.Adopt(EncodedFrameRef(), &SessionA) == nullptr);
+
+        // The block of a released frame is recycled for the next one; the
+        // old handle must not reach the new frame.
+        void* stale = tracker.Adopt(MakeFrame(*arena, 3), &SessionA);
+        EncodedFrame* block = tracker.Find(stale).Get();
+        CHECK(tracker.Release(stale));
+        void* fresh = tracker.Adopt(MakeFrame(*arena, 4), &SessionA);
+        CHECK(tracker.Find(fresh).Get() == block);
+        CHECK(fresh != stale);
+        CHECK(!tracker.Find(stale));
+        CHECK(!tracker.Acquire(stale));
+        CHECK(!tracker.Release(stale));
+        CHECK(tracker.Outstanding() == 1);
+        CHECK(tracker.Find(fresh)->Timestamp() == 4);
+        CHECK(tracker.Release(fresh));
+        CHECK(tracker.Rejected() == 6);
+    }
+
+    void TestReleaseAfterTeardown()
+    {
+        // Handles hold their arena, so they outlive the session and encoder
+        // that produced them.
+        FrameHandleTracker tracker;
+        auto arena = MakeArena();
+        std::weak_ptr<BitstreamArena> watch = arena;
+        void* pulled = tracker.Adopt(MakeFrame(*arena, 5), &SessionA);
+        void* kept;
+        {
+            EncodedFrameRef frame = MakeFrame(*arena, 6);
+            FrameHandleTracker::Loan loan(tracker, frame.Get(), &SessionA);
+            kept = loan.Handle();
+            CHECK(tracker.Acquire(kept));
+        }
+        arena.reset();
+        CHECK(!watch.expired());
+
+        EncodedFrameRef frame = tracker.Find(pulled);
+        CHECK(frame && frame->Timestamp() == 5 && frame->Size() == 16);
+        frame.Reset();
+        CHECK(tracker.Release(pulled));
+        CHECK(tracker.Release(kept));
+        CHECK(watch.expired());
+        CHECK(tracker.Outstanding() == 0);
+    }
+
+    void TestReleaseAllOnShutdown()
+    {
+        FrameHandleTracker tracker;
+        auto arena = MakeArena();
+        auto other = MakeArena();
+        std::vector<void*> handles;
+        for (int i = 0; i < 3; i++)
+            handles.push_back(tracker.Adopt(MakeFrame(*arena, i), &SessionA));
+        CHECK(tracker.Acquire(handles[0]));
+        void* survivor = tracker.Adopt(MakeFrame(*other, 9), &SessionB);
+
+        // A frame on loan to a callback that runs through shutdown.
+        EncodedFrameRef frame = MakeFrame(*arena, 7);
+        FrameHandleTracker::Loan loan(tracker, frame.Get(), &SessionA);
+        CHECK(tracker.Acquire(loan.Handle()));
+        frame.Reset();
+
+        CHECK(tracker.ReleaseAll(&SessionA) == 5);
+        CHECK(tracker.Outstanding() == 1);
+        for (void* handle : handles)
+        {
+            CHECK(!tracker.Find(handle));
+            CHECK(!tracker.Release(handle));
+        }
+        CHECK(InUse(*arena) == 1);
+        CHECK(tracker.Find(loan.Handle()));
+        CHECK(!tracker.Release(loan.Handle()));
+        CHECK(tracker.ReleaseAll(&SessionA) == 0);
+
+        CHECK(tracker.Find(survivor));
+        CHECK(InUse(*other) == 1);
+        CHECK(tracker.Release(survivor));
+        CHECK(tracker.Outstanding() == 0);
+    }
+
+    void TestConcurrentHandles()
+    {
+        FrameHandleTracker tracker;
+        auto arena = MakeArena(64);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&tracker, &arena, t]()
+                {
+                    for (int i = 0; i < 2000; i++)
+                    {
+                        void* handle = tracker.Adopt(MakeFrame(*arena, t * 10000 + i), &SessionA);
+                        CHECK(tracker.Acquire(handle));
+                        EncodedFrameRef frame = tracker.Find(handle);
+                        CHECK(frame && frame->Timestamp() == t * 10000 + i);
+                        CHECK(tracker.Release(handle));
+                        CHECK(tracker.Release(handle));
+                        CHECK(!tracker.Release(handle));
+                    }
+                });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        CHECK(tracker.Outstanding() == 0);
+        CHECK(tracker.Rejected() == 8000);
+        CHECK(InUse(*arena) == 0);
+    }
+}
+
+void TestFrameHandleTracker()
+{
+    TestLentHandles();
+    TestDoubleRelease();
+    TestStaleAndInvalidHandles();
+    TestReleaseAfterTeardown();
+    TestReleaseAllOnShutdown();
+    TestConcurrentHandles();
+}
@@ -0,0 +1,89 @@
+﻿#include <map>
+#include <mutex>
+#include <set>
+
+#include "Check.h"
+#include "EncodePipeline.h"
+#include "FakeEncoder.h"
+#include "SyntheticFrameSource.h"
+
+// Frames from a synthetic source go to the encoder in the source's own
+// buffers, cropped or not, and the buffers stay untouched until the encoder
+// lets go of them.
+void TestInPlaceEncode()
+{
+    SyntheticFrameSource::Config config;
+    config.width = 320;
+    config.height = 180;
+    config.frameCount = 90;
+    config.bufferCount = 3;
+    config.noise = 3;
+    SyntheticFrameSource source(config);
+
+    struct Posted
+    {
+        const uint8_t* luma;
+        uint64_t checksum;
+    };
+    std::mutex mutex;
+    std::map<int64_t, Posted> posted;
+    std::set<const uint8_t*> buffers;
+    uint32_t wrongMemory = 0;
+    uint32_t changedUnderEncoder = 0;
+    uint32_t delivered = 0;
+
+    FakeEncoder encoder;
+    encoder.delay = std::chrono::microseconds(200);
+    EncodePipeline::Config pipelineConfig;
+    pipelineConfig.captureQueueCapacity = config.bufferCount;
+    pipelineConfig.captureDropPolicy = DropPolicy::DropOldest;
+    EncodePipeline pipeline(pipelineConfig,
+        [&](BorrowedFrame frame)
+        {
+            Posted expected;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                expected = posted[frame.Timestamp()];
+            }
+            if (frame.View().planes[0].data != expected.luma)
+                wrongMemory++;
+            EncodedFrameRef encoded = encoder.Encode(std::move(frame));
+            if (FakeEncoder::Checksum(encoded) != expected.checksum)
+                changedUnderEncoder++;
+            return encoded;
+        },
+        [&](const EncodedFrameRef&) { delivered++; });
+
+    pipeline.Start();
+    uint64_t index = 0;
+    CHECK(source.Start(
+        [&](BorrowedFrame frame)
+        {
+            const uint8_t* base = frame.View().planes[0].data;
+            // Every other frame is cropped; the window stays in the buffer.
+            if (index++ % 2 == 1)
+            {
+                CHECK(frame.Crop({ 32, 16, 128, 90 }));
+                CHECK(frame.View().planes[0].data == base + 16 * frame.View().planes[0].stride + 32);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                posted[frame.Timestamp()] = { frame.View().planes[0].data, FakeEncoder::Checksum(frame.View()) };
+                buffers.insert(base);
+            }
+            pipeline.PostFrame(std::move(frame));
+        }));
+    source.WaitUntilDone();
+    source.Stop();
+    source.WaitFramesReleased();
+    pipeline.Stop();
+
+    EncodePipeline::Stats stats = pipeline.GetStats();
+    CHECK(source.GetStats().framesProduced == config.frameCount && source.GetStats().framesDropped == 0);
+    CHECK(stats.framesPosted == config.frameCount && stats.captureDrops == 0 && stats.framesEncoded == config.frameCount);
+    CHECK(encoder.Encoded() == config.frameCount);
+    CHECK(wrongMemory == 0 && changedUnderEncoder == 0);
+    // Only the source's buffers were ever handed over, over and over.
+    CHECK(buffers.size() <= config.bufferCount);
+    CHECK(delivered <= config.frameCount);
+}
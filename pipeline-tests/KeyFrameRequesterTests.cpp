@@ -0,0 +1,285 @@
+﻿#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "EncodePipeline.h"
+#include "FakeEncoder.h"
+#include "KeyFrameRequester.h"
+
+namespace
+{
+    using Clock = KeyFrameRequester::Clock;
+    using std::chrono::milliseconds;
+
+    // Time only moves when a test says so.
+    struct FakeClock
+    {
+        Clock::time_point now = Clock::time_point() + std::chrono::hours(1);
+
+        Clock::time_point Advance(milliseconds step)
+        {
+            now += step;
+            return now;
+        }
+    };
+
+    void TestCoalescing()
+    {
+        FakeClock clock;
+        KeyFrameRequester requester(milliseconds(500));
+        CHECK(!requester.ShouldForce(clock.now));
+
+        // A burst of PLIs between two frames costs one IDR.
+        for (int i = 0; i < 5; i++)
+            requester.Request();
+        CHECK(requester.ShouldForce(clock.now));
+
+        // PLIs while the forced IDR is still in the encoder are answered by it.
+        requester.Request();
+        CHECK(!requester.ShouldForce(clock.Advance(milliseconds(33))));
+        requester.Request();
+        requester.OnKeyFrame(clock.Advance(milliseconds(10)));
+        for (int i = 0; i < 30; i++)
+            CHECK(!requester.ShouldForce(clock.Advance(milliseconds(33))));
+
+        KeyFrameRequester::Stats stats = requester.GetStats();
+        CHECK(stats.requests == 7);
+        CHECK(stats.coalesced == 5);
+        CHECK(stats.forced == 1);
+        CHECK(stats.deferred == 0);
+    }
+
+    void TestMinInterval()
+    {
+        FakeClock clock;
+        KeyFrameRequester requester(milliseconds(500));
+        requester.Request();
+        CHECK(requester.ShouldForce(clock.now));
+        Clock::time_point keyFrame = clock.Advance(milliseconds(20));
+        requester.OnKeyFrame(keyFrame);
+
+        // A PLI right after an IDR waits out the interval, counted once
+        // however many frames go by meanwhile.
+        requester.Request();
+        uint32_t framesWaited = 0;
+        while (!requester.ShouldForce(clock.Advance(milliseconds(33))))
+            framesWaited++;
+        CHECK(clock.now - keyFrame >= milliseconds(500));
+        CHECK(clock.now - keyFrame < milliseconds(533));
+        CHECK(framesWaited == 15);
+        requester.OnKeyFrame(clock.now);
+        CHECK(requester.GetStats().deferred == 1);
+        CHECK(requester.GetStats().forced == 2);
+
+        // A keyframe the encoder made on its own, say at a scene cut,
+        // satisfies a pending request and restarts the interval.
+        clock.Advance(milliseconds(600));
+        requester.Request();
+        requester.OnKeyFrame(clock.now);
+        CHECK(!requester.ShouldForce(clock.Advance(milliseconds(33))));
+        requester.Request();
+        CHECK(!requester.ShouldForce(clock.Advance(milliseconds(33))));
+        CHECK(requester.ShouldForce(clock.Advance(milliseconds(500))));
+        CHECK(requester.GetStats().forced == 3);
+        CHECK(requester.GetStats().deferred == 2);
+    }
+
+    void TestRetry()
+    {
+        FakeClock clock;
+        KeyFrameRequester requester(milliseconds(500));
+        requester.Request();
+        CHECK(requester.ShouldForce(clock.now));
+        Clock::time_point forcedAt = clock.now;
+
+        // The encoder drops the forced IDR: nothing for minInterval, then
+        // the request is forced again without a new PLI.
+        while (!requester.ShouldForce(clock.Advance(milliseconds(10))))
+            ;
+        CHECK(clock.now - forcedAt == milliseconds(500));
+        CHECK(requester.GetStats().forced == 2);
+        CHECK(requester.GetStats().requests == 1);
+
+        // Once it shows up, retries stop.
+        requester.OnKeyFrame(clock.Advance(milliseconds(10)));
+        for (int i = 0; i < 100; i++)
+            CHECK(!requester.ShouldForce(clock.Advance(milliseconds(33))));
+        CHECK(requester.GetStats().forced == 2);
+    }
+
+    void TestConcurrentRequests()
+    {
+        // PLIs from network threads race the encode thread's polls; every
+        // one is either forced or coalesced into one that is.
+        FakeClock clock;
+        KeyFrameRequester requester(milliseconds(0));
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&requester]()
+                {
+                    for (int i = 0; i < 5000; i++)
+                        requester.Request();
+                });
+        }
+        uint64_t forced = 0;
+        for (int frame = 0; frame < 2000; frame++)
+        {
+            if (requester.ShouldForce(clock.Advance(milliseconds(1))))
+            {
+                forced++;
+                requester.OnKeyFrame(clock.now);
+            }
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        if (requester.ShouldForce(clock.Advance(milliseconds(1))))
+            forced++;
+
+        KeyFrameRequester::Stats stats = requester.GetStats();
+        CHECK(stats.requests == 20000);
+        CHECK(stats.forced == forced);
+        CHECK(forced >= 1);
+        CHECK(stats.requests - stats.coalesced >= stats.forced);
+    }
+
+    // The requester wired to a FakeEncoder behind an EncodePipeline the way
+    // the sessions wire theirs. Frames are posted one at a time, 33 ms of
+    // fake time apart, so requests land between known frames.
+    class KeyFramePipeline
+    {
+    public:
+        static constexpr milliseconds FrameInterval{ 33 };
+
+        explicit KeyFramePipeline(milliseconds minInterval)
+            : m_requester(minInterval),
+              m_pipeline(EncodePipeline::Config(),
+                  [this](BorrowedFrame frame)
+                  {
+                      Clock::time_point now = m_clock.Advance(FrameInterval);
+                      if (m_requester.ShouldForce(now))
+                          m_encoder.RequestKeyFrame();
+                      EncodedFrameRef encoded = m_encoder.Encode(std::move(frame));
+                      if (encoded && encoded->IsKeyFrame())
+                          m_requester.OnKeyFrame(now);
+                      return encoded;
+                  },
+                  [this](const EncodedFrameRef& frame)
+                  {
+                      std::lock_guard<std::mutex> lock(m_mutex);
+                      if (frame->IsKeyFrame())
+                          m_keyFrames.push_back(frame->Timestamp());
+                      m_delivered++;
+                  })
+        {
+            m_pipeline.Start();
+        }
+
+        ~KeyFramePipeline()
+        {
+            m_pipeline.Stop();
+        }
+
+        // Encodes the next count frames, waiting for each to be delivered.
+        void Encode(int64_t count)
+        {
+            for (int64_t i = 0; i < count; i++, m_next++)
+            {
+                FrameView view = FrameView::Packed(FrameFormat::Nv12, m_pixels, 16, 16);
+                view.timestamp = m_next;
+                m_pipeline.PostFrame(BorrowedFrame(view, nullptr));
+                while (Delivered() <= m_next)
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+
+        // A burst of PLIs from several network threads before the next frame.
+        void RequestBurst()
+        {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; t++)
+            {
+                threads.emplace_back([this]()
+                    {
+                        for (int i = 0; i < 10; i++)
+                            m_requester.Request();
+                    });
+            }
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+
+        int64_t Next() const { return m_next; }
+
+        std::vector<int64_t> KeyFrames()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_keyFrames;
+        }
+
+        KeyFrameRequester::Stats Stats() const { return m_requester.GetStats(); }
+
+    private:
+        int64_t Delivered()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_delivered;
+        }
+
+        uint8_t m_pixels[16 * 16 * 3 / 2] = {};
+        FakeClock m_clock;
+        FakeEncoder m_encoder;
+        KeyFrameRequester m_requester;
+        std::mutex m_mutex;
+        std::vector<int64_t> m_keyFrames;
+        int64_t m_delivered = 0;
+        int64_t m_next = 0;
+        EncodePipeline m_pipeline;
+    };
+
+    void TestThroughPipeline()
+    {
+        // How many frames an IDR may trail a request the interval does not
+        // hold back, and the interval in frames.
+        constexpr int64_t MaxLag = 1;
+        constexpr int64_t IntervalFrames = 500 / 33 + 1;
+
+        KeyFramePipeline pipeline(milliseconds(500));
+        pipeline.Encode(45);
+
+        // A burst mid-GOP collapses into one IDR on the next frame or so.
+        int64_t requestedAt = pipeline.Next();
+        pipeline.RequestBurst();
+        pipeline.Encode(2);
+
+        // Another burst right behind it waits out the interval, and is
+        // again answered by a single IDR.
+        pipeline.RequestBurst();
+        pipeline.Encode(IntervalFrames + 10);
+
+        std::vector<int64_t> keyFrames = pipeline.KeyFrames();
+        CHECK(keyFrames.size() == 3);
+        if (keyFrames.size() == 3)
+        {
+            CHECK(keyFrames[0] == 0);
+            CHECK(keyFrames[1] >= requestedAt && keyFrames[1] <= requestedAt + MaxLag);
+            CHECK(keyFrames[2] == keyFrames[1] + IntervalFrames);
+        }
+
+        KeyFrameRequester::Stats stats = pipeline.Stats();
+        CHECK(stats.requests == 80);
+        CHECK(stats.coalesced == 78);
+        CHECK(stats.forced == 2);
+        CHECK(stats.deferred == 1);
+    }
+}
+
+void TestKeyFrameRequester()
+{
+    TestCoalescing();
+    TestMinInterval();
+    TestRetry();
+    TestConcurrentRequests();
+    TestThroughPipeline();
+}
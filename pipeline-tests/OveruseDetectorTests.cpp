@@ -0,0 +1,81 @@
+﻿#include "Check.h"
+#include "OveruseDetector.h"
+
+namespace
+{
+    using Clock = OveruseDetector::Clock;
+    using Signal = OveruseDetector::Signal;
+    using std::chrono::milliseconds;
+    using std::chrono::seconds;
+
+    // Only the adaptations matter here, not the samples behind them.
+    void TestRestoreBackoff()
+    {
+        OveruseDetector detector;
+        Clock::time_point start = Clock::time_point() + std::chrono::hours(1);
+        CHECK(detector.RestoreDelay() == milliseconds(10000));
+
+        detector.OnAdapted(start, Signal::Overuse);
+        CHECK(detector.RestoreDelay() == milliseconds(10000));
+
+        // A restore undone two seconds later doubles the wait.
+        detector.OnAdapted(start + seconds(12), Signal::Underuse);
+        detector.OnAdapted(start + seconds(14), Signal::Overuse);
+        CHECK(detector.RestoreDelay() == milliseconds(20000));
+
+        // Overuse on top of overuse leaves it as it is.
+        detector.OnAdapted(start + seconds(17), Signal::Overuse);
+        CHECK(detector.RestoreDelay() == milliseconds(20000));
+
+        detector.OnAdapted(start + seconds(40), Signal::Underuse);
+        detector.OnAdapted(start + seconds(41), Signal::Overuse);
+        CHECK(detector.RestoreDelay() == milliseconds(40000));
+
+        // A restore that held for restoreDelay resets it.
+        detector.OnAdapted(start + seconds(90), Signal::Underuse);
+        detector.OnAdapted(start + seconds(105), Signal::Overuse);
+        CHECK(detector.RestoreDelay() == milliseconds(10000));
+
+        // The wait never grows past maxRestoreDelay.
+        Clock::time_point now = start + seconds(200);
+        for (int i = 0; i < 10; i++)
+        {
+            detector.OnAdapted(now, Signal::Underuse);
+            now += seconds(1);
+            detector.OnAdapted(now, Signal::Overuse);
+            now += detector.RestoreDelay();
+        }
+        CHECK(detector.RestoreDelay() == milliseconds(240000));
+
+        detector.Reset();
+        CHECK(detector.RestoreDelay() == milliseconds(10000));
+    }
+
+    // Underuse is held back until the last adaptation has settled for the
+    // restore delay in effect.
+    void TestUnderuseWaitsForRestoreDelay()
+    {
+        OveruseDetector detector;
+        Clock::time_point now = Clock::time_point() + std::chrono::hours(1);
+        detector.OnAdapted(now, Signal::Overuse);
+
+        OveruseDetector::Sample sample{ now, milliseconds(5), milliseconds(0), milliseconds(33) };
+        bool underuse = false;
+        Clock::time_point reported;
+        for (int i = 0; i < 30 * 15 && !underuse; i++)
+        {
+            sample.now += milliseconds(33);
+            underuse = detector.AddSample(sample) == Signal::Underuse;
+            reported = sample.now;
+        }
+        CHECK(underuse);
+        CHECK(reported - now >= milliseconds(10000));
+        CHECK(reported - now < milliseconds(12000));
+    }
+}
+
+void TestOveruseDetector()
+{
+    TestRestoreBackoff();
+    TestUnderuseWaitsForRestoreDelay();
+}
@@ -0,0 +1,270 @@
+﻿#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FragmentedMp4Verifier.h"
+#include "ReplayBuffer.h"
+
+namespace
+{
+    // 30 fps in 100 ns units.
+    constexpr int64_t FrameInterval = 333333;
+    constexpr uint64_t GopLength = 30;
+
+    void AppendNal(std::vector<uint8_t>& unit, std::initializer_list<uint8_t> header)
+    {
+        static const uint8_t StartCode[] = { 0, 0, 0, 1 };
+        unit.insert(unit.end(), StartCode, StartCode + sizeof(StartCode));
+        unit.insert(unit.end(), header);
+    }
+
+    // Annex B access units whose slice carries the frame's index right
+    // after its header, in bytes that never make a start code.
+    class Frames
+    {
+    public:
+        EncodedFrameRef Make(uint64_t index) const
+        {
+            bool keyFrame = index % GopLength == 0;
+            std::vector<uint8_t> unit;
+            if (keyFrame)
+            {
+                AppendNal(unit, { 0x67, 0x42, 0xC0, 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5 });
+                AppendNal(unit, { 0x68, 0xCE, 0x3C, 0x80 });
+                AppendNal(unit, { 0x65, 0x88 });
+            }
+            else
+            {
+                AppendNal(unit, { 0x41, 0x9A });
+            }
+            for (int shift = 0; shift < 28; shift += 7)
+                unit.push_back(static_cast<uint8_t>(0x80 | ((index >> shift) & 0x7F)));
+            size_t payload = keyFrame ? 6000 : 800 + index * 37 % 700;
+            for (size_t i = 0; i < payload; i++)
+                unit.push_back(static_cast<uint8_t>(0x80 | (i * 7)));
+
+            EncodedFrameRef frame = m_arena->Allocate(unit.size());
+            frame->Append(unit.data(), unit.size());
+            frame->SetTimestamp(static_cast<int64_t>(index) * FrameInterval);
+            frame->SetKeyFrame(keyFrame);
+            return frame;
+        }
+
+        // The frames in an Annex B dump, by index, and whether each starts
+        // with an IDR.
+        static bool Parse(const std::vector<uint8_t>& data, std::vector<uint64_t>& indices, std::vector<bool>& keyFrames)
+        {
+            indices.clear();
+            keyFrames.clear();
+            for (size_t i = 0; i + 10 <= data.size(); i++)
+            {
+                if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 0 || data[i + 3] != 1)
+                    continue;
+                uint8_t type = data[i + 4] & 0x1F;
+                if (type != 5 && type != 1)
+                    continue;
+                uint64_t index = 0;
+                for (int byte = 0; byte < 4; byte++)
+                    index |= static_cast<uint64_t>(data[i + 6 + byte] & 0x7F) << (7 * byte);
+                indices.push_back(index);
+                keyFrames.push_back(type == 5);
+            }
+            return !indices.empty();
+        }
+
+    private:
+        std::shared_ptr<BitstreamArena> m_arena = std::make_shared<BitstreamArena>(8192, 16);
+    };
+
+    std::filesystem::path TempPath(const char* name)
+    {
+        return std::filesystem::temp_directory_path() / ("pipeline-tests-" + std::to_string(getpid()) + "-" + name);
+    }
+
+    std::vector<uint8_t> ReadFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // The bytes a dump of frames first..last should hold.
+    std::vector<uint8_t> Expected(const Frames& frames, uint64_t first, uint64_t last)
+    {
+        std::vector<uint8_t> data;
+        for (uint64_t index = first; index <= last; index++)
+        {
+            EncodedFrameRef frame = frames.Make(index);
+            data.insert(data.end(), frame->Data(), frame->Data() + frame->Size());
+        }
+        return data;
+    }
+
+    // Dumps everything the ring holds and checks that it is whole GOPs of
+    // consecutive frames up to the newest.
+    void CheckContents(ReplayBuffer& replay, uint64_t newest)
+    {
+        std::filesystem::path path = TempPath("contents.h264");
+        CHECK(replay.Dump(path, INT64_MAX / 2));
+        std::vector<uint64_t> indices;
+        std::vector<bool> keyFrames;
+        CHECK(Frames::Parse(ReadFile(path), indices, keyFrames));
+        std::filesystem::remove(path);
+        if (indices.empty())
+            return;
+
+        CHECK(keyFrames.front());
+        CHECK(indices.front() % GopLength == 0);
+        CHECK(indices.back() == newest);
+        CHECK(indices.size() == newest - indices.front() + 1);
+        ReplayBuffer::Stats stats = replay.GetStats();
+        CHECK(stats.frames == indices.size());
+        CHECK(stats.gops == (newest - indices.front()) / GopLength + 1);
+    }
+
+    void TestBudgetAndEviction()
+    {
+        ReplayBuffer::Config config;
+        config.memoryBudget = 128 * 1024;
+        ReplayBuffer replay(config);
+        Frames frames;
+        for (uint64_t index = 0; index < 1000; index++)
+        {
+            replay.Insert(frames.Make(index));
+            ReplayBuffer::Stats stats = replay.GetStats();
+            CHECK(stats.bytesUsed <= config.memoryBudget);
+            CHECK(stats.gops >= 1);
+            if (index % 47 == 0)
+                CheckContents(replay, index);
+        }
+        CHECK(replay.GetStats().framesDropped == 0);
+
+        // The oldest frame kept is a key frame however the frame count
+        // limit falls, too.
+        config.memoryBudget = 1024 * 1024;
+        config.maxFrames = 50;
+        ReplayBuffer counted(config);
+        for (uint64_t index = 0; index < 200; index++)
+        {
+            counted.Insert(frames.Make(index));
+            CHECK(counted.GetStats().frames <= config.maxFrames);
+        }
+        CheckContents(counted, 199);
+    }
+
+    void TestDumpStartsAtKeyFrame()
+    {
+        ReplayBuffer::Config config;
+        ReplayBuffer replay(config);
+        Frames frames;
+        for (uint64_t index = 0; index < 100; index++)
+            replay.Insert(frames.Make(index));
+
+        // Nine frames back from frame 99 is frame 90's key frame; one more
+        // is mid-GOP, and the dump reaches back to the key frame before.
+        std::filesystem::path path = TempPath("short.h264");
+        CHECK(replay.Dump(path, 9 * FrameInterval));
+        CHECK(ReadFile(path) == Expected(frames, 90, 99));
+        CHECK(replay.Dump(path, 10 * FrameInterval));
+        CHECK(ReadFile(path) == Expected(frames, 60, 99));
+        std::filesystem::remove(path);
+
+        // A fragmented MP4 of the same frames checks out as a whole.
+        path = TempPath("replay.mp4");
+        CHECK(replay.Dump(path, 50 * FrameInterval));
+        FragmentedMp4Verifier::Result result;
+        CHECK(FragmentedMp4Verifier::VerifyFile(path, result));
+        CHECK(result.error.empty());
+        CHECK(result.samples == 70);
+        CHECK(result.keyFrames == 3);
+        std::filesystem::remove(path);
+    }
+
+    // A dump into a pipe nobody reads yet stays inside Dump with its range
+    // pinned, for as long as the test wants.
+    void TestInsertDuringDump()
+    {
+        ReplayBuffer::Config config;
+        config.memoryBudget = 256 * 1024;
+        ReplayBuffer replay(config);
+        Frames frames;
+        uint64_t next = 0;
+        for (; next < 150; next++)
+            replay.Insert(frames.Make(next));
+        const uint64_t newest = next - 1;
+        const ReplayBuffer::Stats before = replay.GetStats();
+
+        std::filesystem::path path = TempPath("pipe.h264");
+        CHECK(mkfifo(path.c_str(), 0600) == 0);
+        int reader = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+        CHECK(reader >= 0);
+        bool dumped = false;
+        std::thread dump([&]()
+            {
+                dumped = replay.Dump(path, INT64_MAX / 2);
+            });
+
+        // Once bytes show up the range is pinned, and the dump is larger
+        // than the pipe holds, so it is still being written.
+        pollfd readable = { reader, POLLIN, 0 };
+        CHECK(poll(&readable, 1, 10000) == 1);
+
+        // More frames than the ring holds: they may take the space in front
+        // of the pinned range, and are dropped once they would have to evict
+        // it. The last ones fall mid-GOP.
+        for (uint64_t i = 0; i < 310; i++, next++)
+        {
+            replay.Insert(frames.Make(next));
+            CHECK(replay.GetStats().bytesUsed <= config.memoryBudget);
+        }
+        uint64_t dropped = replay.GetStats().framesDropped;
+        CHECK(dropped > 0);
+
+        std::vector<uint8_t> data;
+        fcntl(reader, F_SETFL, 0);
+        uint8_t chunk[65536];
+        for (ssize_t read = 0; (read = ::read(reader, chunk, sizeof(chunk))) > 0;)
+            data.insert(data.end(), chunk, chunk + read);
+        dump.join();
+        close(reader);
+        std::filesystem::remove(path);
+
+        // The pinned frames came out untouched.
+        CHECK(dumped);
+        CHECK(data == Expected(frames, newest + 1 - before.frames, newest));
+
+        // After a drop the ring takes nothing until the next key frame, and
+        // then goes on from there.
+        while (next % GopLength != 0)
+        {
+            replay.Insert(frames.Make(next++));
+            CHECK(replay.GetStats().framesDropped == ++dropped);
+        }
+        uint64_t resynced = next;
+        for (uint64_t i = 0; i < 2 * GopLength; i++, next++)
+            replay.Insert(frames.Make(next));
+        CHECK(replay.GetStats().framesDropped == dropped);
+
+        std::filesystem::path resumed = TempPath("resumed.h264");
+        CHECK(replay.Dump(resumed, static_cast<int64_t>(next - resynced - 1) * FrameInterval));
+        CHECK(ReadFile(resumed) == Expected(frames, resynced, next - 1));
+        std::filesystem::remove(resumed);
+    }
+}
+
+void TestReplayBuffer()
+{
+    TestBudgetAndEviction();
+    TestDumpStartsAtKeyFrame();
+    TestInsertDuringDump();
+}
@@ -0,0 +1,218 @@
+﻿#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Check.h"
+#include "EncodePipeline.h"
+#include "FakeEncoder.h"
+#include "LatencyHistogram.h"
+#include "SimulcastEncoder.h"
+#include "SyntheticFrameSource.h"
+
+namespace
+{
+    // The portable half of a capture session: a source, the encode and
+    // delivery threads and an encoder, sharing nothing with other sessions,
+    // and optionally one simulcast layer.
+    class Session
+    {
+    public:
+        Session(uint32_t index, uint64_t frameCount, LatencyHistogram& latency, bool simulcast = false)
+            : m_latency(latency)
+        {
+            SyntheticFrameSource::Config config;
+            config.width = 640;
+            config.height = 360;
+            config.frameCount = frameCount;
+            config.seed = index + 1;
+            m_source = std::make_unique<SyntheticFrameSource>(config);
+
+            EncodePipeline::Config pipelineConfig;
+            pipelineConfig.captureQueueCapacity = config.bufferCount;
+            pipelineConfig.captureDropPolicy = DropPolicy::DropOldest;
+            m_pipeline = std::make_unique<EncodePipeline>(pipelineConfig,
+                [this](BorrowedFrame frame)
+                {
+                    std::chrono::steady_clock::time_point arrival = frame.ArrivalTime();
+                    EncodedFrameRef encoded = m_encoder.Encode(std::move(frame));
+                    m_latency.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - arrival).count()));
+                    return encoded;
+                },
+                [](const EncodedFrameRef&) {});
+
+            if (simulcast)
+            {
+                SimulcastEncoder::Config layers;
+                layers.layers.push_back({ { 320, 180 }, "low" });
+                m_simulcast = std::make_unique<SimulcastEncoder>(std::move(layers),
+                    []() { return std::make_unique<FakeEncoder>(); },
+                    [](const EncodedFrameRef&) {});
+                CHECK(m_simulcast->Initialize());
+            }
+        }
+
+        bool Start()
+        {
+            m_pipeline->Start();
+            if (m_simulcast != nullptr)
+                m_simulcast->Start();
+            return m_source->Start(
+                [this](BorrowedFrame frame)
+                {
+                    if (m_simulcast != nullptr)
+                        m_simulcast->PostFrame(frame.View(), frame.ArrivalTime());
+                    m_pipeline->PostFrame(std::move(frame));
+                });
+        }
+
+        // Like CaptureSession::Shutdown: stops everything and frees nothing,
+        // so calls still holding the session keep working.
+        void Shutdown()
+        {
+            m_source->Stop();
+            m_pipeline->Stop();
+            if (m_simulcast != nullptr)
+                m_simulcast->Stop();
+        }
+
+        EncodePipeline::Stats GetQueueStats() const { return m_pipeline->GetStats(); }
+
+        void RequestKeyFrame()
+        {
+            m_encoder.RequestKeyFrame();
+            if (m_simulcast != nullptr)
+                m_simulcast->RequestKeyFrame();
+        }
+
+        bool GetLayerStats(uint32_t layer, SimulcastEncoder::LayerStats& stats) const
+        {
+            return m_simulcast != nullptr && m_simulcast->GetLayerStats(layer, stats);
+        }
+
+        void Finish()
+        {
+            m_source->WaitUntilDone();
+            m_source->Stop();
+            m_source->WaitFramesReleased();
+            m_pipeline->Stop();
+        }
+
+        uint64_t Encoded() const { return m_encoder.Encoded(); }
+
+    private:
+        LatencyHistogram& m_latency;
+        FakeEncoder m_encoder;
+        std::unique_ptr<SyntheticFrameSource> m_source;
+        std::unique_ptr<EncodePipeline> m_pipeline;
+        std::unique_ptr<SimulcastEncoder> m_simulcast;
+    };
+}
+
+// Destroys sessions while other threads ask them for stats and key frames,
+// the way the exports' session registry lets an app do: a destroy takes the
+// session out of the registry and shuts it down, and whichever call lets go
+// of it last frees it. Meant for the sanitizers as much as for the checks.
+void TestSessions()
+{
+    constexpr uint32_t SessionCount = 4;
+    LatencyHistogram latency;
+    std::mutex mutex;
+    std::unordered_map<uint32_t, std::shared_ptr<Session>> registry;
+    for (uint32_t i = 0; i < SessionCount; i++)
+    {
+        auto session = std::make_shared<Session>(i, 0, latency, true);
+        CHECK(session->Start());
+        registry[i] = std::move(session);
+    }
+
+    std::atomic<bool> done{ false };
+    std::atomic<uint64_t> calls{ 0 };
+    std::vector<std::thread> callers;
+    for (int i = 0; i < 3; i++)
+    {
+        callers.emplace_back([&]()
+            {
+                while (!done)
+                {
+                    for (uint32_t id = 0; id < SessionCount; id++)
+                    {
+                        std::shared_ptr<Session> session;
+                        {
+                            std::lock_guard lock(mutex);
+                            auto found = registry.find(id);
+                            if (found != registry.end())
+                                session = found->second;
+                        }
+                        if (session == nullptr)
+                            continue;
+                        // Give DestroySession room to run in between.
+                        std::this_thread::yield();
+                        EncodePipeline::Stats stats = session->GetQueueStats();
+                        session->RequestKeyFrame();
+                        SimulcastEncoder::LayerStats layer;
+                        CHECK(session->GetLayerStats(1, layer));
+                        CHECK(layer.queues.framesEncoded <= layer.queues.framesPosted);
+                        CHECK(stats.framesEncoded <= stats.framesPosted);
+                        calls++;
+                    }
+                }
+            });
+    }
+
+    for (uint32_t id = 0; id < SessionCount; id++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::shared_ptr<Session> session;
+        {
+            std::lock_guard lock(mutex);
+            session = std::move(registry[id]);
+            registry.erase(id);
+        }
+        session->Shutdown();
+        CHECK(session->GetQueueStats().captureQueueDepth == 0);
+        session->RequestKeyFrame();
+    }
+    done = true;
+    for (std::thread& caller : callers)
+        caller.join();
+    CHECK(calls > 0);
+}
+
+// Runs N independent sessions flat out, the way the multi-session API lets
+// several cameras encode at once, and reports the aggregate frame rate and
+// the capture to encoded latency of their frames as N grows. With nothing
+// shared between sessions the aggregate should grow with N until the cores
+// run out.
+void BenchmarkSessions(uint32_t iterations)
+{
+    uint64_t frameCount = iterations / 500 > 60 ? iterations / 500 : 60;
+    uint32_t cores = std::thread::hardware_concurrency();
+    std::printf("\nsessions, 640x360 synthetic, %llu frames each, %u cores\n", static_cast<unsigned long long>(frameCount), cores);
+    std::printf("%-8s %10s %10s %10s %10s\n", "sessions", "total fps", "fps each", "p50 us", "p95 us");
+    for (uint32_t sessionCount = 1; sessionCount <= 16; sessionCount *= 2)
+    {
+        LatencyHistogram latency;
+        std::vector<std::unique_ptr<Session>> sessions;
+        for (uint32_t i = 0; i < sessionCount; i++)
+            sessions.push_back(std::make_unique<Session>(i, frameCount, latency));
+
+        auto start = std::chrono::steady_clock::now();
+        for (auto& session : sessions)
+            CHECK(session->Start());
+        uint64_t encoded = 0;
+        for (auto& session : sessions)
+        {
+            session->Finish();
+            encoded += session->Encoded();
+        }
+        double seconds = SecondsSince(start);
+
+        LatencyHistogram::Percentiles percentiles = latency.GetPercentiles();
+        std::printf("%-8u %10.1f %10.1f %10llu %10llu\n", sessionCount, encoded / seconds, encoded / seconds / sessionCount,
+            static_cast<unsigned long long>(percentiles.p50), static_cast<unsigned long long>(percentiles.p95));
+    }
+}
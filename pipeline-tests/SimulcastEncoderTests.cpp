@@ -0,0 +1,237 @@
+﻿#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "FakeEncoder.h"
+#include "SimulcastEncoder.h"
+
+namespace
+{
+    struct Delivered
+    {
+        uint32_t layer;
+        std::string rid;
+        int64_t timestamp;
+        uint64_t checksum;
+        bool keyFrame;
+    };
+
+    // An NV12 frame whose pixels depend on its index.
+    struct SourceFrame
+    {
+        SourceFrame(uint32_t width, uint32_t height, int64_t index)
+            : pixels(FrameView::PackedSize(FrameFormat::Nv12, width, height))
+        {
+            for (size_t i = 0; i < pixels.size(); i++)
+                pixels[i] = static_cast<uint8_t>(i * 7 + i / width * 3 + index * 29);
+            view = FrameView::Packed(FrameFormat::Nv12, pixels.data(), width, height);
+            view.timestamp = index;
+        }
+
+        std::vector<uint8_t> pixels;
+        FrameView view;
+    };
+
+    // Two layers under a 640x360 source, each fed by FakeEncoders whose
+    // access units carry the checksum of the frame they were given.
+    class Layers
+    {
+    public:
+        Layers()
+        {
+            SimulcastEncoder::Config config;
+            config.layers.push_back({ Settings(320, 180), "mid" });
+            config.layers.push_back({ Settings(160, 90), "low" });
+            config.minKeyFrameInterval = std::chrono::milliseconds(0);
+            m_simulcast = std::make_unique<SimulcastEncoder>(std::move(config),
+                []() { return std::make_unique<FakeEncoder>(); },
+                [this](const EncodedFrameRef& frame)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_delivered.push_back({ frame->Layer(), frame->Rid(), frame->Timestamp(), FakeEncoder::Checksum(frame), frame->IsKeyFrame() });
+                });
+        }
+
+        ~Layers()
+        {
+            m_simulcast->Stop();
+        }
+
+        SimulcastEncoder& Encoder() { return *m_simulcast; }
+
+        // Posts a frame and waits until the given number of layers has
+        // delivered it.
+        void Post(const FrameView& view, size_t layers)
+        {
+            size_t expected = Count() + layers;
+            m_simulcast->PostFrame(view, std::chrono::steady_clock::now());
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            while (Count() < expected && SecondsSince(start) < 10)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            // Nothing more shows up for a layer that skipped the frame.
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            CHECK(Count() == expected);
+        }
+
+        // The delivery of a frame on a layer, if there was exactly one.
+        bool Find(uint32_t layer, int64_t timestamp, Delivered& found)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            uint32_t matches = 0;
+            for (const Delivered& delivered : m_delivered)
+            {
+                if (delivered.layer == layer && delivered.timestamp == timestamp)
+                {
+                    found = delivered;
+                    matches++;
+                }
+            }
+            return matches == 1;
+        }
+
+    private:
+        static VideoEncoderSettings Settings(uint32_t width, uint32_t height)
+        {
+            VideoEncoderSettings settings;
+            settings.width = width;
+            settings.height = height;
+            return settings;
+        }
+
+        size_t Count()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_delivered.size();
+        }
+
+        std::mutex m_mutex;
+        std::vector<Delivered> m_delivered;
+        std::unique_ptr<SimulcastEncoder> m_simulcast;
+    };
+
+    // What a layer should have encoded: the source scaled down the same
+    // chain the encoder uses.
+    struct Expected
+    {
+        Expected(const FrameView& source, uint32_t width, uint32_t height)
+            : pixels(FrameView::PackedSize(FrameFormat::Nv12, width, height))
+        {
+            view = FrameView::Packed(FrameFormat::Nv12, pixels.data(), width, height);
+            Nv12Scaler scaler;
+            scaled = scaler.Configure(source.width, source.height, width, height, Nv12Scaler::Config()) && scaler.Scale(source, view);
+        }
+
+        uint64_t Checksum() const { return FakeEncoder::Checksum(view); }
+
+        std::vector<uint8_t> pixels;
+        FrameView view;
+        bool scaled;
+    };
+
+    void CheckFrame(Layers& layers, uint32_t layer, int64_t timestamp, const Expected& expected, bool keyFrame)
+    {
+        Delivered delivered;
+        CHECK(expected.scaled);
+        if (!CHECK(layers.Find(layer, timestamp, delivered)))
+            return;
+        CHECK(delivered.rid == (layer == 1 ? "mid" : "low"));
+        CHECK(delivered.checksum == expected.Checksum());
+        CHECK(delivered.keyFrame == keyFrame);
+    }
+
+    void TestLayers()
+    {
+        Layers layers;
+        SimulcastEncoder& simulcast = layers.Encoder();
+        CHECK(simulcast.Initialize());
+        CHECK(simulcast.FirstLayer() == 1);
+        CHECK(simulcast.LayerCount() == 2);
+        simulcast.Start();
+
+        // Each layer is scaled from the one above it and tagged with its
+        // number and rid; only the first frame is a key frame.
+        for (int64_t index = 0; index < 3; index++)
+        {
+            SourceFrame source(640, 360, index);
+            layers.Post(source.view, 2);
+            Expected mid(source.view, 320, 180);
+            Expected low(mid.view, 160, 90);
+            CheckFrame(layers, 1, index, mid, index == 0);
+            CheckFrame(layers, 2, index, low, index == 0);
+        }
+
+        // A request for one layer leaves the other alone; one for all
+        // reaches every layer.
+        CHECK(simulcast.RequestKeyFrame(2));
+        CHECK(!simulcast.RequestKeyFrame(0));
+        CHECK(!simulcast.RequestKeyFrame(3));
+        SourceFrame source(640, 360, 3);
+        layers.Post(source.view, 2);
+        Expected mid(source.view, 320, 180);
+        CheckFrame(layers, 1, 3, mid, false);
+        CheckFrame(layers, 2, 3, Expected(mid.view, 160, 90), true);
+
+        simulcast.RequestKeyFrame();
+        source = SourceFrame(640, 360, 4);
+        layers.Post(source.view, 2);
+        mid = Expected(source.view, 320, 180);
+        CheckFrame(layers, 1, 4, mid, true);
+        CheckFrame(layers, 2, 4, Expected(mid.view, 160, 90), true);
+
+        // A source smaller than a layer skips it, and the layer below is
+        // scaled from the source instead. A format the scaler can't take
+        // skips them all.
+        source = SourceFrame(240, 136, 5);
+        layers.Post(source.view, 1);
+        CheckFrame(layers, 2, 5, Expected(source.view, 160, 90), false);
+        source = SourceFrame(640, 360, 6);
+        source.view.format = FrameFormat::Bgra8;
+        layers.Post(source.view, 0);
+
+        SimulcastEncoder::LayerStats stats;
+        CHECK(simulcast.GetLayerStats(1, stats));
+        CHECK(stats.queues.framesDelivered == 5);
+        CHECK(stats.keyFrames == 2);
+        CHECK(stats.scaleDrops == 2);
+        CHECK(stats.bytesEncoded == 5 * FakeEncoder::AccessUnitSize);
+        CHECK(simulcast.GetLayerStats(2, stats));
+        CHECK(stats.queues.framesDelivered == 6);
+        CHECK(stats.keyFrames == 3);
+        CHECK(stats.scaleDrops == 1);
+        CHECK(!simulcast.GetLayerStats(0, stats));
+        simulcast.Stop();
+    }
+
+    void TestInvalidLayers()
+    {
+        // Layers must shrink, have even sizes and short rids.
+        auto encoder = []() { return std::make_unique<FakeEncoder>(); };
+        auto deliver = [](const EncodedFrameRef&) {};
+        VideoEncoderSettings small;
+        small.width = 160;
+        small.height = 90;
+        VideoEncoderSettings large = small;
+        large.width = 320;
+        large.height = 180;
+        VideoEncoderSettings odd = small;
+        odd.width = 161;
+
+        SimulcastEncoder::Config growing;
+        growing.layers = { { small, "a" }, { large, "b" } };
+        CHECK(!SimulcastEncoder(growing, encoder, deliver).Initialize());
+        SimulcastEncoder::Config uneven;
+        uneven.layers = { { odd, "a" } };
+        CHECK(!SimulcastEncoder(uneven, encoder, deliver).Initialize());
+        SimulcastEncoder::Config longRid;
+        longRid.layers = { { small, std::string(EncodedFrame::MaxRidLength + 1, 'r') } };
+        CHECK(!SimulcastEncoder(longRid, encoder, deliver).Initialize());
+    }
+}
+
+void TestSimulcastEncoder()
+{
+    TestLayers();
+    TestInvalidLayers();
+}
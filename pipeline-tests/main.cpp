@@ -0,0 +1,117 @@
+﻿// Checks the portable parts of the capture and encode pipeline on Linux:
+// buffer pools, the encode threads, simulcast layers, frame handles, key
+// frame requests, the capture clock, CPU adaptation, the containers,
+// instant replay and the allocations a frame costs. Encoders are fakes, so
+// no camera, codec or device is needed. --bench adds microbenchmarks.
+//
+// Linux build:
+//   cd ../webrtc-utils && g++ -std=c++17 -O2 -I. ../pipeline-tests/*.cpp
+//       BufferPool.cpp EncodedFrame.cpp EncodePipeline.cpp FrameView.cpp FrameSource.cpp
+//       SyntheticFrameSource.cpp FrameHandleTracker.cpp EncodedFrameRing.cpp
+//       LatencyHistogram.cpp KeyFrameRequester.cpp CaptureClock.cpp FragmentedMp4Muxer.cpp
+//       FragmentedMp4Verifier.cpp ReplayBuffer.cpp OveruseDetector.cpp CpuAdaptation.cpp
+//       SimulcastEncoder.cpp Nv12Scaler.cpp PixelConvert.cpp PixelConvertX86.cpp
+//       PixelConvertNeon.cpp -lpthread -o pipeline-tests
+//
+// Usage: pipeline-tests [--bench] [--iterations N] [--only NAME]
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Check.h"
+
+namespace
+{
+    // Checks also run on pipeline threads.
+    std::atomic<uint32_t> s_failures{ 0 };
+
+    const struct
+    {
+        const char* name;
+        void (*test)();
+        void (*benchmark)(uint32_t iterations);
+    } Components[] = {
+        { "BufferPool", TestBufferPool, BenchmarkBufferPool },
+        { "InPlaceEncode", TestInPlaceEncode, nullptr },
+        { "EncodePipeline", TestEncodePipeline, nullptr },
+        { "FrameHandleTracker", TestFrameHandleTracker, nullptr },
+        { "EncodedFrameRing", TestEncodedFrameRing, BenchmarkEncodedFrameRing },
+        { "Sessions", TestSessions, BenchmarkSessions },
+        { "SimulcastEncoder", TestSimulcastEncoder, nullptr },
+        { "KeyFrameRequester", TestKeyFrameRequester, nullptr },
+        { "CaptureClock", TestCaptureClock, nullptr },
+        { "FragmentedMp4", TestFragmentedMp4, nullptr },
+        { "ReplayBuffer", TestReplayBuffer, nullptr },
+        { "OveruseDetector", TestOveruseDetector, nullptr },
+        { "CpuAdaptation", TestCpuAdaptation, nullptr },
+        { "Allocations", TestAllocations, nullptr },
+    };
+
+    int Usage()
+    {
+        std::fprintf(stderr, "usage: pipeline-tests [--bench] [--iterations N] [--only NAME]\n");
+        return 2;
+    }
+}
+
+bool Check(bool condition, const char* expression, const char* file, int line)
+{
+    if (!condition)
+    {
+        s_failures++;
+        std::printf("  FAILED %s:%d: %s\n", file, line, expression);
+    }
+    return condition;
+}
+
+uint32_t CheckFailures()
+{
+    return s_failures;
+}
+
+int main(int argc, char** argv)
+{
+    bool benchmark = false;
+    uint32_t iterations = 200000;
+    const char* only = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "--bench") == 0)
+            benchmark = true;
+        else if (value == nullptr)
+            return Usage();
+        else if (std::strcmp(arg, "--iterations") == 0)
+            iterations = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--only") == 0)
+            only = argv[++i];
+        else
+            return Usage();
+    }
+    if (iterations == 0)
+        return Usage();
+
+    bool passed = true;
+    for (const auto& component : Components)
+    {
+        if (component.test == nullptr || (only != nullptr && std::strcmp(only, component.name) != 0))
+            continue;
+        uint32_t before = CheckFailures();
+        component.test();
+        bool result = CheckFailures() == before;
+        std::printf("%-20s %s\n", component.name, result ? "ok" : "FAILED");
+        passed = result && passed;
+    }
+    if (benchmark)
+    {
+        for (const auto& component : Components)
+        {
+            if (component.benchmark != nullptr && (only == nullptr || std::strcmp(only, component.name) == 0))
+                component.benchmark(iterations);
+        }
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,643 @@
+﻿// Pixel conversion, scaling and static scene check and benchmark: compares
+// every instruction set the CPU supports against the scalar kernels,
+// measures scaler quality as PSNR against an exact area-sampled reference,
+// then prints throughput.
+//
+// Linux build:
+//   cd ../webrtc-utils && g++ -std=c++17 -O2 -I. ../pixel-bench/main.cpp
+//       PixelConvert.cpp PixelConvertX86.cpp PixelConvertNeon.cpp Nv12Scaler.cpp
+//       FrameView.cpp StaticSceneDetector.cpp -o pixel-bench
+//
+// Usage: pixel-bench [--size WxH] [--frames N] [--check-only]
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "Nv12Scaler.h"
+#include "PixelConvert.h"
+#include "StaticSceneDetector.h"
+
+namespace
+{
+    // Destination planes for each conversion. Strides are padded past the
+    // row width so overruns and stride mistakes show up as mismatches.
+    struct Planes
+    {
+        std::vector<uint8_t> yuy2Y;
+        std::vector<uint8_t> yuy2UV;
+        std::vector<uint8_t> bgraY;
+        std::vector<uint8_t> bgraUV;
+        std::vector<uint8_t> nv12Y;
+        std::vector<uint8_t> nv12UV;
+        std::vector<uint8_t> i420Y;
+        std::vector<uint8_t> u;
+        std::vector<uint8_t> v;
+        std::vector<uint8_t> bgra;
+
+        bool operator==(const Planes& other) const
+        {
+            return yuy2Y == other.yuy2Y && yuy2UV == other.yuy2UV && bgraY == other.bgraY && bgraUV == other.bgraUV &&
+                nv12Y == other.nv12Y && nv12UV == other.nv12UV && i420Y == other.i420Y && u == other.u && v == other.v && bgra == other.bgra;
+        }
+    };
+
+    struct Source
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t padding;
+        std::vector<uint8_t> yuy2;
+        std::vector<uint8_t> bgra;
+        std::vector<uint8_t> y;
+        std::vector<uint8_t> uv;
+        std::vector<uint8_t> u;
+        std::vector<uint8_t> v;
+
+        uint32_t Yuy2Stride() const { return width * 2 + padding; }
+        uint32_t BgraStride() const { return width * 4 + padding; }
+        uint32_t YStride() const { return width + padding; }
+        uint32_t UVStride() const { return width + padding; }
+        uint32_t ChromaStride() const { return width / 2 + padding; }
+    };
+
+    const ColorSpace ColorSpaces[] = {
+        { ColorMatrix::Bt601, ColorRange::Limited },
+        { ColorMatrix::Bt601, ColorRange::Full },
+        { ColorMatrix::Bt709, ColorRange::Limited },
+        { ColorMatrix::Bt709, ColorRange::Full },
+    };
+
+    Source MakeSource(uint32_t width, uint32_t height, uint32_t padding, std::mt19937& random)
+    {
+        Source source;
+        source.width = width;
+        source.height = height;
+        source.padding = padding;
+        auto fill = [&random](std::vector<uint8_t>& plane, size_t size)
+        {
+            plane.resize(size);
+            for (uint8_t& value : plane)
+                value = static_cast<uint8_t>(random());
+        };
+        fill(source.yuy2, static_cast<size_t>(source.Yuy2Stride()) * height);
+        fill(source.bgra, static_cast<size_t>(source.BgraStride()) * height);
+        fill(source.y, static_cast<size_t>(source.YStride()) * height);
+        fill(source.uv, static_cast<size_t>(source.UVStride()) * height / 2);
+        fill(source.u, static_cast<size_t>(source.ChromaStride()) * height / 2);
+        fill(source.v, static_cast<size_t>(source.ChromaStride()) * height / 2);
+        return source;
+    }
+
+    Planes MakePlanes(const Source& source)
+    {
+        size_t lumaSize = static_cast<size_t>(source.YStride()) * source.height;
+        size_t uvSize = static_cast<size_t>(source.UVStride()) * source.height / 2;
+        size_t chromaSize = static_cast<size_t>(source.ChromaStride()) * source.height / 2;
+        Planes planes;
+        planes.yuy2Y.assign(lumaSize, 0xcd);
+        planes.yuy2UV.assign(uvSize, 0xcd);
+        planes.bgraY.assign(lumaSize, 0xcd);
+        planes.bgraUV.assign(uvSize, 0xcd);
+        planes.nv12Y.assign(lumaSize, 0xcd);
+        planes.nv12UV.assign(uvSize, 0xcd);
+        planes.i420Y.assign(lumaSize, 0xcd);
+        planes.u.assign(chromaSize, 0xcd);
+        planes.v.assign(chromaSize, 0xcd);
+        planes.bgra.assign(static_cast<size_t>(source.BgraStride()) * source.height, 0xcd);
+        return planes;
+    }
+
+    void ConvertAll(const Source& s, const ColorSpace& colorSpace, Planes& out)
+    {
+        Yuy2ToNv12(s.yuy2.data(), s.Yuy2Stride(), out.yuy2Y.data(), s.YStride(), out.yuy2UV.data(), s.UVStride(), s.width, s.height);
+        BgraToNv12(s.bgra.data(), s.BgraStride(), out.bgraY.data(), s.YStride(), out.bgraUV.data(), s.UVStride(),
+            s.width, s.height, colorSpace);
+        I420ToNv12(s.y.data(), s.YStride(), s.u.data(), s.ChromaStride(), s.v.data(), s.ChromaStride(),
+            out.nv12Y.data(), s.YStride(), out.nv12UV.data(), s.UVStride(), s.width, s.height);
+        Nv12ToI420(s.y.data(), s.YStride(), s.uv.data(), s.UVStride(), out.i420Y.data(), s.YStride(),
+            out.u.data(), s.ChromaStride(), out.v.data(), s.ChromaStride(), s.width, s.height);
+        Nv12ToBgra(s.y.data(), s.YStride(), s.uv.data(), s.UVStride(), out.bgra.data(), s.BgraStride(), s.width, s.height, colorSpace);
+    }
+
+    const PixelIsa Isas[] = { PixelIsa::Sse41, PixelIsa::Avx2, PixelIsa::Neon };
+
+    // Every supported instruction set against the scalar kernels, over
+    // widths that leave a scalar tail of each possible length.
+    bool CheckAll()
+    {
+        std::mt19937 random(1234);
+        bool passed = true;
+        for (PixelIsa isa : Isas)
+        {
+            if (!IsPixelIsaSupported(isa))
+            {
+                std::printf("%-7s not supported, skipped\n", PixelIsaName(isa));
+                continue;
+            }
+            uint32_t cases = 0;
+            uint32_t failures = 0;
+            for (uint32_t width = 2; width <= 160; width += 2)
+            {
+                for (uint32_t padding : { 0u, 7u })
+                {
+                    Source source = MakeSource(width, 6, padding, random);
+                    for (const ColorSpace& colorSpace : ColorSpaces)
+                    {
+                        Planes expected = MakePlanes(source);
+                        Planes actual = MakePlanes(source);
+                        SetPixelIsa(PixelIsa::Scalar);
+                        ConvertAll(source, colorSpace, expected);
+                        SetPixelIsa(isa);
+                        ConvertAll(source, colorSpace, actual);
+                        cases++;
+                        if (!(expected == actual))
+                        {
+                            if (failures++ < 5)
+                                std::printf("%-7s mismatch at width %u, padding %u\n", PixelIsaName(isa), width, padding);
+                        }
+                    }
+                }
+            }
+            std::printf("%-7s %u cases, %u mismatches\n", PixelIsaName(isa), cases, failures);
+            passed = passed && failures == 0;
+        }
+        SetPixelIsa(PixelIsa::Scalar);
+        return passed;
+    }
+
+    struct Nv12Image
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> y;
+        std::vector<uint8_t> uv;
+
+        Nv12Image(uint32_t w, uint32_t h) : width(w), height(h), y(static_cast<size_t>(w) * h), uv(static_cast<size_t>(w) * h / 2) {}
+    };
+
+    const ScaleFilter Filters[] = { ScaleFilter::Bilinear, ScaleFilter::Box };
+
+    const char* FilterName(ScaleFilter filter)
+    {
+        return filter == ScaleFilter::Box ? "box" : "bilinear";
+    }
+
+    // Every supported instruction set against the scalar kernels for
+    // ratios up, down and uneven between the axes.
+    bool CheckScaler()
+    {
+        const uint32_t sizes[][4] = {
+            { 64, 48, 32, 24 }, { 98, 66, 34, 22 }, { 130, 70, 96, 64 }, { 200, 100, 20, 10 },
+            { 62, 40, 124, 80 }, { 100, 60, 66, 58 }, { 1282, 6, 642, 4 },
+        };
+        std::mt19937 random(42);
+        bool passed = true;
+        for (PixelIsa isa : Isas)
+        {
+            if (!IsPixelIsaSupported(isa))
+                continue;
+            uint32_t cases = 0;
+            uint32_t failures = 0;
+            for (const auto& size : sizes)
+            {
+                Nv12Image source(size[0], size[1]);
+                for (uint8_t& value : source.y)
+                    value = static_cast<uint8_t>(random());
+                for (uint8_t& value : source.uv)
+                    value = static_cast<uint8_t>(random());
+                for (ScaleFilter filter : Filters)
+                {
+                    Nv12Image expected(size[2], size[3]);
+                    Nv12Image actual(size[2], size[3]);
+                    Nv12Scaler scaler;
+                    scaler.Configure(size[0], size[1], size[2], size[3], { filter, ChromaSiting::Left });
+                    SetPixelIsa(PixelIsa::Scalar);
+                    scaler.Scale(source.y.data(), size[0], source.uv.data(), size[0], expected.y.data(), size[2], expected.uv.data(), size[2]);
+                    SetPixelIsa(isa);
+                    scaler.Scale(source.y.data(), size[0], source.uv.data(), size[0], actual.y.data(), size[2], actual.uv.data(), size[2]);
+                    cases++;
+                    if (expected.y != actual.y || expected.uv != actual.uv)
+                    {
+                        failures++;
+                        std::printf("%-7s scaler mismatch %ux%u -> %ux%u %s\n", PixelIsaName(isa), size[0], size[1], size[2], size[3], FilterName(filter));
+                    }
+                }
+            }
+            std::printf("%-7s %u scaler cases, %u mismatches\n", PixelIsaName(isa), cases, failures);
+            passed = passed && failures == 0;
+        }
+        SetPixelIsa(PixelIsa::Scalar);
+        return passed;
+    }
+
+    // Test pattern over continuous coordinates in source luma pixels: a zone
+    // plate whose frequency rises towards the corners over smooth ramps,
+    // and chroma waves of different directions.
+    double PatternY(double x, double y, double width, double height)
+    {
+        double dx = x - width / 2;
+        double dy = y - height / 2;
+        return 128 + 60 * std::cos(3.14159265 * (dx * dx + dy * dy) / (width * 2)) + 40 * std::sin(x / 37) * std::cos(y / 23);
+    }
+
+    double PatternU(double x, double y)
+    {
+        return 128 + 80 * std::sin(x / 53 + y / 71);
+    }
+
+    double PatternV(double x, double y)
+    {
+        return 128 + 80 * std::cos(x / 41 - y / 29);
+    }
+
+    uint8_t ToSample(double value)
+    {
+        return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0), 255.0)));
+    }
+
+    // Renders the pattern for a size whose pixels are scale source pixels
+    // wide, averaging samples x samples points over each pixel's footprint.
+    // Chroma sits with the left luma pixel and between the two rows.
+    Nv12Image Render(uint32_t width, uint32_t height, double scaleX, double scaleY, double sourceWidth, double sourceHeight, int samples)
+    {
+        Nv12Image image(width, height);
+        auto average = [samples](double left, double top, double w, double h, const std::function<double(double, double)>& pattern)
+        {
+            double sum = 0;
+            for (int j = 0; j < samples; j++)
+            {
+                for (int i = 0; i < samples; i++)
+                    sum += pattern(left + (i + 0.5) * w / samples, top + (j + 0.5) * h / samples);
+            }
+            return sum / (samples * samples);
+        };
+        auto luma = [&](double x, double y) { return PatternY(x, y, sourceWidth, sourceHeight); };
+        for (uint32_t row = 0; row < height; row++)
+        {
+            for (uint32_t column = 0; column < width; column++)
+                image.y[static_cast<size_t>(row) * width + column] = ToSample(average(column * scaleX, row * scaleY, scaleX, scaleY, luma));
+        }
+        for (uint32_t row = 0; row < height / 2; row++)
+        {
+            for (uint32_t column = 0; column < width / 2; column++)
+            {
+                // Footprint of two by two pixels centered on the chroma site.
+                double left = (column * 2 + 0.5) * scaleX - scaleX;
+                double top = row * 2 * scaleY;
+                uint8_t* uv = &image.uv[static_cast<size_t>(row) * width + column * 2];
+                uv[0] = ToSample(average(left, top, scaleX * 2, scaleY * 2, PatternU));
+                uv[1] = ToSample(average(left, top, scaleX * 2, scaleY * 2, PatternV));
+            }
+        }
+        return image;
+    }
+
+    double Psnr(const uint8_t* a, const uint8_t* b, size_t count, size_t stride, size_t offset)
+    {
+        double error = 0;
+        size_t samples = 0;
+        for (size_t i = offset; i < count; i += stride, samples++)
+        {
+            double difference = static_cast<double>(a[i]) - b[i];
+            error += difference * difference;
+        }
+        if (error == 0)
+            return 99.0;
+        return 10 * std::log10(255.0 * 255.0 * samples / error);
+    }
+
+    void ScalerQuality(uint32_t width, uint32_t height)
+    {
+        std::printf("\nscaler PSNR against an area-sampled reference, dB\n");
+        std::printf("%-24s%-10s%8s%8s%8s\n", "", "filter", "Y", "U", "V");
+        Nv12Image source = Render(width, height, 1.0, 1.0, width, height, 4);
+        const double ratios[] = { 1.5, 2.0, 3.0, 2.0 / 1.5 };
+        for (double ratio : ratios)
+        {
+            uint32_t dstWidth = static_cast<uint32_t>(width / ratio) & ~1u;
+            uint32_t dstHeight = static_cast<uint32_t>(height / ratio) & ~1u;
+            Nv12Image reference = Render(dstWidth, dstHeight, static_cast<double>(width) / dstWidth,
+                static_cast<double>(height) / dstHeight, width, height, 8);
+            for (ScaleFilter filter : Filters)
+            {
+                Nv12Image scaled(dstWidth, dstHeight);
+                Nv12Scaler scaler;
+                scaler.Configure(width, height, dstWidth, dstHeight, { filter, ChromaSiting::Left });
+                scaler.Scale(source.y.data(), width, source.uv.data(), width, scaled.y.data(), dstWidth, scaled.uv.data(), dstWidth);
+                char sizes[32];
+                std::snprintf(sizes, sizeof(sizes), "%ux%u -> %ux%u", width, height, dstWidth, dstHeight);
+                std::printf("%-24s%-10s%8.2f%8.2f%8.2f\n", sizes, FilterName(filter),
+                    Psnr(scaled.y.data(), reference.y.data(), scaled.y.size(), 1, 0),
+                    Psnr(scaled.uv.data(), reference.uv.data(), scaled.uv.size(), 2, 0),
+                    Psnr(scaled.uv.data(), reference.uv.data(), scaled.uv.size(), 2, 1));
+            }
+        }
+    }
+
+    double Measure(uint32_t frames, const std::function<void()>& convert)
+    {
+        convert();
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frames; i++)
+            convert();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() > 0 ? frames / elapsed.count() : 0.0;
+    }
+
+    void Benchmark(uint32_t width, uint32_t height, uint32_t frames)
+    {
+        std::mt19937 random(5678);
+        Source s = MakeSource(width, height, 0, random);
+        Planes out = MakePlanes(s);
+        const ColorSpace colorSpace{ ColorMatrix::Bt709, ColorRange::Limited };
+
+        std::printf("\n%ux%u, frames per second\n%-14s", width, height, "");
+        std::vector<PixelIsa> isas{ PixelIsa::Scalar };
+        for (PixelIsa isa : Isas)
+        {
+            if (IsPixelIsaSupported(isa))
+                isas.push_back(isa);
+        }
+        for (PixelIsa isa : isas)
+            std::printf("%10s", PixelIsaName(isa));
+        std::printf("\n");
+
+        const struct
+        {
+            const char* name;
+            std::function<void()> convert;
+        } conversions[] = {
+            { "YUY2->NV12", [&] { Yuy2ToNv12(s.yuy2.data(), s.Yuy2Stride(), out.bgraY.data(), s.YStride(), out.bgraUV.data(), s.UVStride(), width, height); } },
+            { "BGRA->NV12", [&] { BgraToNv12(s.bgra.data(), s.BgraStride(), out.bgraY.data(), s.YStride(), out.bgraUV.data(), s.UVStride(), width, height, colorSpace); } },
+            { "I420->NV12", [&] { I420ToNv12(s.y.data(), s.YStride(), s.u.data(), s.ChromaStride(), s.v.data(), s.ChromaStride(),
+                out.bgraY.data(), s.YStride(), out.bgraUV.data(), s.UVStride(), width, height); } },
+            { "NV12->I420", [&] { Nv12ToI420(s.y.data(), s.YStride(), s.uv.data(), s.UVStride(), out.bgraY.data(), s.YStride(),
+                out.u.data(), s.ChromaStride(), out.v.data(), s.ChromaStride(), width, height); } },
+            { "NV12->BGRA", [&] { Nv12ToBgra(s.y.data(), s.YStride(), s.uv.data(), s.UVStride(), out.bgra.data(), s.BgraStride(), width, height, colorSpace); } },
+        };
+        for (const auto& conversion : conversions)
+        {
+            std::printf("%-14s", conversion.name);
+            for (PixelIsa isa : isas)
+            {
+                SetPixelIsa(isa);
+                std::printf("%10.1f", Measure(frames, conversion.convert));
+            }
+            std::printf("\n");
+        }
+    }
+
+    void BenchmarkScaler(uint32_t width, uint32_t height, uint32_t frames)
+    {
+        std::mt19937 random(91);
+        Nv12Image source(width, height);
+        for (uint8_t& value : source.y)
+            value = static_cast<uint8_t>(random());
+        for (uint8_t& value : source.uv)
+            value = static_cast<uint8_t>(random());
+
+        std::vector<PixelIsa> isas{ PixelIsa::Scalar };
+        for (PixelIsa isa : Isas)
+        {
+            if (IsPixelIsaSupported(isa))
+                isas.push_back(isa);
+        }
+        std::printf("\nscaler, frames per second\n%-34s", "");
+        for (PixelIsa isa : isas)
+            std::printf("%10s", PixelIsaName(isa));
+        std::printf("\n");
+
+        const double ratios[] = { 1.5, 2.0, 3.0 };
+        for (double ratio : ratios)
+        {
+            uint32_t dstWidth = static_cast<uint32_t>(width / ratio) & ~1u;
+            uint32_t dstHeight = static_cast<uint32_t>(height / ratio) & ~1u;
+            Nv12Image scaled(dstWidth, dstHeight);
+            for (ScaleFilter filter : Filters)
+            {
+                Nv12Scaler scaler;
+                scaler.Configure(width, height, dstWidth, dstHeight, { filter, ChromaSiting::Left });
+                char name[48];
+                std::snprintf(name, sizeof(name), "%ux%u -> %ux%u %s", width, height, dstWidth, dstHeight, FilterName(filter));
+                std::printf("%-34s", name);
+                for (PixelIsa isa : isas)
+                {
+                    SetPixelIsa(isa);
+                    std::printf("%10.1f", Measure(frames, [&]
+                    {
+                        scaler.Scale(source.y.data(), width, source.uv.data(), width, scaled.y.data(), dstWidth, scaled.uv.data(), dstWidth);
+                    }));
+                }
+                std::printf("\n");
+            }
+        }
+    }
+
+    // A luma plane and a copy of it disturbed the way a static scene
+    // detector sees it: sensor noise everywhere, a moving object over part
+    // of the frame, or a new picture altogether.
+    struct SceneFrames
+    {
+        const char* name;
+        std::vector<uint8_t> reference;
+        std::vector<uint8_t> next;
+    };
+
+    std::vector<SceneFrames> MakeScenes(uint32_t width, uint32_t stride, uint32_t height, std::mt19937& random)
+    {
+        std::vector<uint8_t> base(static_cast<size_t>(stride) * height);
+        for (uint32_t row = 0; row < height; row++)
+        {
+            for (uint32_t column = 0; column < stride; column++)
+                base[static_cast<size_t>(row) * stride + column] = ToSample(PatternY(column, row, width, height));
+        }
+
+        std::vector<SceneFrames> scenes;
+        scenes.push_back({ "unchanged", base, base });
+
+        SceneFrames noise = { "noise", base, base };
+        for (uint8_t& value : noise.next)
+            value = static_cast<uint8_t>(std::min(std::max(value + static_cast<int>(random() % 5) - 2, 0), 255));
+        scenes.push_back(noise);
+
+        // A box a tenth of each side, off the tile grid.
+        SceneFrames box = { "moving box", base, base };
+        for (uint32_t row = height / 3 + 5; row < height / 3 + 5 + height / 10; row++)
+        {
+            for (uint32_t column = width / 2 + 7; column < width / 2 + 7 + width / 10 && column < width; column++)
+                box.next[static_cast<size_t>(row) * stride + column] = static_cast<uint8_t>(random());
+        }
+        scenes.push_back(box);
+
+        SceneFrames cut = { "cut", base, base };
+        for (uint8_t& value : cut.next)
+            value = static_cast<uint8_t>(random());
+        scenes.push_back(cut);
+        return scenes;
+    }
+
+    FrameView LumaView(const std::vector<uint8_t>& luma, uint32_t width, uint32_t stride, uint32_t height, int64_t timestamp)
+    {
+        // The detector only reads the luma plane.
+        FrameView view;
+        view.format = FrameFormat::Nv12;
+        view.width = width;
+        view.height = height;
+        view.timestamp = timestamp;
+        view.planes[0] = { const_cast<uint8_t*>(luma.data()), stride, 0 };
+        view.planes[1] = view.planes[0];
+        return view;
+    }
+
+    // Change ratios from every supported instruction set against the scalar
+    // ones, over sizes that leave partial tiles and columns.
+    bool CheckStaticScene()
+    {
+        const uint32_t sizes[][2] = { { 64, 64 }, { 98, 66 }, { 130, 70 }, { 362, 202 }, { 1282, 18 } };
+        std::mt19937 random(77);
+        bool passed = true;
+        for (PixelIsa isa : Isas)
+        {
+            if (!IsPixelIsaSupported(isa))
+                continue;
+            uint32_t cases = 0;
+            uint32_t failures = 0;
+            for (const auto& size : sizes)
+            {
+                for (uint32_t padding : { 0u, 9u })
+                {
+                    uint32_t stride = size[0] + padding;
+                    for (const SceneFrames& scene : MakeScenes(size[0], stride, size[1], random))
+                    {
+                        // The floors cover no floor, one within the noise and one
+                        // past it.
+                        for (uint32_t floor : { 0u, 1u, 4u })
+                        {
+                            StaticSceneDetector::Config config;
+                            config.tileSize = 32;
+                            config.rowStep = floor == 1 ? 3 : 1;
+                            config.noiseFloor = static_cast<uint8_t>(floor);
+                            config.tileThreshold = 0.5;
+                            double ratios[2];
+                            for (int pass = 0; pass < 2; pass++)
+                            {
+                                SetPixelIsa(pass == 0 ? PixelIsa::Scalar : isa);
+                                StaticSceneDetector detector(config);
+                                detector.Check(LumaView(scene.reference, size[0], stride, size[1], 0));
+                                ratios[pass] = detector.Check(LumaView(scene.next, size[0], stride, size[1], 1)).changeRatio;
+                            }
+                            cases++;
+                            if (ratios[0] != ratios[1])
+                            {
+                                failures++;
+                                std::printf("%-7s change ratio mismatch %ux%u %s, floor %u: %f, %f\n", PixelIsaName(isa), size[0], size[1],
+                                    scene.name, floor, ratios[0], ratios[1]);
+                            }
+                        }
+                    }
+                }
+            }
+            std::printf("%-7s %u static scene cases, %u mismatches\n", PixelIsaName(isa), cases, failures);
+            passed = passed && failures == 0;
+        }
+        SetPixelIsa(PixelIsa::Scalar);
+        return passed;
+    }
+
+    // Each scene alternates its two frames, so every check compares the
+    // whole frame; frames that pass also store the reference rows.
+    void BenchmarkStaticScene(uint32_t width, uint32_t height, uint32_t frames)
+    {
+        std::mt19937 random(23);
+        std::vector<SceneFrames> scenes = MakeScenes(width, width, height, random);
+
+        std::vector<PixelIsa> isas{ PixelIsa::Scalar };
+        for (PixelIsa isa : Isas)
+        {
+            if (IsPixelIsaSupported(isa))
+                isas.push_back(isa);
+        }
+        std::printf("\nstatic scene detector, frames per second\n%-34s", "");
+        for (PixelIsa isa : isas)
+            std::printf("%10s", PixelIsaName(isa));
+        std::printf("%10s\n", "changed");
+
+        for (uint32_t rowStep : { 1u, 4u })
+        {
+            for (const SceneFrames& scene : scenes)
+            {
+                StaticSceneDetector::Config config;
+                config.rowStep = rowStep;
+                char name[48];
+                std::snprintf(name, sizeof(name), "%ux%u %s, rows 1/%u", width, height, scene.name, rowStep);
+                std::printf("%-34s", name);
+                double ratio = 0;
+                for (PixelIsa isa : isas)
+                {
+                    SetPixelIsa(isa);
+                    StaticSceneDetector detector(config);
+                    int64_t timestamp = 0;
+                    detector.Check(LumaView(scene.reference, width, width, height, timestamp));
+                    std::printf("%10.1f", Measure(frames, [&]
+                    {
+                        const std::vector<uint8_t>& luma = ++timestamp % 2 != 0 ? scene.next : scene.reference;
+                        ratio = detector.Check(LumaView(luma, width, width, height, timestamp)).changeRatio;
+                    }));
+                }
+                std::printf("%9.1f%%\n", ratio * 100);
+            }
+        }
+    }
+
+    int Usage()
+    {
+        std::fprintf(stderr, "usage: pixel-bench [--size WxH] [--frames N] [--check-only]\n");
+        return 2;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 1920;
+    uint32_t height = 1080;
+    uint32_t frames = 200;
+    bool checkOnly = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "--check-only") == 0)
+            checkOnly = true;
+        else if (value == nullptr)
+            return Usage();
+        else if (std::strcmp(arg, "--size") == 0 && std::sscanf(value, "%ux%u", &width, &height) == 2)
+            i++;
+        else if (std::strcmp(arg, "--frames") == 0)
+            frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else
+            return Usage();
+    }
+    if (width == 0 || height == 0 || (width & 1) != 0 || (height & 1) != 0 || frames == 0)
+        return Usage();
+
+    PixelIsa detected = ActivePixelIsa();
+    std::printf("detected %s\n", PixelIsaName(detected));
+    bool passed = CheckAll();
+    passed = CheckScaler() && passed;
+    passed = CheckStaticScene() && passed;
+    if (!checkOnly)
+    {
+        ScalerQuality(width, height);
+        Benchmark(width, height, frames);
+        BenchmarkScaler(width, height, frames);
+        BenchmarkStaticScene(width, height, frames);
+    }
+    SetPixelIsa(detected);
+    return passed ? 0 : 1;
+}
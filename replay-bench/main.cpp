@@ -0,0 +1,242 @@
+﻿// Offline encode benchmark: replays a YUV file or synthetic frames through
+// an encoder backend and prints throughput, latency percentiles and
+// bitrate.
+//
+// Linux build with the OpenH264 software backend:
+//   cd ../webrtc-utils && g++ -std=c++17 -O2 -DWEBRTCUTILS_OPENH264 -I. ../replay-bench/main.cpp
+//       ReplayBenchmark.cpp YuvFileReader.cpp EncodePipeline.cpp EncodedFrame.cpp BufferPool.cpp
+//       PipelineMetrics.cpp LatencyHistogram.cpp OpenH264Encoder.cpp Trace.cpp
+//       BitstreamRecorder.cpp FragmentedMp4Muxer.cpp FragmentedMp4Verifier.cpp FrameView.cpp
+//       CpuAdaptation.cpp OveruseDetector.cpp Nv12Scaler.cpp PixelConvert.cpp
+//       PixelConvertX86.cpp PixelConvertNeon.cpp FrameSource.cpp YuvFileSource.cpp
+//       MappedYuvFileSource.cpp SyntheticFrameSource.cpp -lopenh264 -lpthread -o replay-bench
+//
+// Usage: replay-bench <file.y4m | file.yuv | synthetic:WxH> [--size WxH] [--i420] [--fps N]
+//            [--frames N] [--loops N] [--bitrate BPS] [--realtime] [--record out.mp4|out.h264]
+//            [--encode-delay US] [--adapt] [--motion PX] [--noise N] [--boxes N] [--mmap] [--verify]
+//            [--baseline]
+//
+// synthetic:WxH generates frames instead of reading them: boxes moving
+// --motion pixels a frame over a gradient, with luma noise of up to
+// --noise. The same options give the same frames on every run; --frames
+// defaults to 300 for it.
+//
+// --mmap plays the file out of a memory mapping instead of reading it, so
+// that large sequences, 4K and up, cost no reads or copies of their own.
+// I420 input, which includes every Y4M file, is still converted to NV12.
+//
+// --encode-delay holds every full-size encode for US microseconds more,
+// smaller frames proportionally less; with --adapt --realtime it shows
+// how CPU adaptation steps down and back up under a known load.
+//
+// --verify reads an MP4 --record back once the run is over and checks its
+// fragments, sample tables and index; a bad file fails the run.
+//
+// --baseline also makes the copies the old path made for every frame,
+// packing it and copying it into the sample on the way in and copying the
+// bitstream three times on the way out, and prints them next to today's.
+// Its throughput and latency include those copies.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "FragmentedMp4Verifier.h"
+#include "MappedYuvFileSource.h"
+#include "OpenH264Encoder.h"
+#include "ReplayBenchmark.h"
+#include "SyntheticFrameSource.h"
+#include "YuvFileSource.h"
+
+static void PrintLatency(const char* name, const LatencyHistogram::Percentiles& latency)
+{
+    std::printf("%-18s p50 %6llu us  p95 %6llu us  p99 %6llu us  max %6llu us\n", name,
+        static_cast<unsigned long long>(latency.p50), static_cast<unsigned long long>(latency.p95),
+        static_cast<unsigned long long>(latency.p99), static_cast<unsigned long long>(latency.max));
+}
+
+static std::unique_ptr<IVideoEncoderBackend> CreateEncoder()
+{
+#ifdef WEBRTCUTILS_OPENH264
+    return std::make_unique<OpenH264Encoder>();
+#else
+    return nullptr;
+#endif
+}
+
+static int Usage()
+{
+    std::fprintf(stderr, "usage: replay-bench <file.y4m | file.yuv | synthetic:WxH> [--size WxH] [--i420] [--fps N] "
+        "[--frames N] [--loops N] [--bitrate BPS] [--realtime] [--record out.mp4|out.h264] "
+        "[--encode-delay US] [--adapt] [--motion PX] [--noise N] [--boxes N] [--mmap] [--verify] [--baseline]\n");
+    return 2;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+        return Usage();
+
+    ReplayBenchmark::Config config;
+    YuvFileSource::Config file;
+    SyntheticFrameSource::Config synthetic;
+    file.path = argv[1];
+    bool generate = std::sscanf(argv[1], "synthetic:%ux%u", &synthetic.width, &synthetic.height) == 2;
+    bool mapped = false;
+    bool verify = false;
+    for (int i = 2; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (std::strcmp(arg, "--realtime") == 0)
+            file.realtime = synthetic.realtime = true;
+        else if (std::strcmp(arg, "--adapt") == 0)
+            config.adapt = true;
+        else if (std::strcmp(arg, "--mmap") == 0)
+            mapped = true;
+        else if (std::strcmp(arg, "--verify") == 0)
+            verify = true;
+        else if (std::strcmp(arg, "--baseline") == 0)
+            config.baseline = true;
+        else if (std::strcmp(arg, "--i420") == 0)
+            file.input.format = YuvFormat::I420;
+        else if (value == nullptr)
+            return Usage();
+        else if (std::strcmp(arg, "--size") == 0 && std::sscanf(value, "%ux%u", &file.input.width, &file.input.height) == 2)
+            i++;
+        else if (std::strcmp(arg, "--fps") == 0)
+            file.input.frameRate = synthetic.frameRate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--frames") == 0)
+            file.maxFrames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--loops") == 0)
+            file.loops = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--motion") == 0)
+            synthetic.motion = std::strtod(argv[++i], nullptr);
+        else if (std::strcmp(arg, "--noise") == 0)
+            synthetic.noise = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--boxes") == 0)
+            synthetic.boxCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--bitrate") == 0)
+            config.encoder.bitrate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (std::strcmp(arg, "--record") == 0)
+            config.recordPath = argv[++i];
+        else if (std::strcmp(arg, "--encode-delay") == 0)
+            config.encodeDelay = std::chrono::microseconds(std::strtoul(argv[++i], nullptr, 10));
+        else
+            return Usage();
+    }
+    if (file.input.frameRate == 0 || file.loops == 0)
+        return Usage();
+    const std::string& record = config.recordPath;
+    if (verify && (record.size() < 4 || record.compare(record.size() - 4, 4, ".mp4") != 0))
+    {
+        std::fprintf(stderr, "--verify needs --record out.mp4\n");
+        return 2;
+    }
+
+    // Later passes over a file reuse the same frames, so that they measure
+    // the encoder rather than the disk.
+    file.preload = file.loops > 1;
+    file.bufferCount = config.bufferCount;
+    synthetic.bufferCount = config.bufferCount;
+    synthetic.frameCount = static_cast<uint64_t>(file.maxFrames > 0 ? file.maxFrames : 300) * file.loops;
+    std::unique_ptr<PacedFrameSource> source;
+    if (generate)
+    {
+        source = std::make_unique<SyntheticFrameSource>(synthetic);
+    }
+    else if (mapped)
+    {
+        MappedYuvFileSource::Config mapping;
+        mapping.path = file.path;
+        mapping.input = file.input;
+        mapping.maxFrames = file.maxFrames;
+        mapping.loops = file.loops;
+        mapping.realtime = file.realtime;
+        mapping.bufferCount = config.bufferCount;
+        auto reader = std::make_unique<MappedYuvFileSource>(mapping);
+        if (!reader->Open())
+        {
+            std::fprintf(stderr, "could not map %s\n", argv[1]);
+            return 1;
+        }
+        source = std::move(reader);
+    }
+    else
+    {
+        auto reader = std::make_unique<YuvFileSource>(file);
+        if (!reader->Open())
+        {
+            std::fprintf(stderr, "could not read %s\n", argv[1]);
+            return 1;
+        }
+        source = std::move(reader);
+    }
+
+    std::unique_ptr<IVideoEncoderBackend> encoder = CreateEncoder();
+    if (encoder == nullptr)
+    {
+        std::fprintf(stderr, "built without an encoder backend; rebuild with -DWEBRTCUTILS_OPENH264\n");
+        return 1;
+    }
+
+    ReplayBenchmark::Result result;
+    if (!ReplayBenchmark::Run(config, *source, *encoder, result))
+    {
+        std::fprintf(stderr, "replay of %s failed\n", argv[1]);
+        return 1;
+    }
+
+    std::printf("%s %ux%u, %s\n", encoder->Name(), result.width, result.height, file.realtime ? "realtime" : "flat out");
+    std::printf("frames            %llu in, %llu encoded, %llu key\n", static_cast<unsigned long long>(result.framesIn),
+        static_cast<unsigned long long>(result.framesEncoded), static_cast<unsigned long long>(result.keyFrames));
+    std::printf("throughput        %.1f fps over %.2f s\n", result.fps, result.seconds);
+    std::printf("bitrate           %.0f kbps (%llu bytes)\n", result.bitrate / 1000, static_cast<unsigned long long>(result.bytesEncoded));
+    PrintLatency("submit->encoded", result.submitToEncoded);
+    PrintLatency("encode", result.encodeLatency);
+    // Each encoded byte should be copied exactly once, into the arena;
+    // anything above 1.00x the bitstream is a copy too many.
+    uint64_t bytesCopied = result.bitstream.bytesCopied;
+    std::printf("bytes copied      %llu, %.0f per frame, %.2fx the bitstream, heap fallbacks %llu\n",
+        static_cast<unsigned long long>(bytesCopied), result.framesEncoded > 0 ? static_cast<double>(bytesCopied) / result.framesEncoded : 0.0,
+        result.bytesEncoded > 0 ? static_cast<double>(bytesCopied) / result.bytesEncoded : 0.0,
+        static_cast<unsigned long long>(result.bitstream.heapFallbacks));
+    if (config.baseline && result.framesEncoded > 0)
+    {
+        // Frames are encoded in place now, so the arena write is the only
+        // copy left.
+        double frames = static_cast<double>(result.framesEncoded);
+        double input = result.baselineInputCopied / frames;
+        double bitstream = result.baselineBitstreamCopied / frames;
+        std::printf("copies per frame  before %.0f bytes (input %.0f, bitstream %.0f), after %.0f bytes\n",
+            input + bitstream, input, bitstream, bytesCopied / frames);
+    }
+    if (config.adapt)
+    {
+        std::printf("adaptation        level %u, %ux%u at %u fps, usage %.2f, %llu down, %llu up, %llu frames dropped\n",
+            result.adaptation.level, result.adaptation.width, result.adaptation.height, result.adaptation.frameRate,
+            result.adaptation.usage, static_cast<unsigned long long>(result.adaptation.degradations),
+            static_cast<unsigned long long>(result.adaptation.restorations), static_cast<unsigned long long>(result.framesDropped));
+    }
+    if (!config.recordPath.empty())
+    {
+        std::printf("recorded          %llu frames, %llu bytes to %s, %llu dropped\n",
+            static_cast<unsigned long long>(result.recording.framesRecorded), static_cast<unsigned long long>(result.recording.bytesWritten),
+            config.recordPath.c_str(), static_cast<unsigned long long>(result.recording.framesDropped));
+    }
+    if (verify)
+    {
+        FragmentedMp4Verifier::Result check;
+        if (!FragmentedMp4Verifier::VerifyFile(config.recordPath, check))
+        {
+            std::printf("verify            FAILED: %s\n", check.error.c_str());
+            return 1;
+        }
+        std::printf("verify            ok, %u fragments, %llu samples, %llu key, %u index entries, %.2f s\n", check.fragments,
+            static_cast<unsigned long long>(check.samples), static_cast<unsigned long long>(check.keyFrames), check.indexEntries,
+            check.duration / 90000.0);
+    }
+    return 0;
+}
@@ -13,9 +13,8 @@ namespace uwp_webrtc
         };
         public List<VideoFormat> SupportedFormats => _supportedFormats;
         
-        private bool _forceKeyFrame;
-        
-        public void ForceKeyFrame() => _forceKeyFrame = true;
+        // Frames are encoded natively, so the request goes to the native encoder.
+        public void ForceKeyFrame() => WindowsUtils.RequestKeyFrame();
 
         public MediaFoundationVideoEncoder()
         {
@@ -0,0 +1,61 @@
+﻿using System;
+using System.Runtime.InteropServices;
+
+namespace uwp_webrtc
+{
+    /// <summary>
+    /// Keeps a native encoded frame alive without copying it. Dispose returns the buffer to the native pool.
+    /// </summary>
+    public sealed class NativeEncodedFrame : IDisposable
+    {
+        private IntPtr handle;
+
+        public IntPtr Data { get; }
+        public int Size { get; }
+        public long Timestamp { get; }
+        public bool IsKeyFrame { get; }
+
+        internal NativeEncodedFrame(IntPtr frame)
+        {
+            WindowsUtils.AcquireEncodedFrame(frame);
+            handle = frame;
+
+            if (WindowsUtils.GetEncodedFrameInfo(frame, out EncodedFrameInfo info))
+            {
+                Data = info.Data;
+                Size = (int)info.Size;
+                Timestamp = info.Timestamp;
+                IsKeyFrame = info.KeyFrame;
+            }
+        }
+
+        ~NativeEncodedFrame()
+        {
+            Release();
+        }
+
+        public unsafe byte* Pointer => (byte*)Data;
+
+        public void CopyTo(byte[] destination, int offset)
+        {
+            if (handle == IntPtr.Zero)
+                throw new ObjectDisposedException(nameof(NativeEncodedFrame));
+            
+            Marshal.Copy(Data, destination, offset, Size);
+        }
+
+        public void Dispose()
+        {
+            Release();
+            GC.SuppressFinalize(this);
+        }
+
+        private void Release()
+        {
+            IntPtr frame = handle;
+            handle = IntPtr.Zero;
+            if (frame != IntPtr.Zero)
+                WindowsUtils.ReleaseEncodedFrame(frame);
+        }
+    }
+}
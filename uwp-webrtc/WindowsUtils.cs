@@ -3,10 +3,142 @@ using System.Runtime.InteropServices;
 
 namespace uwp_webrtc
 {
+    internal enum CaptureDropPolicy
+    {
+        DropOldest = 0,
+        LatestOnly = 1
+    }
+
+    internal enum EncoderProfile
+    {
+        Baseline = 0,
+        Main = 1,
+        High = 2
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct EncoderConfig
+    {
+        public uint Width;
+        public uint Height;
+        public uint FrameRate;
+        public uint Bitrate;
+        public EncoderProfile Profile;
+        public uint Level;
+    }
+
+    internal enum DownscaleFilter
+    {
+        None = 0,
+        Bilinear = 1,
+        Box = 2
+    }
+
+    internal enum RecordingSync
+    {
+        None = 0,
+        OnStop = 1,
+        EveryWrite = 2
+    }
+
+    internal enum RecordingContainer
+    {
+        AnnexB = 0,
+        FragmentedMp4 = 1
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct RecordingConfig
+    {
+        public uint MemoryBudget;
+        public RecordingSync Sync;
+        public RecordingContainer Container;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct RecordingStats
+    {
+        public ulong FramesRecorded;
+        public ulong BytesWritten;
+        public ulong Writes;
+        public ulong FramesDropped;
+        public ulong WriteErrors;
+        [MarshalAs(UnmanagedType.U1)]
+        public bool Recording;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct QueueStats
+    {
+        public uint CaptureQueueDepth;
+        public uint DeliveryQueueDepth;
+        public ulong FramesCaptured;
+        public ulong CaptureDrops;
+        public ulong FramesEncoded;
+        public ulong DeliveryDrops;
+        public ulong FramesDelivered;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct LatencyPercentiles
+    {
+        public ulong Count;
+        public ulong P50;
+        public ulong P95;
+        public ulong P99;
+        public ulong Max;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct PipelineStats
+    {
+        public double CaptureFps;
+        public double EncodedFps;
+        public double EncodedBitrate;
+        public ulong FramesCaptured;
+        public ulong FramesEncoded;
+        public ulong KeyFrames;
+        public ulong BytesEncoded;
+        public ulong DropsNoConsumer;
+        public ulong DropsCaptureQueue;
+        public ulong DropsFormatChange;
+        public ulong DropsDeliveryQueue;
+        public ulong DropsPullQueue;
+        public ulong DropsConversion;
+        public ulong DropsAdaptation;
+        public ulong DropsStaticScene;
+        public uint CaptureQueueDepth;
+        public uint DeliveryQueueDepth;
+        public uint PullQueueDepth;
+        public LatencyPercentiles CaptureToEncoded;
+        public LatencyPercentiles EncodeLatency;
+        public uint AdaptationLevel;
+        public uint AdaptedWidth;
+        public uint AdaptedHeight;
+        public uint AdaptedFrameRate;
+        public double EncodeUsage;
+        public double ChangeRatio;
+        public ulong FramesUnchanged;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    internal struct EncodedFrameInfo
+    {
+        public IntPtr Data;
+        public uint Size;
+        public long Timestamp;
+        [MarshalAs(UnmanagedType.U1)]
+        public bool KeyFrame;
+        public uint Layer;
+        public IntPtr Rid;
+    }
+
     internal class WindowsUtils
     {
         public delegate void FrameEncodedCallback(uint rtpDuration, IntPtr data, int size);
         
+        public delegate void EncodedFrameHandleCallback(uint rtpDuration, IntPtr frame);
+        
         [DllImport("webrtc-utils.dll", EntryPoint = "Setup", ExactSpelling = true)]
         internal static extern bool Setup();
         
@@ -18,6 +150,80 @@ namespace uwp_webrtc
         
         [DllImport("webrtc-utils.dll", EntryPoint = "SetFrameEncodedCallback", ExactSpelling = true)]
         internal static extern bool SetFrameEncodedCallback(FrameEncodedCallback callback);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetEncodedFrameHandleCallback", ExactSpelling = true)]
+        internal static extern void SetEncodedFrameHandleCallback(EncodedFrameHandleCallback callback);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "AcquireEncodedFrame", ExactSpelling = true)]
+        internal static extern void AcquireEncodedFrame(IntPtr frame);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "ReleaseEncodedFrame", ExactSpelling = true)]
+        internal static extern void ReleaseEncodedFrame(IntPtr frame);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetEncodedFrameInfo", ExactSpelling = true)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool GetEncodedFrameInfo(IntPtr frame, out EncodedFrameInfo info);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetOutstandingEncodedFrames", ExactSpelling = true)]
+        internal static extern uint GetOutstandingEncodedFrames();
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetEncodedFramePullCapacity", ExactSpelling = true)]
+        internal static extern void SetEncodedFramePullCapacity(uint capacity);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetEncodedFrames", ExactSpelling = true)]
+        internal static extern uint GetEncodedFrames([Out] IntPtr[] frames, uint maxFrames, uint timeoutMs);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetCaptureQueuePolicy", ExactSpelling = true)]
+        internal static extern void SetCaptureQueuePolicy(uint capacity, CaptureDropPolicy policy);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetQueueStats", ExactSpelling = true)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool GetQueueStats(out QueueStats stats);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetPipelineStats", ExactSpelling = true)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool GetPipelineStats(out PipelineStats stats);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetEncoderConfig", ExactSpelling = true)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool SetEncoderConfig(ref EncoderConfig config);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "Reconfigure", ExactSpelling = true)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool Reconfigure(ref EncoderConfig config);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "RequestKeyFrame", ExactSpelling = true)]
+        internal static extern void RequestKeyFrame();
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetTraceJson", ExactSpelling = true)]
+        internal static extern uint GetTraceJson(byte[] buffer, uint capacity);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "StartRecording", ExactSpelling = true, CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool StartRecording(string fileName, ref RecordingConfig config);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "StopRecording", ExactSpelling = true)]
+        internal static extern void StopRecording();
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "GetRecordingStats", ExactSpelling = true)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool GetRecordingStats(out RecordingStats stats);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetReplayBuffer", ExactSpelling = true)]
+        internal static extern void SetReplayBuffer(uint seconds, uint memoryBudget);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "DumpReplay", ExactSpelling = true, CharSet = CharSet.Unicode)]
+        [return: MarshalAs(UnmanagedType.U1)]
+        internal static extern bool DumpReplay(string fileName, uint seconds);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetDownscaleFilter", ExactSpelling = true)]
+        internal static extern void SetDownscaleFilter(DownscaleFilter filter);
+        
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetCpuAdaptation", ExactSpelling = true)]
+        internal static extern void SetCpuAdaptation([MarshalAs(UnmanagedType.U1)] bool enabled);
+
+        [DllImport("webrtc-utils.dll", EntryPoint = "SetStaticFrameSkipping", ExactSpelling = true)]
+        internal static extern void SetStaticFrameSkipping([MarshalAs(UnmanagedType.U1)] bool enabled);
     }
     
 }
\ No newline at end of file
@@ -11,33 +11,44 @@ namespace uwp_webrtc
     {
         private bool isPaused;
         private bool isStarted = false;
+        private readonly WindowsUtils.EncodedFrameHandleCallback frameEncodedCallback;
 
         public event EncodedSampleDelegate OnVideoSourceEncodedSample;
         public event RawVideoSampleDelegate OnVideoSourceRawSample;
         public event RawVideoSampleFasterDelegate OnVideoSourceRawSampleFaster;
         public event SourceErrorDelegate OnVideoSourceError;
+        
+        /// <summary>
+        /// Raised with the native frame itself; the subscriber owns it and must dispose it.
+        /// </summary>
+        public event Action<uint, NativeEncodedFrame> OnNativeEncodedFrame;
 
         public WindowsVideoEndpoint()
         {
+            frameEncodedCallback = FrameEncoded;
             Task.Run(() =>
                 {
                     WindowsUtils.Setup();
-                    WindowsUtils.SetFrameEncodedCallback(FrameEncoded);
+                    WindowsUtils.SetEncodedFrameHandleCallback(frameEncodedCallback);
                     WindowsUtils.StartVideo();
                 }
             );
         }
 
-        private void FrameEncoded(uint rtpDuration, IntPtr data, int size)
+        private void FrameEncoded(uint rtpDuration, IntPtr frame)
         {
-            if (size == 0)
+            var nativeSubscribers = OnNativeEncodedFrame;
+            if (nativeSubscribers != null)
+                nativeSubscribers(rtpDuration, new NativeEncodedFrame(frame));
+
+            var sampleSubscribers = OnVideoSourceEncodedSample;
+            if (sampleSubscribers == null || !WindowsUtils.GetEncodedFrameInfo(frame, out EncodedFrameInfo info) || info.Size == 0)
                 return;
             
-            byte[] sample = new byte[size];
-            Marshal.Copy(data, sample, 0, size);
-            
-            if (OnVideoSourceEncodedSample != null)
-                OnVideoSourceEncodedSample(rtpDuration, sample);
+            // IVideoSource consumers need their own array, so this is the only copy left.
+            byte[] sample = new byte[info.Size];
+            Marshal.Copy(info.Data, sample, 0, (int)info.Size);
+            sampleSubscribers(rtpDuration, sample);
         }
 
         public async Task StartVideo()
@@ -98,7 +109,7 @@ namespace uwp_webrtc
 
         public void ForceKeyFrame()
         {
-            throw new NotImplementedException();
+            WindowsUtils.RequestKeyFrame();
         }
 
         public bool HasEncodedVideoSubscribers() => OnVideoSourceEncodedSample != null;
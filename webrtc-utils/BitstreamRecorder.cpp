@@ -0,0 +1,227 @@
+﻿#include "BitstreamRecorder.h"
+
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static FILE* OpenForWriting(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    FILE* file = nullptr;
+    return _wfopen_s(&file, path.c_str(), L"wb") == 0 ? file : nullptr;
+#else
+    return std::fopen(path.c_str(), "wb");
+#endif
+}
+
+static bool SyncToDisk(FILE* file)
+{
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+BitstreamRecorder::BitstreamRecorder() = default;
+
+BitstreamRecorder::~BitstreamRecorder()
+{
+    Stop();
+}
+
+bool BitstreamRecorder::Start(const std::filesystem::path& path, const Config& config)
+{
+    std::lock_guard control(m_controlMutex);
+    if (m_writer.joinable())
+        return false;
+
+    m_file = OpenForWriting(path);
+    if (m_file == nullptr)
+        return false;
+    // Every write is already a large batch; stdio buffering would only add
+    // a copy.
+    std::setvbuf(m_file, nullptr, _IONBF, 0);
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_config = config;
+        size_t capacity = m_config.memoryBudget / 2;
+        if (m_config.writeSize > capacity)
+            m_config.writeSize = capacity;
+        m_front.assign(Alignment + capacity, 0);
+        m_back.assign(Alignment + capacity, 0);
+        m_frontSize = 0;
+        m_backSize = 0;
+        m_carrySize = 0;
+        m_stopping = false;
+        m_waitingForKeyFrame = true;
+        m_resyncing = false;
+    }
+    m_muxer = m_config.container == Container::FragmentedMp4 ? std::make_unique<FragmentedMp4Muxer>() : nullptr;
+    m_writer = std::thread(&BitstreamRecorder::WriteLoop, this);
+    m_recording.store(true, std::memory_order_release);
+    return true;
+}
+
+void BitstreamRecorder::Stop()
+{
+    std::lock_guard control(m_controlMutex);
+    if (!m_writer.joinable())
+        return;
+
+    m_recording.store(false, std::memory_order_release);
+    {
+        std::lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_writer.join();
+
+    if (m_config.sync != SyncPolicy::None && !SyncToDisk(m_file))
+        m_writeErrors.fetch_add(1, std::memory_order_relaxed);
+    std::fclose(m_file);
+    m_file = nullptr;
+    m_front = std::vector<uint8_t>();
+    m_back = std::vector<uint8_t>();
+    m_staging = std::vector<uint8_t>();
+    m_muxer = nullptr;
+}
+
+void BitstreamRecorder::Record(const EncodedFrameRef& frame)
+{
+    if (!frame || !m_recording.load(std::memory_order_acquire))
+        return;
+
+    bool wake = false;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_stopping)
+            return;
+
+        if (m_waitingForKeyFrame)
+        {
+            if (!frame->IsKeyFrame())
+            {
+                if (m_resyncing)
+                    m_framesDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_waitingForKeyFrame = false;
+            m_resyncing = false;
+        }
+
+        size_t recordSize = frame->Size() + (m_config.container == Container::FragmentedMp4 ? sizeof(FrameRecord) : 0);
+        if (m_frontSize + recordSize > m_front.size() - Alignment)
+        {
+            m_framesDropped.fetch_add(1, std::memory_order_relaxed);
+            m_waitingForKeyFrame = true;
+            m_resyncing = true;
+            return;
+        }
+
+        uint8_t* destination = m_front.data() + Alignment + m_frontSize;
+        if (m_config.container == Container::FragmentedMp4)
+        {
+            FrameRecord record = { static_cast<uint32_t>(frame->Size()), frame->IsKeyFrame() ? 1u : 0u, frame->Timestamp() };
+            std::memcpy(destination, &record, sizeof(record));
+            destination += sizeof(record);
+        }
+        std::memcpy(destination, frame->Data(), frame->Size());
+        m_frontSize += recordSize;
+        wake = m_frontSize >= m_config.writeSize;
+    }
+    m_framesRecorded.fetch_add(1, std::memory_order_relaxed);
+    if (wake)
+        m_wake.notify_one();
+}
+
+void BitstreamRecorder::WriteLoop()
+{
+    std::unique_lock lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait_for(lock, std::chrono::seconds(1), [this]() { return m_stopping || m_frontSize >= m_config.writeSize; });
+        bool stopping = m_stopping;
+        if (m_frontSize > 0 || stopping)
+        {
+            std::swap(m_front, m_back);
+            m_backSize = std::exchange(m_frontSize, 0);
+            lock.unlock();
+            WriteBack(stopping);
+            lock.lock();
+        }
+        if (stopping)
+            return;
+    }
+}
+
+void BitstreamRecorder::WriteBack(bool final)
+{
+    if (m_muxer == nullptr)
+    {
+        // The carried remainder goes right in front of the new data so the
+        // two leave in one write.
+        uint8_t* start = m_back.data() + Alignment - m_carrySize;
+        std::memcpy(start, m_carry, m_carrySize);
+        WriteAligned(start, m_carrySize + m_backSize, final);
+        m_backSize = 0;
+        return;
+    }
+
+    m_staging.assign(m_carry, m_carry + m_carrySize);
+    const uint8_t* data = m_back.data() + Alignment;
+    for (size_t offset = 0; offset < m_backSize;)
+    {
+        FrameRecord record;
+        std::memcpy(&record, data + offset, sizeof(record));
+        offset += sizeof(record);
+        m_muxer->AddFrame(data + offset, record.size, record.timestamp, record.keyFrame != 0, m_staging);
+        offset += record.size;
+    }
+    if (final)
+        m_muxer->Finish(m_staging);
+    WriteAligned(m_staging.data(), m_staging.size(), final);
+    m_backSize = 0;
+}
+
+void BitstreamRecorder::WriteAligned(const uint8_t* start, size_t total, bool final)
+{
+    size_t size = final ? total : total & ~(Alignment - 1);
+
+    if (size > 0)
+    {
+        if (std::fwrite(start, 1, size, m_file) == size)
+        {
+            m_bytesWritten.fetch_add(size, std::memory_order_relaxed);
+            m_writes.fetch_add(1, std::memory_order_relaxed);
+            if (m_config.sync == SyncPolicy::EveryWrite && !SyncToDisk(m_file))
+                m_writeErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            m_writeErrors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    m_carrySize = total - size;
+    std::memcpy(m_carry, start + size, m_carrySize);
+}
+
+BitstreamRecorder::Stats BitstreamRecorder::GetStats() const
+{
+    Stats stats;
+    stats.recording = IsRecording();
+    stats.framesRecorded = m_framesRecorded.load(std::memory_order_relaxed);
+    stats.bytesWritten = m_bytesWritten.load(std::memory_order_relaxed);
+    stats.writes = m_writes.load(std::memory_order_relaxed);
+    stats.framesDropped = m_framesDropped.load(std::memory_order_relaxed);
+    stats.writeErrors = m_writeErrors.load(std::memory_order_relaxed);
+    return stats;
+}
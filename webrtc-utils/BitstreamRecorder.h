@@ -0,0 +1,130 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EncodedFrame.h"
+#include "FragmentedMp4Muxer.h"
+
+// Records encoded frames to an Annex B or fragmented MP4 file without
+// putting disk I/O on the encode thread. Record only copies the frame into the front buffer; a
+// background thread swaps buffers and writes the back one in large
+// page-aligned chunks. Memory is bounded by the budget: when the writer
+// falls behind, frames are dropped and recording resumes at the next key
+// frame so the file stays decodable.
+class BitstreamRecorder
+{
+public:
+    enum class SyncPolicy
+    {
+        // Leave flushing to the OS.
+        None,
+        // Flush to disk once, when recording stops.
+        OnStop,
+        // Flush to disk after every write.
+        EveryWrite,
+    };
+
+    enum class Container
+    {
+        // Raw H.264 elementary stream.
+        AnnexB,
+        // Timestamped and seekable; muxed on the writer thread.
+        FragmentedMp4,
+    };
+
+    struct Config
+    {
+        Container container = Container::AnnexB;
+        // Split evenly between the two buffers. MP4 recordings also hold
+        // the fragment being muxed.
+        size_t memoryBudget = 8 * 1024 * 1024;
+        // The writer wakes up once this much is buffered, or after a second.
+        size_t writeSize = 1024 * 1024;
+        SyncPolicy sync = SyncPolicy::OnStop;
+    };
+
+    struct Stats
+    {
+        bool recording;
+        uint64_t framesRecorded;
+        uint64_t bytesWritten;
+        uint64_t writes;
+        // Frames lost to a full buffer, including the ones skipped while
+        // waiting for the next key frame.
+        uint64_t framesDropped;
+        uint64_t writeErrors;
+    };
+
+    BitstreamRecorder();
+    BitstreamRecorder(const BitstreamRecorder&) = delete;
+    BitstreamRecorder& operator=(const BitstreamRecorder&) = delete;
+    ~BitstreamRecorder();
+
+    // Replaces the file if it exists. Fails when already recording. Start
+    // and Stop may be called from any thread.
+    bool Start(const std::filesystem::path& path, const Config& config);
+    // Writes out everything buffered and closes the file.
+    void Stop();
+    bool IsRecording() const { return m_recording.load(std::memory_order_acquire); }
+
+    // Encode thread. Never waits for the disk.
+    void Record(const EncodedFrameRef& frame);
+
+    Stats GetStats() const;
+
+private:
+    // Writes are whole multiples of this; the remainder is carried into the
+    // next write, and only the last write of a recording is partial.
+    static constexpr size_t Alignment = 4096;
+
+    // Precedes each frame in the buffers of an MP4 recording.
+    struct FrameRecord
+    {
+        uint32_t size;
+        uint32_t keyFrame;
+        int64_t timestamp;
+    };
+
+    void WriteLoop();
+    void WriteBack(bool final);
+    void WriteAligned(const uint8_t* start, size_t total, bool final);
+
+    // Serializes Start and Stop.
+    std::mutex m_controlMutex;
+    Config m_config;
+    FILE* m_file = nullptr;
+    std::atomic<bool> m_recording{ false };
+    std::thread m_writer;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+    // Both buffers keep Alignment bytes of headroom in front of the data,
+    // where the carried remainder of the previous write is placed.
+    std::vector<uint8_t> m_front;
+    size_t m_frontSize = 0;
+    bool m_waitingForKeyFrame = true;
+    bool m_resyncing = false;
+
+    // Writer thread.
+    std::vector<uint8_t> m_back;
+    size_t m_backSize = 0;
+    uint8_t m_carry[Alignment] = {};
+    size_t m_carrySize = 0;
+    std::unique_ptr<FragmentedMp4Muxer> m_muxer;
+    std::vector<uint8_t> m_staging;
+
+    std::atomic<uint64_t> m_framesRecorded{ 0 };
+    std::atomic<uint64_t> m_bytesWritten{ 0 };
+    std::atomic<uint64_t> m_writes{ 0 };
+    std::atomic<uint64_t> m_framesDropped{ 0 };
+    std::atomic<uint64_t> m_writeErrors{ 0 };
+};
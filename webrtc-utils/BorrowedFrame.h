@@ -0,0 +1,166 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "FrameView.h"
+
+// Frame whose memory is owned by someone else, e.g. a locked
+// SoftwareBitmap, described by a FrameView. The release hook runs exactly
+// once, when the frame is destroyed or Released, so the owner can unlock
+// its buffer only after the last consumer is done reading it.
+class BorrowedFrame
+{
+public:
+    // A move-only void() callable kept inside the frame, so that handing a
+    // frame out never touches the heap. A capture that does not fit is a
+    // compile error, not a silent allocation.
+    class ReleaseHook
+    {
+    public:
+        static constexpr size_t Capacity = 64;
+
+        ReleaseHook() = default;
+        ReleaseHook(std::nullptr_t) {}
+
+        template <typename Function, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Function>, ReleaseHook>>>
+        ReleaseHook(Function&& function)
+        {
+            using Stored = std::decay_t<Function>;
+            static_assert(sizeof(Stored) <= Capacity && alignof(Stored) <= alignof(std::max_align_t),
+                "the release hook's captures must fit inside the frame");
+            new (m_storage) Stored(std::forward<Function>(function));
+            m_operations = &OperationsFor<Stored>;
+        }
+
+        ReleaseHook(ReleaseHook&& other) noexcept
+        {
+            *this = std::move(other);
+        }
+
+        ReleaseHook& operator=(ReleaseHook&& other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                if (other.m_operations != nullptr)
+                {
+                    other.m_operations->move(other.m_storage, m_storage);
+                    m_operations = std::exchange(other.m_operations, nullptr);
+                }
+            }
+            return *this;
+        }
+
+        ReleaseHook(const ReleaseHook&) = delete;
+        ReleaseHook& operator=(const ReleaseHook&) = delete;
+
+        ~ReleaseHook()
+        {
+            Reset();
+        }
+
+        explicit operator bool() const { return m_operations != nullptr; }
+        void operator()() { m_operations->invoke(m_storage); }
+
+        void Reset()
+        {
+            if (m_operations != nullptr)
+                std::exchange(m_operations, nullptr)->destroy(m_storage);
+        }
+
+    private:
+        struct Operations
+        {
+            void (*invoke)(void* storage);
+            // Moves into uninitialized storage and destroys the source.
+            void (*move)(void* from, void* to);
+            void (*destroy)(void* storage);
+        };
+
+        template <typename Stored>
+        static constexpr Operations OperationsFor = {
+            [](void* storage) { (*static_cast<Stored*>(storage))(); },
+            [](void* from, void* to)
+            {
+                new (to) Stored(std::move(*static_cast<Stored*>(from)));
+                static_cast<Stored*>(from)->~Stored();
+            },
+            [](void* storage) { static_cast<Stored*>(storage)->~Stored(); },
+        };
+
+        alignas(std::max_align_t) unsigned char m_storage[Capacity];
+        const Operations* m_operations = nullptr;
+    };
+
+    BorrowedFrame() = default;
+
+    BorrowedFrame(const FrameView& view, ReleaseHook release)
+        : m_view(view), m_release(std::move(release))
+    {
+    }
+
+    BorrowedFrame(BorrowedFrame&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    BorrowedFrame& operator=(BorrowedFrame&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            m_view = std::exchange(other.m_view, FrameView());
+            m_arrivalTime = other.m_arrivalTime;
+            m_release = std::move(other.m_release);
+        }
+        return *this;
+    }
+
+    BorrowedFrame(const BorrowedFrame&) = delete;
+    BorrowedFrame& operator=(const BorrowedFrame&) = delete;
+
+    ~BorrowedFrame()
+    {
+        Release();
+    }
+
+    const FrameView& View() const { return m_view; }
+    uint32_t Width() const { return m_view.width; }
+    uint32_t Height() const { return m_view.height; }
+    int64_t Timestamp() const { return m_view.timestamp; }
+    void SetTimestamp(int64_t timestamp) { m_view.timestamp = timestamp; }
+    // When the frame reached us, for latency accounting.
+    std::chrono::steady_clock::time_point ArrivalTime() const { return m_arrivalTime; }
+    void SetArrivalTime(std::chrono::steady_clock::time_point arrivalTime) { m_arrivalTime = arrivalTime; }
+    explicit operator bool() const { return static_cast<bool>(m_view); }
+
+    // Narrows the frame to a region of itself; the pixels stay where they are.
+    bool Crop(const FrameRect& rect)
+    {
+        FrameView cropped;
+        if (!m_view.Crop(rect, cropped))
+            return false;
+        m_view = cropped;
+        return true;
+    }
+
+    void Release()
+    {
+        m_view = FrameView();
+        if (m_release)
+        {
+            ReleaseHook release = std::move(m_release);
+            release();
+        }
+    }
+
+private:
+    FrameView m_view;
+    std::chrono::steady_clock::time_point m_arrivalTime;
+    ReleaseHook m_release;
+};
@@ -0,0 +1,176 @@
+﻿#include "BufferPool.h"
+
+#include <algorithm>
+#include <new>
+
+static uint64_t PackHead(uint32_t tag, uint32_t block)
+{
+    return (static_cast<uint64_t>(tag) << 32) | block;
+}
+
+static size_t AlignUp(size_t size)
+{
+    return (size + BufferPool::Alignment - 1) & ~(BufferPool::Alignment - 1);
+}
+
+PooledBuffer::PooledBuffer(BufferPool* pool, uint32_t sizeClass, uint32_t block, uint8_t* data, size_t capacity)
+    : m_pool(pool), m_sizeClass(sizeClass), m_block(block), m_data(data), m_capacity(capacity)
+{
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        Reset();
+        m_pool = other.m_pool;
+        m_sizeClass = other.m_sizeClass;
+        m_block = other.m_block;
+        m_data = other.m_data;
+        m_capacity = other.m_capacity;
+        m_size = other.m_size;
+        other.m_pool = nullptr;
+        other.m_data = nullptr;
+        other.m_capacity = 0;
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+PooledBuffer::~PooledBuffer()
+{
+    Reset();
+}
+
+void PooledBuffer::Reset()
+{
+    if (m_pool != nullptr)
+        m_pool->Release(m_sizeClass, m_block);
+
+    m_pool = nullptr;
+    m_data = nullptr;
+    m_capacity = 0;
+    m_size = 0;
+}
+
+BufferPool::BufferPool(const std::vector<SizeClass>& sizeClasses)
+    : m_classes(sizeClasses.size())
+{
+    std::vector<SizeClass> sorted = sizeClasses;
+    std::sort(sorted.begin(), sorted.end(),
+        [](const SizeClass& a, const SizeClass& b) { return a.blockSize < b.blockSize; });
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        Class& sizeClass = m_classes[i];
+        sizeClass.blockSize = AlignUp(sorted[i].blockSize);
+        sizeClass.blockCount = sorted[i].blockCount;
+        if (sizeClass.blockCount == 0)
+        {
+            sizeClass.freeHead.store(PackHead(0, InvalidBlock));
+            continue;
+        }
+
+        sizeClass.memory = static_cast<uint8_t*>(::operator new(sizeClass.blockSize * sizeClass.blockCount, std::align_val_t(Alignment)));
+        sizeClass.next = new std::atomic<uint32_t>[sizeClass.blockCount];
+        for (uint32_t block = 0; block < sizeClass.blockCount; block++)
+            sizeClass.next[block].store(block + 1 < sizeClass.blockCount ? block + 1 : InvalidBlock);
+        sizeClass.freeHead.store(PackHead(0, 0));
+    }
+}
+
+BufferPool::~BufferPool()
+{
+    for (Class& sizeClass : m_classes)
+    {
+        if (sizeClass.memory != nullptr)
+            ::operator delete(sizeClass.memory, std::align_val_t(Alignment));
+        delete[] sizeClass.next;
+    }
+}
+
+bool BufferPool::Pop(Class& sizeClass, uint32_t& block)
+{
+    uint64_t head = sizeClass.freeHead.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint32_t top = static_cast<uint32_t>(head);
+        if (top == InvalidBlock)
+            return false;
+
+        uint32_t next = sizeClass.next[top].load(std::memory_order_relaxed);
+        uint64_t newHead = PackHead(static_cast<uint32_t>(head >> 32) + 1, next);
+        if (sizeClass.freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            block = top;
+            return true;
+        }
+    }
+}
+
+void BufferPool::Push(Class& sizeClass, uint32_t block)
+{
+    uint64_t head = sizeClass.freeHead.load(std::memory_order_relaxed);
+    while (true)
+    {
+        sizeClass.next[block].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        uint64_t newHead = PackHead(static_cast<uint32_t>(head >> 32), block);
+        if (sizeClass.freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed))
+            return;
+    }
+}
+
+PooledBuffer BufferPool::Acquire(size_t size)
+{
+    for (uint32_t i = 0; i < m_classes.size(); i++)
+    {
+        Class& sizeClass = m_classes[i];
+        if (sizeClass.blockSize < size)
+            continue;
+
+        uint32_t block;
+        if (!Pop(sizeClass, block))
+            continue;
+
+        uint32_t inUse = sizeClass.inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+        uint32_t highWater = sizeClass.highWater.load(std::memory_order_relaxed);
+        while (inUse > highWater && !sizeClass.highWater.compare_exchange_weak(highWater, inUse, std::memory_order_relaxed))
+        {
+        }
+
+        m_acquired.fetch_add(1, std::memory_order_relaxed);
+        PooledBuffer buffer(this, i, block, sizeClass.memory + static_cast<size_t>(block) * sizeClass.blockSize, sizeClass.blockSize);
+        buffer.SetSize(size);
+        return buffer;
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    return PooledBuffer();
+}
+
+void BufferPool::Release(uint32_t sizeClass, uint32_t block)
+{
+    Class& owner = m_classes[sizeClass];
+    owner.inUse.fetch_sub(1, std::memory_order_relaxed);
+    Push(owner, block);
+}
+
+BufferPool::Stats BufferPool::GetStats() const
+{
+    Stats stats;
+    stats.acquired = m_acquired.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    stats.reservedBytes = 0;
+    for (const Class& sizeClass : m_classes)
+    {
+        stats.reservedBytes += sizeClass.blockSize * sizeClass.blockCount;
+        stats.classes.push_back({ sizeClass.blockSize, sizeClass.blockCount,
+            sizeClass.inUse.load(std::memory_order_relaxed), sizeClass.highWater.load(std::memory_order_relaxed) });
+    }
+    return stats;
+}
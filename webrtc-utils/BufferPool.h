@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class BufferPool;
+
+// Move-only handle to a block owned by a BufferPool. The block goes back to
+// its pool when the handle is destroyed or Reset.
+class PooledBuffer
+{
+public:
+    PooledBuffer() = default;
+    PooledBuffer(PooledBuffer&& other) noexcept;
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept;
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer();
+
+    uint8_t* Data() const { return m_data; }
+    size_t Capacity() const { return m_capacity; }
+    size_t Size() const { return m_size; }
+    void SetSize(size_t size) { m_size = size <= m_capacity ? size : m_capacity; }
+    explicit operator bool() const { return m_data != nullptr; }
+
+    void Reset();
+
+private:
+    friend class BufferPool;
+    PooledBuffer(BufferPool* pool, uint32_t sizeClass, uint32_t block, uint8_t* data, size_t capacity);
+
+    BufferPool* m_pool = nullptr;
+    uint32_t m_sizeClass = 0;
+    uint32_t m_block = 0;
+    uint8_t* m_data = nullptr;
+    size_t m_capacity = 0;
+    size_t m_size = 0;
+};
+
+// Fixed-capacity pool of 64-byte aligned blocks grouped in size classes.
+// All memory is reserved up front; Acquire and release never touch the heap
+// and are lock-free, so capture and encode threads can share one pool.
+class BufferPool
+{
+public:
+    static constexpr size_t Alignment = 64;
+
+    struct SizeClass
+    {
+        size_t blockSize;
+        uint32_t blockCount;
+    };
+
+    struct SizeClassStats
+    {
+        size_t blockSize;
+        uint32_t blockCount;
+        uint32_t inUse;
+        uint32_t highWater;
+    };
+
+    struct Stats
+    {
+        uint64_t acquired;
+        uint64_t misses;
+        size_t reservedBytes;
+        std::vector<SizeClassStats> classes;
+    };
+
+    explicit BufferPool(const std::vector<SizeClass>& sizeClasses);
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+    ~BufferPool();
+
+    // Returns an empty handle when no class fits or the fitting classes are
+    // exhausted; callers fall back to their own allocation and the miss is
+    // counted in the stats.
+    PooledBuffer Acquire(size_t size);
+
+    Stats GetStats() const;
+
+private:
+    friend class PooledBuffer;
+
+    static constexpr uint32_t InvalidBlock = UINT32_MAX;
+
+    struct Class
+    {
+        size_t blockSize = 0;
+        uint32_t blockCount = 0;
+        uint8_t* memory = nullptr;
+        // Treiber stack of free block indices; the upper 32 bits of the head
+        // carry a tag that is bumped on every pop to defeat ABA.
+        std::atomic<uint64_t> freeHead{ 0 };
+        std::atomic<uint32_t>* next = nullptr;
+        std::atomic<uint32_t> inUse{ 0 };
+        std::atomic<uint32_t> highWater{ 0 };
+    };
+
+    bool Pop(Class& sizeClass, uint32_t& block);
+    void Push(Class& sizeClass, uint32_t block);
+    void Release(uint32_t sizeClass, uint32_t block);
+
+    std::vector<Class> m_classes;
+    std::atomic<uint64_t> m_acquired{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+};
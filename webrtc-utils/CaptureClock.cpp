@@ -0,0 +1,103 @@
+﻿#include "CaptureClock.h"
+
+#include <algorithm>
+#include <cmath>
+
+CaptureClock::CaptureClock()
+    : CaptureClock(Config())
+{
+}
+
+CaptureClock::CaptureClock(const Config& config, uint32_t rtpOffset)
+    : m_config(config), m_rtpOffset(rtpOffset)
+{
+    Reset();
+}
+
+void CaptureClock::Reset()
+{
+    m_started = false;
+    m_base = 0;
+    m_lastMediaTime = 0;
+    m_lastRaw = 0.0;
+    m_smoothed = 0.0;
+    m_interval = TicksPerSecond / (m_config.nominalFrameRate > 0 ? m_config.nominalFrameRate : 30.0);
+    m_drift = 0.0;
+    m_jitter = 0.0;
+}
+
+CaptureClock::Timing CaptureClock::OnFrame(int64_t captureTime, int64_t arrivalTime)
+{
+    if (!m_started || captureTime < m_firstCapture)
+    {
+        // The capture clock jumped back; continue one interval after the
+        // last frame so media time and RTP timestamps stay monotonic.
+        int64_t base = 0;
+        if (m_started)
+        {
+            base = m_lastMediaTime + static_cast<int64_t>(m_interval);
+            m_resyncs++;
+        }
+        Reset();
+        m_started = true;
+        m_firstCapture = captureTime;
+        m_firstArrival = arrivalTime;
+        m_base = base;
+        m_lastMediaTime = base;
+        return { base, static_cast<int64_t>(m_interval), ToRtpTimestamp(base) };
+    }
+
+    // Over a long enough span, arrival jitter averages out and the ratio of
+    // elapsed system time to elapsed capture time is the camera's drift.
+    int64_t captureElapsed = captureTime - m_firstCapture;
+    int64_t arrivalElapsed = arrivalTime - m_firstArrival;
+    if (captureElapsed >= m_config.driftWarmup && arrivalElapsed > 0)
+    {
+        double maxDrift = m_config.maxDriftPpm * 1e-6;
+        double drift = static_cast<double>(arrivalElapsed) / static_cast<double>(captureElapsed) - 1.0;
+        m_drift = std::clamp(drift, -maxDrift, maxDrift);
+    }
+
+    double raw = static_cast<double>(captureElapsed) * (1.0 + m_drift);
+    double gap = raw - m_lastRaw;
+    m_lastRaw = raw;
+
+    // A gap of several intervals means the camera dropped frames; step the
+    // prediction over them instead of treating the gap as jitter.
+    double frames = std::max(1.0, std::round(gap / m_interval));
+    double predicted = m_smoothed + frames * m_interval;
+    double error = raw - predicted;
+    if (std::abs(error) > 2.0 * m_interval)
+    {
+        // Too far off to be jitter, e.g. a stall; start over from raw time.
+        m_smoothed = raw;
+        m_resyncs++;
+    }
+    else
+    {
+        m_smoothed = predicted + m_config.phaseGain * error;
+        if (frames == 1.0)
+            m_interval += m_config.intervalGain * (gap - m_interval);
+    }
+    m_jitter += (std::abs(raw - m_smoothed) - m_jitter) / 16.0;
+
+    // Keep the timeline strictly increasing in RTP units as well.
+    int64_t minStep = TicksPerSecond / RtpClockRate + 1;
+    int64_t mediaTime = std::max(m_base + static_cast<int64_t>(std::llround(m_smoothed)), m_lastMediaTime + minStep);
+    m_smoothed = static_cast<double>(mediaTime - m_base);
+    m_lastMediaTime = mediaTime;
+
+    return { mediaTime, static_cast<int64_t>(m_interval), ToRtpTimestamp(mediaTime) };
+}
+
+uint32_t CaptureClock::ToRtpTimestamp(int64_t mediaTime) const
+{
+    // Wraps modulo 2^32 as RTP timestamps do. 90 kHz is 9/1000 of the tick
+    // rate, which keeps the product far from overflowing.
+    return m_rtpOffset + static_cast<uint32_t>(mediaTime * 9 / 1000);
+}
+
+uint32_t CaptureClock::ToRtpDuration(int64_t duration)
+{
+    return static_cast<uint32_t>(duration * 9 / 1000);
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include <cstdint>
+
+// Maps camera frame times onto the media timeline used for encoder sample
+// times and RTP timestamps. Capture times jitter with USB and driver
+// scheduling and the camera clock drifts against the system clock that
+// paces RTCP, so the raw values are not used directly: the clock tracks
+// the real frame interval, smooths each frame onto it, corrects for the
+// measured drift and never goes backwards. All times are in 100 ns ticks,
+// the unit Media Foundation uses for sample times.
+class CaptureClock
+{
+public:
+    static constexpr int64_t TicksPerSecond = 10000000;
+    static constexpr uint32_t RtpClockRate = 90000;
+
+    struct Config
+    {
+        double nominalFrameRate = 30.0;
+        // Share of each frame's timing error taken into the smoothed time.
+        double phaseGain = 0.05;
+        // Share of each measured interval taken into the interval estimate.
+        double intervalGain = 0.005;
+        // Drift is only estimated once this much capture time has passed.
+        int64_t driftWarmup = 2 * TicksPerSecond;
+        double maxDriftPpm = 1000.0;
+    };
+
+    struct Timing
+    {
+        // Drift-corrected media time of the frame; the first frame is zero.
+        int64_t mediaTime;
+        // Expected time until the next frame.
+        int64_t duration;
+        uint32_t rtpTimestamp;
+    };
+
+    CaptureClock();
+    explicit CaptureClock(const Config& config, uint32_t rtpOffset = 0);
+
+    // captureTime is the frame's own timestamp, arrivalTime the system
+    // clock when it was received; both only need to be monotonic.
+    Timing OnFrame(int64_t captureTime, int64_t arrivalTime);
+
+    void Reset();
+
+    uint32_t ToRtpTimestamp(int64_t mediaTime) const;
+    static uint32_t ToRtpDuration(int64_t duration);
+
+    double FrameInterval() const { return m_interval; }
+    double DriftPpm() const { return m_drift * 1e6; }
+    // Mean absolute difference between raw and smoothed frame times.
+    double Jitter() const { return m_jitter; }
+    uint64_t Resyncs() const { return m_resyncs; }
+
+private:
+    Config m_config;
+    uint32_t m_rtpOffset;
+    bool m_started = false;
+    int64_t m_firstCapture = 0;
+    int64_t m_firstArrival = 0;
+    // Media time where the current run started; nonzero after a resync so
+    // the timeline carries on instead of restarting at zero.
+    int64_t m_base = 0;
+    int64_t m_lastMediaTime = 0;
+    double m_lastRaw = 0.0;
+    double m_smoothed = 0.0;
+    double m_interval = 0.0;
+    double m_drift = 0.0;
+    double m_jitter = 0.0;
+    uint64_t m_resyncs = 0;
+};
@@ -0,0 +1,566 @@
+﻿#include "pch.h"
+#include "CaptureSession.h"
+#include "MediaCaptureSource.h"
+#include "MediaFoundationEncoder.h"
+#include "OpenH264Encoder.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+using namespace winrt;
+
+static uint64_t PackSize(uint32_t width, uint32_t height)
+{
+    return static_cast<uint64_t>(width) << 32 | height;
+}
+
+static CaptureClock::Config ClockConfig(const VideoEncoderSettings& settings)
+{
+    CaptureClock::Config config;
+    config.nominalFrameRate = settings.frameRate;
+    return config;
+}
+
+// Relative names are placed in the app's local folder.
+static bool ResolveLocalPath(const std::wstring& fileName, std::filesystem::path& path)
+{
+    path = fileName;
+    try
+    {
+        if (path.is_relative())
+            path = std::filesystem::path(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path().c_str()) / path;
+    }
+    catch (hresult_error const& e)
+    {
+        OutputDebugString(e.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+static std::unique_ptr<IVideoEncoderBackend> CreateEncoderBackend(const CaptureSession::Config& config)
+{
+    switch (config.encoderBackend)
+    {
+    case VideoEncoderBackendType::MediaFoundation:
+    {
+        // Each layer has a delivery queue of its own, but they share the
+        // pull ring, which one layer's frames can fill on their own.
+        MediaFoundationEncoder::Config encoder;
+        encoder.heldFrames = config.pipeline.deliveryQueueCapacity + config.pullCapacity + 1;
+        return std::make_unique<MediaFoundationEncoder>(encoder);
+    }
+#ifdef WEBRTCUTILS_OPENH264
+    case VideoEncoderBackendType::OpenH264:
+        return std::make_unique<OpenH264Encoder>();
+#endif
+    default:
+        OutputDebugString(L"Encoder backend not available in this build\n");
+        return nullptr;
+    }
+}
+
+CaptureSession::CaptureSession(Config config)
+    : m_config(std::move(config)), m_keyFrames(m_config.minKeyFrameInterval), m_clock(ClockConfig(m_config.encoder))
+{
+}
+
+CaptureSession::~CaptureSession()
+{
+    Shutdown();
+    // Nothing else holds the session any more. The pipelines go before the
+    // encoder their threads used, and the source, closing the camera unless
+    // the app owns it, last.
+    m_simulcast = nullptr;
+    m_pipeline = nullptr;
+    m_source = nullptr;
+}
+
+bool CaptureSession::Initialize()
+{
+    m_encoder = CreateEncoderBackend(m_config);
+    if (m_encoder == nullptr || !SetupSource() || !m_encoder->Configure(m_config.encoder))
+        return false;
+    m_encoderSettings = m_config.encoder;
+    m_outputSize = PackSize(m_config.encoder.width, m_config.encoder.height);
+    if (!m_config.recordFileName.empty() && !StartRecording(m_config.recordFileName, m_config.recording))
+        OutputDebugString(L"Could not open the recording file\n");
+
+    if (m_config.replaySeconds > 0)
+    {
+        ReplayBuffer::Config replay;
+        replay.window = static_cast<int64_t>(m_config.replaySeconds) * CaptureClock::TicksPerSecond;
+        replay.memoryBudget = m_config.replayMemoryBudget;
+        m_replay = std::make_unique<ReplayBuffer>(replay);
+    }
+
+    if (m_config.pullCapacity > 0)
+    {
+        m_pullRing = std::make_unique<EncodedFrameRing>(m_config.pullCapacity);
+        m_hasConsumer = true;
+    }
+
+    m_pipeline = std::make_unique<EncodePipeline>(m_config.pipeline,
+        [this](BorrowedFrame frame) { return Encode(std::move(frame)); },
+        [this](const EncodedFrameRef& frame) { Deliver(frame); });
+
+    if (!m_config.simulcast.empty())
+    {
+        SimulcastEncoder::Config simulcast;
+        simulcast.layers = m_config.simulcast;
+        for (SimulcastEncoder::Layer& layer : simulcast.layers)
+        {
+            layer.encoder.frameRate = m_config.encoder.frameRate;
+            layer.encoder.profile = m_config.encoder.profile;
+            layer.encoder.level = m_config.encoder.level;
+        }
+        simulcast.pipeline = m_config.pipeline;
+        simulcast.scaling = m_config.scaling;
+        simulcast.minKeyFrameInterval = m_config.minKeyFrameInterval;
+        m_simulcast = std::make_unique<SimulcastEncoder>(std::move(simulcast),
+            [this]() { return CreateEncoderBackend(m_config); },
+            [this](const EncodedFrameRef& frame) { Deliver(frame); });
+        if (!m_simulcast->Initialize())
+        {
+            OutputDebugString(L"Invalid simulcast layers\n");
+            return false;
+        }
+    }
+    m_delivery.resize(LayerCount());
+
+    if (m_config.adaptToCpu)
+    {
+        m_adaptation = std::make_unique<CpuAdaptation>(m_config.adaptation);
+        m_adaptation->Reset(m_config.encoder);
+    }
+
+    if (m_config.skipStaticFrames)
+        m_staticScene = std::make_unique<StaticSceneDetector>(m_config.staticScene);
+    return true;
+}
+
+bool CaptureSession::Start()
+{
+    if (m_shutdown || m_source == nullptr || m_pipeline == nullptr)
+        return false;
+
+    m_pipeline->Start();
+    if (m_simulcast != nullptr)
+        m_simulcast->Start();
+    m_capturing = m_source->Start([this](BorrowedFrame frame) { OnFrame(std::move(frame)); });
+    return m_capturing;
+}
+
+void CaptureSession::Shutdown()
+{
+    // Only stops. Calls racing DestroySession on other threads may still
+    // hold the session and read the source, the pipelines and the layers;
+    // they are freed by the destructor, after the last of those calls.
+    if (m_shutdown.exchange(true))
+        return;
+    if (m_source != nullptr)
+        m_source->Stop();
+    m_capturing = false;
+
+    if (m_pipeline != nullptr)
+        m_pipeline->Stop();
+    if (m_simulcast != nullptr)
+        m_simulcast->Stop();
+    if (m_pullRing != nullptr)
+        m_pullRing->Interrupt();
+    if (m_encoder != nullptr)
+        m_encoder->Shutdown();
+    m_recorder.Stop();
+}
+
+void CaptureSession::SetFrameCallback(FrameCallback callback, void* context)
+{
+    std::lock_guard lock(m_callbackMutex);
+    m_frameCallback = callback;
+    m_frameCallbackContext = context;
+    m_hasConsumer = callback != nullptr || m_pullRing != nullptr;
+}
+
+uint32_t CaptureSession::PullFrames(EncodedFrameRef* frames, uint32_t maxFrames, std::chrono::milliseconds timeout)
+{
+    if (m_pullRing == nullptr)
+        return 0;
+    return m_pullRing->PopBatch(frames, maxFrames, timeout);
+}
+
+bool CaptureSession::Reconfigure(const VideoEncoderSettings& settings)
+{
+    if (m_shutdown || m_encoder == nullptr || settings.width == 0 || settings.height == 0 || settings.frameRate == 0 || settings.bitrate == 0)
+        return false;
+
+    VideoEncoderSettings current;
+    {
+        std::lock_guard lock(m_settingsMutex);
+        current = m_settingsPending ? m_pendingSettings : m_encoderSettings;
+    }
+
+    uint64_t captureSize = m_captureSize.load();
+    bool scale = m_config.scaleOnReconfigure && settings.width <= captureSize >> 32 && settings.height <= (captureSize & UINT32_MAX);
+    if (!scale && (settings.width != current.width || settings.height != current.height))
+    {
+        if (!SelectFormat(settings))
+            return false;
+    }
+
+    std::lock_guard lock(m_settingsMutex);
+    m_pendingSettings = settings;
+    m_settingsPending = true;
+    m_outputSize = PackSize(settings.width, settings.height);
+    return true;
+}
+
+EncodedFrameRef CaptureSession::Encode(BorrowedFrame frame)
+{
+    // Runs on the encode thread, the only one allowed to touch the encoder.
+    if (m_settingsPending.exchange(false))
+    {
+        VideoEncoderSettings settings;
+        {
+            std::lock_guard lock(m_settingsMutex);
+            settings = m_pendingSettings;
+        }
+        if (m_encoder->Reconfigure(settings))
+        {
+            std::lock_guard lock(m_settingsMutex);
+            m_encoderSettings = settings;
+            // New settings from the app start adaptation over.
+            if (m_adaptation != nullptr)
+                m_adaptation->Reset(settings);
+        }
+        else
+        {
+            OutputDebugString(L"Encoder rejected the new settings\n");
+        }
+        // An Adapt that raced with Reconfigure, or a rejected change, may
+        // have left another size there; scale to the settings in effect.
+        m_outputSize = PackSize(m_encoderSettings.width, m_encoderSettings.height);
+    }
+
+    if (frame.Width() != m_encoderSettings.width || frame.Height() != m_encoderSettings.height)
+    {
+        m_metrics.OnDropped(PipelineMetrics::DropReason::FormatChange);
+        return EncodedFrameRef();
+    }
+
+    if (m_keyFrames.ShouldForce(KeyFrameRequester::Clock::now()))
+        m_encoder->RequestKeyFrame();
+
+    m_metrics.OnEncodeInput(frame.Timestamp(), frame.ArrivalTime());
+    std::chrono::steady_clock::time_point encodeStart = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration queueDelay = encodeStart - frame.ArrivalTime();
+    EncodedFrameRef encoded = m_encoder->Encode(std::move(frame));
+    if (m_adaptation != nullptr)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        VideoEncoderSettings adapted;
+        if (m_adaptation->OnFrameEncoded({ now, now - encodeStart, queueDelay, m_adaptation->FrameInterval() }, adapted))
+            Adapt(adapted);
+    }
+    if (encoded)
+    {
+        encoded->SetLayer(0, m_config.rid.c_str());
+        m_metrics.OnEncoded(encoded->Timestamp(), encoded->Size(), encoded->IsKeyFrame());
+        if (encoded->IsKeyFrame())
+            m_keyFrames.OnKeyFrame(KeyFrameRequester::Clock::now());
+        m_recorder.Record(encoded);
+        if (m_replay != nullptr)
+            m_replay->Insert(encoded);
+    }
+    return encoded;
+}
+
+void CaptureSession::Adapt(const VideoEncoderSettings& settings)
+{
+    // Encode thread. A smaller size is reached by scaling captured frames;
+    // the camera keeps its format so restoring is just as cheap. Settings
+    // from the app that are still to be applied win, and start adaptation
+    // over once they are.
+    if (m_settingsPending)
+        return;
+    if (!m_encoder->Reconfigure(settings))
+    {
+        OutputDebugString(L"Encoder rejected the adapted settings\n");
+        return;
+    }
+    {
+        std::lock_guard lock(m_settingsMutex);
+        m_encoderSettings = settings;
+    }
+    m_outputSize = PackSize(settings.width, settings.height);
+}
+
+void CaptureSession::RequestKeyFrame()
+{
+    m_keyFrames.Request();
+    if (m_staticScene != nullptr)
+        m_staticScene->PassNextFrame();
+    if (m_simulcast != nullptr)
+        m_simulcast->RequestKeyFrame();
+}
+
+bool CaptureSession::RequestKeyFrame(uint32_t layer)
+{
+    // A static scene would hold the key frame back until the keep-alive.
+    if (m_staticScene != nullptr)
+        m_staticScene->PassNextFrame();
+    if (layer == 0)
+    {
+        m_keyFrames.Request();
+        return true;
+    }
+    return m_simulcast != nullptr && m_simulcast->RequestKeyFrame(layer);
+}
+
+bool CaptureSession::StartRecording(const std::wstring& fileName, const BitstreamRecorder::Config& config)
+{
+    std::filesystem::path path;
+    if (!ResolveLocalPath(fileName, path) || !m_recorder.Start(path, config))
+        return false;
+    // The recording begins at a key frame; don't wait a whole GOP for it.
+    m_keyFrames.Request();
+    if (m_staticScene != nullptr)
+        m_staticScene->PassNextFrame();
+    OutputDebugString((L"Recording to " + path.wstring() + L"\n").c_str());
+    return true;
+}
+
+bool CaptureSession::DumpReplay(const std::wstring& fileName, uint32_t seconds)
+{
+    std::filesystem::path path;
+    if (m_replay == nullptr || !ResolveLocalPath(fileName, path))
+        return false;
+    return m_replay->Dump(path, static_cast<int64_t>(seconds) * CaptureClock::TicksPerSecond);
+}
+
+void CaptureSession::StopRecording()
+{
+    m_recorder.Stop();
+}
+
+EncodePipeline::Stats CaptureSession::GetQueueStats() const
+{
+    if (m_pipeline == nullptr)
+        return EncodePipeline::Stats();
+    return m_pipeline->GetStats();
+}
+
+CaptureSession::PipelineStats CaptureSession::GetPipelineStats()
+{
+    PipelineStats stats = {};
+    stats.metrics = m_metrics.TakeSnapshot();
+    stats.queues = GetQueueStats();
+    stats.adaptation = m_adaptation != nullptr ? m_adaptation->GetStats() : CpuAdaptation::Stats();
+    stats.staticScene = m_staticScene != nullptr ? m_staticScene->GetStats() : StaticSceneDetector::Stats();
+    stats.metrics.drops[static_cast<size_t>(PipelineMetrics::DropReason::CaptureQueue)] = stats.queues.captureDrops;
+    stats.metrics.drops[static_cast<size_t>(PipelineMetrics::DropReason::DeliveryQueue)] = stats.queues.deliveryDrops;
+    if (m_pullRing != nullptr)
+    {
+        stats.pullQueueDepth = m_pullRing->Depth();
+        stats.metrics.drops[static_cast<size_t>(PipelineMetrics::DropReason::PullQueue)] = m_pullRing->Dropped();
+    }
+    return stats;
+}
+
+uint32_t CaptureSession::LayerCount() const
+{
+    return 1 + (m_simulcast != nullptr ? m_simulcast->LayerCount() : 0);
+}
+
+bool CaptureSession::GetLayerStats(uint32_t layer, SimulcastEncoder::LayerStats& stats) const
+{
+    return m_simulcast != nullptr && m_simulcast->GetLayerStats(layer, stats);
+}
+
+void CaptureSession::Deliver(const EncodedFrameRef& frame)
+{
+    TRACE_SCOPE("deliver");
+    // The duration handed out is the RTP distance from the previous
+    // delivered frame of the same layer, so frames dropped on the way are
+    // accounted for and the sum of durations always matches the capture
+    // timeline.
+    DeliveryState& state = m_delivery[frame->Layer()];
+    uint32_t rtpTimestamp = m_clock.ToRtpTimestamp(frame->Timestamp());
+    uint32_t rtpDuration = state.hasDelivered ? rtpTimestamp - state.lastRtpTimestamp
+        : CaptureClock::ToRtpDuration(CaptureClock::TicksPerSecond / m_config.encoder.frameRate);
+    state.lastRtpTimestamp = rtpTimestamp;
+    state.hasDelivered = true;
+
+    {
+        std::lock_guard lock(m_callbackMutex);
+        if (m_frameCallback != nullptr)
+            m_frameCallback(m_frameCallbackContext, static_cast<int>(rtpDuration), frame.Get());
+    }
+
+    // EncodedFrameRing is single-producer, and every simulcast layer's
+    // encode thread delivers here, so pushes are serialized. With one layer
+    // the lock is never contended.
+    if (m_pullRing != nullptr)
+    {
+        std::lock_guard lock(m_pushMutex);
+        m_pullRing->Push(frame);
+    }
+}
+
+void CaptureSession::OnFrame(BorrowedFrame frame)
+{
+    TRACE_SCOPE("capture");
+    m_metrics.OnCaptured();
+    if (!frame)
+    {
+        // The source could not read a frame that arrived.
+        m_metrics.OnDropped(PipelineMetrics::DropReason::Conversion);
+        return;
+    }
+
+    std::chrono::steady_clock::time_point arrival = frame.ArrivalTime();
+    int64_t arrivalTime = std::chrono::duration_cast<Windows::Foundation::TimeSpan>(arrival.time_since_epoch()).count();
+    CaptureClock::Timing timing = m_clock.OnFrame(frame.Timestamp(), arrivalTime);
+    frame.SetTimestamp(timing.mediaTime);
+
+    // Frames over the adapted frame rate are let go before any pixel is
+    // touched; the clock still sees them to keep tracking the camera.
+    if (m_adaptation != nullptr && !m_adaptation->AcceptFrame(timing.mediaTime))
+    {
+        m_metrics.OnDropped(PipelineMetrics::DropReason::Adaptation);
+        return;
+    }
+
+    if (frame.View().format != FrameFormat::Nv12)
+        frame = ConvertToNv12(frame.View());
+
+    // A rectangle outside the frame leaves it whole; Encode drops it if
+    // that does not match the encoder.
+    if (frame && m_config.crop.width > 0 && m_config.crop.height > 0)
+        frame.Crop(m_config.crop);
+
+    if (frame)
+        m_captureSize = PackSize(frame.Width(), frame.Height());
+
+    // Unchanged frames are let go before scaling and encoding, apart from
+    // the keep-alive ones.
+    if (frame && m_staticScene != nullptr)
+    {
+        TRACE_SCOPE("static scene");
+        if (!m_staticScene->Check(frame.View()).pass)
+        {
+            m_metrics.OnDropped(PipelineMetrics::DropReason::StaticScene);
+            return;
+        }
+    }
+
+    uint64_t outputSize = m_outputSize.load();
+    bool scale = m_config.scaleOnReconfigure || m_adaptation != nullptr;
+    if (frame && scale && outputSize != PackSize(frame.Width(), frame.Height()))
+        frame = ScaleFrame(std::move(frame), static_cast<uint32_t>(outputSize >> 32), static_cast<uint32_t>(outputSize));
+
+    if (!frame)
+    {
+        m_metrics.OnDropped(PipelineMetrics::DropReason::Conversion);
+        return;
+    }
+    frame.SetArrivalTime(arrival);
+
+    if (m_hasConsumer && m_pipeline != nullptr)
+    {
+        // The lower layers scale from the main frame, so they go first.
+        if (m_simulcast != nullptr)
+            m_simulcast->PostFrame(frame.View(), arrival);
+        m_pipeline->PostFrame(std::move(frame));
+    }
+    else
+        m_metrics.OnDropped(PipelineMetrics::DropReason::NoConsumer);
+}
+
+BorrowedFrame CaptureSession::ConvertToNv12(const FrameView& view)
+{
+    TRACE_SCOPE("convert pixels");
+    size_t frameSize = FrameView::PackedSize(FrameFormat::Nv12, view.width, view.height);
+    PooledBuffer block = AcquireFrameBuffer(m_conversionPool, m_conversionFrameSize, frameSize, m_config.pipeline.captureQueueCapacity + 8);
+    if (!block)
+        return BorrowedFrame();
+
+    FrameView nv12 = FrameView::Packed(FrameFormat::Nv12, block.Data(), view.width, view.height);
+    nv12.timestamp = view.timestamp;
+    nv12.color = m_config.conversionColorSpace;
+    if (!ConvertFrame(view, nv12))
+        return BorrowedFrame();
+    return WrapFrameBuffer(std::move(block), m_conversionPool, nv12);
+}
+
+BorrowedFrame CaptureSession::ScaleFrame(BorrowedFrame frame, uint32_t width, uint32_t height)
+{
+    TRACE_SCOPE("scale");
+    // Only downscales; anything else goes on unchanged and is dropped by
+    // Encode as a leftover of the previous size.
+    if (width > frame.Width() || height > frame.Height()
+        || !m_scaler.Configure(frame.Width(), frame.Height(), width, height, m_config.scaling))
+        return frame;
+
+    size_t frameSize = FrameView::PackedSize(FrameFormat::Nv12, width, height);
+    PooledBuffer block = AcquireFrameBuffer(m_scalePool, m_scaleFrameSize, frameSize, m_config.pipeline.captureQueueCapacity + 8);
+    if (!block)
+        return BorrowedFrame();
+
+    FrameView scaled = FrameView::Packed(FrameFormat::Nv12, block.Data(), width, height);
+    scaled.timestamp = frame.Timestamp();
+    scaled.color = frame.View().color;
+    if (!m_scaler.Scale(frame.View(), scaled))
+        return BorrowedFrame();
+    return WrapFrameBuffer(std::move(block), m_scalePool, scaled);
+}
+
+PooledBuffer CaptureSession::AcquireFrameBuffer(std::shared_ptr<BufferPool>& pool, size_t& poolFrameSize, size_t frameSize, uint32_t blocks)
+{
+    // Sized for a full capture queue plus what the encoder holds on to.
+    // Frames of an old size keep their pool alive until released.
+    if (pool == nullptr || poolFrameSize != frameSize)
+    {
+        pool = std::make_shared<BufferPool>(std::vector<BufferPool::SizeClass>{ { frameSize, blocks } });
+        poolFrameSize = frameSize;
+    }
+    return pool->Acquire(frameSize);
+}
+
+BorrowedFrame CaptureSession::WrapFrameBuffer(PooledBuffer block, std::shared_ptr<BufferPool> pool, const FrameView& view)
+{
+    // The block lives in the frame's hook and goes back to the pool before
+    // the pool reference is dropped.
+    return BorrowedFrame(view,
+        [block = std::move(block), pool = std::move(pool)]() mutable
+        {
+            block.Reset();
+        });
+}
+
+bool CaptureSession::SelectFormat(const VideoEncoderSettings& settings)
+{
+    if (m_source == nullptr)
+        return false;
+    FrameSourceFormat requested;
+    requested.width = settings.width;
+    requested.height = settings.height;
+    requested.frameRate = settings.frameRate;
+    FrameSourceFormat negotiated;
+    return m_source->Negotiate(requested, negotiated);
+}
+
+bool CaptureSession::SetupSource()
+{
+    m_source = m_config.source;
+    if (m_source == nullptr)
+    {
+        auto camera = std::make_shared<MediaCaptureSource>(m_config.videoDeviceId);
+        if (!camera->Open())
+            return false;
+        m_source = std::move(camera);
+    }
+
+    // Without an exact match the source keeps its default format.
+    SelectFormat(m_config.encoder);
+    return true;
+}
@@ -0,0 +1,189 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BitstreamRecorder.h"
+#include "BufferPool.h"
+#include "CaptureClock.h"
+#include "CpuAdaptation.h"
+#include "EncodePipeline.h"
+#include "EncodedFrameRing.h"
+#include "FrameSource.h"
+#include "KeyFrameRequester.h"
+#include "Nv12Scaler.h"
+#include "PipelineMetrics.h"
+#include "PixelConvert.h"
+#include "ReplayBuffer.h"
+#include "SimulcastEncoder.h"
+#include "StaticSceneDetector.h"
+#include "VideoEncoderBackend.h"
+
+// One frame source, normally a camera, one encoder and one encode pipeline.
+// Sessions share nothing, so several of them can capture and encode in
+// parallel.
+class CaptureSession
+{
+public:
+    using FrameCallback = void (*)(void* context, int rtpDuration, void* frame);
+
+    struct Config
+    {
+        // Empty selects the first color camera.
+        std::wstring videoDeviceId;
+        // Frames come from here instead of the camera when set.
+        std::shared_ptr<IFrameSource> source;
+        EncodePipeline::Config pipeline;
+        // Zero disables pull mode.
+        uint32_t pullCapacity = 0;
+        VideoEncoderBackendType encoderBackend = VideoEncoderBackendType::MediaFoundation;
+        VideoEncoderSettings encoder;
+        // Forced IDRs are never closer together than this.
+        std::chrono::milliseconds minKeyFrameInterval{ 500 };
+        // Relative to the app's local folder. Empty starts without recording.
+        std::wstring recordFileName = L"output.h264";
+        BitstreamRecorder::Config recording;
+        // Seconds of encoded video kept for DumpReplay; zero disables it.
+        uint32_t replaySeconds = 0;
+        size_t replayMemoryBudget = 32 * 1024 * 1024;
+        // Used when the camera only offers RGB and frames are converted to NV12.
+        ColorSpace conversionColorSpace;
+        // When set, Reconfigure to a size the camera already exceeds scales
+        // captured frames instead of switching the camera format.
+        bool scaleOnReconfigure = false;
+        Nv12Scaler::Config scaling;
+        // Region of the camera frame that is encoded; an empty rectangle
+        // keeps the whole frame. Cropping moves the view, not the pixels.
+        FrameRect crop;
+        // RTP stream id of the main stream, which is simulcast layer 0.
+        std::string rid;
+        // Lower simulcast layers, largest first, scaled from the main
+        // stream. Recording, replay and Reconfigure only cover the main one.
+        std::vector<SimulcastEncoder::Layer> simulcast;
+        // Lowers the frame rate and then the size of the main stream while
+        // encoding falls behind, and restores them once it catches up.
+        bool adaptToCpu = false;
+        CpuAdaptation::Config adaptation;
+        // Lets frames that show nothing new through only once per
+        // keep-alive interval; the rest never reach scaling or the encoder.
+        bool skipStaticFrames = false;
+        StaticSceneDetector::Config staticScene;
+    };
+
+    explicit CaptureSession(Config config);
+    CaptureSession(const CaptureSession&) = delete;
+    CaptureSession& operator=(const CaptureSession&) = delete;
+    ~CaptureSession();
+
+    bool Initialize();
+    bool Start();
+    // Stops capture and encoding for good. Stats and key frame requests
+    // stay safe, and do nothing useful, until the session is destroyed.
+    void Shutdown();
+
+    // The frame passed to the callback is an EncodedFrame* that stays valid
+    // for the duration of the call.
+    void SetFrameCallback(FrameCallback callback, void* context);
+
+    uint32_t PullFrames(EncodedFrameRef* frames, uint32_t maxFrames, std::chrono::milliseconds timeout);
+
+    // Bitrate and frame rate changes reach the encoder on the next frame
+    // without touching the camera. A new resolution also switches the
+    // camera format, unless scaleOnReconfigure is set and the camera size
+    // is at least as large; frames of the old size still queued are dropped.
+    bool Reconfigure(const VideoEncoderSettings& settings);
+
+    // Safe from any thread; bursts are coalesced into one IDR. Without a
+    // layer every simulcast layer starts a new GOP.
+    void RequestKeyFrame();
+    bool RequestKeyFrame(uint32_t layer);
+
+    // Records the encoded stream from the next key frame on. Relative names
+    // are placed in the app's local folder.
+    bool StartRecording(const std::wstring& fileName, const BitstreamRecorder::Config& config);
+    void StopRecording();
+    BitstreamRecorder::Stats GetRecordingStats() const { return m_recorder.GetStats(); }
+
+    // Writes at least the last seconds of video, from the key frame before
+    // them, as Annex B or, for .mp4 names, fragmented MP4. Fails when the
+    // session keeps no replay.
+    bool DumpReplay(const std::wstring& fileName, uint32_t seconds);
+
+    EncodePipeline::Stats GetQueueStats() const;
+
+    struct PipelineStats
+    {
+        PipelineMetrics::Snapshot metrics;
+        EncodePipeline::Stats queues;
+        uint32_t pullQueueDepth;
+        CpuAdaptation::Stats adaptation;
+        StaticSceneDetector::Stats staticScene;
+    };
+
+    // Rates in the result cover the time since the previous call.
+    PipelineStats GetPipelineStats();
+
+    // Including the main stream.
+    uint32_t LayerCount() const;
+    // Lower layers only; the main stream is covered by GetPipelineStats.
+    bool GetLayerStats(uint32_t layer, SimulcastEncoder::LayerStats& stats) const;
+
+private:
+    bool SetupSource();
+    bool SelectFormat(const VideoEncoderSettings& settings);
+    EncodedFrameRef Encode(BorrowedFrame frame);
+    void OnFrame(BorrowedFrame frame);
+    void Deliver(const EncodedFrameRef& frame);
+    void Adapt(const VideoEncoderSettings& settings);
+    BorrowedFrame ConvertToNv12(const FrameView& view);
+    BorrowedFrame ScaleFrame(BorrowedFrame frame, uint32_t width, uint32_t height);
+    static PooledBuffer AcquireFrameBuffer(std::shared_ptr<BufferPool>& pool, size_t& poolFrameSize, size_t frameSize, uint32_t blocks);
+    static BorrowedFrame WrapFrameBuffer(PooledBuffer block, std::shared_ptr<BufferPool> pool, const FrameView& view);
+
+    Config m_config;
+    std::shared_ptr<IFrameSource> m_source;
+    std::unique_ptr<IVideoEncoderBackend> m_encoder;
+    VideoEncoderSettings m_encoderSettings;
+    std::mutex m_settingsMutex;
+    VideoEncoderSettings m_pendingSettings;
+    std::atomic<bool> m_settingsPending{ false };
+    // Width in the upper and height in the lower 32 bits.
+    std::atomic<uint64_t> m_captureSize{ 0 };
+    std::atomic<uint64_t> m_outputSize{ 0 };
+    KeyFrameRequester m_keyFrames;
+    PipelineMetrics m_metrics;
+    BitstreamRecorder m_recorder;
+    std::unique_ptr<ReplayBuffer> m_replay;
+    std::unique_ptr<EncodePipeline> m_pipeline;
+    std::unique_ptr<EncodedFrameRing> m_pullRing;
+    // Serializes pushes to m_pullRing.
+    std::mutex m_pushMutex;
+    std::mutex m_callbackMutex;
+    FrameCallback m_frameCallback = nullptr;
+    void* m_frameCallbackContext = nullptr;
+    std::atomic<bool> m_hasConsumer{ false };
+    bool m_capturing = false;
+    std::atomic<bool> m_shutdown{ false };
+    // Capture thread.
+    CaptureClock m_clock;
+    std::shared_ptr<BufferPool> m_conversionPool;
+    size_t m_conversionFrameSize = 0;
+    Nv12Scaler m_scaler;
+    std::shared_ptr<BufferPool> m_scalePool;
+    size_t m_scaleFrameSize = 0;
+    std::unique_ptr<SimulcastEncoder> m_simulcast;
+    std::unique_ptr<CpuAdaptation> m_adaptation;
+    std::unique_ptr<StaticSceneDetector> m_staticScene;
+    // Delivery threads, one entry per layer, each written only by the
+    // thread delivering that layer.
+    struct DeliveryState
+    {
+        uint32_t lastRtpTimestamp = 0;
+        bool hasDelivered = false;
+    };
+    std::vector<DeliveryState> m_delivery;
+};
@@ -0,0 +1,128 @@
+﻿#include "CpuAdaptation.h"
+
+#include <algorithm>
+
+#include "CaptureClock.h"
+
+static uint64_t PackSize(uint32_t width, uint32_t height)
+{
+    return static_cast<uint64_t>(width) << 32 | height;
+}
+
+CpuAdaptation::CpuAdaptation(const Config& config)
+    : m_config(config), m_detector(config.detector)
+{
+    Reset(VideoEncoderSettings());
+}
+
+void CpuAdaptation::Reset(const VideoEncoderSettings& settings)
+{
+    m_requested = settings;
+    m_steps.clear();
+    Step step = { settings.width, settings.height, settings.frameRate };
+    m_steps.push_back(step);
+    for (;;)
+    {
+        uint32_t frameRate = std::max(m_config.minFrameRate, step.frameRate * 2 / 3);
+        if (frameRate >= step.frameRate)
+            break;
+        step.frameRate = frameRate;
+        m_steps.push_back(step);
+    }
+    while (m_config.scaleResolution)
+    {
+        // Sizes stay even for NV12.
+        uint32_t width = step.width * 3 / 4 & ~1u;
+        uint32_t height = step.height * 3 / 4 & ~1u;
+        if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height < m_config.minPixels)
+            break;
+        step.width = width;
+        step.height = height;
+        m_steps.push_back(step);
+    }
+
+    m_detector.Reset();
+    m_level = 0;
+    m_frameRate = settings.frameRate;
+    m_size = PackSize(settings.width, settings.height);
+}
+
+bool CpuAdaptation::OnFrameEncoded(const OveruseDetector::Sample& sample, VideoEncoderSettings& adapted)
+{
+    OveruseDetector::Signal signal = m_detector.AddSample(sample);
+    m_usage.store(m_detector.Usage(), std::memory_order_relaxed);
+
+    uint32_t level = m_level.load(std::memory_order_relaxed);
+    if (signal == OveruseDetector::Signal::Overuse && level + 1 < m_steps.size())
+    {
+        level++;
+        m_degradations.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (signal == OveruseDetector::Signal::Underuse && level > 0)
+    {
+        level--;
+        m_restorations.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        return false;
+    }
+
+    m_detector.OnAdapted(sample.now, signal);
+    const Step& step = m_steps[level];
+    m_level = level;
+    m_frameRate = step.frameRate;
+    m_size = PackSize(step.width, step.height);
+    adapted = Settings(step);
+    return true;
+}
+
+bool CpuAdaptation::AcceptFrame(int64_t mediaTime)
+{
+    uint32_t frameRate = m_frameRate.load(std::memory_order_relaxed);
+    if (m_level.load(std::memory_order_relaxed) == 0 || frameRate == 0)
+    {
+        m_nextFrame = INT64_MIN;
+        return true;
+    }
+
+    // Frames are due every interval on the media timeline. A quarter
+    // interval of slack absorbs capture jitter without letting through
+    // frames that belong to the interval after.
+    int64_t interval = CaptureClock::TicksPerSecond / frameRate;
+    if (m_nextFrame != INT64_MIN && mediaTime + interval / 4 < m_nextFrame)
+        return false;
+    m_nextFrame = m_nextFrame == INT64_MIN || mediaTime >= m_nextFrame + interval ? mediaTime + interval : m_nextFrame + interval;
+    return true;
+}
+
+OveruseDetector::Clock::duration CpuAdaptation::FrameInterval() const
+{
+    uint32_t frameRate = m_frameRate.load(std::memory_order_relaxed);
+    if (frameRate == 0)
+        return OveruseDetector::Clock::duration::zero();
+    return std::chrono::duration_cast<OveruseDetector::Clock::duration>(std::chrono::seconds(1)) / frameRate;
+}
+
+CpuAdaptation::Stats CpuAdaptation::GetStats() const
+{
+    Stats stats;
+    uint64_t size = m_size.load(std::memory_order_relaxed);
+    stats.level = m_level.load(std::memory_order_relaxed);
+    stats.width = static_cast<uint32_t>(size >> 32);
+    stats.height = static_cast<uint32_t>(size);
+    stats.frameRate = m_frameRate.load(std::memory_order_relaxed);
+    stats.usage = m_usage.load(std::memory_order_relaxed);
+    stats.degradations = m_degradations.load(std::memory_order_relaxed);
+    stats.restorations = m_restorations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+VideoEncoderSettings CpuAdaptation::Settings(const Step& step) const
+{
+    VideoEncoderSettings settings = m_requested;
+    settings.width = step.width;
+    settings.height = step.height;
+    settings.frameRate = step.frameRate;
+    return settings;
+}
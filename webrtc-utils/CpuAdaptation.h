@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "OveruseDetector.h"
+#include "VideoEncoderBackend.h"
+
+// Walks the encode settings down and back up a ladder as the overuse
+// detector asks: the frame rate goes first, down to minFrameRate, then the
+// resolution in steps of 3/4 per side down to minPixels. Restoring climbs
+// the same ladder one step at a time.
+class CpuAdaptation
+{
+public:
+    struct Config
+    {
+        OveruseDetector::Config detector;
+        uint32_t minFrameRate = 15;
+        uint32_t minPixels = 320 * 180;
+        // Off when nothing downstream can scale; only the frame rate adapts.
+        bool scaleResolution = true;
+    };
+
+    struct Stats
+    {
+        // Zero runs the requested settings.
+        uint32_t level;
+        uint32_t width;
+        uint32_t height;
+        uint32_t frameRate;
+        double usage;
+        uint64_t degradations;
+        uint64_t restorations;
+    };
+
+    explicit CpuAdaptation(const Config& config);
+
+    // Encode thread. Builds the ladder for newly requested settings and
+    // starts again from the top of it.
+    void Reset(const VideoEncoderSettings& settings);
+
+    // Encode thread, once per encoded frame. True when the encoder has to
+    // move to the settings returned in adapted.
+    bool OnFrameEncoded(const OveruseDetector::Sample& sample, VideoEncoderSettings& adapted);
+
+    // Capture thread. Thins frames out to the adapted frame rate; the media
+    // time is in 100 ns ticks.
+    bool AcceptFrame(int64_t mediaTime);
+
+    // What the adapted frame rate allows per frame, for the next sample.
+    OveruseDetector::Clock::duration FrameInterval() const;
+
+    Stats GetStats() const;
+
+private:
+    struct Step
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t frameRate;
+    };
+
+    VideoEncoderSettings Settings(const Step& step) const;
+
+    Config m_config;
+    OveruseDetector m_detector;
+    VideoEncoderSettings m_requested;
+    std::vector<Step> m_steps;
+    std::atomic<uint32_t> m_level{ 0 };
+    std::atomic<uint32_t> m_frameRate{ 30 };
+    std::atomic<uint64_t> m_size{ 0 };
+    std::atomic<double> m_usage{ 0.0 };
+    std::atomic<uint64_t> m_degradations{ 0 };
+    std::atomic<uint64_t> m_restorations{ 0 };
+    // Capture thread.
+    int64_t m_nextFrame = INT64_MIN;
+};
@@ -0,0 +1,104 @@
+﻿#include "EncodePipeline.h"
+
+EncodePipeline::EncodePipeline(const Config& config, EncodeFunction encode, DeliverFunction deliver)
+    : m_encode(std::move(encode)),
+      m_deliver(std::move(deliver)),
+      m_captureQueue(config.captureQueueCapacity, config.captureDropPolicy),
+      m_deliveryQueue(config.deliveryQueueCapacity, DropPolicy::DropOldest)
+{
+}
+
+EncodePipeline::~EncodePipeline()
+{
+    Stop();
+}
+
+void EncodePipeline::Start()
+{
+    if (m_running.exchange(true))
+        return;
+
+    m_encodeThread = std::thread(&EncodePipeline::EncodeLoop, this);
+    m_deliveryThread = std::thread(&EncodePipeline::DeliveryLoop, this);
+}
+
+void EncodePipeline::Stop()
+{
+    if (!m_running.exchange(false))
+        return;
+
+    m_encodeWake.Signal();
+    m_deliveryWake.Signal();
+    if (m_encodeThread.joinable())
+        m_encodeThread.join();
+    if (m_deliveryThread.joinable())
+        m_deliveryThread.join();
+
+    BorrowedFrame frame;
+    while (m_captureQueue.Take(frame))
+        frame.Release();
+    EncodedFrameRef encoded;
+    while (m_deliveryQueue.Take(encoded))
+        encoded.Reset();
+}
+
+void EncodePipeline::PostFrame(BorrowedFrame frame)
+{
+    if (!m_running.load(std::memory_order_acquire))
+        return;
+
+    m_captureQueue.Post(std::move(frame));
+    m_encodeWake.Signal();
+}
+
+void EncodePipeline::EncodeLoop()
+{
+    BorrowedFrame frame;
+    while (m_running.load(std::memory_order_acquire))
+    {
+        if (!m_captureQueue.Take(frame))
+        {
+            m_encodeWake.Wait([this]() { return m_captureQueue.Depth() > 0 || !m_running.load(); });
+            continue;
+        }
+
+        EncodedFrameRef encoded = m_encode(std::move(frame));
+        frame.Release();
+        m_framesEncoded.fetch_add(1, std::memory_order_relaxed);
+        if (!encoded || encoded->Size() == 0)
+            continue;
+
+        m_deliveryQueue.Post(std::move(encoded));
+        m_deliveryWake.Signal();
+    }
+}
+
+void EncodePipeline::DeliveryLoop()
+{
+    EncodedFrameRef encoded;
+    while (m_running.load(std::memory_order_acquire))
+    {
+        if (!m_deliveryQueue.Take(encoded))
+        {
+            m_deliveryWake.Wait([this]() { return m_deliveryQueue.Depth() > 0 || !m_running.load(); });
+            continue;
+        }
+
+        m_deliver(encoded);
+        encoded.Reset();
+        m_framesDelivered.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+EncodePipeline::Stats EncodePipeline::GetStats() const
+{
+    Stats stats;
+    stats.captureQueueDepth = m_captureQueue.Depth();
+    stats.deliveryQueueDepth = m_deliveryQueue.Depth();
+    stats.framesPosted = m_captureQueue.Posted();
+    stats.captureDrops = m_captureQueue.Dropped();
+    stats.framesEncoded = m_framesEncoded.load(std::memory_order_relaxed);
+    stats.deliveryDrops = m_deliveryQueue.Dropped();
+    stats.framesDelivered = m_framesDelivered.load(std::memory_order_relaxed);
+    return stats;
+}
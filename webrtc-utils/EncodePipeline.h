@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "BorrowedFrame.h"
+#include "EncodedFrame.h"
+#include "FrameMailbox.h"
+
+// Capture -> encode -> delivery, each stage on its own thread. The capture
+// callback only posts into a bounded mailbox, so a slow encode or a slow
+// subscriber can never stall the frame reader; instead frames are dropped
+// according to the configured policy and counted.
+class EncodePipeline
+{
+public:
+    using EncodeFunction = std::function<EncodedFrameRef(BorrowedFrame frame)>;
+    using DeliverFunction = std::function<void(const EncodedFrameRef& frame)>;
+
+    struct Config
+    {
+        uint32_t captureQueueCapacity = 1;
+        DropPolicy captureDropPolicy = DropPolicy::LatestOnly;
+        uint32_t deliveryQueueCapacity = 30;
+    };
+
+    struct Stats
+    {
+        uint32_t captureQueueDepth;
+        uint32_t deliveryQueueDepth;
+        uint64_t framesPosted;
+        uint64_t captureDrops;
+        uint64_t framesEncoded;
+        uint64_t deliveryDrops;
+        uint64_t framesDelivered;
+    };
+
+    EncodePipeline(const Config& config, EncodeFunction encode, DeliverFunction deliver);
+    EncodePipeline(const EncodePipeline&) = delete;
+    EncodePipeline& operator=(const EncodePipeline&) = delete;
+    ~EncodePipeline();
+
+    void Start();
+    // Stops both workers; frames still queued are released without encoding.
+    void Stop();
+
+    // Called from the capture thread.
+    void PostFrame(BorrowedFrame frame);
+
+    Stats GetStats() const;
+
+private:
+    void EncodeLoop();
+    void DeliveryLoop();
+
+    EncodeFunction m_encode;
+    DeliverFunction m_deliver;
+    FrameMailbox<BorrowedFrame> m_captureQueue;
+    FrameMailbox<EncodedFrameRef> m_deliveryQueue;
+    WakeEvent m_encodeWake;
+    WakeEvent m_deliveryWake;
+    std::atomic<bool> m_running{ false };
+    std::atomic<uint64_t> m_framesEncoded{ 0 };
+    std::atomic<uint64_t> m_framesDelivered{ 0 };
+    std::thread m_encodeThread;
+    std::thread m_deliveryThread;
+};
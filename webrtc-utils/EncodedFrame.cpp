@@ -0,0 +1,143 @@
+﻿#include "EncodedFrame.h"
+
+#include <cstring>
+#include <new>
+#include <utility>
+
+EncodedFrame::EncodedFrame(std::shared_ptr<BitstreamArena> arena, PooledBuffer block, uint8_t* payload, size_t capacity)
+    : m_arena(std::move(arena)), m_block(std::move(block)), m_payload(payload), m_capacity(capacity)
+{
+}
+
+bool EncodedFrame::Append(const uint8_t* data, size_t size)
+{
+    if (size > m_capacity - m_size)
+        return false;
+
+    memcpy(m_payload + m_size, data, size);
+    m_size += size;
+    m_arena->m_bytesCopied.fetch_add(size, std::memory_order_relaxed);
+    return true;
+}
+
+void EncodedFrame::SetLayer(uint32_t layer, const char* rid)
+{
+    m_layer = layer;
+    size_t length = 0;
+    if (rid != nullptr)
+    {
+        length = strnlen(rid, MaxRidLength);
+        memcpy(m_rid, rid, length);
+    }
+    m_rid[length] = '\0';
+}
+
+void EncodedFrame::Release()
+{
+    if (m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // The header lives inside the block it owns, so everything it holds
+    // has to be moved out before the block can be given back.
+    std::shared_ptr<BitstreamArena> arena = std::move(m_arena);
+    PooledBuffer block = std::move(m_block);
+    bool heap = !block;
+    this->~EncodedFrame();
+
+    if (heap)
+        ::operator delete(this, std::align_val_t(BufferPool::Alignment));
+    block.Reset();
+}
+
+EncodedFrameRef::EncodedFrameRef(const EncodedFrameRef& other)
+    : m_frame(other.m_frame)
+{
+    if (m_frame != nullptr)
+        m_frame->AddRef();
+}
+
+EncodedFrameRef::EncodedFrameRef(EncodedFrameRef&& other) noexcept
+    : m_frame(std::exchange(other.m_frame, nullptr))
+{
+}
+
+EncodedFrameRef& EncodedFrameRef::operator=(EncodedFrameRef other) noexcept
+{
+    std::swap(m_frame, other.m_frame);
+    return *this;
+}
+
+EncodedFrameRef::~EncodedFrameRef()
+{
+    Reset();
+}
+
+void EncodedFrameRef::Reset()
+{
+    if (m_frame != nullptr)
+        std::exchange(m_frame, nullptr)->Release();
+}
+
+EncodedFrame* EncodedFrameRef::Detach()
+{
+    return std::exchange(m_frame, nullptr);
+}
+
+EncodedFrameRef EncodedFrameRef::FromDetached(EncodedFrame* frame)
+{
+    return EncodedFrameRef(frame);
+}
+
+BitstreamArena::BitstreamArena(size_t maxFrameSize, uint32_t frameCount)
+    : m_pool({
+        { HeaderSize + maxFrameSize, frameCount },
+        { HeaderSize + maxFrameSize * 4, frameCount / 4 > 0 ? frameCount / 4 : 1 },
+    })
+{
+}
+
+EncodedFrameRef BitstreamArena::Allocate(size_t capacity)
+{
+    PooledBuffer block = m_pool.Acquire(HeaderSize + capacity);
+    uint8_t* memory;
+    size_t blockSize;
+    if (block)
+    {
+        memory = block.Data();
+        blockSize = block.Capacity();
+    }
+    else
+    {
+        m_heapFallbacks.fetch_add(1, std::memory_order_relaxed);
+        blockSize = HeaderSize + capacity;
+        memory = static_cast<uint8_t*>(::operator new(blockSize, std::align_val_t(BufferPool::Alignment)));
+    }
+
+    EncodedFrame* frame = new (memory) EncodedFrame(shared_from_this(), std::move(block), memory + HeaderSize, blockSize - HeaderSize);
+    return EncodedFrameRef(frame);
+}
+
+bool BitstreamArena::Grow(EncodedFrameRef& frame, size_t capacity)
+{
+    if (!frame || frame->Capacity() >= capacity)
+        return static_cast<bool>(frame);
+
+    EncodedFrameRef grown = Allocate(capacity);
+    memcpy(grown->m_payload, frame->Data(), frame->Size());
+    grown->m_size = frame->Size();
+    m_bytesCopied.fetch_add(frame->Size(), std::memory_order_relaxed);
+    grown->m_timestamp = frame->Timestamp();
+    grown->m_keyFrame = frame->IsKeyFrame();
+    grown->SetLayer(frame->Layer(), frame->Rid());
+    frame = std::move(grown);
+    return true;
+}
+
+BitstreamArena::Stats BitstreamArena::GetStats() const
+{
+    Stats stats;
+    stats.pool = m_pool.GetStats();
+    stats.heapFallbacks = m_heapFallbacks.load(std::memory_order_relaxed);
+    stats.bytesCopied = m_bytesCopied.load(std::memory_order_relaxed);
+    return stats;
+}
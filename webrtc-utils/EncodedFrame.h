@@ -0,0 +1,127 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "BufferPool.h"
+
+class BitstreamArena;
+
+struct ByteSpan
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// One encoded access unit. The header is placed at the front of the arena
+// block that also holds the payload, so a frame costs a single pool acquire
+// and nothing else. Frames are only reachable through EncodedFrameRef.
+class EncodedFrame
+{
+public:
+    // Longest rid kept; what a one-byte RTP header extension can carry.
+    static constexpr size_t MaxRidLength = 16;
+
+    const uint8_t* Data() const { return m_payload; }
+    size_t Size() const { return m_size; }
+    size_t Capacity() const { return m_capacity; }
+    ByteSpan Span() const { return { m_payload, m_size }; }
+
+    int64_t Timestamp() const { return m_timestamp; }
+    bool IsKeyFrame() const { return m_keyFrame; }
+    void SetTimestamp(int64_t timestamp) { m_timestamp = timestamp; }
+    void SetKeyFrame(bool keyFrame) { m_keyFrame = keyFrame; }
+    // Simulcast layer, 0 for the full-size stream, and its RTP stream id.
+    // The rid is empty outside simulcast and is truncated to MaxRidLength.
+    uint32_t Layer() const { return m_layer; }
+    const char* Rid() const { return m_rid; }
+    void SetLayer(uint32_t layer, const char* rid);
+
+    // Fails without writing anything when the frame is out of room.
+    bool Append(const uint8_t* data, size_t size);
+
+private:
+    friend class BitstreamArena;
+    friend class EncodedFrameRef;
+
+    EncodedFrame(std::shared_ptr<BitstreamArena> arena, PooledBuffer block, uint8_t* payload, size_t capacity);
+
+    void AddRef() { m_refs.fetch_add(1, std::memory_order_relaxed); }
+    void Release();
+
+    std::atomic<uint32_t> m_refs{ 1 };
+    std::shared_ptr<BitstreamArena> m_arena;
+    PooledBuffer m_block;
+    uint8_t* m_payload;
+    size_t m_capacity;
+    size_t m_size = 0;
+    int64_t m_timestamp = 0;
+    bool m_keyFrame = false;
+    uint32_t m_layer = 0;
+    char m_rid[MaxRidLength + 1] = {};
+};
+
+// Shared, ref-counted handle to an EncodedFrame. Copies only bump the
+// count; the block returns to the arena when the last handle goes away.
+class EncodedFrameRef
+{
+public:
+    EncodedFrameRef() = default;
+    EncodedFrameRef(const EncodedFrameRef& other);
+    EncodedFrameRef(EncodedFrameRef&& other) noexcept;
+    EncodedFrameRef& operator=(EncodedFrameRef other) noexcept;
+    ~EncodedFrameRef();
+
+    EncodedFrame* operator->() const { return m_frame; }
+    EncodedFrame& operator*() const { return *m_frame; }
+    EncodedFrame* Get() const { return m_frame; }
+    explicit operator bool() const { return m_frame != nullptr; }
+
+    void Reset();
+
+    // Hands the reference over to the caller, who must balance it with
+    // FromDetached later. Used to carry a frame across a C boundary.
+    EncodedFrame* Detach();
+    static EncodedFrameRef FromDetached(EncodedFrame* frame);
+    static void AddRef(EncodedFrame* frame) { frame->AddRef(); }
+
+private:
+    friend class BitstreamArena;
+    explicit EncodedFrameRef(EncodedFrame* frame) : m_frame(frame) {}
+
+    EncodedFrame* m_frame = nullptr;
+};
+
+// Preallocated storage for encoded frames. Frames are carved out of a
+// BufferPool so steady-state encoding reuses the same blocks; when the pool
+// is exhausted frames fall back to a dedicated heap block.
+class BitstreamArena : public std::enable_shared_from_this<BitstreamArena>
+{
+public:
+    struct Stats
+    {
+        BufferPool::Stats pool;
+        uint64_t heapFallbacks;
+        uint64_t bytesCopied;
+    };
+
+    BitstreamArena(size_t maxFrameSize, uint32_t frameCount);
+
+    EncodedFrameRef Allocate(size_t capacity);
+    // Moves the frame into one with at least the given capacity, keeping
+    // its contents and metadata. Only used when a burst outgrows its block.
+    bool Grow(EncodedFrameRef& frame, size_t capacity);
+
+    Stats GetStats() const;
+
+private:
+    friend class EncodedFrame;
+
+    static constexpr size_t HeaderSize = (sizeof(EncodedFrame) + BufferPool::Alignment - 1) & ~(BufferPool::Alignment - 1);
+
+    BufferPool m_pool;
+    std::atomic<uint64_t> m_heapFallbacks{ 0 };
+    std::atomic<uint64_t> m_bytesCopied{ 0 };
+};
@@ -0,0 +1,76 @@
+﻿#include "EncodedFrameRing.h"
+
+EncodedFrameRing::EncodedFrameRing(uint32_t capacity)
+    : m_capacity(capacity > 0 ? capacity : 1), m_slots(m_capacity, nullptr)
+{
+}
+
+EncodedFrameRing::~EncodedFrameRing()
+{
+    uint64_t tail = m_tail.load();
+    for (uint64_t head = m_head.load(); head != tail; head++)
+        EncodedFrameRef::FromDetached(m_slots[head % m_capacity]).Reset();
+}
+
+bool EncodedFrameRing::Push(EncodedFrameRef frame)
+{
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) >= m_capacity)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    m_slots[tail % m_capacity] = frame.Detach();
+    m_tail.store(tail + 1);
+
+    // Only the empty -> non-empty transition can find the consumer asleep;
+    // both sides use sequentially consistent accesses so either the consumer
+    // sees the new tail or we see its head and signal.
+    if (m_head.load() == tail && m_sleeping.load())
+    {
+        std::lock_guard lock(m_mutex);
+        m_wakeups.fetch_add(1, std::memory_order_relaxed);
+        m_condition.notify_one();
+    }
+    return true;
+}
+
+uint32_t EncodedFrameRing::PopBatch(EncodedFrameRef* frames, uint32_t maxFrames, std::chrono::milliseconds timeout)
+{
+    if (frames == nullptr || maxFrames == 0)
+        return 0;
+
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (m_tail.load() == head && timeout.count() > 0)
+    {
+        std::unique_lock lock(m_mutex);
+        m_sleeping.store(true);
+        m_condition.wait_for(lock, timeout, [&]() { return m_tail.load() != head || m_interrupted.load(); });
+        m_sleeping.store(false);
+    }
+
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    uint32_t count = 0;
+    while (head != tail && count < maxFrames)
+    {
+        frames[count++] = EncodedFrameRef::FromDetached(m_slots[head % m_capacity]);
+        head++;
+    }
+    m_head.store(head);
+    return count;
+}
+
+void EncodedFrameRing::Interrupt()
+{
+    std::lock_guard lock(m_mutex);
+    m_interrupted.store(true);
+    m_condition.notify_all();
+}
+
+uint32_t EncodedFrameRing::Depth() const
+{
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    return tail > head ? static_cast<uint32_t>(tail - head) : 0;
+}
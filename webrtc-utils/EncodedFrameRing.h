@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "EncodedFrame.h"
+
+// Wait-free SPSC ring of encoded frames for pull-mode consumers. The
+// producer never loops: when the ring is full the new frame is dropped and
+// counted. The consumer is only woken when a push turns the ring from empty
+// to non-empty, so a consumer that keeps up pays no signalling cost.
+class EncodedFrameRing
+{
+public:
+    explicit EncodedFrameRing(uint32_t capacity);
+    EncodedFrameRing(const EncodedFrameRing&) = delete;
+    EncodedFrameRing& operator=(const EncodedFrameRing&) = delete;
+    ~EncodedFrameRing();
+
+    // Producer side. Returns false when the frame was dropped. Calls must
+    // not overlap; several producers need a lock of their own around Push.
+    bool Push(EncodedFrameRef frame);
+
+    // Consumer side. Moves up to maxFrames frames into frames, waiting up to
+    // timeout for the first one. Returns the number of frames written.
+    uint32_t PopBatch(EncodedFrameRef* frames, uint32_t maxFrames, std::chrono::milliseconds timeout);
+
+    // Wakes a consumer blocked in PopBatch, e.g. on shutdown.
+    void Interrupt();
+
+    uint32_t Depth() const;
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint64_t Wakeups() const { return m_wakeups.load(std::memory_order_relaxed); }
+
+private:
+    const uint32_t m_capacity;
+    std::vector<EncodedFrame*> m_slots;
+    alignas(64) std::atomic<uint64_t> m_head{ 0 };
+    alignas(64) std::atomic<uint64_t> m_tail{ 0 };
+    std::atomic<bool> m_sleeping{ false };
+    std::atomic<bool> m_interrupted{ false };
+    std::atomic<uint64_t> m_dropped{ 0 };
+    std::atomic<uint64_t> m_wakeups{ 0 };
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+};
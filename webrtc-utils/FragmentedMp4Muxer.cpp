@@ -0,0 +1,576 @@
+﻿#include "FragmentedMp4Muxer.h"
+
+#include <cstring>
+
+namespace
+{
+    // The track runs on the RTP clock, so sample times match the timestamps
+    // sent over the wire.
+    constexpr uint32_t TrackTimescale = 90000;
+    constexpr uint32_t MovieTimescale = 1000;
+    constexpr uint32_t TrackId = 1;
+
+    constexpr uint32_t SyncSampleFlags = 0x02000000;
+    constexpr uint32_t NonSyncSampleFlags = 0x01010000;
+
+    enum NalType : uint8_t
+    {
+        NalSps = 7,
+        NalPps = 8,
+        NalAccessUnitDelimiter = 9,
+    };
+
+    struct Nal
+    {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    // Walks the NAL units of an Annex B buffer.
+    class NalReader
+    {
+    public:
+        NalReader(const uint8_t* data, size_t size) : m_data(data), m_size(size), m_next(FindStart(0)) {}
+
+        bool Next(Nal& nal)
+        {
+            if (m_next >= m_size)
+                return false;
+
+            size_t start = m_next;
+            size_t end = FindStart(start);
+            m_next = end;
+            // FindStart lands after the start code; trim it and the zero
+            // bytes of a four-byte start code off the previous NAL.
+            if (end < m_size)
+            {
+                end -= 3;
+                while (end > start && m_data[end - 1] == 0)
+                    end--;
+            }
+            nal = { m_data + start, end - start };
+            return nal.size > 0;
+        }
+
+    private:
+        size_t FindStart(size_t from) const
+        {
+            for (size_t i = from; i + 3 <= m_size; i++)
+            {
+                if (m_data[i] == 0 && m_data[i + 1] == 0 && m_data[i + 2] == 1)
+                    return i + 3;
+            }
+            return m_size;
+        }
+
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_next;
+    };
+
+    // Exp-Golomb reader over an RBSP with emulation prevention bytes.
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* data, size_t size)
+        {
+            m_bytes.reserve(size);
+            for (size_t i = 0; i < size; i++)
+            {
+                if (i >= 2 && data[i] == 3 && data[i - 1] == 0 && data[i - 2] == 0)
+                    continue;
+                m_bytes.push_back(data[i]);
+            }
+        }
+
+        uint32_t Bits(uint32_t count)
+        {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                size_t byte = m_position / 8;
+                uint32_t bit = byte < m_bytes.size() ? (m_bytes[byte] >> (7 - m_position % 8)) & 1 : 0;
+                value = (value << 1) | bit;
+                m_position++;
+            }
+            return value;
+        }
+
+        uint32_t Ue()
+        {
+            uint32_t zeros = 0;
+            while (Bits(1) == 0 && zeros < 32)
+                zeros++;
+            return zeros == 0 ? 0 : (1u << zeros) - 1 + Bits(zeros);
+        }
+
+        int32_t Se()
+        {
+            uint32_t value = Ue();
+            return (value & 1) != 0 ? static_cast<int32_t>((value + 1) / 2) : -static_cast<int32_t>(value / 2);
+        }
+
+        bool Overrun() const { return m_position > m_bytes.size() * 8; }
+
+    private:
+        std::vector<uint8_t> m_bytes;
+        size_t m_position = 0;
+    };
+
+    struct SpsInfo
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t chromaFormat = 1;
+        uint32_t bitDepthLuma = 8;
+        uint32_t bitDepthChroma = 8;
+    };
+
+    bool IsHighProfile(uint8_t profile)
+    {
+        switch (profile)
+        {
+        case 100: case 110: case 122: case 244: case 44: case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool ParseSps(const std::vector<uint8_t>& sps, SpsInfo& info)
+    {
+        if (sps.size() < 4)
+            return false;
+
+        // Skip the NAL header, profile, constraint flags and level.
+        BitReader reader(sps.data() + 4, sps.size() - 4);
+        reader.Ue();
+        if (IsHighProfile(sps[1]))
+        {
+            info.chromaFormat = reader.Ue();
+            if (info.chromaFormat == 3)
+                reader.Bits(1);
+            info.bitDepthLuma = reader.Ue() + 8;
+            info.bitDepthChroma = reader.Ue() + 8;
+            reader.Bits(1);
+            if (reader.Bits(1) != 0)
+            {
+                for (uint32_t i = 0; i < (info.chromaFormat != 3 ? 8u : 12u); i++)
+                {
+                    if (reader.Bits(1) == 0)
+                        continue;
+                    int32_t last = 8;
+                    int32_t next = 8;
+                    for (uint32_t j = 0; j < (i < 6 ? 16u : 64u) && next != 0; j++)
+                    {
+                        next = (last + reader.Se() + 256) % 256;
+                        if (next != 0)
+                            last = next;
+                    }
+                }
+            }
+        }
+
+        reader.Ue();
+        uint32_t pocType = reader.Ue();
+        if (pocType == 0)
+        {
+            reader.Ue();
+        }
+        else if (pocType == 1)
+        {
+            reader.Bits(1);
+            reader.Se();
+            reader.Se();
+            for (uint32_t i = reader.Ue(); i > 0 && !reader.Overrun(); i--)
+                reader.Se();
+        }
+        reader.Ue();
+        reader.Bits(1);
+        uint32_t widthInMbs = reader.Ue() + 1;
+        uint32_t heightInMapUnits = reader.Ue() + 1;
+        uint32_t frameMbsOnly = reader.Bits(1);
+        if (frameMbsOnly == 0)
+            reader.Bits(1);
+        reader.Bits(1);
+
+        uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+        if (reader.Bits(1) != 0)
+        {
+            cropLeft = reader.Ue();
+            cropRight = reader.Ue();
+            cropTop = reader.Ue();
+            cropBottom = reader.Ue();
+        }
+        if (reader.Overrun())
+            return false;
+
+        uint32_t cropUnitX = info.chromaFormat == 1 || info.chromaFormat == 2 ? 2 : 1;
+        uint32_t cropUnitY = (info.chromaFormat == 1 ? 2 : 1) * (2 - frameMbsOnly);
+        info.width = widthInMbs * 16 - cropUnitX * (cropLeft + cropRight);
+        info.height = (2 - frameMbsOnly) * heightInMapUnits * 16 - cropUnitY * (cropTop + cropBottom);
+        return true;
+    }
+
+    class BoxWriter
+    {
+    public:
+        explicit BoxWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+        void U8(uint32_t value) { m_out.push_back(static_cast<uint8_t>(value)); }
+        void U16(uint32_t value) { U8(value >> 8); U8(value); }
+        void U32(uint32_t value) { U16(value >> 16); U16(value); }
+        void U64(uint64_t value) { U32(static_cast<uint32_t>(value >> 32)); U32(static_cast<uint32_t>(value)); }
+        void Bytes(const uint8_t* data, size_t size) { m_out.insert(m_out.end(), data, data + size); }
+        void Zeros(size_t count) { m_out.insert(m_out.end(), count, 0); }
+        void Type(const char* type) { Bytes(reinterpret_cast<const uint8_t*>(type), 4); }
+
+        size_t Begin(const char* type)
+        {
+            size_t start = m_out.size();
+            U32(0);
+            Type(type);
+            return start;
+        }
+
+        size_t BeginFull(const char* type, uint32_t version, uint32_t flags)
+        {
+            size_t start = Begin(type);
+            U32((version << 24) | flags);
+            return start;
+        }
+
+        void End(size_t start) { Patch(start, static_cast<uint32_t>(m_out.size() - start)); }
+
+        void Patch(size_t offset, uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+                m_out[offset + i] = static_cast<uint8_t>(value >> (24 - i * 8));
+        }
+
+        size_t Size() const { return m_out.size(); }
+
+        void Matrix()
+        {
+            static const uint32_t identity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+            for (uint32_t value : identity)
+                U32(value);
+        }
+
+    private:
+        std::vector<uint8_t>& m_out;
+    };
+
+    int64_t ToTrackTime(int64_t mediaTime)
+    {
+        return mediaTime * TrackTimescale / 10000000;
+    }
+}
+
+FragmentedMp4Muxer::FragmentedMp4Muxer() : FragmentedMp4Muxer(Config())
+{
+}
+
+FragmentedMp4Muxer::FragmentedMp4Muxer(const Config& config) : m_config(config)
+{
+}
+
+bool FragmentedMp4Muxer::ObserveParameterSets(const uint8_t* data, size_t size)
+{
+    NalReader reader(data, size);
+    Nal nal;
+    while (reader.Next(nal))
+    {
+        uint8_t type = nal.data[0] & 0x1F;
+        if (type == NalSps && m_sps.empty())
+            m_sps.assign(nal.data, nal.data + nal.size);
+        else if (type == NalPps && m_pps.empty())
+            m_pps.assign(nal.data, nal.data + nal.size);
+    }
+    return !m_sps.empty() && !m_pps.empty();
+}
+
+bool FragmentedMp4Muxer::AddFrame(const uint8_t* data, size_t size, int64_t timestamp, bool keyFrame, std::vector<uint8_t>& out)
+{
+    if (!m_headerWritten)
+    {
+        if (!keyFrame || !ObserveParameterSets(data, size))
+            return false;
+        m_firstTimestamp = timestamp;
+        WriteHeader(out);
+    }
+
+    int64_t time = ToTrackTime(timestamp - m_firstTimestamp);
+    if (!m_samples.empty() && (keyFrame || time - m_samples.front().time >= ToTrackTime(m_config.maxFragmentDuration)))
+        WriteFragment(time, out);
+
+    // Parameter sets that match the sample entry are dropped; new ones,
+    // e.g. after a resolution change, stay in band.
+    size_t start = m_mdat.size();
+    NalReader reader(data, size);
+    Nal nal;
+    while (reader.Next(nal))
+    {
+        uint8_t type = nal.data[0] & 0x1F;
+        if (type == NalAccessUnitDelimiter)
+            continue;
+        if (type == NalSps && nal.size == m_sps.size() && std::memcmp(nal.data, m_sps.data(), nal.size) == 0)
+            continue;
+        if (type == NalPps && nal.size == m_pps.size() && std::memcmp(nal.data, m_pps.data(), nal.size) == 0)
+            continue;
+
+        BoxWriter writer(m_mdat);
+        writer.U32(static_cast<uint32_t>(nal.size));
+        writer.Bytes(nal.data, nal.size);
+    }
+    m_samples.push_back({ time, static_cast<uint32_t>(m_mdat.size() - start), keyFrame });
+    return true;
+}
+
+void FragmentedMp4Muxer::Finish(std::vector<uint8_t>& out)
+{
+    if (!m_headerWritten)
+        return;
+
+    if (!m_samples.empty())
+        WriteFragment(m_samples.back().time + m_lastDuration, out);
+
+    size_t start = out.size();
+    BoxWriter box(out);
+    size_t mfra = box.Begin("mfra");
+    size_t tfra = box.BeginFull("tfra", 1, 0);
+    box.U32(TrackId);
+    // One-byte traf, trun and sample numbers.
+    box.U32(0);
+    box.U32(static_cast<uint32_t>(m_fragments.size()));
+    for (const FragmentEntry& entry : m_fragments)
+    {
+        box.U64(static_cast<uint64_t>(entry.time));
+        box.U64(entry.moofOffset);
+        box.U8(1);
+        box.U8(1);
+        box.U8(1);
+    }
+    box.End(tfra);
+    size_t mfro = box.BeginFull("mfro", 0, 0);
+    box.U32(static_cast<uint32_t>(out.size() - mfra + 4));
+    box.End(mfro);
+    box.End(mfra);
+    Emit(out, start);
+
+    m_headerWritten = false;
+    m_bytesWritten = 0;
+    m_sps.clear();
+    m_pps.clear();
+    m_fragments.clear();
+}
+
+void FragmentedMp4Muxer::WriteHeader(std::vector<uint8_t>& out)
+{
+    SpsInfo sps;
+    ParseSps(m_sps, sps);
+
+    size_t start = out.size();
+    BoxWriter box(out);
+
+    size_t ftyp = box.Begin("ftyp");
+    box.Type("isom");
+    box.U32(0x200);
+    box.Type("isom");
+    box.Type("iso6");
+    box.Type("avc1");
+    box.Type("mp41");
+    box.End(ftyp);
+
+    size_t moov = box.Begin("moov");
+
+    size_t mvhd = box.BeginFull("mvhd", 0, 0);
+    box.U32(0);
+    box.U32(0);
+    box.U32(MovieTimescale);
+    box.U32(0);
+    box.U32(0x00010000);
+    box.U16(0x0100);
+    box.Zeros(10);
+    box.Matrix();
+    box.Zeros(24);
+    box.U32(TrackId + 1);
+    box.End(mvhd);
+
+    size_t trak = box.Begin("trak");
+    // Enabled and in the movie.
+    size_t tkhd = box.BeginFull("tkhd", 0, 3);
+    box.U32(0);
+    box.U32(0);
+    box.U32(TrackId);
+    box.U32(0);
+    box.U32(0);
+    box.Zeros(8);
+    box.U16(0);
+    box.U16(0);
+    box.U16(0);
+    box.U16(0);
+    box.Matrix();
+    box.U32(sps.width << 16);
+    box.U32(sps.height << 16);
+    box.End(tkhd);
+
+    size_t mdia = box.Begin("mdia");
+    size_t mdhd = box.BeginFull("mdhd", 0, 0);
+    box.U32(0);
+    box.U32(0);
+    box.U32(TrackTimescale);
+    box.U32(0);
+    // Undetermined language.
+    box.U16(0x55C4);
+    box.U16(0);
+    box.End(mdhd);
+
+    size_t hdlr = box.BeginFull("hdlr", 0, 0);
+    box.U32(0);
+    box.Type("vide");
+    box.Zeros(12);
+    box.Bytes(reinterpret_cast<const uint8_t*>("VideoHandler"), 13);
+    box.End(hdlr);
+
+    size_t minf = box.Begin("minf");
+    size_t vmhd = box.BeginFull("vmhd", 0, 1);
+    box.Zeros(8);
+    box.End(vmhd);
+
+    size_t dinf = box.Begin("dinf");
+    size_t dref = box.BeginFull("dref", 0, 0);
+    box.U32(1);
+    // Media data is in this file.
+    size_t url = box.BeginFull("url ", 0, 1);
+    box.End(url);
+    box.End(dref);
+    box.End(dinf);
+
+    size_t stbl = box.Begin("stbl");
+    size_t stsd = box.BeginFull("stsd", 0, 0);
+    box.U32(1);
+    size_t avc1 = box.Begin("avc1");
+    box.Zeros(6);
+    box.U16(1);
+    box.Zeros(16);
+    box.U16(sps.width);
+    box.U16(sps.height);
+    box.U32(0x00480000);
+    box.U32(0x00480000);
+    box.U32(0);
+    box.U16(1);
+    box.Zeros(32);
+    box.U16(0x0018);
+    box.U16(0xFFFF);
+
+    size_t avcC = box.Begin("avcC");
+    box.U8(1);
+    box.U8(m_sps[1]);
+    box.U8(m_sps[2]);
+    box.U8(m_sps[3]);
+    // Four-byte NAL lengths.
+    box.U8(0xFC | 3);
+    box.U8(0xE0 | 1);
+    box.U16(static_cast<uint32_t>(m_sps.size()));
+    box.Bytes(m_sps.data(), m_sps.size());
+    box.U8(1);
+    box.U16(static_cast<uint32_t>(m_pps.size()));
+    box.Bytes(m_pps.data(), m_pps.size());
+    if (IsHighProfile(m_sps[1]))
+    {
+        box.U8(0xFC | sps.chromaFormat);
+        box.U8(0xF8 | (sps.bitDepthLuma - 8));
+        box.U8(0xF8 | (sps.bitDepthChroma - 8));
+        box.U8(0);
+    }
+    box.End(avcC);
+    box.End(avc1);
+    box.End(stsd);
+
+    // Every sample lives in the fragments, so the sample tables are empty.
+    for (const char* type : { "stts", "stsc", "stco" })
+    {
+        size_t table = box.BeginFull(type, 0, 0);
+        box.U32(0);
+        box.End(table);
+    }
+    size_t stsz = box.BeginFull("stsz", 0, 0);
+    box.U32(0);
+    box.U32(0);
+    box.End(stsz);
+    box.End(stbl);
+    box.End(minf);
+    box.End(mdia);
+    box.End(trak);
+
+    size_t mvex = box.Begin("mvex");
+    size_t trex = box.BeginFull("trex", 0, 0);
+    box.U32(TrackId);
+    box.U32(1);
+    box.U32(0);
+    box.U32(0);
+    box.U32(0);
+    box.End(trex);
+    box.End(mvex);
+    box.End(moov);
+
+    Emit(out, start);
+    m_headerWritten = true;
+    m_sequenceNumber = 0;
+}
+
+void FragmentedMp4Muxer::WriteFragment(int64_t endTime, std::vector<uint8_t>& out)
+{
+    if (m_samples.front().keyFrame)
+        m_fragments.push_back({ m_samples.front().time, m_bytesWritten });
+
+    size_t start = out.size();
+    BoxWriter box(out);
+    size_t moof = box.Begin("moof");
+    size_t mfhd = box.BeginFull("mfhd", 0, 0);
+    box.U32(++m_sequenceNumber);
+    box.End(mfhd);
+
+    size_t traf = box.Begin("traf");
+    // Data offsets are relative to the moof.
+    size_t tfhd = box.BeginFull("tfhd", 0, 0x020000);
+    box.U32(TrackId);
+    box.End(tfhd);
+    size_t tfdt = box.BeginFull("tfdt", 1, 0);
+    box.U64(static_cast<uint64_t>(m_samples.front().time));
+    box.End(tfdt);
+
+    // Per-sample duration, size and flags, plus the data offset.
+    size_t trun = box.BeginFull("trun", 0, 0x000701);
+    box.U32(static_cast<uint32_t>(m_samples.size()));
+    size_t dataOffset = box.Size();
+    box.U32(0);
+    for (size_t i = 0; i < m_samples.size(); i++)
+    {
+        int64_t next = i + 1 < m_samples.size() ? m_samples[i + 1].time : endTime;
+        int64_t duration = next > m_samples[i].time ? next - m_samples[i].time : 1;
+        box.U32(static_cast<uint32_t>(duration));
+        box.U32(m_samples[i].size);
+        box.U32(m_samples[i].keyFrame ? SyncSampleFlags : NonSyncSampleFlags);
+        if (i + 1 == m_samples.size())
+            m_lastDuration = duration;
+    }
+    box.End(trun);
+    box.End(traf);
+    box.End(moof);
+
+    box.Patch(dataOffset, static_cast<uint32_t>(box.Size() - moof + 8));
+    box.U32(static_cast<uint32_t>(m_mdat.size() + 8));
+    box.Type("mdat");
+    box.Bytes(m_mdat.data(), m_mdat.size());
+    Emit(out, start);
+
+    m_samples.clear();
+    m_mdat.clear();
+}
+
+void FragmentedMp4Muxer::Emit(std::vector<uint8_t>& out, size_t start)
+{
+    m_bytesWritten += out.size() - start;
+}
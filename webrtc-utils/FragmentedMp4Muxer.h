@@ -0,0 +1,65 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Turns the encoder's Annex B access units into a fragmented MP4 stream.
+// Output is produced incrementally: the header once the first key frame
+// brings SPS and PPS, then one moof/mdat pair per GOP, or per time slice
+// for long GOPs. Only the fragment being built is held in memory. Finish
+// appends a random access index so players can seek without scanning.
+class FragmentedMp4Muxer
+{
+public:
+    struct Config
+    {
+        // Fragments are cut at key frames and at least this often, in
+        // 100 ns units.
+        int64_t maxFragmentDuration = 20000000;
+    };
+
+    FragmentedMp4Muxer();
+    explicit FragmentedMp4Muxer(const Config& config);
+
+    // timestamp is the capture media time in 100 ns units. Appends whatever
+    // is complete to out. Returns false when the frame was skipped because
+    // no key frame with parameter sets has been seen yet.
+    bool AddFrame(const uint8_t* data, size_t size, int64_t timestamp, bool keyFrame, std::vector<uint8_t>& out);
+
+    // Closes the last fragment and writes the index.
+    void Finish(std::vector<uint8_t>& out);
+
+private:
+    struct Sample
+    {
+        int64_t time;
+        uint32_t size;
+        bool keyFrame;
+    };
+
+    struct FragmentEntry
+    {
+        int64_t time;
+        uint64_t moofOffset;
+    };
+
+    bool ObserveParameterSets(const uint8_t* data, size_t size);
+    void WriteHeader(std::vector<uint8_t>& out);
+    void WriteFragment(int64_t endTime, std::vector<uint8_t>& out);
+    void Emit(std::vector<uint8_t>& out, size_t start);
+
+    Config m_config;
+    std::vector<uint8_t> m_sps;
+    std::vector<uint8_t> m_pps;
+    bool m_headerWritten = false;
+    int64_t m_firstTimestamp = 0;
+    uint32_t m_sequenceNumber = 0;
+    uint64_t m_bytesWritten = 0;
+    int64_t m_lastDuration = 3000;
+
+    // The fragment being built; samples are already length-prefixed.
+    std::vector<Sample> m_samples;
+    std::vector<uint8_t> m_mdat;
+    std::vector<FragmentEntry> m_fragments;
+};
@@ -0,0 +1,366 @@
+﻿#include "FragmentedMp4Verifier.h"
+
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    constexpr uint32_t TrackId = 1;
+    constexpr uint32_t NalIdr = 5;
+
+    // trun flags
+    constexpr uint32_t DataOffsetPresent = 0x000001;
+    constexpr uint32_t FirstSampleFlagsPresent = 0x000004;
+    constexpr uint32_t SampleDurationPresent = 0x000100;
+    constexpr uint32_t SampleSizePresent = 0x000200;
+    constexpr uint32_t SampleFlagsPresent = 0x000400;
+    constexpr uint32_t SampleCompositionOffsetPresent = 0x000800;
+    constexpr uint32_t SampleIsNonSync = 0x00010000;
+    constexpr uint32_t DefaultBaseIsMoof = 0x020000;
+
+    uint32_t U32(const uint8_t* data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+            (static_cast<uint32_t>(data[2]) << 8) | data[3];
+    }
+
+    uint64_t U64(const uint8_t* data)
+    {
+        return (static_cast<uint64_t>(U32(data)) << 32) | U32(data + 4);
+    }
+
+    struct Box
+    {
+        char type[5];
+        size_t offset;
+        // Offset and size of the payload, past the size and type.
+        size_t body;
+        size_t size;
+
+        size_t End() const { return body + size; }
+        bool Is(const char* name) const { return std::memcmp(type, name, 4) == 0; }
+    };
+
+    // Reads the box header at offset; the box has to fit before end.
+    bool ReadBox(const uint8_t* data, size_t offset, size_t end, Box& box)
+    {
+        if (end - offset < 8)
+            return false;
+        uint64_t size = U32(data + offset);
+        size_t header = 8;
+        if (size == 1)
+        {
+            if (end - offset < 16)
+                return false;
+            size = U64(data + offset + 8);
+            header = 16;
+        }
+        else if (size == 0)
+        {
+            size = end - offset;
+        }
+        if (size < header || size > end - offset)
+            return false;
+
+        std::memcpy(box.type, data + offset + 4, 4);
+        box.type[4] = '\0';
+        box.offset = offset;
+        box.body = offset + header;
+        box.size = static_cast<size_t>(size) - header;
+        return true;
+    }
+
+    // The first child of parent with the given type.
+    bool FindChild(const uint8_t* data, const Box& parent, size_t skip, const char* type, Box& child)
+    {
+        for (size_t offset = parent.body + skip; offset < parent.End(); offset = child.End())
+        {
+            if (!ReadBox(data, offset, parent.End(), child))
+                return false;
+            if (child.Is(type))
+                return true;
+        }
+        return false;
+    }
+
+    // Follows a path of nested boxes down from root. Each step names a box
+    // and the bytes of its own fields that come ahead of its children.
+    bool FindPath(const uint8_t* data, const Box& root, std::initializer_list<std::pair<const char*, size_t>> path, Box& box)
+    {
+        box = root;
+        size_t skip = 0;
+        for (const auto& step : path)
+        {
+            Box child;
+            if (!FindChild(data, box, skip, step.first, child))
+                return false;
+            box = child;
+            skip = step.second;
+        }
+        return true;
+    }
+
+    class Checker
+    {
+    public:
+        Checker(const uint8_t* data, size_t size, FragmentedMp4Verifier::Result& result) : m_data(data), m_size(size), m_result(result) {}
+
+        bool Run()
+        {
+            std::vector<Box> boxes;
+            for (size_t offset = 0; offset < m_size;)
+            {
+                Box box;
+                if (!ReadBox(m_data, offset, m_size, box))
+                    return Fail("box at %zu overruns the file", offset);
+                boxes.push_back(box);
+                offset = box.End();
+            }
+
+            if (boxes.size() < 2 || !boxes[0].Is("ftyp") || !boxes[1].Is("moov"))
+                return Fail("file does not start with ftyp and moov");
+            if (!CheckMovie(boxes[1]))
+                return false;
+
+            size_t i = 2;
+            for (; i + 1 < boxes.size() && boxes[i].Is("moof"); i += 2)
+            {
+                if (!boxes[i + 1].Is("mdat"))
+                    return Fail("moof at %zu is not followed by mdat", boxes[i].offset);
+                if (!CheckFragment(boxes[i], boxes[i + 1]))
+                    return false;
+            }
+            if (i >= boxes.size() || !boxes[i].Is("mfra"))
+                return Fail("no mfra after the last fragment, at %zu", i < boxes.size() ? boxes[i].offset : m_size);
+            if (i + 1 != boxes.size())
+                return Fail("%s after mfra", boxes[i + 1].type);
+            return CheckIndex(boxes[i]);
+        }
+
+    private:
+        template<typename... Args>
+        bool Fail(const char* format, Args... args)
+        {
+            char message[256];
+            std::snprintf(message, sizeof(message), format, args...);
+            m_result.error = message;
+            return false;
+        }
+
+        bool CheckMovie(const Box& moov)
+        {
+            Box trex;
+            if (!FindPath(m_data, moov, { { "mvex", 0 }, { "trex", 0 } }, trex) || trex.size < 8 || U32(m_data + trex.body + 4) != TrackId)
+                return Fail("moov has no trex for track %u", TrackId);
+
+            // stsd and avc1 have fields of their own ahead of their children.
+            Box avcC;
+            if (!FindPath(m_data, moov, { { "trak", 0 }, { "mdia", 0 }, { "minf", 0 }, { "stbl", 0 }, { "stsd", 8 }, { "avc1", 78 }, { "avcC", 0 } }, avcC) ||
+                avcC.size < 7)
+                return Fail("moov has no avc1 sample entry with an avcC");
+            // Samples are parsed with four-byte lengths below.
+            if ((m_data[avcC.body + 4] & 3) != 3)
+                return Fail("avcC NAL lengths are %u bytes, not 4", (m_data[avcC.body + 4] & 3) + 1);
+            return true;
+        }
+
+        bool CheckFragment(const Box& moof, const Box& mdat)
+        {
+            Box mfhd;
+            if (!FindChild(m_data, moof, 0, "mfhd", mfhd) || mfhd.size < 8)
+                return Fail("moof at %zu has no mfhd", moof.offset);
+            uint32_t sequence = U32(m_data + mfhd.body + 4);
+            if (sequence != m_result.fragments + 1)
+                return Fail("fragment %u has sequence number %u", m_result.fragments + 1, sequence);
+
+            Box traf, tfhd, tfdt, trun;
+            if (!FindChild(m_data, moof, 0, "traf", traf) || !FindChild(m_data, traf, 0, "tfhd", tfhd) ||
+                !FindChild(m_data, traf, 0, "tfdt", tfdt) || !FindChild(m_data, traf, 0, "trun", trun))
+                return Fail("fragment %u lacks a traf with tfhd, tfdt and trun", sequence);
+            if (tfhd.size < 8 || U32(m_data + tfhd.body + 4) != TrackId)
+                return Fail("fragment %u is not for track %u", sequence, TrackId);
+            if ((U32(m_data + tfhd.body) & DefaultBaseIsMoof) == 0)
+                return Fail("fragment %u data offsets are not relative to the moof", sequence);
+
+            bool longTime = tfdt.size >= 4 && m_data[tfdt.body] == 1;
+            if (tfdt.size < (longTime ? 12u : 8u))
+                return Fail("fragment %u tfdt is truncated", sequence);
+            uint64_t baseTime = longTime ? U64(m_data + tfdt.body + 4) : U32(m_data + tfdt.body + 4);
+            if (baseTime != m_result.duration)
+                return Fail("fragment %u starts at %llu, the one before ended at %llu", sequence,
+                    static_cast<unsigned long long>(baseTime), static_cast<unsigned long long>(m_result.duration));
+
+            if (trun.size < 8)
+                return Fail("fragment %u trun is truncated", sequence);
+            uint32_t flags = U32(m_data + trun.body) & 0xFFFFFF;
+            uint32_t count = U32(m_data + trun.body + 4);
+            if ((flags & (DataOffsetPresent | SampleDurationPresent | SampleSizePresent)) != (DataOffsetPresent | SampleDurationPresent | SampleSizePresent))
+                return Fail("fragment %u trun flags 0x%06x lack the data offset, durations or sizes", sequence, flags);
+            if (count == 0)
+                return Fail("fragment %u is empty", sequence);
+
+            size_t position = trun.body + 8;
+            size_t fixed = 4 + ((flags & FirstSampleFlagsPresent) != 0 ? 4 : 0);
+            size_t perSample = 4 * ((flags & SampleDurationPresent ? 1 : 0) + (flags & SampleSizePresent ? 1 : 0) +
+                (flags & SampleFlagsPresent ? 1 : 0) + (flags & SampleCompositionOffsetPresent ? 1 : 0));
+            if (trun.End() - position < fixed + perSample * count)
+                return Fail("fragment %u trun is too short for %u samples", sequence, count);
+
+            uint32_t dataOffset = U32(m_data + position);
+            position += 4;
+            if (moof.offset + dataOffset != mdat.body)
+                return Fail("fragment %u data offset %u does not point at its mdat", sequence, dataOffset);
+            uint32_t firstFlags = 0;
+            if ((flags & FirstSampleFlagsPresent) != 0)
+            {
+                firstFlags = U32(m_data + position);
+                position += 4;
+            }
+
+            size_t sample = mdat.body;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t duration = U32(m_data + position);
+                uint32_t size = U32(m_data + position + 4);
+                position += 8;
+                // Without flags the trex default, sync, applies.
+                uint32_t sampleFlags = 0;
+                if ((flags & SampleFlagsPresent) != 0)
+                {
+                    sampleFlags = U32(m_data + position);
+                    position += 4;
+                }
+                if (i == 0 && (flags & FirstSampleFlagsPresent) != 0)
+                    sampleFlags = firstFlags;
+                if ((flags & SampleCompositionOffsetPresent) != 0)
+                    position += 4;
+
+                if (size > mdat.End() - sample)
+                    return Fail("fragment %u sample %u runs past the mdat", sequence, i);
+                bool sync = (sampleFlags & SampleIsNonSync) == 0;
+                bool idr = false;
+                if (!CheckSample(sample, size, idr))
+                    return Fail("fragment %u sample %u: %s", sequence, i, m_result.error.c_str());
+                if (sync != idr)
+                    return Fail("fragment %u sample %u is marked %s but %s an IDR", sequence, i, sync ? "sync" : "non-sync", idr ? "holds" : "lacks");
+                if (m_result.samples == 0 && !sync)
+                    return Fail("the first sample is not a sync sample");
+
+                if (i == 0 && sync)
+                    m_keyFragments.push_back({ m_result.duration, moof.offset });
+                sample += size;
+                m_result.duration += duration;
+                m_result.samples++;
+                m_result.keyFrames += sync ? 1 : 0;
+            }
+            if (sample != mdat.End())
+                return Fail("fragment %u samples cover %zu of %zu mdat bytes", sequence, sample - mdat.body, mdat.size);
+
+            m_result.fragments++;
+            return true;
+        }
+
+        // Walks the length-prefixed NAL units of a sample.
+        bool CheckSample(size_t offset, size_t size, bool& idr)
+        {
+            size_t end = offset + size;
+            if (offset == end)
+            {
+                m_result.error = "empty sample";
+                return false;
+            }
+            while (offset < end)
+            {
+                uint32_t length = end - offset >= 4 ? U32(m_data + offset) : 0;
+                if (length == 0 || length > end - offset - 4)
+                {
+                    m_result.error = "NAL length overruns the sample";
+                    return false;
+                }
+                uint8_t header = m_data[offset + 4];
+                if ((header & 0x80) != 0)
+                {
+                    m_result.error = "NAL forbidden bit set";
+                    return false;
+                }
+                idr |= (header & 0x1F) == NalIdr;
+                offset += 4 + length;
+            }
+            return true;
+        }
+
+        bool CheckIndex(const Box& mfra)
+        {
+            Box tfra, mfro;
+            if (!FindChild(m_data, mfra, 0, "tfra", tfra) || !FindChild(m_data, mfra, 0, "mfro", mfro))
+                return Fail("mfra lacks tfra or mfro");
+            if (mfro.size < 8 || U32(m_data + mfro.body + 4) != mfra.End() - mfra.offset || mfro.End() != mfra.End())
+                return Fail("mfro does not close an mfra of %zu bytes", mfra.End() - mfra.offset);
+
+            if (tfra.size < 16 || U32(m_data + tfra.body + 4) != TrackId)
+                return Fail("tfra is not for track %u", TrackId);
+            bool longTimes = m_data[tfra.body] == 1;
+            uint32_t lengths = U32(m_data + tfra.body + 8);
+            uint32_t count = U32(m_data + tfra.body + 12);
+            size_t entrySize = (longTimes ? 16 : 8) + ((lengths >> 4) & 3) + 1 + ((lengths >> 2) & 3) + 1 + (lengths & 3) + 1;
+            if (tfra.size - 16 < entrySize * count)
+                return Fail("tfra is too short for %u entries", count);
+            if (count != m_keyFragments.size())
+                return Fail("tfra has %u entries for %zu fragments that start with a key frame", count, m_keyFragments.size());
+
+            const uint8_t* entry = m_data + tfra.body + 16;
+            for (uint32_t i = 0; i < count; i++, entry += entrySize)
+            {
+                uint64_t time = longTimes ? U64(entry) : U32(entry);
+                uint64_t moofOffset = longTimes ? U64(entry + 8) : U32(entry + 4);
+                if (time != m_keyFragments[i].time || moofOffset != m_keyFragments[i].moofOffset)
+                {
+                    return Fail("tfra entry %u is %llu at %llu, expected %llu at %llu", i, static_cast<unsigned long long>(time),
+                        static_cast<unsigned long long>(moofOffset), static_cast<unsigned long long>(m_keyFragments[i].time),
+                        static_cast<unsigned long long>(m_keyFragments[i].moofOffset));
+                }
+            }
+            m_result.indexEntries = count;
+            return true;
+        }
+
+        struct KeyFragment
+        {
+            uint64_t time;
+            uint64_t moofOffset;
+        };
+
+        const uint8_t* m_data;
+        size_t m_size;
+        FragmentedMp4Verifier::Result& m_result;
+        std::vector<KeyFragment> m_keyFragments;
+    };
+}
+
+bool FragmentedMp4Verifier::Verify(const uint8_t* data, size_t size, Result& result)
+{
+    result = Result();
+    return Checker(data, size, result).Run();
+}
+
+bool FragmentedMp4Verifier::VerifyFile(const std::string& path, Result& result)
+{
+    result = Result();
+    FILE* file = std::fopen(path.c_str(), "rb");
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t read;
+    while (file != nullptr && (read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    if (file != nullptr)
+        std::fclose(file);
+    if (data.empty())
+    {
+        result.error = "could not read " + path;
+        return false;
+    }
+    return Verify(data.data(), data.size(), result);
+}
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Re-parses a fragmented MP4 as FragmentedMp4Muxer writes it and checks
+// what a player relies on: boxes that tile the file, consecutive fragment
+// sequence numbers, decode times that carry on from one fragment to the
+// next, trun data offsets and sample sizes that cover the mdat exactly,
+// length-prefixed NAL units in every sample, sync samples that hold an IDR,
+// and a tfra entry, with the right time and moof offset, for every
+// fragment that starts with one.
+class FragmentedMp4Verifier
+{
+public:
+    struct Result
+    {
+        uint32_t fragments = 0;
+        uint64_t samples = 0;
+        uint64_t keyFrames = 0;
+        uint32_t indexEntries = 0;
+        // Track time covered, in 90 kHz units.
+        uint64_t duration = 0;
+        // First problem found; empty when the file checks out.
+        std::string error;
+    };
+
+    // A file without the index Finish writes is incomplete and fails.
+    static bool Verify(const uint8_t* data, size_t size, Result& result);
+    static bool VerifyFile(const std::string& path, Result& result);
+};
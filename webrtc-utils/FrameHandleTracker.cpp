@@ -0,0 +1,148 @@
+﻿#include "FrameHandleTracker.h"
+
+FrameHandleTracker::Loan::Loan(FrameHandleTracker& tracker, EncodedFrame* frame, const void* owner)
+    : m_tracker(tracker), m_handle(nullptr)
+{
+    if (frame == nullptr)
+        return;
+
+    EncodedFrameRef::AddRef(frame);
+    m_handle = tracker.Insert(EncodedFrameRef::FromDetached(frame), owner, 0, true);
+}
+
+FrameHandleTracker::Loan::~Loan()
+{
+    if (m_handle != nullptr)
+        m_tracker.EndLoan(m_handle);
+}
+
+void* FrameHandleTracker::Insert(EncodedFrameRef frame, const void* owner, uint32_t acquired, bool lent)
+{
+    std::lock_guard lock(m_mutex);
+    uintptr_t handle = m_nextHandle++;
+    // Skips zero when the counter wraps on 32-bit targets.
+    if (m_nextHandle == 0)
+        m_nextHandle = 1;
+    Entry& entry = m_handles[handle];
+    entry.frame = std::move(frame);
+    entry.owner = owner;
+    entry.acquired = acquired;
+    entry.lent = lent;
+    m_outstanding += acquired;
+    m_acquired += acquired;
+    return reinterpret_cast<void*>(handle);
+}
+
+void FrameHandleTracker::EndLoan(void* handle)
+{
+    EncodedFrameRef frame;
+    std::lock_guard lock(m_mutex);
+    auto it = m_handles.find(reinterpret_cast<uintptr_t>(handle));
+    if (it == m_handles.end())
+        return;
+
+    it->second.lent = false;
+    if (it->second.acquired == 0)
+    {
+        frame = std::move(it->second.frame);
+        m_handles.erase(it);
+    }
+}
+
+bool FrameHandleTracker::Acquire(void* handle)
+{
+    std::lock_guard lock(m_mutex);
+    auto it = m_handles.find(reinterpret_cast<uintptr_t>(handle));
+    if (it == m_handles.end())
+    {
+        m_rejected++;
+        return false;
+    }
+
+    it->second.acquired++;
+    m_outstanding++;
+    m_acquired++;
+    return true;
+}
+
+void* FrameHandleTracker::Adopt(EncodedFrameRef frame, const void* owner)
+{
+    if (!frame)
+        return nullptr;
+    return Insert(std::move(frame), owner, 1, false);
+}
+
+bool FrameHandleTracker::Release(void* handle)
+{
+    // The frame goes back to its arena after the lock is dropped.
+    EncodedFrameRef frame;
+    std::lock_guard lock(m_mutex);
+    auto it = m_handles.find(reinterpret_cast<uintptr_t>(handle));
+    if (it == m_handles.end() || it->second.acquired == 0)
+    {
+        m_rejected++;
+        return false;
+    }
+
+    m_outstanding--;
+    if (--it->second.acquired == 0 && !it->second.lent)
+    {
+        frame = std::move(it->second.frame);
+        m_handles.erase(it);
+    }
+    return true;
+}
+
+EncodedFrameRef FrameHandleTracker::Find(void* handle) const
+{
+    std::lock_guard lock(m_mutex);
+    auto it = m_handles.find(reinterpret_cast<uintptr_t>(handle));
+    return it != m_handles.end() ? it->second.frame : EncodedFrameRef();
+}
+
+uint32_t FrameHandleTracker::ReleaseAll(const void* owner)
+{
+    std::unordered_map<uintptr_t, Entry> released;
+    uint32_t count = 0;
+    {
+        std::lock_guard lock(m_mutex);
+        for (auto it = m_handles.begin(); it != m_handles.end();)
+        {
+            if (it->second.owner != owner || it->second.acquired == 0)
+            {
+                ++it;
+                continue;
+            }
+            count += it->second.acquired;
+            // A frame still on loan to a running callback stays findable
+            // until the loan ends.
+            if (it->second.lent)
+            {
+                it->second.acquired = 0;
+                ++it;
+                continue;
+            }
+            released.insert(m_handles.extract(it++));
+        }
+        m_outstanding -= count;
+    }
+    return count;
+}
+
+uint32_t FrameHandleTracker::Outstanding() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_outstanding;
+}
+
+uint64_t FrameHandleTracker::Acquired() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_acquired;
+}
+
+uint64_t FrameHandleTracker::Rejected() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_rejected;
+}
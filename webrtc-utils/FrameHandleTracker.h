@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "EncodedFrame.h"
+
+// Bookkeeping for encoded frames lent across the C ABI. A handle is an
+// opaque token, never the frame pointer, and tokens are not reused: a
+// handle is valid while the callback that lent it runs, and each Acquire
+// keeps the frame alive until the matching Release. Null, made-up, stale
+// and double-released handles are refused and counted instead of touching
+// a frame.
+//
+// Every handle carries an owner, the session it came from, so that a
+// session's handles can be released in one go when it shuts down.
+class FrameHandleTracker
+{
+public:
+    // Lends a frame to callbacks for as long as the loan lives. Handles
+    // acquired from it outlive the loan.
+    class Loan
+    {
+    public:
+        Loan(FrameHandleTracker& tracker, EncodedFrame* frame, const void* owner);
+        ~Loan();
+        Loan(const Loan&) = delete;
+        Loan& operator=(const Loan&) = delete;
+
+        void* Handle() const { return m_handle; }
+
+    private:
+        FrameHandleTracker& m_tracker;
+        void* m_handle;
+    };
+
+    // False, and nothing happens, for a handle that is neither lent nor
+    // acquired.
+    bool Acquire(void* handle);
+    // False for a handle that is not acquired, including one already
+    // released as often as it was acquired.
+    bool Release(void* handle);
+    // Turns a reference the caller owns into an acquired handle.
+    void* Adopt(EncodedFrameRef frame, const void* owner);
+    // The frame behind a lent or acquired handle; empty for any other.
+    EncodedFrameRef Find(void* handle) const;
+    // Releases every acquisition of the owner's handles, as the app would
+    // have; later calls with those handles are refused. Returns how many
+    // acquisitions were released.
+    uint32_t ReleaseAll(const void* owner);
+
+    // Acquisitions not yet released.
+    uint32_t Outstanding() const;
+    uint64_t Acquired() const;
+    // Acquire and Release calls refused for a handle that wasn't valid.
+    uint64_t Rejected() const;
+
+private:
+    struct Entry
+    {
+        EncodedFrameRef frame;
+        const void* owner = nullptr;
+        uint32_t acquired = 0;
+        bool lent = false;
+    };
+
+    void* Insert(EncodedFrameRef frame, const void* owner, uint32_t acquired, bool lent);
+    void EndLoan(void* handle);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<uintptr_t, Entry> m_handles;
+    uintptr_t m_nextHandle = 1;
+    uint32_t m_outstanding = 0;
+    uint64_t m_acquired = 0;
+    uint64_t m_rejected = 0;
+};
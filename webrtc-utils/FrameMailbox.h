@@ -0,0 +1,176 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+enum class DropPolicy
+{
+    // Keep up to capacity items; when full the oldest queued item is dropped.
+    DropOldest,
+    // Capacity is forced to one; every post replaces what is queued.
+    LatestOnly,
+};
+
+// Bounded single-producer/single-consumer mailbox. Items travel in nodes
+// handed over through atomic slots, so neither side ever blocks. When the
+// mailbox is full the producer evicts the oldest item itself; head is a
+// monotonic counter advanced by CAS from both sides, which keeps the consumer
+// from returning an item the producer already evicted.
+//
+// Nodes are allocated once, with the mailbox: one per slot, one for the
+// producer to fill and one for a taker to empty. Whoever takes an item puts
+// its node back on a free list that only the producer pops from, so that
+// list needs no ABA tag.
+template <typename T>
+class FrameMailbox
+{
+public:
+    FrameMailbox(uint32_t capacity, DropPolicy policy)
+        : m_capacity(policy == DropPolicy::LatestOnly || capacity == 0 ? 1 : capacity), m_slots(m_capacity), m_nodes(m_capacity + 2)
+    {
+        for (Node& node : m_nodes)
+            PushFree(&node);
+    }
+
+    FrameMailbox(const FrameMailbox&) = delete;
+    FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+    ~FrameMailbox()
+    {
+        T item;
+        while (Take(item))
+        {
+        }
+    }
+
+    // Producer side. Returns false when an older item was evicted to make
+    // room; the evicted item is destroyed on the calling thread.
+    bool Post(T item)
+    {
+        bool dropped = false;
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        while (tail - m_head.load(std::memory_order_acquire) >= m_capacity)
+        {
+            T evicted;
+            if (Take(evicted))
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                dropped = true;
+            }
+        }
+
+        Node* node = PopFree();
+        node->item = std::move(item);
+        m_slots[tail % m_capacity].store(node, std::memory_order_relaxed);
+        m_tail.store(tail + 1, std::memory_order_release);
+        m_posted.fetch_add(1, std::memory_order_relaxed);
+        return !dropped;
+    }
+
+    // Consumer side. Returns false when empty.
+    bool Take(T& item)
+    {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        while (true)
+        {
+            if (head == m_tail.load(std::memory_order_acquire))
+                return false;
+
+            Node* node = m_slots[head % m_capacity].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                item = std::move(node->item);
+                PushFree(node);
+                return true;
+            }
+        }
+    }
+
+    uint32_t Depth() const
+    {
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        return tail > head ? static_cast<uint32_t>(tail - head) : 0;
+    }
+
+    uint32_t Capacity() const { return m_capacity; }
+    uint64_t Posted() const { return m_posted.load(std::memory_order_relaxed); }
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Node
+    {
+        T item;
+        std::atomic<Node*> next{ nullptr };
+    };
+
+    // Any thread that took an item.
+    void PushFree(Node* node)
+    {
+        Node* head = m_free.load(std::memory_order_relaxed);
+        do
+        {
+            node->next.store(head, std::memory_order_relaxed);
+        } while (!m_free.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // Producer only. A node can't be popped and pushed back under the one
+    // popper, so the head's next is stable while it is read. Never empty:
+    // no more nodes are out than the producer and one taker hold.
+    Node* PopFree()
+    {
+        Node* head = m_free.load(std::memory_order_acquire);
+        while (!m_free.compare_exchange_weak(head, head->next.load(std::memory_order_relaxed), std::memory_order_acquire, std::memory_order_acquire))
+        {
+        }
+        return head;
+    }
+
+    const uint32_t m_capacity;
+    std::vector<std::atomic<Node*>> m_slots;
+    std::vector<Node> m_nodes;
+    std::atomic<Node*> m_free{ nullptr };
+    alignas(64) std::atomic<uint64_t> m_head{ 0 };
+    alignas(64) std::atomic<uint64_t> m_tail{ 0 };
+    std::atomic<uint64_t> m_posted{ 0 };
+    std::atomic<uint64_t> m_dropped{ 0 };
+};
+
+// Wakes a sleeping consumer. Signalling only takes the lock when the
+// consumer announced it is about to sleep, so the producer stays lock-free in
+// the common case.
+class WakeEvent
+{
+public:
+    void Signal()
+    {
+        m_signalled.store(true);
+        if (m_sleeping.load())
+        {
+            std::lock_guard lock(m_mutex);
+            m_condition.notify_one();
+        }
+    }
+
+    template <typename Predicate>
+    void Wait(Predicate ready)
+    {
+        if (m_signalled.exchange(false) || ready())
+            return;
+
+        std::unique_lock lock(m_mutex);
+        m_sleeping.store(true);
+        m_condition.wait(lock, [&]() { return m_signalled.exchange(false) || ready(); });
+        m_sleeping.store(false);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::atomic<bool> m_signalled{ false };
+    std::atomic<bool> m_sleeping{ false };
+};
@@ -0,0 +1,217 @@
+﻿#include "FrameSource.h"
+
+#include "CaptureClock.h"
+
+FrameBufferSet::FrameBufferSet(uint32_t count, size_t size)
+    : m_buffers(count, std::vector<uint8_t>(size)), m_lent(count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        m_free.push_back(i);
+}
+
+BorrowedFrame FrameBufferSet::Acquire(FrameFormat format, uint32_t width, uint32_t height, bool wait)
+{
+    uint32_t index;
+    if (!Take(wait, index))
+        return BorrowedFrame();
+
+    FrameView view = FrameView::Packed(format, m_buffers[index].data(), width, height);
+    if (!view || FrameView::PackedSize(format, width, height) > m_buffers[index].size())
+    {
+        Release(index);
+        return BorrowedFrame();
+    }
+    return BorrowedFrame(view, [set = shared_from_this(), index]() { set->Release(index); });
+}
+
+BorrowedFrame FrameBufferSet::Lend(const FrameView& view, BorrowedFrame::ReleaseHook release, bool wait)
+{
+    uint32_t index;
+    if (!view || !Take(wait, index))
+        return BorrowedFrame();
+    // Kept with the place rather than in the frame's hook, which only has
+    // room for the set and the index.
+    m_lent[index] = std::move(release);
+    return BorrowedFrame(view, [set = shared_from_this(), index]() { set->Release(index); });
+}
+
+void FrameBufferSet::Interrupt()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_interrupted = true;
+    }
+    m_freed.notify_all();
+}
+
+void FrameBufferSet::Resume()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_interrupted = false;
+}
+
+bool FrameBufferSet::Take(bool wait, uint32_t& index)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (wait)
+        m_freed.wait(lock, [this]() { return !m_free.empty() || m_interrupted; });
+    if (m_free.empty() || m_interrupted)
+        return false;
+    index = m_free.back();
+    m_free.pop_back();
+    return true;
+}
+
+void FrameBufferSet::Release(uint32_t index)
+{
+    // Only the frame holding the place touches its hook.
+    if (m_lent[index])
+    {
+        BorrowedFrame::ReleaseHook release = std::move(m_lent[index]);
+        release();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(index);
+    }
+    m_freed.notify_all();
+}
+
+PacedFrameSource::PacedFrameSource(bool realtime, uint32_t bufferCount)
+    : m_realtime(realtime), m_bufferCount(bufferCount > 0 ? bufferCount : 1), m_buffers(std::make_shared<FrameBufferSet>(m_bufferCount, 0)),
+      m_inFlight(std::make_shared<InFlight>())
+{
+    // Frames from the buffer set can't outnumber its buffers.
+    m_inFlight->held.reserve(m_bufferCount);
+    m_inFlight->free.reserve(m_bufferCount);
+}
+
+PacedFrameSource::~PacedFrameSource()
+{
+    Stop();
+}
+
+bool PacedFrameSource::Start(FrameHandler handler)
+{
+    if (Running() || handler == nullptr || Format().frameRate == 0)
+        return false;
+    m_handler = std::move(handler);
+    m_stopping = false;
+    m_buffers->Resume();
+    {
+        std::lock_guard<std::mutex> lock(m_doneMutex);
+        m_done = false;
+    }
+    m_thread = std::thread([this]() { Run(); });
+    return true;
+}
+
+void PacedFrameSource::Stop()
+{
+    if (!m_thread.joinable())
+        return;
+    m_stopping = true;
+    m_buffers->Interrupt();
+    m_thread.join();
+    m_handler = nullptr;
+}
+
+void PacedFrameSource::WaitUntilDone()
+{
+    std::unique_lock<std::mutex> lock(m_doneMutex);
+    m_doneChanged.wait(lock, [this]() { return m_done; });
+}
+
+void PacedFrameSource::WaitFramesReleased()
+{
+    std::unique_lock<std::mutex> lock(m_inFlight->mutex);
+    m_inFlight->released.wait(lock, [this]() { return m_inFlight->count == 0; });
+}
+
+PacedFrameSource::Stats PacedFrameSource::GetStats() const
+{
+    Stats stats;
+    stats.framesProduced = m_framesProduced.load(std::memory_order_relaxed);
+    stats.framesDropped = m_framesDropped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void PacedFrameSource::ResizeBuffers(size_t size)
+{
+    // Frames still out keep the old set alive through their hooks.
+    m_buffers = std::make_shared<FrameBufferSet>(m_bufferCount, size);
+}
+
+void PacedFrameSource::Run()
+{
+    const uint32_t frameRate = Format().frameRate;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint64_t index = 0; !m_stopping; index++)
+    {
+        int64_t captureTime = static_cast<int64_t>(index * CaptureClock::TicksPerSecond / frameRate);
+        if (m_realtime)
+            std::this_thread::sleep_until(start + std::chrono::microseconds(captureTime / 10));
+
+        BorrowedFrame frame;
+        if (!NextFrame(index, frame) || m_stopping)
+            break;
+        if (!frame)
+        {
+            m_framesDropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        frame.SetTimestamp(captureTime);
+        frame.SetArrivalTime(std::chrono::steady_clock::now());
+        m_framesProduced.fetch_add(1, std::memory_order_relaxed);
+        m_handler(Track(std::move(frame)));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_doneMutex);
+        m_done = true;
+    }
+    m_doneChanged.notify_all();
+}
+
+BorrowedFrame PacedFrameSource::Track(BorrowedFrame frame)
+{
+    // The frame is parked in a slot; the hook releases it and then counts it.
+    FrameView view = frame.View();
+    std::chrono::steady_clock::time_point arrival = frame.ArrivalTime();
+    uint32_t slot;
+    {
+        std::lock_guard<std::mutex> lock(m_inFlight->mutex);
+        m_inFlight->count++;
+        if (!m_inFlight->free.empty())
+        {
+            slot = m_inFlight->free.back();
+            m_inFlight->free.pop_back();
+            m_inFlight->held[slot] = std::move(frame);
+        }
+        else
+        {
+            slot = static_cast<uint32_t>(m_inFlight->held.size());
+            m_inFlight->held.push_back(std::move(frame));
+            m_inFlight->free.reserve(m_inFlight->held.size());
+        }
+    }
+    BorrowedFrame tracked(view,
+        [inFlight = m_inFlight, slot]()
+        {
+            BorrowedFrame held;
+            {
+                std::lock_guard<std::mutex> lock(inFlight->mutex);
+                held = std::move(inFlight->held[slot]);
+                inFlight->free.push_back(slot);
+            }
+            held.Release();
+            {
+                std::lock_guard<std::mutex> lock(inFlight->mutex);
+                inFlight->count--;
+            }
+            inFlight->released.notify_all();
+        });
+    tracked.SetArrivalTime(arrival);
+    return tracked;
+}
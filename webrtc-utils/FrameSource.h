@@ -0,0 +1,156 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BorrowedFrame.h"
+
+struct FrameSourceFormat
+{
+    FrameFormat format = FrameFormat::Nv12;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t frameRate = 0;
+};
+
+// Anything that produces raw frames for the encode path: a camera, a file,
+// a generator. Frames are pushed to the handler on the source's own thread,
+// one at a time.
+class IFrameSource
+{
+public:
+    // The frame's timestamp is its capture time on the source's clock in
+    // 100 ns ticks, and its arrival time when the source produced it. It
+    // holds on to the source's buffer until released, so a consumer that
+    // keeps frames makes the source wait or drop. An empty frame stands
+    // for one that arrived but could not be read.
+    using FrameHandler = std::function<void(BorrowedFrame frame)>;
+
+    virtual ~IFrameSource() = default;
+
+    // Switches to the format closest to requested that the source offers;
+    // fields left zero are up to the source. Fails, keeping the current
+    // format, when nothing matches the size. negotiated is what the source
+    // produces afterwards either way. Sources that cannot switch while
+    // running fail then, unless nothing changes.
+    virtual bool Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated) = 0;
+
+    virtual bool Start(FrameHandler handler) = 0;
+    // Once it returns the handler is not called again.
+    virtual void Stop() = 0;
+};
+
+// A fixed set of equal frame buffers for sources that fill their own. The
+// set is shared with the release hooks, so frames may outlive the source.
+class FrameBufferSet : public std::enable_shared_from_this<FrameBufferSet>
+{
+public:
+    FrameBufferSet(uint32_t count, size_t size);
+
+    // Waits for a free buffer when asked to; returns an empty frame when
+    // none is free or Interrupt was called. The view is packed NV12 or
+    // I420 of the given size.
+    BorrowedFrame Acquire(FrameFormat format, uint32_t width, uint32_t height, bool wait);
+    // Takes a buffer's place for a frame whose memory lives elsewhere, such
+    // as a file mapping, so such frames are held to the same count. The
+    // hook runs before the place is given back.
+    BorrowedFrame Lend(const FrameView& view, BorrowedFrame::ReleaseHook release, bool wait);
+
+    // Wakes and fails waiting acquires until Resume.
+    void Interrupt();
+    void Resume();
+
+private:
+    bool Take(bool wait, uint32_t& index);
+    void Release(uint32_t index);
+
+    std::vector<std::vector<uint8_t>> m_buffers;
+    // Hooks of the frames Lend handed out, by place.
+    std::vector<BorrowedFrame::ReleaseHook> m_lent;
+    std::vector<uint32_t> m_free;
+    bool m_interrupted = false;
+    std::mutex m_mutex;
+    std::condition_variable m_freed;
+};
+
+// Runs a source that makes its frames itself, on a thread of its own. Frames
+// go out either as fast as the consumer takes them back, which is the
+// backpressure of an offline benchmark, or paced at the frame rate and
+// dropped when no buffer is free, the way a camera behaves. Timestamps are
+// the frame index at the frame rate, so the same source gives the same
+// frames with the same times on every run.
+//
+// Derived classes call Stop in their destructor, before the members
+// NextFrame uses are gone.
+class PacedFrameSource : public IFrameSource
+{
+public:
+    struct Stats
+    {
+        uint64_t framesProduced;
+        // Realtime only: frames skipped because every buffer was in use.
+        uint64_t framesDropped;
+    };
+
+    ~PacedFrameSource() override;
+
+    bool Start(FrameHandler handler) override;
+    void Stop() override;
+
+    // Returns once the source has run out of frames or was stopped.
+    void WaitUntilDone();
+    // Returns once every frame handed out has been released.
+    void WaitFramesReleased();
+    Stats GetStats() const;
+
+protected:
+    PacedFrameSource(bool realtime, uint32_t bufferCount);
+
+    // Source thread. Renders frame index into a buffer from Buffers(), or
+    // leaves frame empty when none is free; false ends the stream.
+    virtual bool NextFrame(uint64_t index, BorrowedFrame& frame) = 0;
+    virtual FrameSourceFormat Format() const = 0;
+
+    bool Realtime() const { return m_realtime; }
+    uint32_t BufferCount() const { return m_bufferCount; }
+    FrameBufferSet& Buffers() { return *m_buffers; }
+    // For Negotiate, which may only resize buffers while stopped.
+    bool Running() const { return m_thread.joinable(); }
+    void ResizeBuffers(size_t size);
+
+private:
+    // Shared with the release hooks of frames handed out. The frames a
+    // subclass produced are parked in slots that are reused, so tracking
+    // stops allocating once the pipeline's depth has been reached.
+    struct InFlight
+    {
+        std::mutex mutex;
+        std::condition_variable released;
+        uint32_t count = 0;
+        std::vector<BorrowedFrame> held;
+        std::vector<uint32_t> free;
+    };
+
+    void Run();
+    BorrowedFrame Track(BorrowedFrame frame);
+
+    const bool m_realtime;
+    const uint32_t m_bufferCount;
+    std::shared_ptr<FrameBufferSet> m_buffers;
+    std::shared_ptr<InFlight> m_inFlight;
+    FrameHandler m_handler;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{ false };
+    std::mutex m_doneMutex;
+    std::condition_variable m_doneChanged;
+    bool m_done = true;
+    std::atomic<uint64_t> m_framesProduced{ 0 };
+    std::atomic<uint64_t> m_framesDropped{ 0 };
+};
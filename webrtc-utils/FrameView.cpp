@@ -0,0 +1,163 @@
+﻿#include "FrameView.h"
+
+#include <cstring>
+
+static bool IsSubsampled(FrameFormat format)
+{
+    return format != FrameFormat::Bgra8;
+}
+
+uint32_t FrameView::PlaneCount(FrameFormat format)
+{
+    switch (format)
+    {
+    case FrameFormat::Nv12:
+        return 2;
+    case FrameFormat::I420:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+uint32_t FrameView::PlaneRows(uint32_t plane) const
+{
+    return plane > 0 ? (height + 1) / 2 : height;
+}
+
+uint32_t FrameView::PlaneRowBytes(uint32_t plane) const
+{
+    switch (format)
+    {
+    case FrameFormat::Nv12:
+        return plane > 0 ? (width + 1) / 2 * 2 : width;
+    case FrameFormat::I420:
+        return plane > 0 ? (width + 1) / 2 : width;
+    case FrameFormat::Yuy2:
+        return (width + 1) / 2 * 4;
+    default:
+        return width * 4;
+    }
+}
+
+size_t FrameView::PackedSize(FrameFormat format, uint32_t width, uint32_t height)
+{
+    FrameView view;
+    view.format = format;
+    view.width = width;
+    view.height = height;
+    size_t size = 0;
+    for (uint32_t plane = 0; plane < view.PlaneCount(); plane++)
+        size += static_cast<size_t>(view.PlaneRowBytes(plane)) * view.PlaneRows(plane);
+    return size;
+}
+
+FrameView FrameView::Packed(FrameFormat format, uint8_t* buffer, uint32_t width, uint32_t height)
+{
+    FrameView view;
+    view.format = format;
+    view.width = width;
+    view.height = height;
+    uint32_t offset = 0;
+    for (uint32_t plane = 0; plane < view.PlaneCount(); plane++)
+    {
+        view.planes[plane].data = buffer + offset;
+        view.planes[plane].stride = view.PlaneRowBytes(plane);
+        view.planes[plane].offset = offset;
+        offset += view.PlaneRowBytes(plane) * view.PlaneRows(plane);
+    }
+    return view;
+}
+
+bool FrameView::IsPacked() const
+{
+    const uint8_t* next = planes[0].data;
+    for (uint32_t plane = 0; plane < PlaneCount(); plane++)
+    {
+        if (planes[plane].data != next || planes[plane].stride != PlaneRowBytes(plane))
+            return false;
+        next += static_cast<size_t>(planes[plane].stride) * PlaneRows(plane);
+    }
+    return true;
+}
+
+bool FrameView::FitsIn(size_t bufferSize) const
+{
+    for (uint32_t plane = 0; plane < PlaneCount(); plane++)
+    {
+        uint32_t rows = PlaneRows(plane);
+        if (planes[plane].data == nullptr || planes[plane].stride < PlaneRowBytes(plane) || rows == 0)
+            return false;
+        size_t end = planes[plane].offset + static_cast<size_t>(planes[plane].stride) * (rows - 1) + PlaneRowBytes(plane);
+        if (end > bufferSize)
+            return false;
+    }
+    return true;
+}
+
+bool FrameView::Crop(const FrameRect& rect, FrameView& cropped) const
+{
+    FrameRect area = rect;
+    if (IsSubsampled(format))
+    {
+        area.width += area.x & 1;
+        area.height += area.y & 1;
+        area.x &= ~1u;
+        area.y &= ~1u;
+        area.width = (area.width + 1) & ~1u;
+        area.height = (area.height + 1) & ~1u;
+    }
+    if (area.width == 0 || area.height == 0 || area.x > width || area.y > height
+        || area.width > width - area.x || area.height > height - area.y)
+        return false;
+
+    cropped = *this;
+    cropped.width = area.width;
+    cropped.height = area.height;
+    for (uint32_t plane = 0; plane < PlaneCount(); plane++)
+    {
+        // Bytes per pixel column and rows skipped, in this plane's units.
+        uint32_t column;
+        uint32_t row = plane > 0 ? area.y / 2 : area.y;
+        switch (format)
+        {
+        case FrameFormat::Nv12:
+            column = area.x;
+            break;
+        case FrameFormat::I420:
+            column = plane > 0 ? area.x / 2 : area.x;
+            break;
+        case FrameFormat::Yuy2:
+            column = area.x * 2;
+            break;
+        default:
+            column = area.x * 4;
+            break;
+        }
+        uint32_t skip = row * planes[plane].stride + column;
+        cropped.planes[plane].data = planes[plane].data + skip;
+        cropped.planes[plane].offset = planes[plane].offset + skip;
+    }
+    return true;
+}
+
+bool CopyFrame(const FrameView& src, const FrameView& dst)
+{
+    if (src.format != dst.format || src.width != dst.width || src.height != dst.height || !src || !dst)
+        return false;
+
+    for (uint32_t plane = 0; plane < src.PlaneCount(); plane++)
+    {
+        uint32_t rowBytes = src.PlaneRowBytes(plane);
+        const uint8_t* from = src.planes[plane].data;
+        uint8_t* to = dst.planes[plane].data;
+        if (src.planes[plane].stride == rowBytes && dst.planes[plane].stride == rowBytes)
+        {
+            std::memcpy(to, from, static_cast<size_t>(rowBytes) * src.PlaneRows(plane));
+            continue;
+        }
+        for (uint32_t row = 0; row < src.PlaneRows(plane); row++)
+            std::memcpy(to + static_cast<size_t>(row) * dst.planes[plane].stride, from + static_cast<size_t>(row) * src.planes[plane].stride, rowBytes);
+    }
+    return true;
+}
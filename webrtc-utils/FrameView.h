@@ -0,0 +1,91 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class FrameFormat
+{
+    // Full-resolution luma plane, then one plane of interleaved U and V.
+    Nv12,
+    // Luma, U and V planes.
+    I420,
+    Yuy2,
+    Bgra8,
+};
+
+enum class ColorMatrix
+{
+    Bt601,
+    Bt709,
+};
+
+enum class ColorRange
+{
+    // 16-235 luma, 16-240 chroma.
+    Limited,
+    Full,
+};
+
+struct ColorSpace
+{
+    ColorMatrix matrix = ColorMatrix::Bt601;
+    ColorRange range = ColorRange::Limited;
+};
+
+struct FramePlane
+{
+    uint8_t* data = nullptr;
+    // Bytes between the starts of two rows; at least the row size.
+    uint32_t stride = 0;
+    // Where data sits in the buffer that holds the frame.
+    uint32_t offset = 0;
+};
+
+struct FrameRect
+{
+    uint32_t x = 0;
+    uint32_t y = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Describes a frame in memory someone else owns: the planes may be padded,
+// start anywhere in their buffer, or be a window into a larger frame.
+// Copying a view never copies pixels.
+struct FrameView
+{
+    static constexpr uint32_t MaxPlanes = 3;
+
+    FrameFormat format = FrameFormat::Nv12;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    FramePlane planes[MaxPlanes];
+    // Capture media time in 100 ns units.
+    int64_t timestamp = 0;
+    ColorSpace color;
+
+    // A tightly packed frame starting at buffer, as the file reader and the
+    // frame pools lay it out.
+    static FrameView Packed(FrameFormat format, uint8_t* buffer, uint32_t width, uint32_t height);
+    static size_t PackedSize(FrameFormat format, uint32_t width, uint32_t height);
+    static uint32_t PlaneCount(FrameFormat format);
+
+    uint32_t PlaneCount() const { return PlaneCount(format); }
+    uint32_t PlaneRows(uint32_t plane) const;
+    uint32_t PlaneRowBytes(uint32_t plane) const;
+    explicit operator bool() const { return planes[0].data != nullptr; }
+
+    // True when the planes follow each other without padding, so the frame
+    // is PackedSize bytes from planes[0].data.
+    bool IsPacked() const;
+    // Checks every plane's rows against the size of the buffer the offsets
+    // refer to.
+    bool FitsIn(size_t bufferSize) const;
+    // A window into this frame, without copying. For subsampled formats
+    // the rectangle is widened to even coordinates and sizes.
+    bool Crop(const FrameRect& rect, FrameView& cropped) const;
+};
+
+// Copies pixels between two views of the same format and size, whatever
+// their strides; the way back to a packed frame for consumers that need one.
+bool CopyFrame(const FrameView& src, const FrameView& dst);
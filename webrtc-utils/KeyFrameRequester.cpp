@@ -0,0 +1,64 @@
+﻿#include "KeyFrameRequester.h"
+
+KeyFrameRequester::KeyFrameRequester(std::chrono::milliseconds minInterval)
+    : m_minInterval(minInterval)
+{
+}
+
+void KeyFrameRequester::Request()
+{
+    m_requests.fetch_add(1, std::memory_order_relaxed);
+    if (m_pending.exchange(true, std::memory_order_acq_rel))
+        m_coalesced.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool KeyFrameRequester::ShouldForce(Clock::time_point now)
+{
+    // A forced IDR is still on its way out of the encoder; anything asked
+    // for meanwhile is answered by it. If it never shows up, force again.
+    if (m_waitingForKeyFrame)
+    {
+        if (now - m_forcedAt < m_minInterval)
+            return false;
+        m_waitingForKeyFrame = false;
+        m_pending.store(true, std::memory_order_relaxed);
+    }
+    if (!m_pending.load(std::memory_order_acquire))
+        return false;
+
+    if (m_hasKeyFrame && now - m_lastKeyFrame < m_minInterval)
+    {
+        if (!m_deferring)
+        {
+            m_deferring = true;
+            m_deferred.fetch_add(1, std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    m_pending.store(false, std::memory_order_relaxed);
+    m_waitingForKeyFrame = true;
+    m_forcedAt = now;
+    m_deferring = false;
+    m_forced.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void KeyFrameRequester::OnKeyFrame(Clock::time_point now)
+{
+    m_pending.store(false, std::memory_order_relaxed);
+    m_waitingForKeyFrame = false;
+    m_deferring = false;
+    m_hasKeyFrame = true;
+    m_lastKeyFrame = now;
+}
+
+KeyFrameRequester::Stats KeyFrameRequester::GetStats() const
+{
+    Stats stats;
+    stats.requests = m_requests.load(std::memory_order_relaxed);
+    stats.coalesced = m_coalesced.load(std::memory_order_relaxed);
+    stats.forced = m_forced.load(std::memory_order_relaxed);
+    stats.deferred = m_deferred.load(std::memory_order_relaxed);
+    return stats;
+}
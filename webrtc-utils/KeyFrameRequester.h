@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Turns receiver keyframe requests (PLI/FIR) into encoder IDRs. Requests
+// may come from any thread and only set a flag, so a burst of them costs one
+// IDR. The encode thread asks once per frame whether to force one; forced
+// IDRs are spaced at least minInterval apart, and a keyframe the encoder
+// produced on its own also satisfies whatever was pending.
+class KeyFrameRequester
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        uint64_t requests;
+        uint64_t coalesced;
+        uint64_t forced;
+        uint64_t deferred;
+    };
+
+    explicit KeyFrameRequester(std::chrono::milliseconds minInterval = std::chrono::milliseconds(500));
+
+    void Request();
+
+    // Encode thread only. True when the next frame must be an IDR.
+    bool ShouldForce(Clock::time_point now);
+    // Encode thread only. Called for every keyframe that came out of the
+    // encoder, forced or not.
+    void OnKeyFrame(Clock::time_point now);
+
+    Stats GetStats() const;
+
+private:
+    const Clock::duration m_minInterval;
+    std::atomic<bool> m_pending{ false };
+    bool m_waitingForKeyFrame = false;
+    bool m_deferring = false;
+    bool m_hasKeyFrame = false;
+    Clock::time_point m_lastKeyFrame;
+    Clock::time_point m_forcedAt;
+    std::atomic<uint64_t> m_requests{ 0 };
+    std::atomic<uint64_t> m_coalesced{ 0 };
+    std::atomic<uint64_t> m_forced{ 0 };
+    std::atomic<uint64_t> m_deferred{ 0 };
+};
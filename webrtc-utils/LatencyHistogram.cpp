@@ -0,0 +1,75 @@
+﻿#include "LatencyHistogram.h"
+
+static uint32_t HighestBit(uint64_t value)
+{
+    uint32_t bit = 0;
+    while (value >>= 1)
+        bit++;
+    return bit;
+}
+
+uint32_t LatencyHistogram::IndexOf(uint64_t value)
+{
+    if (value >= (uint64_t(1) << 32))
+        value = (uint64_t(1) << 32) - 1;
+    if (value < (uint64_t(1) << SubBucketBits))
+        return static_cast<uint32_t>(value);
+
+    // Keep the top SubBucketBits bits; the shift picks the bucket and the
+    // remaining top bits (always in the upper half) the sub-bucket.
+    uint32_t shift = HighestBit(value) - (SubBucketBits - 1);
+    return shift * SubBucketHalf + static_cast<uint32_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::ValueAt(uint32_t index)
+{
+    if (index < (1u << SubBucketBits))
+        return index;
+
+    uint32_t shift = index / SubBucketHalf - 1;
+    uint64_t subBucket = index - shift * SubBucketHalf;
+    // Middle of the bucket's range.
+    return (subBucket << shift) + ((uint64_t(1) << shift) >> 1);
+}
+
+void LatencyHistogram::Record(uint64_t microseconds)
+{
+    m_counts[IndexOf(microseconds)].fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (microseconds > max && !m_max.compare_exchange_weak(max, microseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+LatencyHistogram::Percentiles LatencyHistogram::GetPercentiles() const
+{
+    uint64_t counts[BucketCount];
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BucketCount; i++)
+    {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+
+    Percentiles percentiles = {};
+    percentiles.count = total;
+    percentiles.max = m_max.load(std::memory_order_relaxed);
+    if (total == 0)
+        return percentiles;
+
+    const uint64_t targets[] = { (total * 50 + 99) / 100, (total * 95 + 99) / 100, (total * 99 + 99) / 100 };
+    uint64_t* results[] = { &percentiles.p50, &percentiles.p95, &percentiles.p99 };
+    uint64_t seen = 0;
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < BucketCount && next < 3; i++)
+    {
+        seen += counts[i];
+        while (next < 3 && seen >= targets[next])
+        {
+            uint64_t value = ValueAt(i);
+            *results[next++] = value < percentiles.max ? value : percentiles.max;
+        }
+    }
+    return percentiles;
+}
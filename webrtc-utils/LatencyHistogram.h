@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// HDR-style histogram of microsecond latencies: exact below 64 us, then 32
+// linear buckets per power of two, so every recorded value is within about
+// 3% of its bucket. Record is a couple of relaxed atomic adds and can be
+// called from any thread; percentiles are read from a snapshot while
+// recording goes on.
+class LatencyHistogram
+{
+public:
+    struct Percentiles
+    {
+        uint64_t count;
+        uint64_t p50;
+        uint64_t p95;
+        uint64_t p99;
+        uint64_t max;
+    };
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t microseconds);
+
+    Percentiles GetPercentiles() const;
+
+private:
+    static constexpr uint32_t SubBucketBits = 6;
+    static constexpr uint32_t SubBucketHalf = 1u << (SubBucketBits - 1);
+    // Values up to 2^32 us (a bit over an hour); anything larger is clamped.
+    static constexpr uint32_t BucketCount = (32 - SubBucketBits + 1) * SubBucketHalf + SubBucketHalf;
+
+    static uint32_t IndexOf(uint64_t value);
+    static uint64_t ValueAt(uint32_t index);
+
+    std::atomic<uint64_t> m_counts[BucketCount] = {};
+    std::atomic<uint64_t> m_max{ 0 };
+};
@@ -0,0 +1,230 @@
+﻿#include "MappedYuvFileSource.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "PixelConvert.h"
+
+#ifdef _WIN32
+#include <filesystem>
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A read-only mapping of a whole file.
+class MappedYuvFileSource::Mapping
+{
+public:
+    Mapping() = default;
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+
+    ~Mapping()
+    {
+        if (m_data == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, m_size);
+#endif
+    }
+
+    bool Open(const std::string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFile2(std::filesystem::path(path).c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0
+            ? CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        if (mapping == nullptr)
+            return false;
+        m_data = static_cast<uint8_t*>(MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0));
+        CloseHandle(mapping);
+        m_size = static_cast<size_t>(size.QuadPart);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat info;
+        if (fstat(file, &info) == 0 && info.st_size > 0)
+        {
+            void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (data != MAP_FAILED)
+            {
+                m_data = static_cast<uint8_t*>(data);
+                m_size = static_cast<size_t>(info.st_size);
+                // Frames are played in order; pages behind can go early.
+                madvise(m_data, m_size, MADV_SEQUENTIAL);
+            }
+        }
+        close(file);
+#endif
+        return m_data != nullptr;
+    }
+
+    // Asks for a range to be read in ahead of use. Only a hint; nothing
+    // waits for it.
+    void Prefetch(size_t offset, size_t size) const
+    {
+        if (offset >= m_size)
+            return;
+        size = std::min(size, m_size - offset);
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range = { m_data + offset, size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        // madvise wants a page-aligned start.
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = offset / page * page;
+        madvise(m_data + start, size + offset - start, MADV_WILLNEED);
+#endif
+    }
+
+    const uint8_t* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+MappedYuvFileSource::MappedYuvFileSource(const Config& config)
+    : PacedFrameSource(config.realtime, config.bufferCount), m_config(config)
+{
+}
+
+MappedYuvFileSource::~MappedYuvFileSource()
+{
+    Stop();
+}
+
+bool MappedYuvFileSource::Open()
+{
+    if (Running())
+        return false;
+
+    // Frames still out hold on to the old mapping.
+    m_mapping = std::make_shared<Mapping>();
+    m_frames.clear();
+    if (!m_mapping->Open(m_config.path) || !IndexFrames())
+    {
+        m_mapping = nullptr;
+        m_frames.clear();
+        return false;
+    }
+
+    ResizeBuffers(m_format != m_fileFormat ? FrameView::PackedSize(m_format, m_file.width, m_file.height) : 0);
+    return true;
+}
+
+bool MappedYuvFileSource::IndexFrames()
+{
+    const char* data = reinterpret_cast<const char*>(m_mapping->Data());
+    const size_t size = m_mapping->Size();
+    const std::string& path = m_config.path;
+    bool y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+
+    m_file = m_config.input;
+    size_t offset = 0;
+    if (y4m)
+    {
+        const char* end = static_cast<const char*>(std::memchr(data, '\n', std::min<size_t>(size, 255)));
+        if (end == nullptr)
+            return false;
+        char line[256];
+        std::memcpy(line, data, end - data);
+        line[end - data] = '\0';
+        if (!YuvFileReader::ParseY4mHeader(line, m_file))
+            return false;
+        offset = end - data + 1;
+    }
+    if (m_file.width == 0 || m_file.height == 0 || (m_file.width & 1) != 0 || (m_file.height & 1) != 0 || m_file.frameRate == 0)
+        return false;
+
+    m_fileFormat = m_file.format == YuvFormat::I420 ? FrameFormat::I420 : FrameFormat::Nv12;
+    const size_t frameSize = FrameView::PackedSize(m_fileFormat, m_file.width, m_file.height);
+    while (size - offset >= frameSize)
+    {
+        if (y4m)
+        {
+            // Every frame has its own header line, parameters and all.
+            if (size - offset < 6 || std::memcmp(data + offset, "FRAME", 5) != 0)
+                break;
+            const char* end = static_cast<const char*>(std::memchr(data + offset, '\n', std::min<size_t>(size - offset, 256)));
+            if (end == nullptr)
+                break;
+            offset = end - data + 1;
+            if (size - offset < frameSize)
+                break;
+        }
+        m_frames.push_back(offset);
+        offset += frameSize;
+    }
+    return !m_frames.empty();
+}
+
+bool MappedYuvFileSource::Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated)
+{
+    FrameFormat format = requested.format == FrameFormat::I420 ? FrameFormat::I420 : FrameFormat::Nv12;
+    bool sizeMatches = (requested.width == 0 || requested.width == m_file.width) && (requested.height == 0 || requested.height == m_file.height);
+    bool changed = format != m_format;
+    if (m_mapping != nullptr && sizeMatches && changed && !Running())
+    {
+        m_format = format;
+        ResizeBuffers(m_format != m_fileFormat ? FrameView::PackedSize(m_format, m_file.width, m_file.height) : 0);
+    }
+    negotiated = Format();
+    return m_mapping != nullptr && sizeMatches && (!changed || !Running());
+}
+
+FrameSourceFormat MappedYuvFileSource::Format() const
+{
+    FrameSourceFormat format;
+    format.format = m_format;
+    format.width = m_file.width;
+    format.height = m_file.height;
+    format.frameRate = m_mapping != nullptr ? m_file.frameRate : 0;
+    return format;
+}
+
+FrameView MappedYuvFileSource::FileFrame(size_t frame) const
+{
+    // The mapping is read-only, like every frame a source hands out.
+    uint8_t* data = const_cast<uint8_t*>(m_mapping->Data()) + m_frames[frame];
+    return FrameView::Packed(m_fileFormat, data, m_file.width, m_file.height);
+}
+
+bool MappedYuvFileSource::NextFrame(uint64_t index, BorrowedFrame& frame)
+{
+    uint64_t passFrames = m_config.maxFrames > 0 ? std::min<uint64_t>(m_config.maxFrames, m_frames.size()) : m_frames.size();
+    if (m_mapping == nullptr || passFrames == 0 || (m_config.loops > 0 && index >= passFrames * m_config.loops))
+        return false;
+
+    // The first frame asks for the whole window, every later one for the
+    // frame that enters it.
+    size_t current = static_cast<size_t>(index % passFrames);
+    size_t frameSize = FrameView::PackedSize(m_fileFormat, m_file.width, m_file.height);
+    for (uint32_t ahead = index == 0 ? 0 : m_config.prefetchFrames; m_config.prefetchFrames > 0 && ahead <= m_config.prefetchFrames; ahead++)
+        m_mapping->Prefetch(m_frames[(current + ahead) % passFrames], frameSize);
+
+    FrameView view = FileFrame(current);
+    if (m_format == m_fileFormat)
+    {
+        frame = Buffers().Lend(view, [mapping = m_mapping]() {}, !Realtime());
+        return true;
+    }
+
+    frame = Buffers().Acquire(m_format, m_file.width, m_file.height, !Realtime());
+    if (frame && !ConvertFrame(view, frame.View()))
+        frame = BorrowedFrame();
+    return true;
+}
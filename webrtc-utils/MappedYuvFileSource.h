@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "FrameSource.h"
+#include "YuvFileReader.h"
+
+// Plays a raw NV12/I420 or Y4M file straight out of a memory mapping. The
+// header is parsed and every frame located once, on Open; after that frames
+// are views into the mapping, with no read and no copy, and the kernel is
+// told to read ahead of the frame being played. Frames a consumer still
+// holds keep the mapping alive, even past the source.
+//
+// Frames go out in place when the negotiated layout is the file's, and are
+// converted out of the mapping into the source's buffers otherwise. Y4M is
+// always I420, so a consumer that wants NV12 pays for that conversion.
+class MappedYuvFileSource : public PacedFrameSource
+{
+public:
+    struct Config
+    {
+        std::string path;
+        YuvFileReader::Options input;
+        // Frames per pass; zero plays the whole file.
+        uint32_t maxFrames = 0;
+        // Passes over the file; zero loops until stopped.
+        uint32_t loops = 1;
+        bool realtime = false;
+        // Frames out at once, whether borrowed from the mapping or
+        // converted.
+        uint32_t bufferCount = 3;
+        // Frames the kernel is asked to read ahead of the one played.
+        uint32_t prefetchFrames = 4;
+    };
+
+    explicit MappedYuvFileSource(const Config& config);
+    ~MappedYuvFileSource() override;
+
+    // Fails when the file can't be mapped or holds no whole frame.
+    bool Open();
+
+    // The size is the file's; only a request for that size, or none,
+    // succeeds. NV12 and I420 are both offered.
+    bool Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated) override;
+
+    uint64_t FrameCount() const { return m_frames.size(); }
+
+protected:
+    bool NextFrame(uint64_t index, BorrowedFrame& frame) override;
+    FrameSourceFormat Format() const override;
+
+private:
+    class Mapping;
+
+    FrameView FileFrame(size_t frame) const;
+    bool IndexFrames();
+
+    Config m_config;
+    std::shared_ptr<Mapping> m_mapping;
+    YuvFileReader::Options m_file;
+    FrameFormat m_fileFormat = FrameFormat::Nv12;
+    FrameFormat m_format = FrameFormat::Nv12;
+    // Offset of each frame's pixels in the mapping.
+    std::vector<size_t> m_frames;
+};
@@ -0,0 +1,281 @@
+﻿#include "pch.h"
+#include "MediaCaptureSource.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+using namespace winrt;
+using namespace winrt::Windows::Media::Capture;
+using namespace winrt::Windows::Media::Capture::Frames;
+using namespace winrt::Windows::Foundation::Collections;
+using namespace winrt::Windows::Media::MediaProperties;
+using namespace winrt::Windows::Graphics::Imaging;
+
+static void OnMediaCaptureFailed(MediaCapture const& sender, MediaCaptureFailedEventArgs const& errorEventArgs)
+{
+    OutputDebugString(L"MediaCapture Failed");
+    OutputDebugString(errorEventArgs.Message().c_str());
+}
+
+static hstring ToLower(const hstring& str)
+{
+    std::wstring lower_str;
+    lower_str = str;
+    std::transform(lower_str.begin(), lower_str.end(), lower_str.begin(),
+        [](unsigned char c) { return std::tolower(c); });
+    return hstring(lower_str);
+}
+
+static bool CaseInsensitiveCompare(const hstring& str1, const hstring& str2)
+{
+    return ToLower(str1) == ToLower(str2);
+}
+
+MediaCaptureSource::MediaCaptureSource(std::wstring videoDeviceId)
+    : m_videoDeviceId(std::move(videoDeviceId))
+{
+}
+
+MediaCaptureSource::~MediaCaptureSource()
+{
+    Close();
+}
+
+bool MediaCaptureSource::Open()
+{
+    try {
+        MediaCaptureInitializationSettings settings;
+        settings.SharingMode(MediaCaptureSharingMode::ExclusiveControl);
+        settings.MemoryPreference(MediaCaptureMemoryPreference::Auto);
+        settings.StreamingCaptureMode(StreamingCaptureMode::Video);
+        if (!m_videoDeviceId.empty())
+            settings.VideoDeviceId(m_videoDeviceId);
+
+        m_mediaCapture = MediaCapture();
+        m_mediaCapture.InitializeAsync(settings).get();
+        m_mediaCapture.Failed(OnMediaCaptureFailed);
+
+        for (IKeyValuePair<hstring, MediaFrameSource> item : m_mediaCapture.FrameSources()) {
+            if (item.Value().Info().MediaStreamType() == MediaStreamType::VideoRecord || item.Value().Info().MediaStreamType() == MediaStreamType::VideoPreview
+                && item.Value().Info().SourceKind() == MediaFrameSourceKind::Color) {
+                    m_frameSource = item.Value();
+            }
+        }
+
+        if (m_frameSource == nullptr)
+            return false;
+
+        m_mediaReader = m_mediaCapture.CreateFrameReaderAsync(m_frameSource).get();
+        m_mediaReader.AcquisitionMode(MediaFrameReaderAcquisitionMode::Realtime);
+        m_frameArrivedToken = m_mediaReader.FrameArrived({ this, &MediaCaptureSource::OnFrameArrived });
+        return true;
+    }
+    catch (hresult_error const& ex)
+    {
+        hstring message = ex.message();
+
+        OutputDebugString(L"Could not open the capture device\n");
+        OutputDebugString(message.c_str());
+        return false;
+    }
+}
+
+bool MediaCaptureSource::Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated)
+{
+    if (m_frameSource == nullptr)
+        return false;
+
+    bool selected = false;
+    try
+    {
+        // The reader has to be stopped for the source to take a new format.
+        if (m_capturing)
+            m_mediaReader.StopAsync().get();
+        selected = SelectFormat(requested);
+        if (m_capturing)
+            m_mediaReader.StartAsync().get();
+    }
+    catch (hresult_error const& ex)
+    {
+        OutputDebugString(ex.message().c_str());
+        selected = false;
+    }
+    negotiated = CurrentFormat();
+    return selected;
+}
+
+bool MediaCaptureSource::Start(FrameHandler handler)
+{
+    if (m_mediaReader == nullptr || handler == nullptr || m_capturing)
+        return false;
+
+    {
+        std::lock_guard lock(m_handlerMutex);
+        m_handler = std::move(handler);
+    }
+    try
+    {
+        MediaFrameReaderStartStatus status = m_mediaReader.StartAsync().get();
+        m_capturing = status == MediaFrameReaderStartStatus::Success;
+    }
+    catch (hresult_error const& ex)
+    {
+        OutputDebugString(ex.message().c_str());
+        m_capturing = false;
+    }
+    return m_capturing;
+}
+
+void MediaCaptureSource::Stop()
+{
+    if (m_mediaReader != nullptr && m_capturing)
+        m_mediaReader.StopAsync().get();
+    m_capturing = false;
+
+    // Waits out a frame still being handed over.
+    std::lock_guard lock(m_handlerMutex);
+    m_handler = nullptr;
+}
+
+void MediaCaptureSource::Close()
+{
+    Stop();
+    if (m_mediaReader != nullptr)
+    {
+        m_mediaReader.FrameArrived(m_frameArrivedToken);
+        m_mediaReader.Close();
+        m_mediaReader = nullptr;
+    }
+    m_frameSource = nullptr;
+    if (m_mediaCapture != nullptr)
+    {
+        m_mediaCapture.Close();
+        m_mediaCapture = nullptr;
+    }
+}
+
+bool MediaCaptureSource::SelectFormat(const FrameSourceFormat& requested)
+{
+    // NV12 goes to the encoder as is; the others are converted on arrival.
+    const hstring subtypes[] = { MediaEncodingSubtypes::Nv12(), MediaEncodingSubtypes::Yuy2(), MediaEncodingSubtypes::Bgra8() };
+    for (const hstring& subtype : subtypes) {
+        for (MediaFrameFormat format : m_frameSource.SupportedFormats()) {
+            float framerate = format.FrameRate().Numerator() / format.FrameRate().Denominator();
+
+            if (framerate >= requested.frameRate && CaseInsensitiveCompare(format.Subtype(), subtype) && format.VideoFormat().Width() == requested.width && format.VideoFormat().Height() == requested.height) {
+                m_frameSource.SetFormatAsync(format).get();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+FrameSourceFormat MediaCaptureSource::CurrentFormat() const
+{
+    FrameSourceFormat current;
+    MediaFrameFormat format = m_frameSource != nullptr ? m_frameSource.CurrentFormat() : nullptr;
+    if (format == nullptr)
+        return current;
+    current.format = CaseInsensitiveCompare(format.Subtype(), MediaEncodingSubtypes::Yuy2()) ? FrameFormat::Yuy2
+        : CaseInsensitiveCompare(format.Subtype(), MediaEncodingSubtypes::Bgra8()) ? FrameFormat::Bgra8 : FrameFormat::Nv12;
+    current.width = format.VideoFormat().Width();
+    current.height = format.VideoFormat().Height();
+    if (format.FrameRate().Denominator() > 0)
+        current.frameRate = format.FrameRate().Numerator() / format.FrameRate().Denominator();
+    return current;
+}
+
+void MediaCaptureSource::OnFrameArrived(MediaFrameReader const& sender, MediaFrameArrivedEventArgs const&)
+{
+    std::lock_guard lock(m_handlerMutex);
+    if (m_handler == nullptr)
+        return;
+
+    try
+    {
+        MediaFrameReference reference = sender.TryAcquireLatestFrame();
+        if (reference == nullptr)
+            return;
+        VideoMediaFrame videoFrame = reference.VideoMediaFrame();
+        if (videoFrame == nullptr)
+            return;
+
+        SoftwareBitmap source = videoFrame.SoftwareBitmap();
+        if (videoFrame.SoftwareBitmap() == nullptr) {
+            TRACE_SCOPE("convert");
+            source = SoftwareBitmap::CreateCopyFromSurfaceAsync(videoFrame.Direct3DSurface()).get();
+        }
+
+        if (source == nullptr)
+        {
+            OutputDebugString(L"Could not get SoftwareBitmap");
+            return;
+        }
+
+        BitmapPixelFormat pixelFormat = source.BitmapPixelFormat();
+        if (pixelFormat != BitmapPixelFormat::Nv12 && pixelFormat != BitmapPixelFormat::Yuy2 && pixelFormat != BitmapPixelFormat::Bgra8)
+        {
+            source.Close();
+            m_handler(BorrowedFrame());
+            return;
+        }
+
+        // SystemRelativeTime is the driver's capture time on the QPC clock;
+        // arrival time falls back in for sources that do not provide it.
+        std::chrono::steady_clock::time_point arrival = std::chrono::steady_clock::now();
+        int64_t arrivalTime = std::chrono::duration_cast<Windows::Foundation::TimeSpan>(arrival.time_since_epoch()).count();
+        Windows::Foundation::IReference<Windows::Foundation::TimeSpan> captureTime = reference.SystemRelativeTime();
+
+        BitmapBuffer lockedBuffer = source.LockBuffer(BitmapBufferAccessMode::Read);
+        Windows::Foundation::IMemoryBufferReference referenceBuff = lockedBuffer.CreateReference();
+        uint8_t* buffer;
+        uint32_t capacity;
+        referenceBuff.as<impl::IMemoryBufferByteAccess>()->GetBuffer(&buffer, &capacity);
+
+        // The bitmap's planes may be padded or start past the beginning of
+        // the buffer, so the view takes the layout the bitmap reports.
+        FrameView view;
+        view.format = pixelFormat == BitmapPixelFormat::Nv12 ? FrameFormat::Nv12
+            : pixelFormat == BitmapPixelFormat::Yuy2 ? FrameFormat::Yuy2 : FrameFormat::Bgra8;
+        view.width = source.PixelWidth();
+        view.height = source.PixelHeight();
+        view.timestamp = captureTime != nullptr ? captureTime.Value().count() : arrivalTime;
+        bool described = static_cast<uint32_t>(lockedBuffer.GetPlaneCount()) >= view.PlaneCount();
+        for (uint32_t plane = 0; described && plane < view.PlaneCount(); ++plane)
+        {
+            BitmapPlaneDescription layout = lockedBuffer.GetPlaneDescription(plane);
+            described = layout.StartIndex >= 0 && layout.Stride > 0;
+            if (described)
+                view.planes[plane] = { buffer + layout.StartIndex, static_cast<uint32_t>(layout.Stride), static_cast<uint32_t>(layout.StartIndex) };
+        }
+
+        if (!described || !view.FitsIn(capacity))
+        {
+            referenceBuff.Close();
+            lockedBuffer.Close();
+            source.Close();
+            m_handler(BorrowedFrame());
+            return;
+        }
+
+        // Whoever ends up reading the frame, the encoder included, holds the
+        // lock until it releases the frame.
+        BorrowedFrame frame(view,
+            [referenceBuff, lockedBuffer, source]()
+            {
+                referenceBuff.Close();
+                lockedBuffer.Close();
+                source.Close();
+            });
+        frame.SetArrivalTime(arrival);
+        m_handler(std::move(frame));
+    }
+    catch (hresult_error const& ex)
+    {
+        hstring message = ex.message();
+
+        OutputDebugString(L"Could not read a captured frame\n");
+        OutputDebugString(message.c_str());
+    }
+}
@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include <mutex>
+#include <string>
+
+#include "FrameSource.h"
+
+// The camera, through Windows.Media.Capture. Frames come in the format the
+// camera delivers, NV12, YUY2 or BGRA, and stay locked in the camera's
+// bitmap until released. Timestamps are the driver's capture time on the
+// QPC clock, or the arrival time for cameras that do not report one.
+class MediaCaptureSource : public IFrameSource
+{
+public:
+    // An empty id opens the default camera.
+    explicit MediaCaptureSource(std::wstring videoDeviceId);
+    MediaCaptureSource(const MediaCaptureSource&) = delete;
+    MediaCaptureSource& operator=(const MediaCaptureSource&) = delete;
+    ~MediaCaptureSource() override;
+
+    // Fails when the camera can't be opened or has no color stream.
+    bool Open();
+
+    // Needs the exact size and at least the frame rate. NV12 is taken over
+    // YUY2 and BGRA whatever the requested format, as it needs no
+    // conversion.
+    bool Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated) override;
+    bool Start(FrameHandler handler) override;
+    void Stop() override;
+
+private:
+    bool SelectFormat(const FrameSourceFormat& requested);
+    FrameSourceFormat CurrentFormat() const;
+    void OnFrameArrived(winrt::Windows::Media::Capture::Frames::MediaFrameReader const& sender,
+        winrt::Windows::Media::Capture::Frames::MediaFrameArrivedEventArgs const& args);
+    void Close();
+
+    std::wstring m_videoDeviceId;
+    winrt::Windows::Media::Capture::MediaCapture m_mediaCapture = nullptr;
+    winrt::Windows::Media::Capture::Frames::MediaFrameSource m_frameSource = nullptr;
+    winrt::Windows::Media::Capture::Frames::MediaFrameReader m_mediaReader = nullptr;
+    winrt::event_token m_frameArrivedToken;
+    std::mutex m_handlerMutex;
+    FrameHandler m_handler;
+    bool m_capturing = false;
+};
@@ -4,128 +4,323 @@
 #include <mferror.h>
 #include <codecapi.h>
 
-#include <fstream>
-#include <sstream>
-
 #include "MediaFoundationEncoder.h"
+#include "MediaSamplePool.h"
+#include "Trace.h"
 
 using namespace winrt;
-using namespace Windows::Storage;
-using namespace Windows::Storage::Streams;
 
-static com_ptr<IMFTransform> transform;
+// Inputs the transform holds for lookahead before it returns output, plus
+// the one being submitted. Frames waiting in the capture queue are not in
+// samples yet, so they need none.
+constexpr uint32_t TransformInputFrames = 8;
+// Output is drained into the arena as soon as it comes out.
+constexpr uint32_t TransformOutputFrames = 2;
+// A key frame can take this many times a frame's share of the bitrate.
+constexpr size_t KeyFrameRatio = 4;
+constexpr size_t MinBitstreamBlock = 64 * 1024;
+constexpr size_t MaxBitstreamBlock = 4 * 1024 * 1024;
+
+// Twice what a key frame is expected to take at the configured rate, never
+// more than a raw frame or a few megabytes. A burst that outgrows it moves
+// to a larger block.
+static size_t BitstreamBlockSize(const VideoEncoderSettings& settings, size_t frameSize)
+{
+    size_t frameBudget = settings.bitrate / 8 / (settings.frameRate > 0 ? settings.frameRate : 1);
+    size_t size = 2 * KeyFrameRatio * frameBudget;
+    size = size < MinBitstreamBlock ? MinBitstreamBlock : size;
+    size = size > MaxBitstreamBlock ? MaxBitstreamBlock : size;
+    return size < frameSize ? size : frameSize;
+}
+
+static eAVEncH264VProfile ToProfile(H264Profile profile)
+{
+    switch (profile)
+    {
+    case H264Profile::Baseline:
+        return eAVEncH264VProfile_Base;
+    case H264Profile::High:
+        return eAVEncH264VProfile_High;
+    default:
+        return eAVEncH264VProfile_Main;
+    }
+}
 
-static std::ofstream m_file;
+MediaFoundationEncoder::MediaFoundationEncoder() = default;
 
-Windows::Foundation::IAsyncAction SaveBinaryFileAsync()
+MediaFoundationEncoder::MediaFoundationEncoder(const Config& config)
+    : m_config(config)
+{
+}
+
+MediaFoundationEncoder::~MediaFoundationEncoder()
+{
+    Shutdown();
+}
+
+bool MediaFoundationEncoder::Configure(const VideoEncoderSettings& settings)
+{
+    Shutdown();
+    return CreateTransform(settings);
+}
+
+bool MediaFoundationEncoder::CreateTransform(const VideoEncoderSettings& settings)
 {
     try
     {
-        StorageFolder localFolder = ApplicationData::Current().LocalFolder();
-        StorageFile file = co_await localFolder.CreateFileAsync(L"output.h264",
-            CreationCollisionOption::ReplaceExisting);
+        check_hresult(MFStartup(MF_VERSION));
+        m_started = true;
 
-        IRandomAccessStream randomAccessStream = co_await file.OpenAsync(FileAccessMode::ReadWrite);
-        IOutputStream outputStream = randomAccessStream.GetOutputStreamAt(0);
-        DataWriter writer(outputStream);
+        check_hresult(CoCreateInstance(CLSID_MSH264EncoderMFT,
+            nullptr,
+            CLSCTX_INPROC_SERVER,
+            IID_PPV_ARGS(m_transform.put()))
+        );
+
+        SetMediaTypes(settings);
 
-        // Example: Write some binary data
-        std::vector<uint8_t> binaryData = { /* your H.264 data here */ };
-        writer.WriteBytes(binaryData);
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
+        return true;
 
-        // Commit the DataWriter to the stream
-        co_await writer.StoreAsync();
-        co_await writer.FlushAsync();
-        writer.Close();
+    } catch (hresult_error const& e)
+    {
+        OutputDebugString(e.message().c_str());
+        return false;
     }
-    catch (winrt::hresult_error const& ex)
+    
+}
+
+bool MediaFoundationEncoder::Reconfigure(const VideoEncoderSettings& settings)
+{
+    if (m_transform == nullptr)
+        return Configure(settings);
+
+    if (!settings.NeedsRestart(m_settings))
+        return SetRate(settings.bitrate, settings.frameRate);
+
+    // A new frame size or profile only needs new media types; keeping the
+    // transform avoids the CoCreateInstance and MFStartup cost of a full
+    // re-init. Pending input is discarded, it has the old size anyway.
+    try
     {
-        // Handle errors
-        winrt::hstring message = ex.message();
-        // Log or display error
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, NULL));
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, NULL));
+        SetMediaTypes(settings);
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
+        return true;
+    } catch (hresult_error const& e)
+    {
+        OutputDebugString(L"Transform refused new media types, recreating it\n");
+        OutputDebugString(e.message().c_str());
     }
+
+    ReleaseTransform();
+    return CreateTransform(settings);
 }
 
-Windows::Foundation::IAsyncAction SaveWithStdOfstreamAsync()
+void MediaFoundationEncoder::SetMediaTypes(const VideoEncoderSettings& settings)
 {
-    StorageFolder localFolder = ApplicationData::Current().LocalFolder();
+    com_ptr<IMFMediaType> inputMediaType;
+    check_hresult(MFCreateMediaType(inputMediaType.put()));
+    check_hresult(inputMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+    check_hresult(inputMediaType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
+    check_hresult(inputMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+    check_hresult(MFSetAttributeSize(inputMediaType.get(), MF_MT_FRAME_SIZE, settings.width, settings.height));   // Set resolution
+    check_hresult(MFSetAttributeRatio(inputMediaType.get(), MF_MT_FRAME_RATE, settings.frameRate, 1));       // Set FPS
 
-    StorageFile file = co_await localFolder.CreateFileAsync(L"output.h264",
-        CreationCollisionOption::ReplaceExisting);
+    com_ptr<IMFMediaType> outputMediaType;
+    check_hresult(MFCreateMediaType(outputMediaType.put()));
+    check_hresult(outputMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+    check_hresult(outputMediaType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264));
+    check_hresult(outputMediaType->SetUINT32(MF_MT_AVG_BITRATE, settings.bitrate));
+    check_hresult(outputMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+    check_hresult(MFSetAttributeSize(outputMediaType.get(), MF_MT_FRAME_SIZE, settings.width, settings.height));
+    check_hresult(MFSetAttributeRatio(outputMediaType.get(), MF_MT_FRAME_RATE, settings.frameRate, 1));
+    check_hresult(outputMediaType->SetUINT32(MF_MT_MPEG2_PROFILE, ToProfile(settings.profile)));
+    check_hresult(outputMediaType->SetUINT32(MF_MT_MPEG2_LEVEL, settings.level));
 
-    std::wstring filePath = file.Path().c_str();
+    check_hresult(m_transform->SetOutputType(0, outputMediaType.get(), 0));
+    check_hresult(m_transform->SetInputType(0, inputMediaType.get(), 0));
 
-    m_file.open(filePath, std::ios::out | std::ios::binary);
-    if (m_file.is_open())
-    {
-        OutputDebugString(filePath.c_str());
-        OutputDebugString(L"File opened successfully\n");
+    DWORD mftStatus;
+    m_transform->GetInputStatus(0, &mftStatus);
+    if (mftStatus != MFT_INPUT_STATUS_ACCEPT_DATA) {
+        throw hresult_error(mftStatus);
     }
+
+    MFT_OUTPUT_STREAM_INFO streamInfo;
+    check_hresult(m_transform->GetOutputStreamInfo(0, &streamInfo));
+    size_t frameSize = static_cast<size_t>(settings.width) * settings.height * 3 / 2;
+    size_t bitstreamSize = BitstreamBlockSize(settings, frameSize);
+    size_t outputSize = streamInfo.cbSize > 0 ? streamInfo.cbSize : bitstreamSize;
+
+    // Each pool holds as many blocks as can be out at once, so steady state
+    // never misses. On a reconfigure the pools are replaced; frames still
+    // out keep the old ones alive until they come back.
+    m_bufferPool = std::make_shared<BufferPool>(std::vector<BufferPool::SizeClass>{
+        { outputSize, TransformOutputFrames },
+        { frameSize, TransformInputFrames },
+    });
+    m_inputSamples = std::make_unique<MediaSamplePool>(m_bufferPool, TransformInputFrames);
+    m_outputSamples = std::make_unique<MediaSamplePool>(m_bufferPool, TransformOutputFrames);
+    // One more block for the frame being drained.
+    m_bitstreamArena = std::make_shared<BitstreamArena>(bitstreamSize, m_config.heldFrames + 1);
+    m_bitstreamSize = bitstreamSize;
+    m_settings = settings;
+    m_frameRate = settings.frameRate;
+    m_pendingFrameRate = 0;
+}
+
+void MediaFoundationEncoder::RequestKeyFrame()
+{
+    m_keyFrameRequested = true;
 }
 
-void MediaFoundationEncoder::Initialize()
+bool MediaFoundationEncoder::SetRate(uint32_t bitrate, uint32_t frameRate)
 {
+    if (bitrate == 0 || frameRate == 0)
+        return false;
+
+    // The transform is only touched from the encode thread; the new rates
+    // are applied before the next input.
+    m_pendingBitrate = bitrate;
+    m_pendingFrameRate = frameRate;
+    return true;
+}
+
+std::vector<EncodedFrameRef> MediaFoundationEncoder::Flush()
+{
+    std::vector<EncodedFrameRef> frames;
+    if (m_transform == nullptr)
+        return frames;
+
     try
     {
-        SaveWithStdOfstreamAsync();
-        
-        check_hresult(MFStartup(MF_VERSION));
+        check_hresult(m_transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, NULL));
+        while (true)
+        {
+            EncodedFrameRef frame;
+            if (AppendOutput(frame, 0) != S_OK)
+                break;
+            frames.push_back(std::move(frame));
+        }
+    } catch (hresult_error const& e)
+    {
+        OutputDebugString(e.message().c_str());
+    }
+    return frames;
+}
 
-        check_hresult(CoCreateInstance(CLSID_MSH264EncoderMFT,
-            nullptr,
-            CLSCTX_INPROC_SERVER,
-            IID_PPV_ARGS(transform.put()))
-        );
+void MediaFoundationEncoder::ApplyPendingControls()
+{
+    uint32_t frameRate = m_pendingFrameRate.exchange(0);
+    if (frameRate != 0 && frameRate != m_settings.frameRate)
+        ApplyFrameRate(frameRate);
 
-        com_ptr<IMFMediaType> inputMediaType;
-        check_hresult(MFCreateMediaType(inputMediaType.put()));
-        check_hresult(inputMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
-        check_hresult(inputMediaType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
-        check_hresult(inputMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
-        check_hresult(MFSetAttributeSize(inputMediaType.get(), MF_MT_FRAME_SIZE, 640, 480));   // Set resolution
-        check_hresult(MFSetAttributeRatio(inputMediaType.get(), MF_MT_FRAME_RATE, 30, 1));       // Set FPS
+    bool keyFrame = m_keyFrameRequested.exchange(false);
+    uint32_t bitrate = m_pendingBitrate.exchange(0);
+    if (!keyFrame && bitrate == 0)
+        return;
+
+    com_ptr<ICodecAPI> codecApi = m_transform.try_as<ICodecAPI>();
+    if (codecApi == nullptr)
+        return;
+
+    VARIANT value = {};
+    value.vt = VT_UI4;
+    if (bitrate != 0)
+    {
+        value.ulVal = bitrate;
+        codecApi->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &value);
+        m_settings.bitrate = bitrate;
+    }
+    if (keyFrame)
+    {
+        value.ulVal = 1;
+        codecApi->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &value);
+    }
+}
+
+void MediaFoundationEncoder::ApplyFrameRate(uint32_t frameRate)
+{
+    // The codec API has no frame rate the transform picks up mid-stream, so
+    // both media types are set again with only MF_MT_FRAME_RATE changed.
+    // The rate control budgets bits per frame from it. If the transform
+    // refuses, it keeps the old rate and so do m_settings and the sample
+    // durations.
+    try
+    {
+        com_ptr<IMFMediaType> currentOutput;
+        com_ptr<IMFMediaType> currentInput;
+        check_hresult(m_transform->GetOutputCurrentType(0, currentOutput.put()));
+        check_hresult(m_transform->GetInputCurrentType(0, currentInput.put()));
 
         com_ptr<IMFMediaType> outputMediaType;
+        com_ptr<IMFMediaType> inputMediaType;
         check_hresult(MFCreateMediaType(outputMediaType.put()));
-        check_hresult(outputMediaType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
-        check_hresult(outputMediaType->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264));
-        check_hresult(outputMediaType->SetUINT32(MF_MT_AVG_BITRATE, 1500000));
-        check_hresult(outputMediaType->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
-        check_hresult(MFSetAttributeSize(outputMediaType.get(), MF_MT_FRAME_SIZE, 640, 480));
-        check_hresult(MFSetAttributeRatio(outputMediaType.get(), MF_MT_FRAME_RATE, 30, 1));
-        check_hresult(outputMediaType->SetUINT32(MF_MT_MPEG2_PROFILE, eAVEncH264VProfile_Main));
-        check_hresult(outputMediaType->SetUINT32(MF_MT_MPEG2_LEVEL, 41));
-
-        check_hresult(transform->SetOutputType(0, outputMediaType.get(), 0));
-        check_hresult(transform->SetInputType(0, inputMediaType.get(), 0));
-
-        DWORD mftStatus;
-        transform->GetInputStatus(0, &mftStatus);
-        if (mftStatus != MFT_INPUT_STATUS_ACCEPT_DATA) {
-            throw hresult_error(mftStatus);
-        }
-        
-        check_hresult(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
-        check_hresult(transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
+        check_hresult(MFCreateMediaType(inputMediaType.put()));
+        check_hresult(currentOutput->CopyAllItems(outputMediaType.get()));
+        check_hresult(currentInput->CopyAllItems(inputMediaType.get()));
+        check_hresult(MFSetAttributeRatio(outputMediaType.get(), MF_MT_FRAME_RATE, frameRate, 1));
+        check_hresult(MFSetAttributeRatio(inputMediaType.get(), MF_MT_FRAME_RATE, frameRate, 1));
 
+        check_hresult(m_transform->SetOutputType(0, outputMediaType.get(), 0));
+        check_hresult(m_transform->SetInputType(0, inputMediaType.get(), 0));
+        m_settings.frameRate = frameRate;
+        m_frameRate = frameRate;
     } catch (hresult_error const& e)
     {
+        OutputDebugString(L"Transform refused the new frame rate\n");
         OutputDebugString(e.message().c_str());
     }
-    
 }
 
 void MediaFoundationEncoder::Shutdown()
 {
-    transform = nullptr;
+    ReleaseTransform();
+}
+
+void MediaFoundationEncoder::ReleaseTransform()
+{
+    if (!m_started)
+        return;
+
+    m_started = false;
+    m_transform = nullptr;
+    m_inputSamples = nullptr;
+    m_outputSamples = nullptr;
+    m_bufferPool = nullptr;
+    m_bitstreamArena = nullptr;
     MFShutdown();
-    m_file.close();
 }
 
-HRESULT CreateSample(com_ptr<IMFSample>& sample, DWORD maxLenght)
+BufferPool::Stats MediaFoundationEncoder::GetBufferPoolStats()
+{
+    if (m_bufferPool == nullptr)
+        return BufferPool::Stats();
+    return m_bufferPool->GetStats();
+}
+
+BitstreamArena::Stats MediaFoundationEncoder::GetBitstreamStats() const
+{
+    if (m_bitstreamArena == nullptr)
+        return BitstreamArena::Stats();
+    return m_bitstreamArena->GetStats();
+}
+
+HRESULT MediaFoundationEncoder::CreateSample(com_ptr<IMFSample>& sample, DWORD maxLenght)
 {
     try
     {
+        if (m_outputSamples != nullptr)
+        {
+            sample = m_outputSamples->Acquire(maxLenght);
+            if (sample != nullptr)
+                return S_OK;
+        }
+
         com_ptr<IMFMediaBuffer> buffer;
         check_hresult(MFCreateMemoryBuffer(maxLenght, buffer.put()));
         check_hresult(MFCreateSample(sample.put()));
@@ -137,14 +332,14 @@ HRESULT CreateSample(com_ptr<IMFSample>& sample, DWORD maxLenght)
     } 
 }
 
-HRESULT ProcessOutput(com_ptr<IMFSample>& decodeOutput)
+HRESULT MediaFoundationEncoder::ProcessOutput(com_ptr<IMFSample>& decodeOutput)
 {
     MFT_OUTPUT_STREAM_INFO streamInfo;
     MFT_OUTPUT_DATA_BUFFER outputDataBuffer;
     DWORD processOutputStatus;
     HRESULT result = S_OK;
     
-    check_hresult(transform->GetOutputStreamInfo(0, &streamInfo));
+    check_hresult(m_transform->GetOutputStreamInfo(0, &streamInfo));
     
     outputDataBuffer.dwStreamID = 0;
     outputDataBuffer.dwStatus = 0;
@@ -156,14 +351,14 @@ HRESULT ProcessOutput(com_ptr<IMFSample>& decodeOutput)
         outputDataBuffer.pSample = decodeOutput.get();
     }
     
-    HRESULT transformResult = transform->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
-    std::wstringstream ss;
-    ss << L"5 - Status: " << processOutputStatus << L" - result: " << transformResult << "\n";
-    //OutputDebugString(ss.str().c_str());
+    HRESULT transformResult = m_transform->ProcessOutput(0, 1, &outputDataBuffer, &processOutputStatus);
 
     if (transformResult == S_OK)
     {
-        decodeOutput.copy_to(&outputDataBuffer.pSample);
+        // Our own samples are already owned by decodeOutput; taking another
+        // reference here would keep pooled samples from ever being recycled.
+        if (decodeOutput == nullptr)
+            decodeOutput.attach(outputDataBuffer.pSample);
     }
     else if (transformResult == MF_E_TRANSFORM_NEED_MORE_INPUT) {
         //OutputDebugString(L" 6 - Needs more input\n");
@@ -184,69 +379,127 @@ HRESULT ProcessOutput(com_ptr<IMFSample>& decodeOutput)
     return result;
 }
 
-std::vector<uint8_t> MediaFoundationEncoder::ProcessFrame(uint8_t* data, int size, int64_t timestamp)
+HRESULT MediaFoundationEncoder::AppendOutput(EncodedFrameRef& outputData, int64_t timestamp)
+{
+    TRACE_SCOPE("encode output");
+    com_ptr<IMFSample> decodeOutput;
+    HRESULT encoderResult = ProcessOutput(decodeOutput);
+    if (encoderResult != S_OK)
+        return encoderResult;
+
+    uint8_t* buffData = nullptr;
+    DWORD lenght = 0;
+    com_ptr<IMFMediaBuffer> decodeBuffer;
+
+    check_hresult(decodeOutput->ConvertToContiguousBuffer(decodeBuffer.put()));
+    check_hresult(decodeBuffer->Lock(&buffData, nullptr, &lenght));
+
+    // Each drained sample is copied exactly once, into the arena
+    // block every consumer then reads in place.
+    if (!outputData)
+    {
+        LONGLONG sampleTime = 0;
+        outputData = m_bitstreamArena->Allocate(lenght > m_bitstreamSize ? lenght : m_bitstreamSize);
+        outputData->SetTimestamp(SUCCEEDED(decodeOutput->GetSampleTime(&sampleTime)) ? sampleTime : timestamp);
+    }
+    if (!outputData->Append(buffData, lenght))
+    {
+        m_bitstreamArena->Grow(outputData, (outputData->Size() + lenght) * 2);
+        outputData->Append(buffData, lenght);
+    }
+    if (MFGetAttributeUINT32(decodeOutput.get(), MFSampleExtension_CleanPoint, FALSE))
+        outputData->SetKeyFrame(true);
+
+    check_hresult(decodeBuffer->Unlock());
+    return S_OK;
+}
+
+EncodedFrameRef MediaFoundationEncoder::EncodeSample(const com_ptr<IMFSample>& sample, int64_t timestamp)
 {
-    std::vector<uint8_t> outputData;
+    EncodedFrameRef outputData;
     try {
-        std::wstringstream ss;
-        ss << L"1 - Received Frame: " << timestamp << " with " << size << " bytes \n";
-        //OutputDebugString(ss.str().c_str());
+        ApplyPendingControls();
+        check_hresult(sample->SetSampleTime(timestamp));
+        check_hresult(sample->SetSampleDuration(10000000 / m_frameRate.load()));
 
-        com_ptr<IMFSample> sample;
-        check_hresult(MFCreateSample(sample.put()));
+        {
+            TRACE_SCOPE("encode input");
+            m_transform->ProcessInput(0, sample.get(), 0);
+        }
+        
+        while (AppendOutput(outputData, timestamp) == S_OK)
+        {
+        }
+        
+        return outputData;
+    } catch (hresult_error const& e)
+    {
+        OutputDebugString(L"Encoding a sample failed\n");
+        OutputDebugString(e.message().c_str());
+        return outputData;
+    }
+}
+
+EncodedFrameRef MediaFoundationEncoder::ProcessFrame(const FrameView& view)
+{
+    try {
+        if (m_transform == nullptr || view.format != FrameFormat::Nv12)
+            return EncodedFrameRef();
+
+        TRACE_SCOPE("repack");
+        DWORD size = static_cast<DWORD>(FrameView::PackedSize(FrameFormat::Nv12, view.width, view.height));
+        com_ptr<IMFSample> sample = m_inputSamples != nullptr ? m_inputSamples->Acquire(size) : nullptr;
         com_ptr<IMFMediaBuffer> buffer;
-        check_hresult(MFCreateMemoryBuffer(size, buffer.put()));
+        if (sample != nullptr)
+        {
+            check_hresult(sample->GetBufferByIndex(0, buffer.put()));
+        }
+        else
+        {
+            check_hresult(MFCreateSample(sample.put()));
+            check_hresult(MFCreateMemoryBuffer(size, buffer.put()));
+            check_hresult(sample->AddBuffer(buffer.get()));
+        }
         
         uint8_t* bufferData = nullptr;
         DWORD maxLength = 0;
-        buffer->Lock(&bufferData, &maxLength, nullptr);
-        memcpy(bufferData, data, size);
+        check_hresult(buffer->Lock(&bufferData, &maxLength, nullptr));
+        bool copied = maxLength >= size && CopyFrame(view, FrameView::Packed(FrameFormat::Nv12, bufferData, view.width, view.height));
         buffer->Unlock();
+        if (!copied)
+            return EncodedFrameRef();
         buffer->SetCurrentLength(size);
-        
-        check_hresult(sample->AddBuffer(buffer.get()));
-        check_hresult(sample->SetSampleTime(timestamp));
-        check_hresult(sample->SetSampleDuration(333333));
 
-        //OutputDebugString(L"2 - Processing Input\n");
-        transform->ProcessInput(0, sample.get(), 0);
-        
-        HRESULT encoderResult = S_OK;
+        return EncodeSample(sample, view.timestamp);
+    } catch (hresult_error const& e)
+    {
+        OutputDebugString(L"Packing a frame for the transform failed\n");
+        OutputDebugString(e.message().c_str());
+        return EncodedFrameRef();
+    }
+}
 
-        while (encoderResult == S_OK)
-        {
-            com_ptr<IMFSample> decodeOutput;
-            //OutputDebugString(L"3 - Processing Output\n");
-            encoderResult = ProcessOutput(decodeOutput);
-
-            if (encoderResult == S_OK)
-            {
-                ss.clear();
-                ss.str(L"");
-                uint8_t* buffData = nullptr;
-                DWORD lenght = 0;
-                com_ptr<IMFMediaBuffer> decodeBuffer;
-
-                check_hresult(decodeOutput->ConvertToContiguousBuffer(decodeBuffer.put()));
-                check_hresult(decodeBuffer->Lock(&buffData, nullptr, &lenght));
-                outputData.insert(outputData.end(), buffData, buffData + lenght);
-				m_file.write(reinterpret_cast<const char*>(buffData), lenght);
-                ss.clear();
-                ss.str(L"");
-                ss << "Writing " << lenght << " bytes to File\n";
-                //OutputDebugString(ss.str().c_str());
-                
-                check_hresult(decodeBuffer->Unlock());
-            }
-        }
-        
-        return outputData;
+EncodedFrameRef MediaFoundationEncoder::Encode(BorrowedFrame frame)
+{
+    if (m_transform == nullptr)
+        return EncodedFrameRef();
+
+    // Padded or cropped frames are packed into a pooled sample; the frame
+    // is released as soon as its pixels are copied. So are packed ones when
+    // every pooled sample is still inside the transform.
+    int64_t timestamp = frame.Timestamp();
+    com_ptr<IMFSample> sample = frame.View().IsPacked() && m_inputSamples != nullptr ? m_inputSamples->Wrap(frame) : nullptr;
+    if (sample == nullptr)
+        return ProcessFrame(frame.View());
+
+    try {
+        // From here the sample is the only owner of the frame, so the capture
+        // buffer is released as soon as the transform drops its reference.
+        return EncodeSample(sample, timestamp);
     } catch (hresult_error const& e)
     {
-        std::wstringstream ss;
-        ss << L"ERRRORRRRRR ==========: " << e.message().c_str() << "\n";
-        OutputDebugString(ss.str().c_str());
-        return outputData;
+        OutputDebugString(L"Encoding a frame in place failed\n");
+        OutputDebugString(e.message().c_str());
+        return EncodedFrameRef();
     }
-    
-}
\ No newline at end of file
+}
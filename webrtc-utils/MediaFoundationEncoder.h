@@ -1,9 +1,70 @@
 ﻿#pragma once
 
-class MediaFoundationEncoder
+#include <atomic>
+#include <memory>
+
+#include "BufferPool.h"
+#include "VideoEncoderBackend.h"
+
+struct IMFTransform;
+struct IMFSample;
+class MediaSamplePool;
+
+class MediaFoundationEncoder : public IVideoEncoderBackend
 {
 public:
-    void Initialize();
-    void Shutdown();
-    std::vector<uint8_t> ProcessFrame(uint8_t* data, int size, int64_t timestamp);
+    struct Config
+    {
+        // Encoded frames alive at once outside the encoder: a full delivery
+        // queue, a pull ring and whatever is being delivered. The arena has
+        // a block for each; more fall back to the heap.
+        uint32_t heldFrames = 32;
+    };
+
+    MediaFoundationEncoder();
+    explicit MediaFoundationEncoder(const Config& config);
+    ~MediaFoundationEncoder() override;
+
+    const char* Name() const override { return "MediaFoundation"; }
+    bool Configure(const VideoEncoderSettings& settings) override;
+    // Encodes packed frames in place; their release hook runs once the
+    // transform no longer needs the memory. Others are copied first.
+    EncodedFrameRef Encode(BorrowedFrame frame) override;
+    void RequestKeyFrame() override;
+    bool SetRate(uint32_t bitrate, uint32_t frameRate) override;
+    bool Reconfigure(const VideoEncoderSettings& settings) override;
+    std::vector<EncodedFrameRef> Flush() override;
+    void Shutdown() override;
+
+    // Encodes a copy of the frame packed into a pooled sample. Returns an
+    // empty reference while the transform is still buffering.
+    EncodedFrameRef ProcessFrame(const FrameView& view);
+    BufferPool::Stats GetBufferPoolStats();
+    BitstreamArena::Stats GetBitstreamStats() const override;
+
+private:
+    bool CreateTransform(const VideoEncoderSettings& settings);
+    void SetMediaTypes(const VideoEncoderSettings& settings);
+    void ReleaseTransform();
+    HRESULT CreateSample(winrt::com_ptr<IMFSample>& sample, DWORD maxLenght);
+    HRESULT ProcessOutput(winrt::com_ptr<IMFSample>& decodeOutput);
+    HRESULT AppendOutput(EncodedFrameRef& outputData, int64_t timestamp);
+    void ApplyPendingControls();
+    void ApplyFrameRate(uint32_t frameRate);
+    EncodedFrameRef EncodeSample(const winrt::com_ptr<IMFSample>& sample, int64_t timestamp);
+
+    Config m_config;
+    VideoEncoderSettings m_settings;
+    std::atomic<bool> m_keyFrameRequested{ false };
+    std::atomic<uint32_t> m_pendingBitrate{ 0 };
+    std::atomic<uint32_t> m_pendingFrameRate{ 0 };
+    // The rate the transform was last given; stamps sample durations.
+    std::atomic<uint32_t> m_frameRate{ 30 };
+    winrt::com_ptr<IMFTransform> m_transform;
+    std::shared_ptr<BufferPool> m_bufferPool;
+    std::unique_ptr<MediaSamplePool> m_inputSamples;
+    std::unique_ptr<MediaSamplePool> m_outputSamples;
+    std::shared_ptr<BitstreamArena> m_bitstreamArena;
+    size_t m_bitstreamSize = 0;
+    bool m_started = false;
 };
\ No newline at end of file
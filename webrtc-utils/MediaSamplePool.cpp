@@ -0,0 +1,291 @@
+﻿#include "pch.h"
+#include "MediaSamplePool.h"
+
+#include <mferror.h>
+
+using namespace winrt;
+
+// {5C1A9E0B-7F3D-4C8E-9A61-2B74D0E8F113}
+static const GUID MFSamplePool_SlotIndex = { 0x5c1a9e0b, 0x7f3d, 0x4c8e, { 0x9a, 0x61, 0x2b, 0x74, 0xd0, 0xe8, 0xf1, 0x13 } };
+
+struct PooledMediaBuffer : implements<PooledMediaBuffer, IMFMediaBuffer>
+{
+    explicit PooledMediaBuffer(std::shared_ptr<BufferPool> bufferPool)
+        : m_bufferPool(std::move(bufferPool))
+    {
+    }
+
+    bool Attach(size_t size)
+    {
+        m_block = m_bufferPool->Acquire(size);
+        m_block.SetSize(0);
+        return static_cast<bool>(m_block);
+    }
+
+    void Detach()
+    {
+        m_block.Reset();
+    }
+
+    HRESULT __stdcall Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength) noexcept final
+    {
+        if (ppbBuffer == nullptr)
+            return E_POINTER;
+        if (!m_block)
+            return MF_E_INVALIDREQUEST;
+
+        *ppbBuffer = m_block.Data();
+        if (pcbMaxLength != nullptr)
+            *pcbMaxLength = static_cast<DWORD>(m_block.Capacity());
+        if (pcbCurrentLength != nullptr)
+            *pcbCurrentLength = static_cast<DWORD>(m_block.Size());
+        return S_OK;
+    }
+
+    HRESULT __stdcall Unlock() noexcept final
+    {
+        return S_OK;
+    }
+
+    HRESULT __stdcall GetCurrentLength(DWORD* pcbCurrentLength) noexcept final
+    {
+        if (pcbCurrentLength == nullptr)
+            return E_POINTER;
+        *pcbCurrentLength = static_cast<DWORD>(m_block.Size());
+        return S_OK;
+    }
+
+    HRESULT __stdcall SetCurrentLength(DWORD cbCurrentLength) noexcept final
+    {
+        if (cbCurrentLength > m_block.Capacity())
+            return E_INVALIDARG;
+        m_block.SetSize(cbCurrentLength);
+        return S_OK;
+    }
+
+    HRESULT __stdcall GetMaxLength(DWORD* pcbMaxLength) noexcept final
+    {
+        if (pcbMaxLength == nullptr)
+            return E_POINTER;
+        *pcbMaxLength = static_cast<DWORD>(m_block.Capacity());
+        return S_OK;
+    }
+
+private:
+    std::shared_ptr<BufferPool> m_bufferPool;
+    PooledBuffer m_block;
+};
+
+// Exposes a captured frame to the transform without copying it. Only for
+// packed NV12, which is the layout the encoder's input type promises.
+struct BorrowedMediaBuffer : implements<BorrowedMediaBuffer, IMFMediaBuffer>
+{
+    void Attach(BorrowedFrame& frame)
+    {
+        m_frame = std::move(frame);
+        m_size = static_cast<DWORD>(FrameView::PackedSize(FrameFormat::Nv12, m_frame.Width(), m_frame.Height()));
+        m_currentLength = m_size;
+    }
+
+    // Runs the frame's release hook.
+    void Detach()
+    {
+        m_frame.Release();
+        m_size = 0;
+        m_currentLength = 0;
+    }
+
+    HRESULT __stdcall Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength) noexcept final
+    {
+        if (ppbBuffer == nullptr)
+            return E_POINTER;
+        if (!m_frame)
+            return MF_E_INVALIDREQUEST;
+
+        *ppbBuffer = m_frame.View().planes[0].data;
+        if (pcbMaxLength != nullptr)
+            *pcbMaxLength = m_size;
+        if (pcbCurrentLength != nullptr)
+            *pcbCurrentLength = m_currentLength;
+        return S_OK;
+    }
+
+    HRESULT __stdcall Unlock() noexcept final
+    {
+        return S_OK;
+    }
+
+    HRESULT __stdcall GetCurrentLength(DWORD* pcbCurrentLength) noexcept final
+    {
+        if (pcbCurrentLength == nullptr)
+            return E_POINTER;
+        *pcbCurrentLength = m_currentLength;
+        return S_OK;
+    }
+
+    HRESULT __stdcall SetCurrentLength(DWORD cbCurrentLength) noexcept final
+    {
+        if (cbCurrentLength > m_size)
+            return E_INVALIDARG;
+        m_currentLength = cbCurrentLength;
+        return S_OK;
+    }
+
+    HRESULT __stdcall GetMaxLength(DWORD* pcbMaxLength) noexcept final
+    {
+        if (pcbMaxLength == nullptr)
+            return E_POINTER;
+        *pcbMaxLength = m_size;
+        return S_OK;
+    }
+
+private:
+    BorrowedFrame m_frame;
+    DWORD m_size = 0;
+    DWORD m_currentLength = 0;
+};
+
+struct MediaSamplePool::Slot
+{
+    com_ptr<IMFTrackedSample> sample;
+    com_ptr<PooledMediaBuffer> buffer;
+    com_ptr<BorrowedMediaBuffer> borrowed;
+};
+
+// Invoked by a tracked sample once its last reference is gone. The pool may
+// already be destroyed while the transform still held samples, so the owner
+// pointer is cleared under a lock on shutdown.
+struct MediaSamplePool::SampleReturnCallback : implements<SampleReturnCallback, IMFAsyncCallback>
+{
+    explicit SampleReturnCallback(MediaSamplePool* owner)
+        : m_owner(owner)
+    {
+    }
+
+    void Detach()
+    {
+        std::lock_guard lock(m_ownerMutex);
+        m_owner = nullptr;
+    }
+
+    HRESULT __stdcall GetParameters(DWORD*, DWORD*) noexcept final
+    {
+        return E_NOTIMPL;
+    }
+
+    HRESULT __stdcall Invoke(IMFAsyncResult* result) noexcept final
+    {
+        com_ptr<::IUnknown> object;
+        if (FAILED(result->GetObject(object.put())))
+            return S_OK;
+
+        com_ptr<IMFSample> sample = object.try_as<IMFSample>();
+        std::lock_guard lock(m_ownerMutex);
+        if (sample != nullptr && m_owner != nullptr)
+            m_owner->Return(sample.get());
+        return S_OK;
+    }
+
+private:
+    std::mutex m_ownerMutex;
+    MediaSamplePool* m_owner;
+};
+
+MediaSamplePool::MediaSamplePool(std::shared_ptr<BufferPool> bufferPool, uint32_t sampleCount)
+    : m_bufferPool(std::move(bufferPool)), m_slots(sampleCount)
+{
+    m_returnCallback = make_self<SampleReturnCallback>(this);
+    m_free.reserve(sampleCount);
+
+    for (uint32_t i = 0; i < sampleCount; i++)
+    {
+        Slot& slot = m_slots[i];
+        check_hresult(MFCreateTrackedSample(slot.sample.put()));
+        slot.buffer = make_self<PooledMediaBuffer>(m_bufferPool);
+        slot.borrowed = make_self<BorrowedMediaBuffer>();
+        m_free.push_back(i);
+    }
+}
+
+MediaSamplePool::~MediaSamplePool()
+{
+    m_returnCallback->Detach();
+}
+
+com_ptr<IMFSample> MediaSamplePool::Acquire(size_t size)
+{
+    uint32_t index;
+    if (!TakeSlot(index))
+        return nullptr;
+
+    Slot& slot = m_slots[index];
+    if (!slot.buffer->Attach(size))
+    {
+        std::lock_guard lock(m_freeMutex);
+        m_free.push_back(index);
+        m_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return Hand(index, slot.buffer.as<IMFMediaBuffer>().get());
+}
+
+com_ptr<IMFSample> MediaSamplePool::Wrap(BorrowedFrame& frame)
+{
+    uint32_t index;
+    if (!TakeSlot(index))
+        return nullptr;
+
+    Slot& slot = m_slots[index];
+    slot.borrowed->Attach(frame);
+    return Hand(index, slot.borrowed.as<IMFMediaBuffer>().get());
+}
+
+bool MediaSamplePool::TakeSlot(uint32_t& index)
+{
+    std::lock_guard lock(m_freeMutex);
+    if (m_free.empty())
+    {
+        m_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    index = m_free.back();
+    m_free.pop_back();
+    return true;
+}
+
+com_ptr<IMFSample> MediaSamplePool::Hand(uint32_t index, IMFMediaBuffer* buffer)
+{
+    // The slot's sample may last have carried the other kind of buffer.
+    // Attributes from the last use, such as CleanPoint on an encoder output,
+    // must not carry over either; only the slot index is ours to keep. Time
+    // and duration can't be cleared and are left for whoever fills the
+    // sample.
+    Slot& slot = m_slots[index];
+    com_ptr<IMFSample> sample = slot.sample.as<IMFSample>();
+    check_hresult(sample->RemoveAllBuffers());
+    check_hresult(sample->AddBuffer(buffer));
+    check_hresult(sample->DeleteAllItems());
+    check_hresult(sample->SetUINT32(MFSamplePool_SlotIndex, index));
+    check_hresult(slot.sample->SetAllocator(m_returnCallback.get(), nullptr));
+
+    // Only the caller keeps the sample alive from here on; the slot reference
+    // is dropped so the tracked sample can report when it becomes free.
+    slot.sample = nullptr;
+    return sample;
+}
+
+void MediaSamplePool::Return(IMFSample* sample)
+{
+    UINT32 index = 0;
+    if (FAILED(sample->GetUINT32(MFSamplePool_SlotIndex, &index)) || index >= m_slots.size())
+        return;
+
+    Slot& slot = m_slots[index];
+    slot.buffer->Detach();
+    slot.borrowed->Detach();
+    slot.sample = nullptr;
+    sample->QueryInterface(IID_PPV_ARGS(slot.sample.put()));
+
+    std::lock_guard lock(m_freeMutex);
+    m_free.push_back(index);
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <mfapi.h>
+#include <mfidl.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "BorrowedFrame.h"
+#include "BufferPool.h"
+
+// Recycles IMFSamples whose single buffer is either backed by a BufferPool
+// block or wraps a borrowed frame in place. Samples are tracked, so they
+// return to the free list once the transform and every other holder
+// released them, and their block goes back to the BufferPool, or the frame
+// is released, at the same time. Each slot keeps its buffer objects for
+// good, so neither kind allocates once the pool is built.
+class MediaSamplePool
+{
+public:
+    MediaSamplePool(std::shared_ptr<BufferPool> bufferPool, uint32_t sampleCount);
+    ~MediaSamplePool();
+
+    // Returns nullptr when no sample or block is free; callers fall back to
+    // MFCreateSample/MFCreateMemoryBuffer. The sample comes without
+    // attributes, but its time and duration are the last user's.
+    winrt::com_ptr<IMFSample> Acquire(size_t size);
+    // Puts a packed NV12 frame in a sample without copying it. When no
+    // sample is free the frame is left alone and nullptr returned.
+    winrt::com_ptr<IMFSample> Wrap(BorrowedFrame& frame);
+
+    uint64_t Fallbacks() const { return m_fallbacks.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot;
+    struct SampleReturnCallback;
+
+    bool TakeSlot(uint32_t& index);
+    winrt::com_ptr<IMFSample> Hand(uint32_t index, IMFMediaBuffer* buffer);
+    void Return(IMFSample* sample);
+
+    std::shared_ptr<BufferPool> m_bufferPool;
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+    std::mutex m_freeMutex;
+    winrt::com_ptr<SampleReturnCallback> m_returnCallback;
+    std::atomic<uint64_t> m_fallbacks{ 0 };
+};
@@ -0,0 +1,158 @@
+﻿#include "Nv12Scaler.h"
+#include "PixelConvertKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+bool Nv12Scaler::Configure(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, const Config& config)
+{
+    if (m_configured && srcWidth == m_srcWidth && srcHeight == m_srcHeight && dstWidth == m_dstWidth && dstHeight == m_dstHeight
+        && config.filter == m_config.filter && config.siting == m_config.siting)
+        return true;
+
+    m_configured = false;
+    if (srcWidth == 0 || srcHeight == 0 || dstWidth == 0 || dstHeight == 0
+        || ((srcWidth | srcHeight | dstWidth | dstHeight) & 1) != 0)
+        return false;
+
+    Plane luma;
+    Plane chroma;
+    luma.srcWidth = srcWidth;
+    chroma.srcWidth = srcWidth / 2;
+    chroma.channels = 2;
+    if (!BuildAxis(srcWidth, dstWidth, config.filter, false, luma.horizontal)
+        || !BuildAxis(srcHeight, dstHeight, config.filter, false, luma.vertical)
+        || !BuildAxis(srcWidth / 2, dstWidth / 2, config.filter, config.siting == ChromaSiting::Left, chroma.horizontal)
+        || !BuildAxis(srcHeight / 2, dstHeight / 2, config.filter, false, chroma.vertical))
+        return false;
+
+    m_luma = std::move(luma);
+    m_chroma = std::move(chroma);
+    m_row.resize(srcWidth);
+    m_rows.resize(std::max(m_luma.vertical.taps, m_chroma.vertical.taps));
+    m_srcWidth = srcWidth;
+    m_srcHeight = srcHeight;
+    m_dstWidth = dstWidth;
+    m_dstHeight = dstHeight;
+    m_config = config;
+    m_configured = true;
+    return true;
+}
+
+bool Nv12Scaler::BuildAxis(uint32_t srcSize, uint32_t dstSize, ScaleFilter filter, bool leftSited, Axis& axis)
+{
+    double ratio = static_cast<double>(srcSize) / dstSize;
+    bool box = filter == ScaleFilter::Box && ratio > 1.0;
+    uint32_t taps = box ? static_cast<uint32_t>(std::ceil(ratio)) + 1 : 2;
+    if (taps > MaxFilterTaps)
+        return false;
+
+    // Output sample i is centered on source position (i + 0.5) * ratio - 0.5.
+    // Left-sited chroma sits half a luma sample, a quarter of a chroma
+    // sample, left of the center on both grids.
+    double shift = leftSited ? -(ratio - 1.0) / 4.0 : 0.0;
+    axis.taps = taps;
+    axis.indices.assign(static_cast<size_t>(dstSize) * taps, 0);
+    axis.weights.assign(static_cast<size_t>(dstSize) * taps, 0);
+    double weights[MaxFilterTaps];
+    for (uint32_t i = 0; i < dstSize; i++)
+    {
+        double center = (i + 0.5) * ratio - 0.5 + shift;
+        int64_t first;
+        uint32_t count;
+        if (box)
+        {
+            // Sample k covers [k - 0.5, k + 0.5).
+            double left = center - ratio / 2.0;
+            double right = center + ratio / 2.0;
+            first = static_cast<int64_t>(std::floor(left + 0.5));
+            count = 0;
+            for (int64_t k = first; k - 0.5 < right && count < taps; k++)
+            {
+                double overlap = std::min(right, k + 0.5) - std::max(left, k - 0.5);
+                weights[count++] = std::max(overlap, 0.0) / ratio;
+            }
+        }
+        else
+        {
+            first = static_cast<int64_t>(std::floor(center));
+            double fraction = center - first;
+            weights[0] = 1.0 - fraction;
+            weights[1] = fraction;
+            count = 2;
+        }
+
+        // Rounds every weight and gives the rounding error to the largest
+        // so each output keeps unit gain.
+        int16_t* fixed = &axis.weights[static_cast<size_t>(i) * taps];
+        uint32_t* indices = &axis.indices[static_cast<size_t>(i) * taps];
+        int32_t total = 0;
+        uint32_t largest = 0;
+        for (uint32_t k = 0; k < count; k++)
+        {
+            fixed[k] = static_cast<int16_t>(std::lround(weights[k] * (1 << FilterShift)));
+            total += fixed[k];
+            if (fixed[k] > fixed[largest])
+                largest = k;
+            // Edges repeat the outermost sample.
+            indices[k] = static_cast<uint32_t>(std::clamp<int64_t>(first + k, 0, srcSize - 1));
+        }
+        fixed[largest] = static_cast<int16_t>(fixed[largest] + (1 << FilterShift) - total);
+        for (uint32_t k = count; k < taps; k++)
+            indices[k] = indices[count - 1];
+    }
+    return true;
+}
+
+void Nv12Scaler::ScalePlane(const Plane& plane, const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride)
+{
+    const Axis& horizontal = plane.horizontal;
+    const Axis& vertical = plane.vertical;
+    uint32_t channels = plane.channels;
+    uint32_t rowBytes = plane.srcWidth * channels;
+    uint32_t dstWidth = static_cast<uint32_t>(horizontal.indices.size() / horizontal.taps);
+    uint32_t dstHeight = static_cast<uint32_t>(vertical.indices.size() / vertical.taps);
+    const int32_t round = 1 << (FilterShift - 1);
+
+    for (uint32_t y = 0; y < dstHeight; y++)
+    {
+        // Vertical pass into one full-width row, then horizontal from it.
+        const uint32_t* rowIndices = &vertical.indices[static_cast<size_t>(y) * vertical.taps];
+        for (uint32_t k = 0; k < vertical.taps; k++)
+            m_rows[k] = src + static_cast<size_t>(rowIndices[k]) * srcStride;
+        FilterRows(m_rows.data(), &vertical.weights[static_cast<size_t>(y) * vertical.taps], vertical.taps, m_row.data(), rowBytes);
+
+        uint8_t* out = dst + static_cast<size_t>(y) * dstStride;
+        const uint32_t* indices = horizontal.indices.data();
+        const int16_t* weights = horizontal.weights.data();
+        for (uint32_t x = 0; x < dstWidth; x++, indices += horizontal.taps, weights += horizontal.taps)
+        {
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                int32_t sum = round;
+                for (uint32_t k = 0; k < horizontal.taps; k++)
+                    sum += weights[k] * m_row[indices[k] * channels + c];
+                out[x * channels + c] = static_cast<uint8_t>(std::clamp(sum >> FilterShift, 0, 255));
+            }
+        }
+    }
+}
+
+bool Nv12Scaler::Scale(const FrameView& src, const FrameView& dst)
+{
+    if (src.format != FrameFormat::Nv12 || dst.format != FrameFormat::Nv12 || src.width != m_srcWidth || src.height != m_srcHeight
+        || dst.width != m_dstWidth || dst.height != m_dstHeight)
+        return false;
+    return Scale(src.planes[0].data, src.planes[0].stride, src.planes[1].data, src.planes[1].stride,
+        dst.planes[0].data, dst.planes[0].stride, dst.planes[1].data, dst.planes[1].stride);
+}
+
+bool Nv12Scaler::Scale(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcUV, uint32_t srcUVStride,
+    uint8_t* dstY, uint32_t dstYStride, uint8_t* dstUV, uint32_t dstUVStride)
+{
+    if (!m_configured)
+        return false;
+    ScalePlane(m_luma, srcY, srcYStride, dstY, dstYStride);
+    ScalePlane(m_chroma, srcUV, srcUVStride, dstUV, dstUVStride);
+    return true;
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameView.h"
+
+enum class ScaleFilter
+{
+    // Two taps per axis. Sharp, but aliases below half size.
+    Bilinear,
+    // Averages the source area under each output pixel; falls back to
+    // bilinear when enlarging.
+    Box,
+};
+
+// Horizontal position of chroma samples. Vertically they always sit
+// halfway between their two luma rows.
+enum class ChromaSiting
+{
+    // With the left luma sample, the H.264 and MPEG-2 default.
+    Left,
+    // Between the two luma samples, as in JPEG and MPEG-1.
+    Center,
+};
+
+// Resizes NV12 frames by any ratio. The filter tables are built once per
+// size pair, so Configure is cheap to call for every frame. Not thread
+// safe; each thread scales with its own instance.
+class Nv12Scaler
+{
+public:
+    struct Config
+    {
+        ScaleFilter filter = ScaleFilter::Box;
+        ChromaSiting siting = ChromaSiting::Left;
+    };
+
+    // Sizes must be even. Fails for ratios beyond what the filter supports.
+    bool Configure(uint32_t srcWidth, uint32_t srcHeight, uint32_t dstWidth, uint32_t dstHeight, const Config& config);
+
+    bool Scale(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcUV, uint32_t srcUVStride,
+        uint8_t* dstY, uint32_t dstYStride, uint8_t* dstUV, uint32_t dstUVStride);
+    // Both views must be NV12 of the configured sizes.
+    bool Scale(const FrameView& src, const FrameView& dst);
+
+    uint32_t DstWidth() const { return m_dstWidth; }
+    uint32_t DstHeight() const { return m_dstHeight; }
+
+private:
+    // For output sample i, taps source indices from indices[i * taps] with
+    // the matching fixed-point weights.
+    struct Axis
+    {
+        uint32_t taps = 0;
+        std::vector<uint32_t> indices;
+        std::vector<int16_t> weights;
+    };
+
+    struct Plane
+    {
+        Axis horizontal;
+        Axis vertical;
+        uint32_t srcWidth = 0;
+        uint32_t channels = 1;
+    };
+
+    static bool BuildAxis(uint32_t srcSize, uint32_t dstSize, ScaleFilter filter, bool leftSited, Axis& axis);
+    void ScalePlane(const Plane& plane, const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride);
+
+    uint32_t m_srcWidth = 0;
+    uint32_t m_srcHeight = 0;
+    uint32_t m_dstWidth = 0;
+    uint32_t m_dstHeight = 0;
+    Config m_config;
+    bool m_configured = false;
+    Plane m_luma;
+    Plane m_chroma;
+    std::vector<uint8_t> m_row;
+    std::vector<const uint8_t*> m_rows;
+};
@@ -0,0 +1,221 @@
+﻿#include "OpenH264Encoder.h"
+#include "Trace.h"
+
+#ifdef WEBRTCUTILS_OPENH264
+
+#include <wels/codec_api.h>
+
+static EProfileIdc ToProfileIdc(H264Profile profile)
+{
+    switch (profile)
+    {
+    case H264Profile::Baseline:
+        return PRO_BASELINE;
+    case H264Profile::High:
+        return PRO_HIGH;
+    default:
+        return PRO_MAIN;
+    }
+}
+
+OpenH264Encoder::OpenH264Encoder() = default;
+
+OpenH264Encoder::~OpenH264Encoder()
+{
+    Shutdown();
+}
+
+bool OpenH264Encoder::Configure(const VideoEncoderSettings& settings)
+{
+    Shutdown();
+
+    if (WelsCreateSVCEncoder(&m_encoder) != 0 || m_encoder == nullptr)
+        return false;
+
+    SEncParamExt params;
+    m_encoder->GetDefaultParams(&params);
+    params.iUsageType = CAMERA_VIDEO_REAL_TIME;
+    params.iPicWidth = static_cast<int>(settings.width);
+    params.iPicHeight = static_cast<int>(settings.height);
+    params.iTargetBitrate = static_cast<int>(settings.bitrate);
+    params.iMaxBitrate = static_cast<int>(settings.bitrate);
+    params.iRCMode = RC_BITRATE_MODE;
+    params.fMaxFrameRate = static_cast<float>(settings.frameRate);
+    params.bEnableFrameSkip = true;
+    params.uiIntraPeriod = 0;
+    params.iSpatialLayerNum = 1;
+    params.sSpatialLayers[0].iVideoWidth = params.iPicWidth;
+    params.sSpatialLayers[0].iVideoHeight = params.iPicHeight;
+    params.sSpatialLayers[0].fFrameRate = params.fMaxFrameRate;
+    params.sSpatialLayers[0].iSpatialBitrate = params.iTargetBitrate;
+    params.sSpatialLayers[0].iMaxSpatialBitrate = params.iMaxBitrate;
+    params.sSpatialLayers[0].uiProfileIdc = ToProfileIdc(settings.profile);
+    params.sSpatialLayers[0].uiLevelIdc = static_cast<ELevelIdc>(settings.level);
+    params.iEntropyCodingModeFlag = settings.profile == H264Profile::Baseline ? 0 : 1;
+
+    int videoFormat = videoFormatI420;
+    if (m_encoder->InitializeExt(&params) != cmResultSuccess
+        || m_encoder->SetOption(ENCODER_OPTION_DATAFORMAT, &videoFormat) != cmResultSuccess)
+    {
+        Shutdown();
+        return false;
+    }
+
+    size_t frameSize = static_cast<size_t>(settings.width) * settings.height * 3 / 2;
+    m_settings = settings;
+    m_pendingBitrate = 0;
+    m_pendingFrameRate = 0;
+    m_chroma.resize(frameSize / 3);
+    m_bitstreamArena = std::make_shared<BitstreamArena>(frameSize, 32);
+    return true;
+}
+
+EncodedFrameRef OpenH264Encoder::Encode(BorrowedFrame frame)
+{
+    if (m_encoder == nullptr)
+        return EncodedFrameRef();
+
+    const FrameView& view = frame.View();
+    if (view.format != FrameFormat::Nv12 || view.width != m_settings.width || view.height != m_settings.height)
+        return EncodedFrameRef();
+
+    // Luma is passed in place, stride and all; only the interleaved chroma
+    // is rewritten.
+    uint32_t chromaWidth = m_settings.width / 2;
+    uint32_t chromaHeight = m_settings.height / 2;
+    uint8_t* u = m_chroma.data();
+    uint8_t* v = u + static_cast<size_t>(chromaWidth) * chromaHeight;
+    {
+        TRACE_SCOPE("convert");
+        for (uint32_t row = 0; row < chromaHeight; row++)
+        {
+            const uint8_t* interleaved = view.planes[1].data + static_cast<size_t>(row) * view.planes[1].stride;
+            uint8_t* uRow = u + static_cast<size_t>(row) * chromaWidth;
+            uint8_t* vRow = v + static_cast<size_t>(row) * chromaWidth;
+            for (uint32_t i = 0; i < chromaWidth; i++)
+            {
+                uRow[i] = interleaved[i * 2];
+                vRow[i] = interleaved[i * 2 + 1];
+            }
+        }
+    }
+
+    SSourcePicture picture = {};
+    picture.iColorFormat = videoFormatI420;
+    picture.iPicWidth = static_cast<int>(m_settings.width);
+    picture.iPicHeight = static_cast<int>(m_settings.height);
+    picture.iStride[0] = static_cast<int>(view.planes[0].stride);
+    picture.iStride[1] = static_cast<int>(chromaWidth);
+    picture.iStride[2] = static_cast<int>(chromaWidth);
+    picture.pData[0] = view.planes[0].data;
+    picture.pData[1] = u;
+    picture.pData[2] = v;
+    // OpenH264 wants milliseconds.
+    picture.uiTimeStamp = frame.Timestamp() / 10000;
+
+    ApplyPendingControls();
+
+    SFrameBSInfo info = {};
+    int result;
+    {
+        TRACE_SCOPE("encode");
+        result = m_encoder->EncodeFrame(&picture, &info);
+    }
+    int64_t timestamp = frame.Timestamp();
+    frame.Release();
+    if (result != cmResultSuccess || info.eFrameType == videoFrameTypeSkip || info.eFrameType == videoFrameTypeInvalid)
+        return EncodedFrameRef();
+
+    size_t size = 0;
+    for (int layer = 0; layer < info.iLayerNum; layer++)
+    {
+        const SLayerBSInfo& layerInfo = info.sLayerInfo[layer];
+        for (int nal = 0; nal < layerInfo.iNalCount; nal++)
+            size += layerInfo.pNalLengthInByte[nal];
+    }
+
+    EncodedFrameRef encoded = m_bitstreamArena->Allocate(size);
+    for (int layer = 0; layer < info.iLayerNum; layer++)
+    {
+        const SLayerBSInfo& layerInfo = info.sLayerInfo[layer];
+        size_t layerSize = 0;
+        for (int nal = 0; nal < layerInfo.iNalCount; nal++)
+            layerSize += layerInfo.pNalLengthInByte[nal];
+        encoded->Append(layerInfo.pBsBuf, layerSize);
+    }
+    encoded->SetTimestamp(timestamp);
+    encoded->SetKeyFrame(info.eFrameType == videoFrameTypeIDR);
+    return encoded;
+}
+
+void OpenH264Encoder::RequestKeyFrame()
+{
+    m_keyFrameRequested = true;
+}
+
+bool OpenH264Encoder::SetRate(uint32_t bitrate, uint32_t frameRate)
+{
+    if (bitrate == 0 || frameRate == 0)
+        return false;
+
+    // OpenH264 is only touched from the encode thread; the new rate is
+    // applied before the next frame.
+    m_pendingBitrate = bitrate;
+    m_pendingFrameRate = frameRate;
+    return true;
+}
+
+void OpenH264Encoder::ApplyPendingControls()
+{
+    if (m_keyFrameRequested.exchange(false))
+        m_encoder->ForceIntraFrame(true);
+
+    uint32_t bitrate = m_pendingBitrate.exchange(0);
+    uint32_t frameRate = m_pendingFrameRate.exchange(0);
+    if (bitrate != 0)
+    {
+        SBitrateInfo bitrateInfo = {};
+        bitrateInfo.iLayer = SPATIAL_LAYER_ALL;
+        bitrateInfo.iBitrate = static_cast<int>(bitrate);
+        if (m_encoder->SetOption(ENCODER_OPTION_BITRATE, &bitrateInfo) == cmResultSuccess)
+            m_settings.bitrate = bitrate;
+    }
+    if (frameRate != 0)
+    {
+        float maxFrameRate = static_cast<float>(frameRate);
+        if (m_encoder->SetOption(ENCODER_OPTION_FRAME_RATE, &maxFrameRate) == cmResultSuccess)
+            m_settings.frameRate = frameRate;
+    }
+}
+
+bool OpenH264Encoder::Reconfigure(const VideoEncoderSettings& settings)
+{
+    if (m_encoder == nullptr || settings.NeedsRestart(m_settings))
+        return Configure(settings);
+    return SetRate(settings.bitrate, settings.frameRate);
+}
+
+std::vector<EncodedFrameRef> OpenH264Encoder::Flush()
+{
+    // The real-time usage has no lookahead; every frame comes out of Encode.
+    return std::vector<EncodedFrameRef>();
+}
+
+void OpenH264Encoder::Shutdown()
+{
+    if (m_encoder == nullptr)
+        return;
+
+    m_encoder->Uninitialize();
+    WelsDestroySVCEncoder(m_encoder);
+    m_encoder = nullptr;
+}
+
+BitstreamArena::Stats OpenH264Encoder::GetBitstreamStats() const
+{
+    if (m_bitstreamArena == nullptr)
+        return BitstreamArena::Stats();
+    return m_bitstreamArena->GetStats();
+}
+
+#endif
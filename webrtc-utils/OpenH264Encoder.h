@@ -0,0 +1,46 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "VideoEncoderBackend.h"
+
+class ISVCEncoder;
+
+// Software H.264 backend on top of Cisco's OpenH264. It has no platform
+// dependencies, so the whole encode pipeline can run off-device. Only built
+// with WEBRTCUTILS_OPENH264 defined and openh264 on the include and link
+// paths.
+class OpenH264Encoder : public IVideoEncoderBackend
+{
+public:
+    OpenH264Encoder();
+    OpenH264Encoder(const OpenH264Encoder&) = delete;
+    OpenH264Encoder& operator=(const OpenH264Encoder&) = delete;
+    ~OpenH264Encoder() override;
+
+    const char* Name() const override { return "OpenH264"; }
+    bool Configure(const VideoEncoderSettings& settings) override;
+    EncodedFrameRef Encode(BorrowedFrame frame) override;
+    void RequestKeyFrame() override;
+    bool SetRate(uint32_t bitrate, uint32_t frameRate) override;
+    bool Reconfigure(const VideoEncoderSettings& settings) override;
+    std::vector<EncodedFrameRef> Flush() override;
+    void Shutdown() override;
+
+    BitstreamArena::Stats GetBitstreamStats() const override;
+
+private:
+    void ApplyPendingControls();
+
+    ISVCEncoder* m_encoder = nullptr;
+    VideoEncoderSettings m_settings;
+    std::shared_ptr<BitstreamArena> m_bitstreamArena;
+    // OpenH264 only takes planar I420, so NV12 chroma is split in here.
+    std::vector<uint8_t> m_chroma;
+    std::atomic<bool> m_keyFrameRequested{ false };
+    // Zero when there is no change waiting for the next frame.
+    std::atomic<uint32_t> m_pendingBitrate{ 0 };
+    std::atomic<uint32_t> m_pendingFrameRate{ 0 };
+};
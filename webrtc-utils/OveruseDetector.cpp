@@ -0,0 +1,95 @@
+﻿#include "OveruseDetector.h"
+
+#include <algorithm>
+
+OveruseDetector::OveruseDetector()
+    : OveruseDetector(Config())
+{
+}
+
+OveruseDetector::OveruseDetector(const Config& config)
+    : m_config(config), m_restoreDelay(config.restoreDelay)
+{
+}
+
+OveruseDetector::Signal OveruseDetector::AddSample(const Sample& sample)
+{
+    if (sample.frameInterval.count() <= 0)
+        return Signal::None;
+
+    double interval = static_cast<double>(sample.frameInterval.count());
+    double usage = static_cast<double>(sample.encodeTime.count()) / interval;
+    m_usage = m_hasUsage ? m_usage + m_config.smoothing * (usage - m_usage) : usage;
+    m_hasUsage = true;
+    m_windowMaxQueue = std::max(m_windowMaxQueue, static_cast<double>(sample.queueDelay.count()) / interval);
+    m_windowSamples++;
+
+    if (!m_started)
+    {
+        m_started = true;
+        m_nextCheck = sample.now + m_config.checkInterval;
+        return Signal::None;
+    }
+    if (sample.now < m_nextCheck)
+        return Signal::None;
+
+    m_nextCheck = sample.now + m_config.checkInterval;
+    bool decided = m_windowSamples >= m_config.minSamples;
+    double maxQueue = m_windowMaxQueue;
+    StartWindow();
+    if (!decided)
+        return Signal::None;
+
+    if (m_usage > m_config.overuseUsage || maxQueue > m_config.overuseQueueFrames)
+    {
+        if (++m_overusedChecks < m_config.overuseChecks)
+            return Signal::None;
+        m_overusedChecks = 0;
+        return Signal::Overuse;
+    }
+    m_overusedChecks = 0;
+
+    bool settled = !m_adapted || sample.now - m_lastAdaptation >= m_restoreDelay;
+    if (m_usage < m_config.underuseUsage && maxQueue < 1.0 && settled)
+        return Signal::Underuse;
+    return Signal::None;
+}
+
+void OveruseDetector::OnAdapted(Clock::time_point now, Signal signal)
+{
+    // Overuse soon after a restore means the restore came too early; wait
+    // longer before the next one. A restore that held for restoreDelay
+    // resets the wait. Overuse that follows overuse says nothing about
+    // restores and leaves the wait as it is.
+    if (signal == Signal::Overuse && m_adapted && m_lastSignal == Signal::Underuse)
+    {
+        bool held = now - m_lastAdaptation >= m_config.restoreDelay;
+        m_restoreDelay = held ? m_config.restoreDelay : std::min(m_restoreDelay * 2, m_config.maxRestoreDelay);
+    }
+    m_adapted = true;
+    m_lastAdaptation = now;
+    m_lastSignal = signal;
+
+    m_hasUsage = false;
+    m_overusedChecks = 0;
+    m_nextCheck = now + m_config.checkInterval;
+    StartWindow();
+}
+
+void OveruseDetector::Reset()
+{
+    m_usage = 0.0;
+    m_hasUsage = false;
+    m_started = false;
+    m_overusedChecks = 0;
+    m_restoreDelay = m_config.restoreDelay;
+    m_adapted = false;
+    m_lastSignal = Signal::None;
+    StartWindow();
+}
+
+void OveruseDetector::StartWindow()
+{
+    m_windowSamples = 0;
+    m_windowMaxQueue = 0.0;
+}
@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Tells from encode timings whether the encoder keeps up with the frame
+// rate. Usage is the smoothed share of the frame interval spent encoding;
+// together with how long frames waited in front of the encoder it is
+// checked at a fixed interval. Overuse has to persist for a few checks
+// before it is reported, and underuse is only reported once the last
+// adaptation has settled, with the wait doubled whenever a restore turns
+// out to be premature. Time always comes in with the samples and never
+// from a clock, so the same samples give the same decisions.
+class OveruseDetector
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        // Usage above which the encoder counts as overused.
+        double overuseUsage = 0.85;
+        // Usage below which there is room to restore quality.
+        double underuseUsage = 0.45;
+        // Queue delay, in frame intervals, that counts as overuse whatever
+        // the usage.
+        double overuseQueueFrames = 2.0;
+        // Weight of each new frame in the smoothed usage.
+        double smoothing = 0.1;
+        std::chrono::milliseconds checkInterval{ 1000 };
+        // Samples a check needs to be decided at all.
+        uint32_t minSamples = 5;
+        // Consecutive overused checks before overuse is reported.
+        uint32_t overuseChecks = 2;
+        std::chrono::milliseconds restoreDelay{ 10000 };
+        std::chrono::milliseconds maxRestoreDelay{ 240000 };
+    };
+
+    enum class Signal
+    {
+        None,
+        Overuse,
+        Underuse,
+    };
+
+    struct Sample
+    {
+        Clock::time_point now;
+        // Time inside the encoder.
+        Clock::duration encodeTime;
+        // Time from arrival to encoder input.
+        Clock::duration queueDelay;
+        // The interval the frame rate in effect allows per frame.
+        Clock::duration frameInterval;
+    };
+
+    OveruseDetector();
+    explicit OveruseDetector(const Config& config);
+
+    // Encode thread, once per encoded frame.
+    Signal AddSample(const Sample& sample);
+    // Encode thread. Call after acting on a signal; measurements taken
+    // under the old settings are thrown away.
+    void OnAdapted(Clock::time_point now, Signal signal);
+    // Forgets everything, including the restore backoff.
+    void Reset();
+
+    // Smoothed usage as a share of the frame interval; zero before the
+    // first sample.
+    double Usage() const { return m_usage; }
+    std::chrono::milliseconds RestoreDelay() const { return m_restoreDelay; }
+
+private:
+    void StartWindow();
+
+    Config m_config;
+    double m_usage = 0.0;
+    bool m_hasUsage = false;
+    bool m_started = false;
+    Clock::time_point m_nextCheck;
+    uint32_t m_windowSamples = 0;
+    double m_windowMaxQueue = 0.0;
+    uint32_t m_overusedChecks = 0;
+    std::chrono::milliseconds m_restoreDelay;
+    bool m_adapted = false;
+    Clock::time_point m_lastAdaptation;
+    Signal m_lastSignal = Signal::None;
+};
@@ -0,0 +1,78 @@
+﻿#include "PipelineMetrics.h"
+
+static uint64_t ElapsedMicroseconds(PipelineMetrics::Clock::time_point from, PipelineMetrics::Clock::time_point to)
+{
+    if (to <= from)
+        return 0;
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+PipelineMetrics::PipelineMetrics()
+    : m_lastSnapshot(Clock::now())
+{
+    for (InFlight& frame : m_inFlight)
+        frame.mediaTime = -1;
+}
+
+void PipelineMetrics::OnDropped(DropReason reason)
+{
+    m_drops[static_cast<size_t>(reason)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void PipelineMetrics::OnEncodeInput(int64_t mediaTime, Clock::time_point captureTime)
+{
+    InFlight& frame = m_inFlight[m_inFlightNext++ % InFlightCapacity];
+    frame.mediaTime = mediaTime;
+    frame.captureTime = captureTime;
+    frame.encodeTime = Clock::now();
+}
+
+void PipelineMetrics::OnEncoded(int64_t mediaTime, size_t size, bool keyFrame)
+{
+    m_framesEncoded.fetch_add(1, std::memory_order_relaxed);
+    m_bytesEncoded.fetch_add(size, std::memory_order_relaxed);
+    if (keyFrame)
+        m_keyFrames.fetch_add(1, std::memory_order_relaxed);
+
+    // Newest first; the match is almost always the last input.
+    Clock::time_point now = Clock::now();
+    for (uint32_t i = 1; i <= InFlightCapacity; i++)
+    {
+        InFlight& frame = m_inFlight[(m_inFlightNext - i) % InFlightCapacity];
+        if (frame.mediaTime != mediaTime)
+            continue;
+
+        m_captureToEncoded.Record(ElapsedMicroseconds(frame.captureTime, now));
+        m_encodeLatency.Record(ElapsedMicroseconds(frame.encodeTime, now));
+        frame.mediaTime = -1;
+        break;
+    }
+}
+
+PipelineMetrics::Snapshot PipelineMetrics::TakeSnapshot()
+{
+    std::lock_guard lock(m_snapshotMutex);
+    Snapshot snapshot = {};
+    snapshot.framesCaptured = m_framesCaptured.load(std::memory_order_relaxed);
+    snapshot.framesEncoded = m_framesEncoded.load(std::memory_order_relaxed);
+    snapshot.keyFrames = m_keyFrames.load(std::memory_order_relaxed);
+    snapshot.bytesEncoded = m_bytesEncoded.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < static_cast<size_t>(DropReason::Count); i++)
+        snapshot.drops[i] = m_drops[i].load(std::memory_order_relaxed);
+    snapshot.captureToEncoded = m_captureToEncoded.GetPercentiles();
+    snapshot.encodeLatency = m_encodeLatency.GetPercentiles();
+
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - m_lastSnapshot).count();
+    if (seconds > 0)
+    {
+        snapshot.captureFps = (snapshot.framesCaptured - m_lastCaptured) / seconds;
+        snapshot.encodedFps = (snapshot.framesEncoded - m_lastEncoded) / seconds;
+        snapshot.encodedBitrate = (snapshot.bytesEncoded - m_lastBytes) * 8 / seconds;
+    }
+    m_lastSnapshot = now;
+    m_lastCaptured = snapshot.framesCaptured;
+    m_lastEncoded = snapshot.framesEncoded;
+    m_lastBytes = snapshot.bytesEncoded;
+    return snapshot;
+}
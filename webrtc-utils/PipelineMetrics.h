@@ -0,0 +1,99 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include "LatencyHistogram.h"
+
+// Per-session counters and latency histograms. Every hot-path call is a few
+// relaxed atomic operations; Snapshot may run on any thread at any time and
+// only contends with other snapshots.
+class PipelineMetrics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class DropReason
+    {
+        // No callback or pull consumer was attached.
+        NoConsumer,
+        // Evicted from the capture queue by a newer frame.
+        CaptureQueue,
+        // Left over from before a resolution change.
+        FormatChange,
+        // Evicted from the delivery queue.
+        DeliveryQueue,
+        // The pull-mode ring was full.
+        PullQueue,
+        // A frame had an unusable layout or could not be converted to NV12
+        // or scaled.
+        Conversion,
+        // Over the frame rate CPU adaptation settled on.
+        Adaptation,
+        // Showed no change from the last frame encoded.
+        StaticScene,
+        Count,
+    };
+
+    struct Snapshot
+    {
+        // Rates cover the time since the previous snapshot.
+        double captureFps;
+        double encodedFps;
+        double encodedBitrate;
+        uint64_t framesCaptured;
+        uint64_t framesEncoded;
+        uint64_t keyFrames;
+        uint64_t bytesEncoded;
+        uint64_t drops[static_cast<size_t>(DropReason::Count)];
+        LatencyHistogram::Percentiles captureToEncoded;
+        LatencyHistogram::Percentiles encodeLatency;
+    };
+
+    PipelineMetrics();
+
+    // Capture thread.
+    void OnCaptured() { m_framesCaptured.fetch_add(1, std::memory_order_relaxed); }
+
+    // Any thread. Queue drops are counted by the queues themselves and
+    // filled in by the owner of the snapshot.
+    void OnDropped(DropReason reason);
+
+    // Encode thread. captureTime is when the frame arrived from the camera.
+    void OnEncodeInput(int64_t mediaTime, Clock::time_point captureTime);
+    void OnEncoded(int64_t mediaTime, size_t size, bool keyFrame);
+
+    Snapshot TakeSnapshot();
+
+private:
+    struct InFlight
+    {
+        int64_t mediaTime;
+        Clock::time_point captureTime;
+        Clock::time_point encodeTime;
+    };
+
+    // Encoders may hold several inputs before the matching output shows up;
+    // outputs are paired with inputs by media time.
+    static constexpr uint32_t InFlightCapacity = 32;
+
+    std::atomic<uint64_t> m_framesCaptured{ 0 };
+    std::atomic<uint64_t> m_framesEncoded{ 0 };
+    std::atomic<uint64_t> m_keyFrames{ 0 };
+    std::atomic<uint64_t> m_bytesEncoded{ 0 };
+    std::atomic<uint64_t> m_drops[static_cast<size_t>(DropReason::Count)] = {};
+    LatencyHistogram m_captureToEncoded;
+    LatencyHistogram m_encodeLatency;
+
+    // Encode thread only.
+    InFlight m_inFlight[InFlightCapacity] = {};
+    uint32_t m_inFlightNext = 0;
+
+    std::mutex m_snapshotMutex;
+    Clock::time_point m_lastSnapshot;
+    uint64_t m_lastCaptured = 0;
+    uint64_t m_lastEncoded = 0;
+    uint64_t m_lastBytes = 0;
+};
@@ -0,0 +1,458 @@
+﻿#include "PixelConvert.h"
+#include "PixelConvertKernels.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(PIXEL_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static uint8_t Clamp(int32_t value)
+{
+    return static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+static uint32_t ScalarYuy2ToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x += 2)
+    {
+        y0[x] = src0[x * 2];
+        y0[x + 1] = src0[x * 2 + 2];
+        y1[x] = src1[x * 2];
+        y1[x + 1] = src1[x * 2 + 2];
+        // Rounds up like the vector average instructions.
+        uv[x] = static_cast<uint8_t>((src0[x * 2 + 1] + src1[x * 2 + 1] + 1) >> 1);
+        uv[x + 1] = static_cast<uint8_t>((src0[x * 2 + 3] + src1[x * 2 + 3] + 1) >> 1);
+    }
+    return width;
+}
+
+static uint8_t ToLuma(const uint8_t* bgra, const YuvCoefficients& c)
+{
+    return Clamp((c.yB * bgra[0] + c.yG * bgra[1] + c.yR * bgra[2] + c.yOffset) >> YuvShift);
+}
+
+static uint32_t ScalarBgraToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width,
+    const YuvCoefficients& c)
+{
+    for (uint32_t x = 0; x < width; x += 2)
+    {
+        const uint8_t* a = src0 + x * 4;
+        const uint8_t* b = src1 + x * 4;
+        y0[x] = ToLuma(a, c);
+        y0[x + 1] = ToLuma(a + 4, c);
+        y1[x] = ToLuma(b, c);
+        y1[x + 1] = ToLuma(b + 4, c);
+
+        int32_t blue = (a[0] + a[4] + b[0] + b[4] + 2) >> 2;
+        int32_t green = (a[1] + a[5] + b[1] + b[5] + 2) >> 2;
+        int32_t red = (a[2] + a[6] + b[2] + b[6] + 2) >> 2;
+        uv[x] = Clamp((c.uB * blue + c.uG * green + c.uR * red + c.uvOffset) >> YuvShift);
+        uv[x + 1] = Clamp((c.vB * blue + c.vG * green + c.vR * red + c.uvOffset) >> YuvShift);
+    }
+    return width;
+}
+
+static uint32_t ScalarInterleaveUV(const uint8_t* u, const uint8_t* v, uint8_t* uv, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uv[i * 2] = u[i];
+        uv[i * 2 + 1] = v[i];
+    }
+    return count;
+}
+
+static uint32_t ScalarDeinterleaveUV(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        u[i] = uv[i * 2];
+        v[i] = uv[i * 2 + 1];
+    }
+    return count;
+}
+
+static uint32_t ScalarNv12ToBgra(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, uint32_t width, const RgbCoefficients& c)
+{
+    const int32_t round = 1 << (RgbShift - 1);
+    for (uint32_t x = 0; x < width; x++)
+    {
+        int32_t luma = c.y * (y[x] - c.yOffset);
+        int32_t u = uv[x & ~1u] - 128;
+        int32_t v = uv[x | 1u] - 128;
+        bgra[x * 4] = Clamp((luma + c.uB * u + round) >> RgbShift);
+        bgra[x * 4 + 1] = Clamp((luma - c.uG * u - c.vG * v + round) >> RgbShift);
+        bgra[x * 4 + 2] = Clamp((luma + c.vR * v + round) >> RgbShift);
+        bgra[x * 4 + 3] = 255;
+    }
+    return width;
+}
+
+static uint32_t ScalarFilterRows(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width)
+{
+    for (uint32_t x = 0; x < width; x++)
+    {
+        int32_t sum = 1 << (FilterShift - 1);
+        for (uint32_t k = 0; k < taps; k++)
+            sum += weights[k] * rows[k][x];
+        dst[x] = Clamp(sum >> FilterShift);
+    }
+    return width;
+}
+
+static uint32_t ScalarColumnSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor)
+{
+    for (uint32_t column = 0; column * SadColumnWidth < width; column++)
+    {
+        uint32_t sum = 0;
+        uint32_t end = column * SadColumnWidth + SadColumnWidth < width ? column * SadColumnWidth + SadColumnWidth : width;
+        for (uint32_t x = column * SadColumnWidth; x < end; x++)
+        {
+            int32_t difference = a[x] > b[x] ? a[x] - b[x] : b[x] - a[x];
+            sum += static_cast<uint32_t>(difference > floor ? difference - floor : 0);
+        }
+        sums[column] += sum;
+    }
+    return width;
+}
+
+const PixelKernels ScalarPixelKernels = {
+    ScalarYuy2ToNv12,
+    ScalarBgraToNv12,
+    ScalarInterleaveUV,
+    ScalarDeinterleaveUV,
+    ScalarNv12ToBgra,
+    ScalarFilterRows,
+    ScalarColumnSad,
+};
+
+struct MatrixWeights
+{
+    double red;
+    double blue;
+};
+
+static MatrixWeights WeightsOf(ColorMatrix matrix)
+{
+    return matrix == ColorMatrix::Bt709 ? MatrixWeights{ 0.2126, 0.0722 } : MatrixWeights{ 0.299, 0.114 };
+}
+
+static int16_t Fixed(double value, int shift)
+{
+    return static_cast<int16_t>(std::lround(value * (1 << shift)));
+}
+
+static YuvCoefficients ToYuvCoefficients(const ColorSpace& colorSpace)
+{
+    MatrixWeights k = WeightsOf(colorSpace.matrix);
+    double green = 1.0 - k.red - k.blue;
+    bool limited = colorSpace.range == ColorRange::Limited;
+    double lumaScale = limited ? 219.0 / 255.0 : 1.0;
+    double chromaScale = limited ? 224.0 / 255.0 : 1.0;
+    double uScale = chromaScale / (2.0 * (1.0 - k.blue));
+    double vScale = chromaScale / (2.0 * (1.0 - k.red));
+
+    YuvCoefficients c;
+    c.yR = Fixed(k.red * lumaScale, YuvShift);
+    c.yG = Fixed(green * lumaScale, YuvShift);
+    c.yB = Fixed(k.blue * lumaScale, YuvShift);
+    c.uR = Fixed(-k.red * uScale, YuvShift);
+    c.uG = Fixed(-green * uScale, YuvShift);
+    c.uB = Fixed((1.0 - k.blue) * uScale, YuvShift);
+    c.vR = Fixed((1.0 - k.red) * vScale, YuvShift);
+    c.vG = Fixed(-green * vScale, YuvShift);
+    c.vB = Fixed(-k.blue * vScale, YuvShift);
+    c.yOffset = ((limited ? 16 : 0) << YuvShift) + (1 << (YuvShift - 1));
+    c.uvOffset = (128 << YuvShift) + (1 << (YuvShift - 1));
+    return c;
+}
+
+static RgbCoefficients ToRgbCoefficients(const ColorSpace& colorSpace)
+{
+    MatrixWeights k = WeightsOf(colorSpace.matrix);
+    double green = 1.0 - k.red - k.blue;
+    bool limited = colorSpace.range == ColorRange::Limited;
+    double lumaScale = limited ? 255.0 / 219.0 : 1.0;
+    double chromaScale = limited ? 255.0 / 224.0 : 1.0;
+
+    RgbCoefficients c;
+    c.y = Fixed(lumaScale, RgbShift);
+    c.vR = Fixed(2.0 * (1.0 - k.red) * chromaScale, RgbShift);
+    c.uG = Fixed(2.0 * k.blue * (1.0 - k.blue) / green * chromaScale, RgbShift);
+    c.vG = Fixed(2.0 * k.red * (1.0 - k.red) / green * chromaScale, RgbShift);
+    c.uB = Fixed(2.0 * (1.0 - k.blue) * chromaScale, RgbShift);
+    c.yOffset = limited ? 16 : 0;
+    return c;
+}
+
+#ifdef PIXEL_X86
+static bool CpuHas(PixelIsa isa)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    bool avx2 = false;
+    if (maxLeaf >= 7 && osAvx)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    return isa == PixelIsa::Sse41 ? sse41 : avx2;
+#else
+    __builtin_cpu_init();
+    return isa == PixelIsa::Sse41 ? __builtin_cpu_supports("sse4.1") : __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+static const PixelKernels* KernelsFor(PixelIsa isa)
+{
+    switch (isa)
+    {
+    case PixelIsa::Scalar:
+        return &ScalarPixelKernels;
+#ifdef PIXEL_X86
+    case PixelIsa::Sse41:
+        return CpuHas(PixelIsa::Sse41) ? Sse41PixelKernels() : nullptr;
+    case PixelIsa::Avx2:
+        return CpuHas(PixelIsa::Avx2) ? Avx2PixelKernels() : nullptr;
+#endif
+#ifdef PIXEL_NEON
+    case PixelIsa::Neon:
+        return NeonPixelKernels();
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+static PixelIsa DetectPixelIsa()
+{
+    for (PixelIsa isa : { PixelIsa::Avx2, PixelIsa::Neon, PixelIsa::Sse41 })
+    {
+        if (KernelsFor(isa) != nullptr)
+            return isa;
+    }
+    return PixelIsa::Scalar;
+}
+
+static std::atomic<PixelIsa> s_isa{ DetectPixelIsa() };
+static std::atomic<const PixelKernels*> s_kernels{ KernelsFor(s_isa.load()) };
+
+PixelIsa ActivePixelIsa()
+{
+    return s_isa.load(std::memory_order_relaxed);
+}
+
+bool IsPixelIsaSupported(PixelIsa isa)
+{
+    return KernelsFor(isa) != nullptr;
+}
+
+bool SetPixelIsa(PixelIsa isa)
+{
+    const PixelKernels* kernels = KernelsFor(isa);
+    if (kernels == nullptr)
+        return false;
+    s_kernels.store(kernels, std::memory_order_relaxed);
+    s_isa.store(isa, std::memory_order_relaxed);
+    return true;
+}
+
+const char* PixelIsaName(PixelIsa isa)
+{
+    switch (isa)
+    {
+    case PixelIsa::Sse41:
+        return "SSE4.1";
+    case PixelIsa::Avx2:
+        return "AVX2";
+    case PixelIsa::Neon:
+        return "NEON";
+    default:
+        return "scalar";
+    }
+}
+
+void FilterRows(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width)
+{
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    uint32_t done = kernels->filterRows(rows, weights, taps, dst, width);
+    if (done >= width)
+        return;
+    const uint8_t* tail[MaxFilterTaps];
+    for (uint32_t k = 0; k < taps; k++)
+        tail[k] = rows[k] + done;
+    ScalarFilterRows(tail, weights, taps, dst + done, width - done);
+}
+
+void ColumnSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor)
+{
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    uint32_t done = kernels->columnSad(a, b, sums, width, floor);
+    // Kernels stop on a column boundary.
+    if (done < width)
+        ScalarColumnSad(a + done, b + done, sums + done / SadColumnWidth, width - done, floor);
+}
+
+static bool ValidSize(uint32_t width, uint32_t height)
+{
+    return width > 0 && height > 0 && (width & 1) == 0 && (height & 1) == 0;
+}
+
+bool Yuy2ToNv12(const uint8_t* src, uint32_t srcStride, uint8_t* dstY, uint32_t dstYStride,
+    uint8_t* dstUV, uint32_t dstUVStride, uint32_t width, uint32_t height)
+{
+    if (!ValidSize(width, height))
+        return false;
+
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    for (uint32_t row = 0; row < height; row += 2)
+    {
+        const uint8_t* src0 = src + static_cast<size_t>(row) * srcStride;
+        const uint8_t* src1 = src0 + srcStride;
+        uint8_t* y0 = dstY + static_cast<size_t>(row) * dstYStride;
+        uint8_t* y1 = y0 + dstYStride;
+        uint8_t* uv = dstUV + static_cast<size_t>(row / 2) * dstUVStride;
+        uint32_t done = kernels->yuy2ToNv12(src0, src1, y0, y1, uv, width);
+        if (done < width)
+            ScalarYuy2ToNv12(src0 + done * 2, src1 + done * 2, y0 + done, y1 + done, uv + done, width - done);
+    }
+    return true;
+}
+
+bool BgraToNv12(const uint8_t* src, uint32_t srcStride, uint8_t* dstY, uint32_t dstYStride,
+    uint8_t* dstUV, uint32_t dstUVStride, uint32_t width, uint32_t height, const ColorSpace& colorSpace)
+{
+    if (!ValidSize(width, height))
+        return false;
+
+    YuvCoefficients coefficients = ToYuvCoefficients(colorSpace);
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    for (uint32_t row = 0; row < height; row += 2)
+    {
+        const uint8_t* src0 = src + static_cast<size_t>(row) * srcStride;
+        const uint8_t* src1 = src0 + srcStride;
+        uint8_t* y0 = dstY + static_cast<size_t>(row) * dstYStride;
+        uint8_t* y1 = y0 + dstYStride;
+        uint8_t* uv = dstUV + static_cast<size_t>(row / 2) * dstUVStride;
+        uint32_t done = kernels->bgraToNv12(src0, src1, y0, y1, uv, width, coefficients);
+        if (done < width)
+            ScalarBgraToNv12(src0 + done * 4, src1 + done * 4, y0 + done, y1 + done, uv + done, width - done, coefficients);
+    }
+    return true;
+}
+
+static void CopyPlane(const uint8_t* src, uint32_t srcStride, uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height)
+{
+    for (uint32_t row = 0; row < height; row++)
+        std::memcpy(dst + static_cast<size_t>(row) * dstStride, src + static_cast<size_t>(row) * srcStride, width);
+}
+
+bool I420ToNv12(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcU, uint32_t srcUStride,
+    const uint8_t* srcV, uint32_t srcVStride, uint8_t* dstY, uint32_t dstYStride,
+    uint8_t* dstUV, uint32_t dstUVStride, uint32_t width, uint32_t height)
+{
+    if (!ValidSize(width, height))
+        return false;
+
+    CopyPlane(srcY, srcYStride, dstY, dstYStride, width, height);
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    uint32_t count = width / 2;
+    for (uint32_t row = 0; row < height / 2; row++)
+    {
+        const uint8_t* u = srcU + static_cast<size_t>(row) * srcUStride;
+        const uint8_t* v = srcV + static_cast<size_t>(row) * srcVStride;
+        uint8_t* uv = dstUV + static_cast<size_t>(row) * dstUVStride;
+        uint32_t done = kernels->interleaveUV(u, v, uv, count);
+        if (done < count)
+            ScalarInterleaveUV(u + done, v + done, uv + done * 2, count - done);
+    }
+    return true;
+}
+
+bool Nv12ToI420(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcUV, uint32_t srcUVStride,
+    uint8_t* dstY, uint32_t dstYStride, uint8_t* dstU, uint32_t dstUStride,
+    uint8_t* dstV, uint32_t dstVStride, uint32_t width, uint32_t height)
+{
+    if (!ValidSize(width, height))
+        return false;
+
+    CopyPlane(srcY, srcYStride, dstY, dstYStride, width, height);
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    uint32_t count = width / 2;
+    for (uint32_t row = 0; row < height / 2; row++)
+    {
+        const uint8_t* uv = srcUV + static_cast<size_t>(row) * srcUVStride;
+        uint8_t* u = dstU + static_cast<size_t>(row) * dstUStride;
+        uint8_t* v = dstV + static_cast<size_t>(row) * dstVStride;
+        uint32_t done = kernels->deinterleaveUV(uv, u, v, count);
+        if (done < count)
+            ScalarDeinterleaveUV(uv + done * 2, u + done, v + done, count - done);
+    }
+    return true;
+}
+
+bool Nv12ToBgra(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcUV, uint32_t srcUVStride,
+    uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height, const ColorSpace& colorSpace)
+{
+    if (!ValidSize(width, height))
+        return false;
+
+    RgbCoefficients coefficients = ToRgbCoefficients(colorSpace);
+    const PixelKernels* kernels = s_kernels.load(std::memory_order_relaxed);
+    for (uint32_t row = 0; row < height; row++)
+    {
+        const uint8_t* y = srcY + static_cast<size_t>(row) * srcYStride;
+        const uint8_t* uv = srcUV + static_cast<size_t>(row / 2) * srcUVStride;
+        uint8_t* bgra = dst + static_cast<size_t>(row) * dstStride;
+        uint32_t done = kernels->nv12ToBgra(y, uv, bgra, width, coefficients);
+        if (done < width)
+            ScalarNv12ToBgra(y + done, uv + done, bgra + done * 4, width - done, coefficients);
+    }
+    return true;
+}
+
+bool ConvertFrame(const FrameView& src, const FrameView& dst)
+{
+    if (src.width != dst.width || src.height != dst.height || !src || !dst)
+        return false;
+
+    const FramePlane* in = src.planes;
+    const FramePlane* out = dst.planes;
+    uint32_t width = src.width;
+    uint32_t height = src.height;
+    if (src.format == dst.format)
+        return CopyFrame(src, dst);
+    if (dst.format == FrameFormat::Nv12)
+    {
+        switch (src.format)
+        {
+        case FrameFormat::Yuy2:
+            return Yuy2ToNv12(in[0].data, in[0].stride, out[0].data, out[0].stride, out[1].data, out[1].stride, width, height);
+        case FrameFormat::Bgra8:
+            return BgraToNv12(in[0].data, in[0].stride, out[0].data, out[0].stride, out[1].data, out[1].stride, width, height, dst.color);
+        case FrameFormat::I420:
+            return I420ToNv12(in[0].data, in[0].stride, in[1].data, in[1].stride, in[2].data, in[2].stride,
+                out[0].data, out[0].stride, out[1].data, out[1].stride, width, height);
+        default:
+            return false;
+        }
+    }
+    if (src.format == FrameFormat::Nv12 && dst.format == FrameFormat::I420)
+    {
+        return Nv12ToI420(in[0].data, in[0].stride, in[1].data, in[1].stride, out[0].data, out[0].stride,
+            out[1].data, out[1].stride, out[2].data, out[2].stride, width, height);
+    }
+    if (src.format == FrameFormat::Nv12 && dst.format == FrameFormat::Bgra8)
+        return Nv12ToBgra(in[0].data, in[0].stride, in[1].data, in[1].stride, out[0].data, out[0].stride, width, height, src.color);
+    return false;
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+
+#include <cstdint>
+
+#include "FrameView.h"
+
+// Instruction sets the conversion kernels come in. The best one the CPU
+// supports is picked on first use; every kernel gives bit-identical output
+// to the scalar one.
+enum class PixelIsa
+{
+    Scalar,
+    Sse41,
+    Avx2,
+    Neon,
+};
+
+PixelIsa ActivePixelIsa();
+bool IsPixelIsaSupported(PixelIsa isa);
+// Overrides the automatic choice, e.g. to compare against the scalar
+// kernels. Fails for instruction sets the CPU or the build lacks.
+bool SetPixelIsa(PixelIsa isa);
+const char* PixelIsaName(PixelIsa isa);
+
+// Widths and heights are in pixels and must be even; strides are in bytes.
+// NV12 chroma is the average of each 2x2 block, and is repeated over the
+// block when going back to RGB.
+bool Yuy2ToNv12(const uint8_t* src, uint32_t srcStride, uint8_t* dstY, uint32_t dstYStride,
+    uint8_t* dstUV, uint32_t dstUVStride, uint32_t width, uint32_t height);
+
+bool BgraToNv12(const uint8_t* src, uint32_t srcStride, uint8_t* dstY, uint32_t dstYStride,
+    uint8_t* dstUV, uint32_t dstUVStride, uint32_t width, uint32_t height, const ColorSpace& colorSpace);
+
+bool I420ToNv12(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcU, uint32_t srcUStride,
+    const uint8_t* srcV, uint32_t srcVStride, uint8_t* dstY, uint32_t dstYStride,
+    uint8_t* dstUV, uint32_t dstUVStride, uint32_t width, uint32_t height);
+
+bool Nv12ToI420(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcUV, uint32_t srcUVStride,
+    uint8_t* dstY, uint32_t dstYStride, uint8_t* dstU, uint32_t dstUStride,
+    uint8_t* dstV, uint32_t dstVStride, uint32_t width, uint32_t height);
+
+bool Nv12ToBgra(const uint8_t* srcY, uint32_t srcYStride, const uint8_t* srcUV, uint32_t srcUVStride,
+    uint8_t* dst, uint32_t dstStride, uint32_t width, uint32_t height, const ColorSpace& colorSpace);
+
+// Any of the conversions above between two views of the same size; the
+// color field of the YUV side picks the matrix and range. Fails for format
+// pairs without a conversion.
+bool ConvertFrame(const FrameView& src, const FrameView& dst);
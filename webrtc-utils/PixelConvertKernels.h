@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <cstdint>
+
+// Shared between PixelConvert and the per-ISA kernel files; not part of
+// the public interface.
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#else
+// MSVC accepts every intrinsic without per-function target flags.
+#define PIXEL_TARGET(isa)
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_X86 1
+#elif defined(_M_ARM) || defined(_M_ARM64) || defined(__ARM_NEON) || defined(__aarch64__)
+#define PIXEL_NEON 1
+#endif
+
+// RGB to YUV, 15 fractional bits. The offsets include the rounding term.
+struct YuvCoefficients
+{
+    int16_t yR, yG, yB;
+    int16_t uR, uG, uB;
+    int16_t vR, vG, vB;
+    int32_t yOffset;
+    int32_t uvOffset;
+};
+
+// YUV to RGB, 13 fractional bits.
+struct RgbCoefficients
+{
+    int16_t y;
+    int16_t vR;
+    int16_t uG;
+    int16_t vG;
+    int16_t uB;
+    int16_t yOffset;
+};
+
+constexpr int YuvShift = 15;
+constexpr int RgbShift = 13;
+// Scaler filter weights; each set of taps sums to 1 << FilterShift.
+constexpr int FilterShift = 14;
+constexpr uint32_t MaxFilterTaps = 64;
+// Pixels per sum of the column difference kernel.
+constexpr uint32_t SadColumnWidth = 32;
+
+// Row kernels. Each handles as many pixels from the start of the row as
+// suits its vector width and returns that count; the caller finishes the
+// row with the scalar kernel. Widths are even.
+struct PixelKernels
+{
+    // Two source rows into two luma rows and one chroma row.
+    uint32_t (*yuy2ToNv12)(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width);
+    uint32_t (*bgraToNv12)(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width,
+        const YuvCoefficients& coefficients);
+    // count is in chroma samples.
+    uint32_t (*interleaveUV)(const uint8_t* u, const uint8_t* v, uint8_t* uv, uint32_t count);
+    uint32_t (*deinterleaveUV)(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count);
+    uint32_t (*nv12ToBgra)(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, uint32_t width, const RgbCoefficients& coefficients);
+    // Weighted sum of taps source rows, with an odd width allowed.
+    uint32_t (*filterRows)(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width);
+    // Adds the absolute differences of each SadColumnWidth pixels of two
+    // rows to sums[x / SadColumnWidth], less floor for every pixel and
+    // never below zero, with any width allowed.
+    uint32_t (*columnSad)(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor);
+};
+
+extern const PixelKernels ScalarPixelKernels;
+
+// Null when the build has no kernels for the instruction set.
+const PixelKernels* Sse41PixelKernels();
+const PixelKernels* Avx2PixelKernels();
+const PixelKernels* NeonPixelKernels();
+
+// Runs filterRows with the active kernels and finishes the row in scalar.
+// taps must not exceed MaxFilterTaps.
+void FilterRows(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width);
+// Runs columnSad with the active kernels and finishes the row in scalar;
+// sums needs a slot for every started column.
+void ColumnSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor);
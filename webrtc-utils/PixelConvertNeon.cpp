@@ -0,0 +1,197 @@
+﻿#include "PixelConvertKernels.h"
+
+#ifdef PIXEL_NEON
+
+#include <arm_neon.h>
+
+static uint32_t NeonYuy2ToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        // val[0] is luma, val[1] the interleaved chroma of the same pixels.
+        uint8x16x2_t a = vld2q_u8(src0 + x * 2);
+        uint8x16x2_t b = vld2q_u8(src1 + x * 2);
+        vst1q_u8(y0 + x, a.val[0]);
+        vst1q_u8(y1 + x, b.val[0]);
+        vst1q_u8(uv + x, vrhaddq_u8(a.val[1], b.val[1]));
+    }
+    return x;
+}
+
+static uint8x8_t NeonWeightedSum(int16x8_t b, int16x8_t g, int16x8_t r, int16_t wB, int16_t wG, int16_t wR, int32_t offset)
+{
+    int32x4_t low = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(vdupq_n_s32(offset), vget_low_s16(b), wB), vget_low_s16(g), wG), vget_low_s16(r), wR);
+    int32x4_t high = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(vdupq_n_s32(offset), vget_high_s16(b), wB), vget_high_s16(g), wG), vget_high_s16(r), wR);
+    int16x8_t sum = vcombine_s16(vqmovn_s32(vshrq_n_s32(low, YuvShift)), vqmovn_s32(vshrq_n_s32(high, YuvShift)));
+    return vqmovun_s16(sum);
+}
+
+static int16x8_t NeonWiden(uint8x8_t values)
+{
+    return vreinterpretq_s16_u16(vmovl_u8(values));
+}
+
+static uint8x16_t NeonLuma(const uint8x16x4_t& pixels, const YuvCoefficients& c)
+{
+    uint8x8_t low = NeonWeightedSum(NeonWiden(vget_low_u8(pixels.val[0])), NeonWiden(vget_low_u8(pixels.val[1])),
+        NeonWiden(vget_low_u8(pixels.val[2])), c.yB, c.yG, c.yR, c.yOffset);
+    uint8x8_t high = NeonWeightedSum(NeonWiden(vget_high_u8(pixels.val[0])), NeonWiden(vget_high_u8(pixels.val[1])),
+        NeonWiden(vget_high_u8(pixels.val[2])), c.yB, c.yG, c.yR, c.yOffset);
+    return vcombine_u8(low, high);
+}
+
+// Average of each 2x2 block of one channel, rounded like the scalar kernel.
+static int16x8_t NeonBlockAverage(uint8x16_t top, uint8x16_t bottom)
+{
+    uint16x8_t sum = vaddq_u16(vpaddlq_u8(top), vpaddlq_u8(bottom));
+    return vreinterpretq_s16_u16(vrshrq_n_u16(sum, 2));
+}
+
+static uint32_t NeonBgraToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width,
+    const YuvCoefficients& c)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        uint8x16x4_t a = vld4q_u8(src0 + x * 4);
+        uint8x16x4_t b = vld4q_u8(src1 + x * 4);
+        vst1q_u8(y0 + x, NeonLuma(a, c));
+        vst1q_u8(y1 + x, NeonLuma(b, c));
+
+        int16x8_t blue = NeonBlockAverage(a.val[0], b.val[0]);
+        int16x8_t green = NeonBlockAverage(a.val[1], b.val[1]);
+        int16x8_t red = NeonBlockAverage(a.val[2], b.val[2]);
+        uint8x8x2_t chroma;
+        chroma.val[0] = NeonWeightedSum(blue, green, red, c.uB, c.uG, c.uR, c.uvOffset);
+        chroma.val[1] = NeonWeightedSum(blue, green, red, c.vB, c.vG, c.vR, c.uvOffset);
+        vst2_u8(uv + x, chroma);
+    }
+    return x;
+}
+
+static uint32_t NeonInterleaveUV(const uint8_t* u, const uint8_t* v, uint8_t* uv, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16x2_t chroma;
+        chroma.val[0] = vld1q_u8(u + i);
+        chroma.val[1] = vld1q_u8(v + i);
+        vst2q_u8(uv + i * 2, chroma);
+    }
+    return i;
+}
+
+static uint32_t NeonDeinterleaveUV(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        uint8x16x2_t chroma = vld2q_u8(uv + i * 2);
+        vst1q_u8(u + i, chroma.val[0]);
+        vst1q_u8(v + i, chroma.val[1]);
+    }
+    return i;
+}
+
+static uint8x8_t NeonNarrow(int32x4_t low, int32x4_t high)
+{
+    int16x8_t value = vcombine_s16(vqmovn_s32(vshrq_n_s32(low, RgbShift)), vqmovn_s32(vshrq_n_s32(high, RgbShift)));
+    return vqmovun_s16(value);
+}
+
+static uint32_t NeonNv12ToBgra(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, uint32_t width, const RgbCoefficients& c)
+{
+    const int32x4_t round = vdupq_n_s32(1 << (RgbShift - 1));
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        int16x8_t luma = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(y + x), vdup_n_u8(static_cast<uint8_t>(c.yOffset))));
+        int16x8_t chroma = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(uv + x), vdup_n_u8(128)));
+        // Each U and V repeated for the two pixels that share it.
+        int16x8x2_t split = vtrnq_s16(chroma, chroma);
+        int16x8_t u = split.val[0];
+        int16x8_t v = split.val[1];
+
+        int32x4_t lumaLow = vmlal_n_s16(round, vget_low_s16(luma), c.y);
+        int32x4_t lumaHigh = vmlal_n_s16(round, vget_high_s16(luma), c.y);
+        int32x4_t blueLow = vmlal_n_s16(lumaLow, vget_low_s16(u), c.uB);
+        int32x4_t blueHigh = vmlal_n_s16(lumaHigh, vget_high_s16(u), c.uB);
+        int32x4_t greenLow = vmlsl_n_s16(vmlsl_n_s16(lumaLow, vget_low_s16(u), c.uG), vget_low_s16(v), c.vG);
+        int32x4_t greenHigh = vmlsl_n_s16(vmlsl_n_s16(lumaHigh, vget_high_s16(u), c.uG), vget_high_s16(v), c.vG);
+        int32x4_t redLow = vmlal_n_s16(lumaLow, vget_low_s16(v), c.vR);
+        int32x4_t redHigh = vmlal_n_s16(lumaHigh, vget_high_s16(v), c.vR);
+
+        uint8x8x4_t pixels;
+        pixels.val[0] = NeonNarrow(blueLow, blueHigh);
+        pixels.val[1] = NeonNarrow(greenLow, greenHigh);
+        pixels.val[2] = NeonNarrow(redLow, redHigh);
+        pixels.val[3] = vdup_n_u8(255);
+        vst4_u8(bgra + x * 4, pixels);
+    }
+    return x;
+}
+
+static uint32_t NeonFilterRows(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        int32x4_t sum[4];
+        for (int32x4_t& value : sum)
+            value = vdupq_n_s32(1 << (FilterShift - 1));
+        for (uint32_t k = 0; k < taps; k++)
+        {
+            uint8x16_t row = vld1q_u8(rows[k] + x);
+            int16x8_t low = NeonWiden(vget_low_u8(row));
+            int16x8_t high = NeonWiden(vget_high_u8(row));
+            sum[0] = vmlal_n_s16(sum[0], vget_low_s16(low), weights[k]);
+            sum[1] = vmlal_n_s16(sum[1], vget_high_s16(low), weights[k]);
+            sum[2] = vmlal_n_s16(sum[2], vget_low_s16(high), weights[k]);
+            sum[3] = vmlal_n_s16(sum[3], vget_high_s16(high), weights[k]);
+        }
+        int16x8_t low = vcombine_s16(vqmovn_s32(vshrq_n_s32(sum[0], FilterShift)), vqmovn_s32(vshrq_n_s32(sum[1], FilterShift)));
+        int16x8_t high = vcombine_s16(vqmovn_s32(vshrq_n_s32(sum[2], FilterShift)), vqmovn_s32(vshrq_n_s32(sum[3], FilterShift)));
+        vst1q_u8(dst + x, vcombine_u8(vqmovun_s16(low), vqmovun_s16(high)));
+    }
+    return x;
+}
+
+static uint32_t NeonColumnSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor)
+{
+    const uint8x16_t floors = vdupq_n_u8(floor);
+    uint32_t x = 0;
+    for (; x + SadColumnWidth <= width; x += SadColumnWidth)
+    {
+        uint16x8_t sum = vpaddlq_u8(vqsubq_u8(vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x)), floors));
+        sum = vpadalq_u8(sum, vqsubq_u8(vabdq_u8(vld1q_u8(a + x + 16), vld1q_u8(b + x + 16)), floors));
+        uint64x2_t total = vpaddlq_u32(vpaddlq_u16(sum));
+        sums[x / SadColumnWidth] += static_cast<uint32_t>(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1));
+    }
+    return x;
+}
+
+static const PixelKernels s_neonKernels = {
+    NeonYuy2ToNv12,
+    NeonBgraToNv12,
+    NeonInterleaveUV,
+    NeonDeinterleaveUV,
+    NeonNv12ToBgra,
+    NeonFilterRows,
+    NeonColumnSad,
+};
+
+const PixelKernels* NeonPixelKernels()
+{
+    return &s_neonKernels;
+}
+
+#else
+
+const PixelKernels* NeonPixelKernels()
+{
+    return nullptr;
+}
+
+#endif
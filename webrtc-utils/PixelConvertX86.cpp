@@ -0,0 +1,506 @@
+﻿#include "PixelConvertKernels.h"
+
+#ifdef PIXEL_X86
+
+#include <immintrin.h>
+
+// SSE4.1 kernels.
+
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41Yuy2ToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width)
+{
+    const __m128i evenOdd = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i a0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x * 2)), evenOdd);
+        __m128i a1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src0 + x * 2 + 16)), evenOdd);
+        __m128i b0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x * 2)), evenOdd);
+        __m128i b1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src1 + x * 2 + 16)), evenOdd);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_unpacklo_epi64(a0, a1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_unpacklo_epi64(b0, b1));
+        __m128i chroma = _mm_avg_epu8(_mm_unpackhi_epi64(a0, a1), _mm_unpackhi_epi64(b0, b1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), chroma);
+    }
+    return x;
+}
+
+// Four BGRA pixels widened to two vectors of two pixels each.
+struct Sse41Pixels
+{
+    __m128i low;
+    __m128i high;
+};
+
+PIXEL_TARGET("sse4.1")
+static Sse41Pixels Sse41Widen(const uint8_t* bgra)
+{
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bgra));
+    return { _mm_cvtepu8_epi16(pixels), _mm_unpackhi_epi8(pixels, _mm_setzero_si128()) };
+}
+
+PIXEL_TARGET("sse4.1")
+static __m128i Sse41Luma(const Sse41Pixels& pixels, __m128i weights, __m128i offset)
+{
+    __m128i luma = _mm_hadd_epi32(_mm_madd_epi16(pixels.low, weights), _mm_madd_epi16(pixels.high, weights));
+    return _mm_srai_epi32(_mm_add_epi32(luma, offset), YuvShift);
+}
+
+// Two chroma samples, U0 V0 U1 V1, from four pixels of two rows.
+PIXEL_TARGET("sse4.1")
+static __m128i Sse41Chroma(const Sse41Pixels& top, const Sse41Pixels& bottom, __m128i uWeights, __m128i vWeights, __m128i offset)
+{
+    __m128i low = _mm_add_epi16(top.low, bottom.low);
+    __m128i high = _mm_add_epi16(top.high, bottom.high);
+    __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high));
+    __m128i average = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+    __m128i chroma = _mm_hadd_epi32(_mm_madd_epi16(average, uWeights), _mm_madd_epi16(average, vWeights));
+    chroma = _mm_srai_epi32(_mm_add_epi32(chroma, offset), YuvShift);
+    return _mm_shuffle_epi32(chroma, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41BgraToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width,
+    const YuvCoefficients& c)
+{
+    const __m128i yWeights = _mm_setr_epi16(c.yB, c.yG, c.yR, 0, c.yB, c.yG, c.yR, 0);
+    const __m128i uWeights = _mm_setr_epi16(c.uB, c.uG, c.uR, 0, c.uB, c.uG, c.uR, 0);
+    const __m128i vWeights = _mm_setr_epi16(c.vB, c.vG, c.vR, 0, c.vB, c.vG, c.vR, 0);
+    const __m128i yOffset = _mm_set1_epi32(c.yOffset);
+    const __m128i uvOffset = _mm_set1_epi32(c.uvOffset);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i top[4];
+        __m128i bottom[4];
+        __m128i chroma[4];
+        for (int i = 0; i < 4; i++)
+        {
+            Sse41Pixels a = Sse41Widen(src0 + (x + i * 4) * 4);
+            Sse41Pixels b = Sse41Widen(src1 + (x + i * 4) * 4);
+            top[i] = Sse41Luma(a, yWeights, yOffset);
+            bottom[i] = Sse41Luma(b, yWeights, yOffset);
+            chroma[i] = Sse41Chroma(a, b, uWeights, vWeights, uvOffset);
+        }
+        __m128i luma0 = _mm_packus_epi16(_mm_packs_epi32(top[0], top[1]), _mm_packs_epi32(top[2], top[3]));
+        __m128i luma1 = _mm_packus_epi16(_mm_packs_epi32(bottom[0], bottom[1]), _mm_packs_epi32(bottom[2], bottom[3]));
+        __m128i interleaved = _mm_packus_epi16(_mm_packs_epi32(chroma[0], chroma[1]), _mm_packs_epi32(chroma[2], chroma[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), luma0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), luma1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + x), interleaved);
+    }
+    return x;
+}
+
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41InterleaveUV(const uint8_t* u, const uint8_t* v, uint8_t* uv, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i uValues = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + i));
+        __m128i vValues = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + i * 2), _mm_unpacklo_epi8(uValues, vValues));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + i * 2 + 16), _mm_unpackhi_epi8(uValues, vValues));
+    }
+    return i;
+}
+
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41DeinterleaveUV(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count)
+{
+    const __m128i evenOdd = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + i * 2)), evenOdd);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + i * 2 + 16)), evenOdd);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(u + i), _mm_unpacklo_epi64(a, b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(v + i), _mm_unpackhi_epi64(a, b));
+    }
+    return i;
+}
+
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41Nv12ToBgra(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, uint32_t width, const RgbCoefficients& c)
+{
+    const __m128i duplicateU = _mm_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m128i duplicateV = _mm_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+    const __m128i round = _mm_set1_epi32(1 << (RgbShift - 1));
+    const __m128i blueWeights = _mm_setr_epi16(c.y, c.uB, c.y, c.uB, c.y, c.uB, c.y, c.uB);
+    const __m128i redWeights = _mm_setr_epi16(c.y, c.vR, c.y, c.vR, c.y, c.vR, c.y, c.vR);
+    const __m128i greenWeights = _mm_setr_epi16(c.y, static_cast<int16_t>(-c.uG), c.y, static_cast<int16_t>(-c.uG),
+        c.y, static_cast<int16_t>(-c.uG), c.y, static_cast<int16_t>(-c.uG));
+    // Pairs V with 1 so the same multiply-add also adds the rounding term.
+    const __m128i greenVWeights = _mm_setr_epi16(static_cast<int16_t>(-c.vG), 1 << (RgbShift - 1), static_cast<int16_t>(-c.vG), 1 << (RgbShift - 1),
+        static_cast<int16_t>(-c.vG), 1 << (RgbShift - 1), static_cast<int16_t>(-c.vG), 1 << (RgbShift - 1));
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i alpha = _mm_set1_epi8(-1);
+
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i luma = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(y + x))), _mm_set1_epi16(c.yOffset));
+        __m128i chroma = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(uv + x))), _mm_set1_epi16(128));
+        __m128i u = _mm_shuffle_epi8(chroma, duplicateU);
+        __m128i v = _mm_shuffle_epi8(chroma, duplicateV);
+
+        __m128i lumaU[2] = { _mm_unpacklo_epi16(luma, u), _mm_unpackhi_epi16(luma, u) };
+        __m128i lumaV[2] = { _mm_unpacklo_epi16(luma, v), _mm_unpackhi_epi16(luma, v) };
+        __m128i vOne[2] = { _mm_unpacklo_epi16(v, one), _mm_unpackhi_epi16(v, one) };
+        __m128i blue[2];
+        __m128i green[2];
+        __m128i red[2];
+        for (int i = 0; i < 2; i++)
+        {
+            blue[i] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lumaU[i], blueWeights), round), RgbShift);
+            green[i] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lumaU[i], greenWeights), _mm_madd_epi16(vOne[i], greenVWeights)), RgbShift);
+            red[i] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(lumaV[i], redWeights), round), RgbShift);
+        }
+        __m128i b = _mm_packus_epi16(_mm_packs_epi32(blue[0], blue[1]), _mm_setzero_si128());
+        __m128i g = _mm_packus_epi16(_mm_packs_epi32(green[0], green[1]), _mm_setzero_si128());
+        __m128i r = _mm_packus_epi16(_mm_packs_epi32(red[0], red[1]), _mm_setzero_si128());
+        __m128i bg = _mm_unpacklo_epi8(b, g);
+        __m128i ra = _mm_unpacklo_epi8(r, alpha);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + x * 4), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + x * 4 + 16), _mm_unpackhi_epi16(bg, ra));
+    }
+    return x;
+}
+
+// Taps are taken in pairs: the bytes of two rows are interleaved so one
+// multiply-add applies both weights.
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41FilterRows(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i sum[4];
+        for (__m128i& value : sum)
+            value = _mm_set1_epi32(1 << (FilterShift - 1));
+        for (uint32_t k = 0; k < taps; k += 2)
+        {
+            bool pair = k + 1 < taps;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + x));
+            __m128i b = pair ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k + 1] + x)) : zero;
+            __m128i weight = _mm_set1_epi32(static_cast<uint16_t>(weights[k]) | (pair ? static_cast<uint32_t>(static_cast<uint16_t>(weights[k + 1])) << 16 : 0));
+            __m128i low = _mm_unpacklo_epi8(a, b);
+            __m128i high = _mm_unpackhi_epi8(a, b);
+            sum[0] = _mm_add_epi32(sum[0], _mm_madd_epi16(_mm_unpacklo_epi8(low, zero), weight));
+            sum[1] = _mm_add_epi32(sum[1], _mm_madd_epi16(_mm_unpackhi_epi8(low, zero), weight));
+            sum[2] = _mm_add_epi32(sum[2], _mm_madd_epi16(_mm_unpacklo_epi8(high, zero), weight));
+            sum[3] = _mm_add_epi32(sum[3], _mm_madd_epi16(_mm_unpackhi_epi8(high, zero), weight));
+        }
+        for (__m128i& value : sum)
+            value = _mm_srai_epi32(value, FilterShift);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(sum[0], sum[1]), _mm_packs_epi32(sum[2], sum[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), packed);
+    }
+    return x;
+}
+
+PIXEL_TARGET("sse4.1")
+static __m128i Sse41FlooredDifference(const uint8_t* a, const uint8_t* b, __m128i floor)
+{
+    __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+    __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    __m128i difference = _mm_or_si128(_mm_subs_epu8(left, right), _mm_subs_epu8(right, left));
+    return _mm_subs_epu8(difference, floor);
+}
+
+PIXEL_TARGET("sse4.1")
+static uint32_t Sse41ColumnSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor)
+{
+    const __m128i floors = _mm_set1_epi8(static_cast<char>(floor));
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+    for (; x + SadColumnWidth <= width; x += SadColumnWidth)
+    {
+        // psadbw against zero sums the differences into two partial sums,
+        // one per 8-byte half.
+        __m128i low = _mm_sad_epu8(Sse41FlooredDifference(a + x, b + x, floors), zero);
+        __m128i high = _mm_sad_epu8(Sse41FlooredDifference(a + x + 16, b + x + 16, floors), zero);
+        __m128i sum = _mm_add_epi64(low, high);
+        sums[x / SadColumnWidth] += static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum))));
+    }
+    return x;
+}
+
+static const PixelKernels s_sse41Kernels = {
+    Sse41Yuy2ToNv12,
+    Sse41BgraToNv12,
+    Sse41InterleaveUV,
+    Sse41DeinterleaveUV,
+    Sse41Nv12ToBgra,
+    Sse41FilterRows,
+    Sse41ColumnSad,
+};
+
+const PixelKernels* Sse41PixelKernels()
+{
+    return &s_sse41Kernels;
+}
+
+// AVX2 kernels. Most 256-bit instructions work within 128-bit lanes, so
+// results are put back in pixel order with a final cross-lane permute.
+
+PIXEL_TARGET("avx2")
+static uint32_t Avx2Yuy2ToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width)
+{
+    const __m256i evenOdd = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    uint32_t x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i split[4];
+        const uint8_t* sources[4] = { src0 + x * 2, src0 + x * 2 + 32, src1 + x * 2, src1 + x * 2 + 32 };
+        for (int i = 0; i < 4; i++)
+        {
+            // Luma of 16 pixels in the low half, their chroma in the high half.
+            __m256i pixels = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[i])), evenOdd);
+            split[i] = _mm256_permute4x64_epi64(pixels, _MM_SHUFFLE(3, 1, 2, 0));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), _mm256_permute2x128_si256(split[0], split[1], 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), _mm256_permute2x128_si256(split[2], split[3], 0x20));
+        __m256i chroma = _mm256_avg_epu8(_mm256_permute2x128_si256(split[0], split[1], 0x31), _mm256_permute2x128_si256(split[2], split[3], 0x31));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + x), chroma);
+    }
+    return x;
+}
+
+struct Avx2Pixels
+{
+    __m256i low;
+    __m256i high;
+};
+
+// Eight BGRA pixels; low holds pixels 0, 1, 4, 5 and high 2, 3, 6, 7.
+PIXEL_TARGET("avx2")
+static Avx2Pixels Avx2Widen(const uint8_t* bgra)
+{
+    __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bgra));
+    return { _mm256_unpacklo_epi8(pixels, _mm256_setzero_si256()), _mm256_unpackhi_epi8(pixels, _mm256_setzero_si256()) };
+}
+
+PIXEL_TARGET("avx2")
+static __m256i Avx2Luma(const Avx2Pixels& pixels, __m256i weights, __m256i offset)
+{
+    __m256i luma = _mm256_hadd_epi32(_mm256_madd_epi16(pixels.low, weights), _mm256_madd_epi16(pixels.high, weights));
+    return _mm256_srai_epi32(_mm256_add_epi32(luma, offset), YuvShift);
+}
+
+PIXEL_TARGET("avx2")
+static __m256i Avx2Chroma(const Avx2Pixels& top, const Avx2Pixels& bottom, __m256i uWeights, __m256i vWeights, __m256i offset)
+{
+    __m256i low = _mm256_add_epi16(top.low, bottom.low);
+    __m256i high = _mm256_add_epi16(top.high, bottom.high);
+    __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(low, high), _mm256_unpackhi_epi64(low, high));
+    __m256i average = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+    __m256i chroma = _mm256_hadd_epi32(_mm256_madd_epi16(average, uWeights), _mm256_madd_epi16(average, vWeights));
+    chroma = _mm256_srai_epi32(_mm256_add_epi32(chroma, offset), YuvShift);
+    return _mm256_shuffle_epi32(chroma, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// Packs four vectors of eight 32-bit results, in the lane order the
+// helpers above produce, into 32 bytes in pixel order.
+PIXEL_TARGET("avx2")
+static __m256i Avx2Pack(const __m256i* values)
+{
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(values[0], values[1]), _mm256_packs_epi32(values[2], values[3]));
+    return _mm256_permutevar8x32_epi32(packed, order);
+}
+
+PIXEL_TARGET("avx2")
+static uint32_t Avx2BgraToNv12(const uint8_t* src0, const uint8_t* src1, uint8_t* y0, uint8_t* y1, uint8_t* uv, uint32_t width,
+    const YuvCoefficients& c)
+{
+    const __m256i yWeights = _mm256_setr_epi16(c.yB, c.yG, c.yR, 0, c.yB, c.yG, c.yR, 0, c.yB, c.yG, c.yR, 0, c.yB, c.yG, c.yR, 0);
+    const __m256i uWeights = _mm256_setr_epi16(c.uB, c.uG, c.uR, 0, c.uB, c.uG, c.uR, 0, c.uB, c.uG, c.uR, 0, c.uB, c.uG, c.uR, 0);
+    const __m256i vWeights = _mm256_setr_epi16(c.vB, c.vG, c.vR, 0, c.vB, c.vG, c.vR, 0, c.vB, c.vG, c.vR, 0, c.vB, c.vG, c.vR, 0);
+    const __m256i yOffset = _mm256_set1_epi32(c.yOffset);
+    const __m256i uvOffset = _mm256_set1_epi32(c.uvOffset);
+
+    uint32_t x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i top[4];
+        __m256i bottom[4];
+        __m256i chroma[4];
+        for (int i = 0; i < 4; i++)
+        {
+            Avx2Pixels a = Avx2Widen(src0 + (x + i * 8) * 4);
+            Avx2Pixels b = Avx2Widen(src1 + (x + i * 8) * 4);
+            top[i] = Avx2Luma(a, yWeights, yOffset);
+            bottom[i] = Avx2Luma(b, yWeights, yOffset);
+            chroma[i] = Avx2Chroma(a, b, uWeights, vWeights, uvOffset);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y0 + x), Avx2Pack(top));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(y1 + x), Avx2Pack(bottom));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + x), Avx2Pack(chroma));
+    }
+    return x;
+}
+
+PIXEL_TARGET("avx2")
+static uint32_t Avx2InterleaveUV(const uint8_t* u, const uint8_t* v, uint8_t* uv, uint32_t count)
+{
+    uint32_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i uValues = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + i));
+        __m256i vValues = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + i));
+        __m256i low = _mm256_unpacklo_epi8(uValues, vValues);
+        __m256i high = _mm256_unpackhi_epi8(uValues, vValues);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + i * 2), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(uv + i * 2 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    return i;
+}
+
+PIXEL_TARGET("avx2")
+static uint32_t Avx2DeinterleaveUV(const uint8_t* uv, uint8_t* u, uint8_t* v, uint32_t count)
+{
+    const __m256i evenOdd = _mm256_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15,
+        0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    uint32_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + i * 2)), evenOdd);
+        __m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(uv + i * 2 + 32)), evenOdd);
+        a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(u + i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + i), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+PIXEL_TARGET("avx2")
+static uint32_t Avx2Nv12ToBgra(const uint8_t* y, const uint8_t* uv, uint8_t* bgra, uint32_t width, const RgbCoefficients& c)
+{
+    const __m256i duplicateU = _mm256_setr_epi8(0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13,
+        0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13);
+    const __m256i duplicateV = _mm256_setr_epi8(2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15,
+        2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15);
+    const __m256i round = _mm256_set1_epi32(1 << (RgbShift - 1));
+    const __m256i blueWeights = _mm256_set1_epi32(static_cast<uint16_t>(c.y) | (static_cast<uint32_t>(static_cast<uint16_t>(c.uB)) << 16));
+    const __m256i redWeights = _mm256_set1_epi32(static_cast<uint16_t>(c.y) | (static_cast<uint32_t>(static_cast<uint16_t>(c.vR)) << 16));
+    const __m256i greenWeights = _mm256_set1_epi32(static_cast<uint16_t>(c.y) | (static_cast<uint32_t>(static_cast<uint16_t>(-c.uG)) << 16));
+    const __m256i greenVWeights = _mm256_set1_epi32(static_cast<uint16_t>(-c.vG) | (static_cast<uint32_t>(1 << (RgbShift - 1)) << 16));
+    const __m256i one = _mm256_set1_epi16(1);
+    const __m256i alpha = _mm256_set1_epi8(-1);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i luma = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x))), _mm256_set1_epi16(c.yOffset));
+        __m256i chroma = _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x))), _mm256_set1_epi16(128));
+        __m256i u = _mm256_shuffle_epi8(chroma, duplicateU);
+        __m256i v = _mm256_shuffle_epi8(chroma, duplicateV);
+
+        __m256i lumaU[2] = { _mm256_unpacklo_epi16(luma, u), _mm256_unpackhi_epi16(luma, u) };
+        __m256i lumaV[2] = { _mm256_unpacklo_epi16(luma, v), _mm256_unpackhi_epi16(luma, v) };
+        __m256i vOne[2] = { _mm256_unpacklo_epi16(v, one), _mm256_unpackhi_epi16(v, one) };
+        __m256i blue[2];
+        __m256i green[2];
+        __m256i red[2];
+        for (int i = 0; i < 2; i++)
+        {
+            blue[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(lumaU[i], blueWeights), round), RgbShift);
+            green[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(lumaU[i], greenWeights), _mm256_madd_epi16(vOne[i], greenVWeights)), RgbShift);
+            red[i] = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(lumaV[i], redWeights), round), RgbShift);
+        }
+        __m256i b = _mm256_packus_epi16(_mm256_packs_epi32(blue[0], blue[1]), _mm256_setzero_si256());
+        __m256i g = _mm256_packus_epi16(_mm256_packs_epi32(green[0], green[1]), _mm256_setzero_si256());
+        __m256i r = _mm256_packus_epi16(_mm256_packs_epi32(red[0], red[1]), _mm256_setzero_si256());
+        __m256i bg = _mm256_unpacklo_epi8(b, g);
+        __m256i ra = _mm256_unpacklo_epi8(r, alpha);
+        __m256i low = _mm256_unpacklo_epi16(bg, ra);
+        __m256i high = _mm256_unpackhi_epi16(bg, ra);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + x * 4), _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + x * 4 + 32), _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    return x;
+}
+
+// The in-lane unpacks and packs cancel out, so no permute is needed.
+PIXEL_TARGET("avx2")
+static uint32_t Avx2FilterRows(const uint8_t* const* rows, const int16_t* weights, uint32_t taps, uint8_t* dst, uint32_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i sum[4];
+        for (__m256i& value : sum)
+            value = _mm256_set1_epi32(1 << (FilterShift - 1));
+        for (uint32_t k = 0; k < taps; k += 2)
+        {
+            bool pair = k + 1 < taps;
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k] + x));
+            __m256i b = pair ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[k + 1] + x)) : zero;
+            __m256i weight = _mm256_set1_epi32(static_cast<uint16_t>(weights[k]) | (pair ? static_cast<uint32_t>(static_cast<uint16_t>(weights[k + 1])) << 16 : 0));
+            __m256i low = _mm256_unpacklo_epi8(a, b);
+            __m256i high = _mm256_unpackhi_epi8(a, b);
+            sum[0] = _mm256_add_epi32(sum[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(low, zero), weight));
+            sum[1] = _mm256_add_epi32(sum[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(low, zero), weight));
+            sum[2] = _mm256_add_epi32(sum[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(high, zero), weight));
+            sum[3] = _mm256_add_epi32(sum[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(high, zero), weight));
+        }
+        for (__m256i& value : sum)
+            value = _mm256_srai_epi32(value, FilterShift);
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(sum[0], sum[1]), _mm256_packs_epi32(sum[2], sum[3]));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), packed);
+    }
+    return x;
+}
+
+PIXEL_TARGET("avx2")
+static uint32_t Avx2ColumnSad(const uint8_t* a, const uint8_t* b, uint32_t* sums, uint32_t width, uint8_t floor)
+{
+    const __m256i floors = _mm256_set1_epi8(static_cast<char>(floor));
+    uint32_t x = 0;
+    for (; x + SadColumnWidth <= width; x += SadColumnWidth)
+    {
+        __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x));
+        __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x));
+        __m256i difference = _mm256_or_si256(_mm256_subs_epu8(left, right), _mm256_subs_epu8(right, left));
+        __m256i sad = _mm256_sad_epu8(_mm256_subs_epu8(difference, floors), _mm256_setzero_si256());
+        __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+        sums[x / SadColumnWidth] += static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum))));
+    }
+    return x;
+}
+
+static const PixelKernels s_avx2Kernels = {
+    Avx2Yuy2ToNv12,
+    Avx2BgraToNv12,
+    Avx2InterleaveUV,
+    Avx2DeinterleaveUV,
+    Avx2Nv12ToBgra,
+    Avx2FilterRows,
+    Avx2ColumnSad,
+};
+
+const PixelKernels* Avx2PixelKernels()
+{
+    return &s_avx2Kernels;
+}
+
+#else
+
+const PixelKernels* Sse41PixelKernels()
+{
+    return nullptr;
+}
+
+const PixelKernels* Avx2PixelKernels()
+{
+    return nullptr;
+}
+
+#endif
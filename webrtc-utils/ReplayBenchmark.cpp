@@ -0,0 +1,250 @@
+﻿#include "ReplayBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EncodePipeline.h"
+#include "Nv12Scaler.h"
+#include "PipelineMetrics.h"
+
+namespace
+{
+    // Scaled frames handed to the pipeline come back through their release
+    // hook. Waiting for a free one holds the source back the way its own
+    // buffers do, so the encoder sets the pace.
+    class FrameBuffers
+    {
+    public:
+        FrameBuffers(uint32_t count, size_t size)
+            : m_buffers(count, std::vector<uint8_t>(size))
+        {
+            for (uint32_t i = 0; i < count; i++)
+                m_free.push_back(i);
+        }
+
+        uint32_t Acquire()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_freed.wait(lock, [this]() { return !m_free.empty(); });
+            uint32_t index = m_free.back();
+            m_free.pop_back();
+            return index;
+        }
+
+        void Release(uint32_t index)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_free.push_back(index);
+            }
+            m_freed.notify_all();
+        }
+
+        void WaitAllFree()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_freed.wait(lock, [this]() { return m_free.size() == m_buffers.size(); });
+        }
+
+        uint8_t* Data(uint32_t index) { return m_buffers[index].data(); }
+
+    private:
+        std::vector<std::vector<uint8_t>> m_buffers;
+        std::vector<uint32_t> m_free;
+        std::mutex m_mutex;
+        std::condition_variable m_freed;
+    };
+
+    // The way in before frames were encoded in place: the frame was packed
+    // into a buffer of its own, and that was copied into the IMFSample.
+    size_t CopyLikeOldInput(const FrameView& view, std::vector<uint8_t>& sample)
+    {
+        std::vector<uint8_t> packed(FrameView::PackedSize(view.format, view.width, view.height));
+        if (!CopyFrame(view, FrameView::Packed(view.format, packed.data(), view.width, view.height)))
+            return 0;
+        sample.assign(packed.begin(), packed.end());
+        return packed.size() + sample.size();
+    }
+
+    // The way out before the arena: drained output was appended to a
+    // vector, OnFrameArrived copied that for the callback, and the C# side
+    // copied it once more with Marshal.Copy.
+    size_t CopyLikeOldOutput(const EncodedFrame& frame, std::vector<uint8_t>& managed)
+    {
+        std::vector<uint8_t> unit;
+        unit.insert(unit.end(), frame.Data(), frame.Data() + frame.Size());
+        std::vector<uint8_t> callback(unit);
+        managed.assign(callback.begin(), callback.end());
+        return unit.size() + callback.size() + managed.size();
+    }
+}
+
+bool ReplayBenchmark::Run(const Config& config, PacedFrameSource& source, IVideoEncoderBackend& encoder, Result& result)
+{
+    result = Result();
+
+    FrameSourceFormat format;
+    source.Negotiate(FrameSourceFormat(), format);
+    if (format.format != FrameFormat::Nv12 || format.width == 0 || format.height == 0 || format.frameRate == 0)
+        return false;
+
+    VideoEncoderSettings settings = config.encoder;
+    settings.width = format.width;
+    settings.height = format.height;
+    settings.frameRate = format.frameRate;
+    if (!encoder.Configure(settings))
+        return false;
+
+    BitstreamRecorder recorder;
+    if (!config.recordPath.empty())
+    {
+        BitstreamRecorder::Config recording;
+        const std::string& path = config.recordPath;
+        if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".mp4") == 0)
+            recording.container = BitstreamRecorder::Container::FragmentedMp4;
+        if (!recorder.Start(path, recording))
+            return false;
+    }
+
+    PipelineMetrics metrics;
+    std::vector<uint8_t> baselineSample;
+    std::vector<uint8_t> baselineManaged;
+    auto count = [&](const EncodedFrameRef& encoded)
+    {
+        if (!encoded)
+            return;
+        metrics.OnEncoded(encoded->Timestamp(), encoded->Size(), encoded->IsKeyFrame());
+        recorder.Record(encoded);
+        if (config.baseline)
+            result.baselineBitstreamCopied += CopyLikeOldOutput(*encoded, baselineManaged);
+    };
+
+    CpuAdaptation adaptation(config.adaptation);
+    adaptation.Reset(settings);
+    // Encode thread.
+    VideoEncoderSettings encoderSettings = settings;
+    const double inputPixels = static_cast<double>(settings.width) * settings.height;
+
+    // Encoded frames are counted on the encode thread so that none get lost
+    // when the pipeline stops with deliveries still queued.
+    EncodePipeline::Config pipelineConfig;
+    pipelineConfig.captureQueueCapacity = config.bufferCount;
+    pipelineConfig.captureDropPolicy = DropPolicy::DropOldest;
+    EncodePipeline pipeline(pipelineConfig,
+        [&](BorrowedFrame frame)
+        {
+            if (frame.Width() != encoderSettings.width || frame.Height() != encoderSettings.height)
+            {
+                metrics.OnDropped(PipelineMetrics::DropReason::FormatChange);
+                return EncodedFrameRef();
+            }
+
+            metrics.OnEncodeInput(frame.Timestamp(), frame.ArrivalTime());
+            std::chrono::steady_clock::time_point encodeStart = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::duration queueDelay = encodeStart - frame.ArrivalTime();
+            if (config.encodeDelay.count() > 0)
+                std::this_thread::sleep_for(config.encodeDelay * (frame.Width() * static_cast<double>(frame.Height()) / inputPixels));
+            if (config.baseline)
+                result.baselineInputCopied += CopyLikeOldInput(frame.View(), baselineSample);
+            EncodedFrameRef encoded = encoder.Encode(std::move(frame));
+            count(encoded);
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            VideoEncoderSettings adapted;
+            if (config.adapt && adaptation.OnFrameEncoded({ now, now - encodeStart, queueDelay, adaptation.FrameInterval() }, adapted)
+                && encoder.Reconfigure(adapted))
+                encoderSettings = adapted;
+            return encoded;
+        },
+        [](const EncodedFrameRef&) {});
+
+    // Adapted frames are scaled into these, so the source buffer is free
+    // again right away.
+    const size_t frameSize = FrameView::PackedSize(FrameFormat::Nv12, format.width, format.height);
+    FrameBuffers scaledBuffers(config.adapt ? std::max(config.bufferCount, 1u) : 0, frameSize);
+    Nv12Scaler scaler;
+
+    // Source thread.
+    auto post = [&](BorrowedFrame frame)
+    {
+        metrics.OnCaptured();
+        if (!frame)
+            return;
+        if (config.adapt && !adaptation.AcceptFrame(frame.Timestamp()))
+        {
+            metrics.OnDropped(PipelineMetrics::DropReason::Adaptation);
+            return;
+        }
+
+        CpuAdaptation::Stats adapted = adaptation.GetStats();
+        if (config.adapt && (adapted.width != frame.Width() || adapted.height != frame.Height()))
+        {
+            uint32_t scaledBuffer = scaledBuffers.Acquire();
+            FrameView scaled = FrameView::Packed(FrameFormat::Nv12, scaledBuffers.Data(scaledBuffer), adapted.width, adapted.height);
+            scaled.timestamp = frame.Timestamp();
+            bool done = scaler.Configure(frame.Width(), frame.Height(), scaled.width, scaled.height, Nv12Scaler::Config())
+                && scaler.Scale(frame.View(), scaled);
+            std::chrono::steady_clock::time_point arrival = frame.ArrivalTime();
+            frame.Release();
+            if (!done)
+            {
+                scaledBuffers.Release(scaledBuffer);
+                metrics.OnDropped(PipelineMetrics::DropReason::Conversion);
+                return;
+            }
+            BorrowedFrame scaledFrame(scaled, [&scaledBuffers, scaledBuffer]() { scaledBuffers.Release(scaledBuffer); });
+            scaledFrame.SetArrivalTime(arrival);
+            pipeline.PostFrame(std::move(scaledFrame));
+            return;
+        }
+        pipeline.PostFrame(std::move(frame));
+    };
+
+    pipeline.Start();
+    auto start = std::chrono::steady_clock::now();
+    PacedFrameSource::Stats before = source.GetStats();
+    if (!source.Start(post))
+    {
+        pipeline.Stop();
+        encoder.Shutdown();
+        return false;
+    }
+    source.WaitUntilDone();
+    source.Stop();
+
+    // Every frame back means the encode thread has taken all input; the
+    // pipeline is stopped before draining so Flush stays on one thread.
+    source.WaitFramesReleased();
+    scaledBuffers.WaitAllFree();
+    pipeline.Stop();
+    for (const EncodedFrameRef& encoded : encoder.Flush())
+        count(encoded);
+    recorder.Stop();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    PacedFrameSource::Stats after = source.GetStats();
+    uint64_t framesIn = after.framesProduced - before.framesProduced;
+    PipelineMetrics::Snapshot snapshot = metrics.TakeSnapshot();
+    result.width = format.width;
+    result.height = format.height;
+    result.framesIn = framesIn;
+    result.framesEncoded = snapshot.framesEncoded;
+    result.keyFrames = snapshot.keyFrames;
+    result.bytesEncoded = snapshot.bytesEncoded;
+    result.seconds = seconds;
+    result.fps = seconds > 0 ? framesIn / seconds : 0;
+    result.bitrate = framesIn > 0 ? snapshot.bytesEncoded * 8.0 * format.frameRate / framesIn : 0;
+    result.submitToEncoded = snapshot.captureToEncoded;
+    result.encodeLatency = snapshot.encodeLatency;
+    result.bitstream = encoder.GetBitstreamStats();
+    result.recording = recorder.GetStats();
+    result.adaptation = adaptation.GetStats();
+    result.framesDropped = snapshot.drops[static_cast<size_t>(PipelineMetrics::DropReason::Adaptation)]
+        + after.framesDropped - before.framesDropped;
+    encoder.Shutdown();
+    return true;
+}
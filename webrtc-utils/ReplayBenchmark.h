@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "BitstreamRecorder.h"
+#include "CpuAdaptation.h"
+#include "EncodedFrame.h"
+#include "FrameSource.h"
+#include "LatencyHistogram.h"
+#include "VideoEncoderBackend.h"
+
+// Replays a file or synthetic source through an encoder backend on the same
+// EncodePipeline the camera path uses, so encoder and pipeline regressions
+// show up without a camera or a device.
+class ReplayBenchmark
+{
+public:
+    struct Config
+    {
+        // Capture queue capacity. With at least as many places as the
+        // source has buffers, a source that is not realtime waits for the
+        // encoder and nothing is dropped.
+        uint32_t bufferCount = 3;
+        VideoEncoderSettings encoder;
+        // Empty records nothing; a .mp4 name records fragmented MP4 and
+        // anything else Annex B.
+        std::string recordPath;
+        // Added to every encode in proportion to the frame's share of the
+        // input size, to stand in for a busy device.
+        std::chrono::microseconds encodeDelay{ 0 };
+        // Lowers frame rate and size under encode load the way a capture
+        // session does. Meant for realtime replays, where the frame rate is
+        // real.
+        bool adapt = false;
+        CpuAdaptation::Config adaptation;
+        // Also makes, for every frame, the copies the encode path made
+        // before frames were encoded in place and written once into the
+        // arena, and counts them, so old and new can be compared.
+        bool baseline = false;
+    };
+
+    struct Result
+    {
+        uint32_t width;
+        uint32_t height;
+        uint64_t framesIn;
+        uint64_t framesEncoded;
+        uint64_t keyFrames;
+        uint64_t bytesEncoded;
+        double seconds;
+        double fps;
+        // Bits per second at the source's frame rate.
+        double bitrate;
+        // From frame submission to encoded output.
+        LatencyHistogram::Percentiles submitToEncoded;
+        // From encoder input to encoded output.
+        LatencyHistogram::Percentiles encodeLatency;
+        BitstreamArena::Stats bitstream;
+        BitstreamRecorder::Stats recording;
+        CpuAdaptation::Stats adaptation;
+        // Frames left out to reach the adapted frame rate, or skipped by a
+        // realtime source with every buffer in use.
+        uint64_t framesDropped;
+        // With baseline set, the bytes the old path copied on the way into
+        // the encoder and on the way out of it.
+        uint64_t baselineInputCopied;
+        uint64_t baselineBitstreamCopied;
+    };
+
+    // Returns false when the source has no NV12 frames to give or the
+    // encoder refuses the settings. Runs the source until it ends; the
+    // encoder is configured and shut down here.
+    static bool Run(const Config& config, PacedFrameSource& source, IVideoEncoderBackend& encoder, Result& result);
+};
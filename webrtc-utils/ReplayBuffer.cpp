@@ -0,0 +1,178 @@
+﻿#include "ReplayBuffer.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "FragmentedMp4Muxer.h"
+
+static FILE* OpenForWriting(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    FILE* file = nullptr;
+    return _wfopen_s(&file, path.c_str(), L"wb") == 0 ? file : nullptr;
+#else
+    return std::fopen(path.c_str(), "wb");
+#endif
+}
+
+ReplayBuffer::ReplayBuffer(const Config& config)
+    : m_config(config), m_data(config.memoryBudget), m_frames(config.maxFrames > 0 ? config.maxFrames : 1)
+{
+}
+
+bool ReplayBuffer::HeadGopEvictable() const
+{
+    // The head GOP ends where the next one starts, or at the newest frame.
+    uint64_t end = m_keyFrames.size() > 1 ? m_keyFrames[1] : m_next;
+    return m_pinned == NotPinned || end <= m_pinned;
+}
+
+void ReplayBuffer::EvictGop()
+{
+    m_keyFrames.pop_front();
+    m_head = m_keyFrames.empty() ? m_next : m_keyFrames.front();
+}
+
+void ReplayBuffer::Drop()
+{
+    m_framesDropped++;
+    m_waitingForKeyFrame = true;
+    m_resyncing = true;
+}
+
+void ReplayBuffer::Insert(const EncodedFrameRef& frame)
+{
+    if (!frame || frame->Size() == 0)
+        return;
+
+    const uint64_t capacity = m_data.size();
+    const uint64_t size = frame->Size();
+    uint64_t position;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_waitingForKeyFrame && !frame->IsKeyFrame())
+        {
+            if (m_resyncing)
+                m_framesDropped++;
+            return;
+        }
+        if (size > capacity)
+        {
+            Drop();
+            return;
+        }
+
+        // Frames never wrap, so each one can be written out in one piece.
+        position = m_writePosition;
+        if (position % capacity + size > capacity)
+            position += capacity - position % capacity;
+
+        while (m_head < m_next && (position + size - At(m_head).position > capacity || m_next - m_head == m_frames.size()))
+        {
+            if (!HeadGopEvictable())
+            {
+                Drop();
+                return;
+            }
+            EvictGop();
+        }
+
+        // Evicting the GOP a delta frame belongs to leaves it undecodable.
+        if (m_head == m_next && !frame->IsKeyFrame())
+        {
+            Drop();
+            return;
+        }
+    }
+
+    // Only this thread writes the ring, and the space is no longer indexed,
+    // so the copy runs without the lock.
+    std::memcpy(m_data.data() + position % capacity, frame->Data(), size);
+
+    std::lock_guard lock(m_mutex);
+    m_frames[m_next % m_frames.size()] = { position, static_cast<uint32_t>(size), frame->Timestamp(), frame->IsKeyFrame() };
+    if (frame->IsKeyFrame())
+        m_keyFrames.push_back(m_next);
+    m_next++;
+    m_writePosition = position + size;
+    m_waitingForKeyFrame = false;
+    m_resyncing = false;
+
+    // Drop GOPs that the rest of the ring already covers the window without.
+    while (m_keyFrames.size() > 1 && frame->Timestamp() - At(m_keyFrames[1]).timestamp >= m_config.window && HeadGopEvictable())
+        EvictGop();
+}
+
+bool ReplayBuffer::Dump(const std::filesystem::path& path, int64_t duration)
+{
+    std::lock_guard dumpLock(m_dumpMutex);
+
+    std::vector<Entry> entries;
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_keyFrames.empty())
+            return false;
+
+        int64_t start = At(m_next - 1).timestamp - duration;
+        uint64_t first = m_keyFrames.front();
+        for (uint64_t keyFrame : m_keyFrames)
+        {
+            if (At(keyFrame).timestamp > start)
+                break;
+            first = keyFrame;
+        }
+
+        // Frames from here on stay put until the dump is done, so they can
+        // be read without the lock.
+        m_pinned = first;
+        entries.reserve(m_next - first);
+        for (uint64_t sequence = first; sequence < m_next; sequence++)
+            entries.push_back(At(sequence));
+    }
+
+    bool written = false;
+    FILE* file = OpenForWriting(path);
+    if (file != nullptr)
+    {
+        written = true;
+        const uint64_t capacity = m_data.size();
+        if (path.extension() == ".mp4")
+        {
+            FragmentedMp4Muxer muxer;
+            std::vector<uint8_t> out;
+            for (const Entry& entry : entries)
+            {
+                muxer.AddFrame(m_data.data() + entry.position % capacity, entry.size, entry.timestamp, entry.keyFrame, out);
+                written = written && std::fwrite(out.data(), 1, out.size(), file) == out.size();
+                out.clear();
+            }
+            muxer.Finish(out);
+            written = written && std::fwrite(out.data(), 1, out.size(), file) == out.size();
+        }
+        else
+        {
+            for (const Entry& entry : entries)
+                written = written && std::fwrite(m_data.data() + entry.position % capacity, 1, entry.size, file) == entry.size;
+        }
+        written = std::fclose(file) == 0 && written;
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_pinned = NotPinned;
+    return written;
+}
+
+ReplayBuffer::Stats ReplayBuffer::GetStats() const
+{
+    std::lock_guard lock(m_mutex);
+    Stats stats = {};
+    stats.frames = static_cast<uint32_t>(m_next - m_head);
+    stats.gops = static_cast<uint32_t>(m_keyFrames.size());
+    if (m_head < m_next)
+    {
+        stats.duration = At(m_next - 1).timestamp - At(m_head).timestamp;
+        stats.bytesUsed = static_cast<size_t>(m_writePosition - At(m_head).position);
+    }
+    stats.framesDropped = m_framesDropped;
+    return stats;
+}
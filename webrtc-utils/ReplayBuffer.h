@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "EncodedFrame.h"
+
+// Keeps the last few seconds of encoded video for instant replay. Frames
+// are copied once, into a fixed byte ring, and indexed by key frame so that
+// eviction always drops whole GOPs and every dump starts at an IDR. Memory
+// never exceeds the configured budget. A dump writes straight out of the
+// ring; the range being dumped is pinned so the encoder drops new frames
+// rather than overwrite it, and never waits for the disk.
+class ReplayBuffer
+{
+public:
+    struct Config
+    {
+        // 100 ns units.
+        int64_t window = 30 * 10000000LL;
+        size_t memoryBudget = 32 * 1024 * 1024;
+        uint32_t maxFrames = 4096;
+    };
+
+    struct Stats
+    {
+        uint32_t frames;
+        uint32_t gops;
+        // 100 ns units, from the oldest to the newest frame.
+        int64_t duration;
+        size_t bytesUsed;
+        // Frames that could not be kept, including the ones skipped while
+        // waiting for the next key frame.
+        uint64_t framesDropped;
+    };
+
+    explicit ReplayBuffer(const Config& config);
+    ReplayBuffer(const ReplayBuffer&) = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    // Encode thread.
+    void Insert(const EncodedFrameRef& frame);
+
+    // Writes the newest frames covering at least duration, starting at the
+    // nearest preceding key frame. A .mp4 path gets fragmented MP4, anything
+    // else Annex B. Any thread; dumps are serialized.
+    bool Dump(const std::filesystem::path& path, int64_t duration);
+
+    Stats GetStats() const;
+
+private:
+    struct Entry
+    {
+        // Position in the byte stream; the ring offset is this modulo the
+        // budget.
+        uint64_t position;
+        uint32_t size;
+        int64_t timestamp;
+        bool keyFrame;
+    };
+
+    static constexpr uint64_t NotPinned = UINT64_MAX;
+
+    const Entry& At(uint64_t sequence) const { return m_frames[sequence % m_frames.size()]; }
+    bool HeadGopEvictable() const;
+    void EvictGop();
+    void Drop();
+
+    Config m_config;
+    std::vector<uint8_t> m_data;
+    std::vector<Entry> m_frames;
+
+    mutable std::mutex m_mutex;
+    // Frames in the ring are [m_head, m_next); m_keyFrames holds the
+    // sequence numbers of the key frames among them, oldest first.
+    uint64_t m_head = 0;
+    uint64_t m_next = 0;
+    std::deque<uint64_t> m_keyFrames;
+    uint64_t m_writePosition = 0;
+    uint64_t m_pinned = NotPinned;
+    uint64_t m_framesDropped = 0;
+    bool m_waitingForKeyFrame = true;
+    bool m_resyncing = false;
+
+    std::mutex m_dumpMutex;
+};
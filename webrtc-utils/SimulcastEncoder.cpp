@@ -0,0 +1,166 @@
+﻿#include "SimulcastEncoder.h"
+
+SimulcastEncoder::SimulcastEncoder(Config config, EncoderFactory createEncoder, EncodePipeline::DeliverFunction deliver)
+    : m_config(std::move(config)), m_createEncoder(std::move(createEncoder)), m_deliver(std::move(deliver))
+{
+}
+
+SimulcastEncoder::~SimulcastEncoder()
+{
+    Stop();
+    for (const std::unique_ptr<LayerState>& layer : m_layers)
+    {
+        if (layer->encoder != nullptr)
+            layer->encoder->Shutdown();
+    }
+}
+
+bool SimulcastEncoder::Initialize()
+{
+    uint32_t width = UINT32_MAX;
+    uint32_t height = UINT32_MAX;
+    for (const Layer& config : m_config.layers)
+    {
+        const VideoEncoderSettings& settings = config.encoder;
+        if (settings.width == 0 || settings.height == 0 || settings.width % 2 != 0 || settings.height % 2 != 0
+            || settings.width > width || settings.height > height || config.rid.size() > EncodedFrame::MaxRidLength)
+            return false;
+        width = settings.width;
+        height = settings.height;
+    }
+
+    // Sized for a full capture queue plus what the encoder holds on to.
+    uint32_t blocks = m_config.pipeline.captureQueueCapacity + 8;
+    for (size_t i = 0; i < m_config.layers.size(); i++)
+    {
+        auto layer = std::make_unique<LayerState>();
+        layer->config = m_config.layers[i];
+        layer->number = m_config.firstLayer + static_cast<uint32_t>(i);
+        layer->encoder = m_createEncoder();
+        if (layer->encoder == nullptr || !layer->encoder->Configure(layer->config.encoder))
+            return false;
+        layer->keyFrames = std::make_unique<KeyFrameRequester>(m_config.minKeyFrameInterval);
+        size_t frameSize = FrameView::PackedSize(FrameFormat::Nv12, layer->config.encoder.width, layer->config.encoder.height);
+        layer->pool = std::make_shared<BufferPool>(std::vector<BufferPool::SizeClass>{ { frameSize, blocks } });
+
+        LayerState* state = layer.get();
+        layer->pipeline = std::make_unique<EncodePipeline>(m_config.pipeline,
+            [this, state](BorrowedFrame frame) { return Encode(*state, std::move(frame)); },
+            m_deliver);
+        m_layers.push_back(std::move(layer));
+    }
+    m_frames.resize(m_layers.size());
+    return true;
+}
+
+void SimulcastEncoder::Start()
+{
+    for (const std::unique_ptr<LayerState>& layer : m_layers)
+        layer->pipeline->Start();
+}
+
+void SimulcastEncoder::Stop()
+{
+    for (const std::unique_ptr<LayerState>& layer : m_layers)
+    {
+        if (layer->pipeline != nullptr)
+            layer->pipeline->Stop();
+    }
+}
+
+void SimulcastEncoder::PostFrame(const FrameView& source, std::chrono::steady_clock::time_point arrival)
+{
+    // All layers are scaled before any is posted: a posted frame may be
+    // encoded and released at any moment, but the next layer reads it.
+    const FrameView* from = &source;
+    for (size_t i = 0; i < m_layers.size(); i++)
+    {
+        m_frames[i] = Scale(*m_layers[i], *from);
+        if (m_frames[i])
+            from = &m_frames[i].View();
+    }
+
+    for (size_t i = 0; i < m_layers.size(); i++)
+    {
+        if (!m_frames[i])
+        {
+            m_layers[i]->scaleDrops.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        m_frames[i].SetArrivalTime(arrival);
+        m_layers[i]->pipeline->PostFrame(std::move(m_frames[i]));
+    }
+}
+
+BorrowedFrame SimulcastEncoder::Scale(LayerState& layer, const FrameView& source)
+{
+    uint32_t width = layer.config.encoder.width;
+    uint32_t height = layer.config.encoder.height;
+    if (source.format != FrameFormat::Nv12 || width > source.width || height > source.height
+        || !layer.scaler.Configure(source.width, source.height, width, height, m_config.scaling))
+        return BorrowedFrame();
+
+    PooledBuffer block = layer.pool->Acquire(FrameView::PackedSize(FrameFormat::Nv12, width, height));
+    if (!block)
+        return BorrowedFrame();
+
+    FrameView scaled = FrameView::Packed(FrameFormat::Nv12, block.Data(), width, height);
+    scaled.timestamp = source.timestamp;
+    scaled.color = source.color;
+    if (!layer.scaler.Scale(source, scaled))
+        return BorrowedFrame();
+
+    // The block lives in the frame's hook and goes back to the pool before
+    // the pool reference is dropped.
+    return BorrowedFrame(scaled,
+        [block = std::move(block), pool = layer.pool]() mutable
+        {
+            block.Reset();
+        });
+}
+
+EncodedFrameRef SimulcastEncoder::Encode(LayerState& layer, BorrowedFrame frame)
+{
+    // Runs on the layer's encode thread, the only one touching its encoder.
+    if (layer.keyFrames->ShouldForce(KeyFrameRequester::Clock::now()))
+        layer.encoder->RequestKeyFrame();
+
+    EncodedFrameRef encoded = layer.encoder->Encode(std::move(frame));
+    if (encoded)
+    {
+        encoded->SetLayer(layer.number, layer.config.rid.c_str());
+        layer.bytesEncoded.fetch_add(encoded->Size(), std::memory_order_relaxed);
+        if (encoded->IsKeyFrame())
+        {
+            layer.keyFrameCount.fetch_add(1, std::memory_order_relaxed);
+            layer.keyFrames->OnKeyFrame(KeyFrameRequester::Clock::now());
+        }
+    }
+    return encoded;
+}
+
+void SimulcastEncoder::RequestKeyFrame()
+{
+    for (const std::unique_ptr<LayerState>& layer : m_layers)
+        layer->keyFrames->Request();
+}
+
+bool SimulcastEncoder::RequestKeyFrame(uint32_t layer)
+{
+    if (layer < m_config.firstLayer || layer - m_config.firstLayer >= m_layers.size())
+        return false;
+    m_layers[layer - m_config.firstLayer]->keyFrames->Request();
+    return true;
+}
+
+bool SimulcastEncoder::GetLayerStats(uint32_t layer, LayerStats& stats) const
+{
+    if (layer < m_config.firstLayer || layer - m_config.firstLayer >= m_layers.size())
+        return false;
+    const LayerState& state = *m_layers[layer - m_config.firstLayer];
+    stats.queues = state.pipeline->GetStats();
+    stats.bytesEncoded = state.bytesEncoded.load(std::memory_order_relaxed);
+    stats.keyFrames = state.keyFrameCount.load(std::memory_order_relaxed);
+    stats.scaleDrops = state.scaleDrops.load(std::memory_order_relaxed);
+    return true;
+}
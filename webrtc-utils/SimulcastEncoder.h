@@ -0,0 +1,103 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BufferPool.h"
+#include "EncodePipeline.h"
+#include "KeyFrameRequester.h"
+#include "Nv12Scaler.h"
+#include "VideoEncoderBackend.h"
+
+// The lower-resolution layers of a simulcast stream. Each captured frame
+// is scaled once per layer, every layer from the one above it, and every
+// layer encodes on its own pipeline threads so a busy large layer never
+// holds up the small ones. Encoded frames are tagged with their layer
+// number and rid.
+class SimulcastEncoder
+{
+public:
+    using EncoderFactory = std::function<std::unique_ptr<IVideoEncoderBackend>()>;
+
+    struct Layer
+    {
+        VideoEncoderSettings encoder;
+        // RTP stream id the sender forwards this layer under.
+        std::string rid;
+    };
+
+    struct Config
+    {
+        // Largest first, each no larger than the one before it.
+        std::vector<Layer> layers;
+        // Number of the first layer; the layers above it are encoded
+        // elsewhere, from the frames passed to PostFrame.
+        uint32_t firstLayer = 1;
+        EncodePipeline::Config pipeline;
+        Nv12Scaler::Config scaling;
+        std::chrono::milliseconds minKeyFrameInterval{ 500 };
+    };
+
+    struct LayerStats
+    {
+        EncodePipeline::Stats queues;
+        uint64_t bytesEncoded;
+        uint64_t keyFrames;
+        // Frames the layer was skipped for because the source was smaller
+        // than the layer or no buffer was free.
+        uint64_t scaleDrops;
+    };
+
+    SimulcastEncoder(Config config, EncoderFactory createEncoder, EncodePipeline::DeliverFunction deliver);
+    SimulcastEncoder(const SimulcastEncoder&) = delete;
+    SimulcastEncoder& operator=(const SimulcastEncoder&) = delete;
+    ~SimulcastEncoder();
+
+    // Checks the layer sizes and rids and configures one encoder per layer.
+    bool Initialize();
+    void Start();
+    void Stop();
+
+    // Capture thread. The source only has to stay valid for the call; every
+    // layer gets its own scaled copy.
+    void PostFrame(const FrameView& source, std::chrono::steady_clock::time_point arrival);
+
+    // Safe from any thread.
+    void RequestKeyFrame();
+    bool RequestKeyFrame(uint32_t layer);
+
+    uint32_t FirstLayer() const { return m_config.firstLayer; }
+    uint32_t LayerCount() const { return static_cast<uint32_t>(m_layers.size()); }
+    bool GetLayerStats(uint32_t layer, LayerStats& stats) const;
+
+private:
+    struct LayerState
+    {
+        Layer config;
+        uint32_t number = 0;
+        std::unique_ptr<IVideoEncoderBackend> encoder;
+        std::unique_ptr<EncodePipeline> pipeline;
+        std::unique_ptr<KeyFrameRequester> keyFrames;
+        // Capture thread.
+        Nv12Scaler scaler;
+        std::shared_ptr<BufferPool> pool;
+        std::atomic<uint64_t> bytesEncoded{ 0 };
+        std::atomic<uint64_t> keyFrameCount{ 0 };
+        std::atomic<uint64_t> scaleDrops{ 0 };
+    };
+
+    BorrowedFrame Scale(LayerState& layer, const FrameView& source);
+    EncodedFrameRef Encode(LayerState& layer, BorrowedFrame frame);
+
+    Config m_config;
+    EncoderFactory m_createEncoder;
+    EncodePipeline::DeliverFunction m_deliver;
+    std::vector<std::unique_ptr<LayerState>> m_layers;
+    // Capture thread; one slot per layer, reused for every frame.
+    std::vector<BorrowedFrame> m_frames;
+};
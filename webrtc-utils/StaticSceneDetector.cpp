@@ -0,0 +1,115 @@
+﻿#include "StaticSceneDetector.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "CaptureClock.h"
+#include "PixelConvertKernels.h"
+
+StaticSceneDetector::StaticSceneDetector()
+    : StaticSceneDetector(Config())
+{
+}
+
+StaticSceneDetector::StaticSceneDetector(const Config& config)
+    : m_config(config)
+{
+    m_config.tileSize = std::max(SadColumnWidth, m_config.tileSize / SadColumnWidth * SadColumnWidth);
+    m_config.rowStep = std::max(1u, m_config.rowStep);
+}
+
+StaticSceneDetector::Result StaticSceneDetector::Check(const FrameView& frame)
+{
+    Result result = { 1.0, true, true };
+    m_framesChecked.fetch_add(1, std::memory_order_relaxed);
+    if ((frame.format != FrameFormat::Nv12 && frame.format != FrameFormat::I420) || frame.width == 0 || frame.height == 0)
+    {
+        // Nothing to compare; every such frame counts as changed.
+        m_hasReference = false;
+        m_changeRatio.store(result.changeRatio, std::memory_order_relaxed);
+        return result;
+    }
+
+    if (m_hasReference && frame.width == m_width && frame.height == m_height)
+    {
+        const uint32_t tileSize = m_config.tileSize;
+        const uint32_t rowStep = m_config.rowStep;
+        const uint32_t columnsPerTile = tileSize / SadColumnWidth;
+        const uint32_t tilesX = (m_width + tileSize - 1) / tileSize;
+        const uint32_t tilesY = (m_height + tileSize - 1) / tileSize;
+        const FramePlane& luma = frame.planes[0];
+        uint32_t changedTiles = 0;
+        for (uint32_t tileY = 0; tileY < tilesY; tileY++)
+        {
+            std::fill(m_columnSums.begin(), m_columnSums.end(), 0u);
+            // The first compared row of the tile; rows are picked on the frame
+            // grid so that every tile compares the same rows every frame.
+            uint32_t top = tileY * tileSize;
+            uint32_t bottom = std::min(top + tileSize, m_height);
+            uint32_t first = (top + rowStep - 1) / rowStep * rowStep;
+            uint32_t rows = 0;
+            for (uint32_t y = first; y < bottom; y += rowStep, rows++)
+                ColumnSad(luma.data + static_cast<size_t>(luma.stride) * y, &m_reference[static_cast<size_t>(y / rowStep) * m_width], m_columnSums.data(), m_width, m_config.noiseFloor);
+            if (rows == 0)
+                continue;
+
+            for (uint32_t tileX = 0; tileX < tilesX; tileX++)
+            {
+                uint32_t column = tileX * columnsPerTile;
+                uint32_t end = std::min<uint32_t>(column + columnsPerTile, static_cast<uint32_t>(m_columnSums.size()));
+                uint64_t sad = 0;
+                for (; column < end; column++)
+                    sad += m_columnSums[column];
+                uint32_t width = std::min(tileSize, m_width - tileX * tileSize);
+                if (sad > m_config.tileThreshold * width * rows)
+                    changedTiles++;
+            }
+        }
+        result.changeRatio = static_cast<double>(changedTiles) / (tilesX * tilesY);
+        result.changed = result.changeRatio > m_config.minChangeRatio;
+    }
+
+    bool passNext = m_passNext.exchange(false, std::memory_order_relaxed);
+    int64_t keepAlive = static_cast<int64_t>(m_config.keepAlive.count()) * (CaptureClock::TicksPerSecond / 1000);
+    result.pass = result.changed || passNext || frame.timestamp - m_lastPassed >= keepAlive || frame.timestamp < m_lastPassed;
+    if (!result.changed)
+        m_framesUnchanged.fetch_add(1, std::memory_order_relaxed);
+    if (result.pass)
+        Store(frame);
+    else
+        m_framesSkipped.fetch_add(1, std::memory_order_relaxed);
+    m_changeRatio.store(result.changeRatio, std::memory_order_relaxed);
+    return result;
+}
+
+void StaticSceneDetector::Reset()
+{
+    m_hasReference = false;
+}
+
+StaticSceneDetector::Stats StaticSceneDetector::GetStats() const
+{
+    Stats stats;
+    stats.changeRatio = m_changeRatio.load(std::memory_order_relaxed);
+    stats.framesChecked = m_framesChecked.load(std::memory_order_relaxed);
+    stats.framesUnchanged = m_framesUnchanged.load(std::memory_order_relaxed);
+    stats.framesSkipped = m_framesSkipped.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void StaticSceneDetector::Store(const FrameView& frame)
+{
+    const uint32_t rowStep = m_config.rowStep;
+    if (frame.width != m_width || frame.height != m_height || !m_hasReference)
+    {
+        m_width = frame.width;
+        m_height = frame.height;
+        m_reference.resize(static_cast<size_t>((m_height + rowStep - 1) / rowStep) * m_width);
+        m_columnSums.resize((m_width + SadColumnWidth - 1) / SadColumnWidth);
+    }
+    const FramePlane& luma = frame.planes[0];
+    for (uint32_t y = 0; y < m_height; y += rowStep)
+        std::memcpy(&m_reference[static_cast<size_t>(y / rowStep) * m_width], luma.data + static_cast<size_t>(luma.stride) * y, m_width);
+    m_hasReference = true;
+    m_lastPassed = frame.timestamp;
+}
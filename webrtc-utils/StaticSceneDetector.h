@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "FrameView.h"
+
+// Tells frames that show nothing new apart from the ones that do, from the
+// luma plane alone. Every rowStep-th row is compared with the last frame let
+// through and the absolute differences beyond a noise floor are summed per
+// tile; a tile has changed when their mean passes tileThreshold, and the
+// frame when the share of changed tiles passes minChangeRatio. The floor
+// keeps sensor noise out of the sums, so that a small change like a text
+// cursor still tells a tile apart. Comparing with the last
+// frame let through rather than the previous one lets slow drift add up
+// until it counts. Unchanged frames are still let through once every
+// keepAlive, so the receiver keeps getting frames and the encoder keeps
+// refining a still picture.
+class StaticSceneDetector
+{
+public:
+    struct Config
+    {
+        // Tile side in pixels, a multiple of 32.
+        uint32_t tileSize = 64;
+        // Only every rowStep-th row is compared.
+        uint32_t rowStep = 4;
+        // Luma difference each pixel is allowed before it adds to the sum;
+        // camera noise on a still scene mostly stays within it.
+        uint8_t noiseFloor = 6;
+        // Mean difference beyond the floor, per compared pixel, above which
+        // a tile has changed.
+        double tileThreshold = 0.25;
+        // Share of changed tiles a frame needs beyond this to count as
+        // changed; zero makes any changed tile count.
+        double minChangeRatio = 0.0;
+        std::chrono::milliseconds keepAlive{ 1000 };
+    };
+
+    struct Result
+    {
+        // Share of tiles that changed, 1 for the first frame of a size.
+        double changeRatio;
+        bool changed;
+        // Changed, due for keep-alive or asked for; the frame should be
+        // encoded.
+        bool pass;
+    };
+
+    struct Stats
+    {
+        // Of the last frame checked.
+        double changeRatio;
+        uint64_t framesChecked;
+        uint64_t framesUnchanged;
+        // Unchanged frames that were not let through.
+        uint64_t framesSkipped;
+    };
+
+    StaticSceneDetector();
+    explicit StaticSceneDetector(const Config& config);
+
+    // Capture thread. The frame is NV12 or I420; its timestamp is media time
+    // in 100 ns ticks. Frames let through become the new reference.
+    Result Check(const FrameView& frame);
+    // Capture thread. The next frame is taken as changed.
+    void Reset();
+
+    // Any thread. Lets the next frame through whatever it shows, e.g. so a
+    // key frame request does not wait for the keep-alive.
+    void PassNextFrame() { m_passNext.store(true, std::memory_order_relaxed); }
+
+    Stats GetStats() const;
+
+private:
+    void Store(const FrameView& frame);
+
+    Config m_config;
+    // Capture thread. The compared rows of the last frame let through.
+    std::vector<uint8_t> m_reference;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    bool m_hasReference = false;
+    int64_t m_lastPassed = 0;
+    std::vector<uint32_t> m_columnSums;
+    std::atomic<bool> m_passNext{ false };
+    std::atomic<double> m_changeRatio{ 0.0 };
+    std::atomic<uint64_t> m_framesChecked{ 0 };
+    std::atomic<uint64_t> m_framesUnchanged{ 0 };
+    std::atomic<uint64_t> m_framesSkipped{ 0 };
+};
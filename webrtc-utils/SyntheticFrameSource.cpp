@@ -0,0 +1,154 @@
+﻿#include "SyntheticFrameSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+// Position along a back-and-forth path over [0, range].
+static double Bounce(double position, double range)
+{
+    if (range <= 0)
+        return 0;
+    double folded = std::fmod(position, 2 * range);
+    if (folded < 0)
+        folded += 2 * range;
+    return folded <= range ? folded : 2 * range - folded;
+}
+
+SyntheticFrameSource::SyntheticFrameSource(const Config& config)
+    : PacedFrameSource(config.realtime, config.bufferCount), m_config(config)
+{
+    Prepare();
+}
+
+SyntheticFrameSource::~SyntheticFrameSource()
+{
+    Stop();
+}
+
+bool SyntheticFrameSource::Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated)
+{
+    uint32_t width = requested.width > 0 ? requested.width : m_config.width;
+    uint32_t height = requested.height > 0 ? requested.height : m_config.height;
+    uint32_t frameRate = requested.frameRate > 0 ? requested.frameRate : m_config.frameRate;
+    bool valid = width % 2 == 0 && height % 2 == 0 && frameRate > 0;
+    bool changed = width != m_config.width || height != m_config.height || frameRate != m_config.frameRate;
+    if (valid && changed && !Running())
+    {
+        m_config.width = width;
+        m_config.height = height;
+        m_config.frameRate = frameRate;
+        Prepare();
+    }
+    negotiated = Format();
+    return valid && (!changed || !Running());
+}
+
+FrameSourceFormat SyntheticFrameSource::Format() const
+{
+    FrameSourceFormat format;
+    format.format = FrameFormat::Nv12;
+    format.width = m_config.width;
+    format.height = m_config.height;
+    format.frameRate = m_config.frameRate;
+    return format;
+}
+
+void SyntheticFrameSource::Prepare()
+{
+    const uint32_t width = m_config.width;
+    const uint32_t height = m_config.height;
+    ResizeBuffers(FrameView::PackedSize(FrameFormat::Nv12, width, height));
+    m_background.assign(FrameView::PackedSize(FrameFormat::Nv12, width, height), 0);
+    if (m_background.empty())
+        return;
+
+    // Diagonal luma ramp over chroma ramps in both directions.
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+            m_background[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>(32 + 160 * (x + y) / (width + height));
+    }
+    uint8_t* uv = m_background.data() + static_cast<size_t>(width) * height;
+    for (uint32_t y = 0; y < height / 2; y++)
+    {
+        for (uint32_t x = 0; x < width / 2; x++)
+        {
+            uv[static_cast<size_t>(y) * width + x * 2] = static_cast<uint8_t>(96 + 64 * x / (width / 2));
+            uv[static_cast<size_t>(y) * width + x * 2 + 1] = static_cast<uint8_t>(96 + 64 * y / (height / 2));
+        }
+    }
+
+    m_boxSide = std::min(std::min(width, height), static_cast<uint32_t>(height * m_config.boxSize)) & ~1u;
+    std::mt19937 random(m_config.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    m_boxes.clear();
+    for (uint32_t i = 0; i < m_config.boxCount; i++)
+    {
+        Box box;
+        box.x = unit(random) * (width - m_boxSide);
+        box.y = unit(random) * (height - m_boxSide);
+        double angle = unit(random) * 6.283185307179586;
+        box.dx = std::cos(angle) * m_config.motion;
+        box.dy = std::sin(angle) * m_config.motion;
+        box.y8 = static_cast<uint8_t>(16 + random() % 220);
+        box.u = static_cast<uint8_t>(16 + random() % 225);
+        box.v = static_cast<uint8_t>(16 + random() % 225);
+        m_boxes.push_back(box);
+    }
+}
+
+bool SyntheticFrameSource::NextFrame(uint64_t index, BorrowedFrame& frame)
+{
+    if (m_background.empty() || (m_config.frameCount > 0 && index >= m_config.frameCount))
+        return false;
+    frame = Buffers().Acquire(FrameFormat::Nv12, m_config.width, m_config.height, !Realtime());
+    if (frame)
+        Render(index, frame.View());
+    return true;
+}
+
+void SyntheticFrameSource::Render(uint64_t index, const FrameView& frame) const
+{
+    const uint32_t width = m_config.width;
+    const uint32_t height = m_config.height;
+    uint8_t* luma = frame.planes[0].data;
+    uint8_t* uv = frame.planes[1].data;
+    std::memcpy(luma, m_background.data(), static_cast<size_t>(width) * height);
+    std::memcpy(uv, m_background.data() + static_cast<size_t>(width) * height, static_cast<size_t>(width) * height / 2);
+
+    for (const Box& box : m_boxes)
+    {
+        // Even corners keep the box on whole chroma samples.
+        uint32_t left = static_cast<uint32_t>(Bounce(box.x + box.dx * index, width - m_boxSide)) & ~1u;
+        uint32_t top = static_cast<uint32_t>(Bounce(box.y + box.dy * index, height - m_boxSide)) & ~1u;
+        for (uint32_t y = top; y < top + m_boxSide; y++)
+            std::memset(luma + static_cast<size_t>(y) * width + left, box.y8, m_boxSide);
+        for (uint32_t y = top / 2; y < (top + m_boxSide) / 2; y++)
+        {
+            uint8_t* row = uv + static_cast<size_t>(y) * width + left;
+            for (uint32_t x = 0; x < m_boxSide; x += 2)
+            {
+                row[x] = box.u;
+                row[x + 1] = box.v;
+            }
+        }
+    }
+
+    if (m_config.noise == 0)
+        return;
+    // xorshift seeded by the frame index, so the noise is the same on every
+    // run but differs from frame to frame.
+    uint64_t state = (static_cast<uint64_t>(m_config.seed) << 32 ^ (index + 1) * 0x9e3779b97f4a7c15ull) | 1;
+    const int32_t span = static_cast<int32_t>(m_config.noise) * 2 + 1;
+    const size_t samples = static_cast<size_t>(width) * height;
+    for (size_t i = 0; i < samples; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int32_t value = luma[i] + static_cast<int32_t>(state % span) - static_cast<int32_t>(m_config.noise);
+        luma[i] = static_cast<uint8_t>(value < 0 ? 0 : value > 255 ? 255 : value);
+    }
+}
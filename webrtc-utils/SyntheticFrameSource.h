@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FrameSource.h"
+
+// Generates NV12 test frames without a camera: a fixed gradient with boxes
+// bouncing over it and optional luma noise. Every frame depends only on
+// the configuration and its index, so runs are reproducible down to the
+// byte.
+class SyntheticFrameSource : public PacedFrameSource
+{
+public:
+    struct Config
+    {
+        // Even; Negotiate may change them before Start.
+        uint32_t width = 1280;
+        uint32_t height = 720;
+        uint32_t frameRate = 30;
+        // Zero runs until stopped.
+        uint64_t frameCount = 0;
+        bool realtime = false;
+        uint32_t bufferCount = 3;
+        uint32_t boxCount = 4;
+        // Box side as a share of the frame height.
+        double boxSize = 0.15;
+        // Pixels each box moves per frame; zero gives a static scene.
+        double motion = 4.0;
+        // Largest change noise makes to a luma sample; zero for none.
+        uint32_t noise = 0;
+        uint32_t seed = 1;
+    };
+
+    explicit SyntheticFrameSource(const Config& config);
+    ~SyntheticFrameSource() override;
+
+    // Any even size and frame rate; the format is always NV12.
+    bool Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated) override;
+
+protected:
+    bool NextFrame(uint64_t index, BorrowedFrame& frame) override;
+    FrameSourceFormat Format() const override;
+
+private:
+    struct Box
+    {
+        double x;
+        double y;
+        double dx;
+        double dy;
+        uint8_t y8;
+        uint8_t u;
+        uint8_t v;
+    };
+
+    void Prepare();
+    void Render(uint64_t index, const FrameView& frame) const;
+
+    Config m_config;
+    std::vector<uint8_t> m_background;
+    std::vector<Box> m_boxes;
+    uint32_t m_boxSide = 0;
+};
@@ -0,0 +1,192 @@
+﻿#include "Trace.h"
+
+#ifdef WEBRTCUTILS_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    // A seqlock per slot: sequence is odd while the writer is filling the
+    // slot and 2 * (index + 1) once event index is complete, so a reader
+    // knows both that its copy is whole and which event it copied.
+    struct TraceEvent
+    {
+        std::atomic<uint64_t> sequence{ 0 };
+        std::atomic<const char*> name{ nullptr };
+        std::atomic<uint64_t> timestamp{ 0 };
+        std::atomic<char> phase{ 0 };
+    };
+
+    // Single writer, the owning thread. Readers copy a window and keep the
+    // slots whose sequence still names the event they expected.
+    struct TraceBuffer
+    {
+        static constexpr uint64_t Capacity = 1 << 14;
+
+        explicit TraceBuffer(uint32_t threadId)
+            : threadId(threadId), events(Capacity)
+        {
+        }
+
+        const uint32_t threadId;
+        std::vector<TraceEvent> events;
+        std::atomic<uint64_t> head{ 0 };
+    };
+
+    struct TraceRegistry
+    {
+        // Buffers of exited threads kept for late exports. Older ones are
+        // freed, so threads coming and going don't pile up buffers.
+        static constexpr size_t MaxRetired = 4;
+
+        std::mutex mutex;
+        uint32_t nextThreadId = 1;
+        std::vector<std::shared_ptr<TraceBuffer>> buffers;
+        // Oldest first.
+        std::deque<std::shared_ptr<TraceBuffer>> retired;
+    };
+
+    TraceRegistry& Registry()
+    {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    // Moves the thread's buffer to the retired list when the thread exits.
+    // An export still copying it holds its own reference.
+    class ThreadBufferOwner
+    {
+    public:
+        ThreadBufferOwner() = default;
+        ThreadBufferOwner(const ThreadBufferOwner&) = delete;
+        ThreadBufferOwner& operator=(const ThreadBufferOwner&) = delete;
+
+        ~ThreadBufferOwner()
+        {
+            if (buffer == nullptr)
+                return;
+
+            TraceRegistry& registry = Registry();
+            std::lock_guard lock(registry.mutex);
+            for (auto it = registry.buffers.begin(); it != registry.buffers.end(); ++it)
+            {
+                if (it->get() == buffer)
+                {
+                    registry.retired.push_back(std::move(*it));
+                    registry.buffers.erase(it);
+                    break;
+                }
+            }
+            if (registry.retired.size() > TraceRegistry::MaxRetired)
+                registry.retired.pop_front();
+        }
+
+        TraceBuffer* buffer = nullptr;
+    };
+
+    TraceBuffer& ThreadBuffer()
+    {
+        thread_local ThreadBufferOwner owner;
+        if (owner.buffer == nullptr)
+        {
+            TraceRegistry& registry = Registry();
+            std::lock_guard lock(registry.mutex);
+            registry.buffers.push_back(std::make_shared<TraceBuffer>(registry.nextThreadId++));
+            owner.buffer = registry.buffers.back().get();
+        }
+        return *owner.buffer;
+    }
+
+    uint64_t NowNanoseconds()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    void Record(const char* name, char phase)
+    {
+        TraceBuffer& buffer = ThreadBuffer();
+        uint64_t head = buffer.head.load(std::memory_order_relaxed);
+        TraceEvent& event = buffer.events[head % TraceBuffer::Capacity];
+        event.sequence.store(2 * head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        event.name.store(name, std::memory_order_relaxed);
+        event.timestamp.store(NowNanoseconds(), std::memory_order_relaxed);
+        event.phase.store(phase, std::memory_order_relaxed);
+        event.sequence.store(2 * head + 2, std::memory_order_release);
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    struct EventCopy
+    {
+        const char* name;
+        uint64_t timestamp;
+        char phase;
+    };
+}
+
+void Trace::Begin(const char* name)
+{
+    Record(name, 'B');
+}
+
+void Trace::End(const char* name)
+{
+    Record(name, 'E');
+}
+
+std::string Trace::ExportChromeJson()
+{
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+    {
+        TraceRegistry& registry = Registry();
+        std::lock_guard lock(registry.mutex);
+        buffers.assign(registry.retired.begin(), registry.retired.end());
+        buffers.insert(buffers.end(), registry.buffers.begin(), registry.buffers.end());
+    }
+
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    std::vector<EventCopy> copies;
+    char line[256];
+    for (const std::shared_ptr<TraceBuffer>& buffer : buffers)
+    {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > TraceBuffer::Capacity ? head - TraceBuffer::Capacity : 0;
+        copies.clear();
+        for (uint64_t i = begin; i < head; i++)
+        {
+            // A slot the writer is in, or has lapped, is left out.
+            const TraceEvent& event = buffer->events[i % TraceBuffer::Capacity];
+            uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+            if (sequence != 2 * i + 2)
+                continue;
+            EventCopy copy = { event.name.load(std::memory_order_relaxed),
+                event.timestamp.load(std::memory_order_relaxed), event.phase.load(std::memory_order_relaxed) };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (event.sequence.load(std::memory_order_relaxed) == sequence)
+                copies.push_back(copy);
+        }
+
+        for (const EventCopy& event : copies)
+        {
+            int length = std::snprintf(line, sizeof(line),
+                "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                first ? "" : ",", event.name, event.phase, event.timestamp / 1000.0, buffer->threadId);
+            if (length > 0)
+                json.append(line, static_cast<size_t>(length) < sizeof(line) ? static_cast<size_t>(length) : sizeof(line) - 1);
+            first = false;
+        }
+    }
+    json += "]}";
+    return json;
+}
+
+#endif
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+// Begin/end events for each pipeline stage, kept in per-thread rings and
+// exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Only
+// built when WEBRTCUTILS_TRACING is defined; otherwise TRACE_SCOPE expands
+// to nothing and no tracing code is compiled in.
+
+#include <string>
+
+#ifdef WEBRTCUTILS_TRACING
+
+class Trace
+{
+public:
+    // name must be a string literal or otherwise outlive the trace.
+    static void Begin(const char* name);
+    static void End(const char* name);
+
+    // Snapshot of every live thread's ring and those of the last few
+    // threads to exit. Safe while threads keep tracing; events overwritten
+    // during the copy are left out.
+    static std::string ExportChromeJson();
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name)
+        : m_name(name)
+    {
+        Trace::Begin(name);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope()
+    {
+        Trace::End(m_name);
+    }
+
+private:
+    const char* m_name;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+
+#endif
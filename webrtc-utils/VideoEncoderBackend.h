@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "BorrowedFrame.h"
+#include "EncodedFrame.h"
+
+enum class VideoEncoderBackendType
+{
+    MediaFoundation,
+    OpenH264,
+};
+
+enum class H264Profile
+{
+    Baseline,
+    Main,
+    High,
+};
+
+struct VideoEncoderSettings
+{
+    uint32_t width = 640;
+    uint32_t height = 480;
+    uint32_t frameRate = 30;
+    uint32_t bitrate = 1500000;
+    H264Profile profile = H264Profile::Main;
+    // level_idc, e.g. 41 for level 4.1.
+    uint32_t level = 41;
+
+    // True when moving between the two needs a new stream, as opposed to
+    // a rate change the encoder can take mid-stream.
+    bool NeedsRestart(const VideoEncoderSettings& other) const
+    {
+        return width != other.width || height != other.height || profile != other.profile || level != other.level;
+    }
+};
+
+// H.264 encoder behind the encode pipeline. Input frames are NV12. All calls
+// come from the encode thread, except RequestKeyFrame and SetRate which may
+// be called from any thread.
+class IVideoEncoderBackend
+{
+public:
+    virtual ~IVideoEncoderBackend() = default;
+
+    virtual const char* Name() const = 0;
+
+    virtual bool Configure(const VideoEncoderSettings& settings) = 0;
+
+    // Returns an empty reference while the encoder is still buffering. The
+    // frame's release hook runs once the encoder no longer needs the memory.
+    virtual EncodedFrameRef Encode(BorrowedFrame frame) = 0;
+
+    // The next encoded frame is an IDR frame.
+    virtual void RequestKeyFrame() = 0;
+
+    virtual bool SetRate(uint32_t bitrate, uint32_t frameRate) = 0;
+
+    // Applies new settings to a configured encoder. Rate changes keep the
+    // current stream; anything else restarts it as cheaply as the backend
+    // allows, and the next frame is an IDR frame. Encode thread only.
+    virtual bool Reconfigure(const VideoEncoderSettings& settings) = 0;
+
+    // Drains every frame the encoder still holds.
+    virtual std::vector<EncodedFrameRef> Flush() = 0;
+
+    virtual void Shutdown() = 0;
+
+    virtual BitstreamArena::Stats GetBitstreamStats() const = 0;
+};
@@ -0,0 +1,122 @@
+﻿#include "YuvFileReader.h"
+
+#include <cstdlib>
+#include <cstring>
+
+YuvFileReader::~YuvFileReader()
+{
+    Close();
+}
+
+bool YuvFileReader::Open(const std::string& path, const Options& options)
+{
+    Close();
+
+    m_file = std::fopen(path.c_str(), "rb");
+    if (m_file == nullptr)
+        return false;
+
+    m_y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+    Options parsed = options;
+    char line[256];
+    if (m_y4m && (std::fgets(line, sizeof(line), m_file) == nullptr || !ParseY4mHeader(line, parsed)))
+    {
+        Close();
+        return false;
+    }
+
+    m_format = parsed.format;
+    m_width = parsed.width;
+    m_height = parsed.height;
+    m_frameRate = parsed.frameRate;
+
+    m_dataOffset = std::ftell(m_file);
+    if (m_width == 0 || m_height == 0 || (m_width & 1) != 0 || (m_height & 1) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    m_chroma.resize(FrameSize() / 3);
+    return true;
+}
+
+void YuvFileReader::Close()
+{
+    if (m_file != nullptr)
+        std::fclose(m_file);
+    m_file = nullptr;
+}
+
+bool YuvFileReader::ParseY4mHeader(char* line, Options& options)
+{
+    if (std::strncmp(line, "YUV4MPEG2 ", 10) != 0)
+        return false;
+
+    options.format = YuvFormat::I420;
+    for (char* token = std::strtok(line + 10, " \n"); token != nullptr; token = std::strtok(nullptr, " \n"))
+    {
+        switch (token[0])
+        {
+        case 'W':
+            options.width = static_cast<uint32_t>(std::strtoul(token + 1, nullptr, 10));
+            break;
+        case 'H':
+            options.height = static_cast<uint32_t>(std::strtoul(token + 1, nullptr, 10));
+            break;
+        case 'F':
+        {
+            char* separator = nullptr;
+            unsigned long numerator = std::strtoul(token + 1, &separator, 10);
+            unsigned long denominator = separator != nullptr && *separator == ':' ? std::strtoul(separator + 1, nullptr, 10) : 1;
+            if (numerator > 0 && denominator > 0)
+                options.frameRate = static_cast<uint32_t>((numerator + denominator / 2) / denominator);
+            break;
+        }
+        case 'C':
+            // Only 4:2:0 layouts are supported.
+            if (std::strncmp(token, "C420", 4) != 0)
+                return false;
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+bool YuvFileReader::ReadFrame(uint8_t* nv12, size_t size)
+{
+    if (m_file == nullptr || size < FrameSize())
+        return false;
+
+    if (m_y4m)
+    {
+        char header[64];
+        if (std::fgets(header, sizeof(header), m_file) == nullptr || std::strncmp(header, "FRAME", 5) != 0)
+            return false;
+    }
+
+    size_t lumaSize = static_cast<size_t>(m_width) * m_height;
+    if (m_format == YuvFormat::NV12)
+        return std::fread(nv12, 1, FrameSize(), m_file) == FrameSize();
+
+    if (std::fread(nv12, 1, lumaSize, m_file) != lumaSize || std::fread(m_chroma.data(), 1, m_chroma.size(), m_file) != m_chroma.size())
+        return false;
+
+    size_t chromaSize = lumaSize / 4;
+    const uint8_t* u = m_chroma.data();
+    const uint8_t* v = u + chromaSize;
+    uint8_t* interleaved = nv12 + lumaSize;
+    for (size_t i = 0; i < chromaSize; i++)
+    {
+        interleaved[i * 2] = u[i];
+        interleaved[i * 2 + 1] = v[i];
+    }
+    return true;
+}
+
+bool YuvFileReader::Rewind()
+{
+    return m_file != nullptr && std::fseek(m_file, m_dataOffset, SEEK_SET) == 0;
+}
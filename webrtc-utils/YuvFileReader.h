@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class YuvFormat
+{
+    NV12,
+    I420,
+};
+
+// Reads raw NV12/I420 or Y4M (4:2:0) sequences frame by frame and hands
+// them out as NV12, the layout every encoder backend takes. Y4M files
+// describe themselves; raw files need the size and layout from the caller.
+class YuvFileReader
+{
+public:
+    struct Options
+    {
+        // Ignored for Y4M.
+        YuvFormat format = YuvFormat::NV12;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t frameRate = 30;
+    };
+
+    YuvFileReader() = default;
+    YuvFileReader(const YuvFileReader&) = delete;
+    YuvFileReader& operator=(const YuvFileReader&) = delete;
+    ~YuvFileReader();
+
+    // Reads the stream header line of a Y4M file into options, which keep
+    // whatever the header leaves out. Fails on anything but 4:2:0.
+    static bool ParseY4mHeader(char* line, Options& options);
+
+    bool Open(const std::string& path, const Options& options);
+    void Close();
+
+    // Fills nv12 with the next frame. Returns false at the end of the file.
+    bool ReadFrame(uint8_t* nv12, size_t size);
+    bool Rewind();
+
+    uint32_t Width() const { return m_width; }
+    uint32_t Height() const { return m_height; }
+    uint32_t FrameRate() const { return m_frameRate; }
+    size_t FrameSize() const { return static_cast<size_t>(m_width) * m_height * 3 / 2; }
+
+private:
+    FILE* m_file = nullptr;
+    bool m_y4m = false;
+    YuvFormat m_format = YuvFormat::NV12;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_frameRate = 30;
+    long m_dataOffset = 0;
+    std::vector<uint8_t> m_chroma;
+};
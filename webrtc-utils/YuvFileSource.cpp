@@ -0,0 +1,98 @@
+﻿#include "YuvFileSource.h"
+
+#include <algorithm>
+
+YuvFileSource::YuvFileSource(const Config& config)
+    : PacedFrameSource(config.realtime, config.bufferCount), m_config(config)
+{
+}
+
+YuvFileSource::~YuvFileSource()
+{
+    Stop();
+}
+
+bool YuvFileSource::Open()
+{
+    if (!m_reader.Open(m_config.path, m_config.input))
+        return false;
+
+    ResizeBuffers(m_reader.FrameSize());
+    m_scratch.resize(m_reader.FrameSize());
+    m_frames.clear();
+    if (m_config.preload)
+    {
+        std::vector<uint8_t> frame(m_reader.FrameSize());
+        while ((m_config.maxFrames == 0 || m_frames.size() < m_config.maxFrames) && m_reader.ReadFrame(frame.data(), frame.size()))
+            m_frames.push_back(frame);
+        if (m_frames.empty())
+            return false;
+    }
+    return true;
+}
+
+bool YuvFileSource::Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated)
+{
+    negotiated = Format();
+    return (requested.width == 0 || requested.width == negotiated.width) && (requested.height == 0 || requested.height == negotiated.height);
+}
+
+FrameSourceFormat YuvFileSource::Format() const
+{
+    FrameSourceFormat format;
+    format.format = FrameFormat::Nv12;
+    format.width = m_reader.Width();
+    format.height = m_reader.Height();
+    format.frameRate = m_reader.FrameRate();
+    return format;
+}
+
+bool YuvFileSource::NextFrame(uint64_t index, BorrowedFrame& frame)
+{
+    if (index == 0)
+    {
+        m_loop = 0;
+        m_frameInLoop = 0;
+        if (!m_config.preload && !m_reader.Rewind())
+            return false;
+    }
+
+    frame = Buffers().Acquire(FrameFormat::Nv12, m_reader.Width(), m_reader.Height(), !Realtime());
+    // A frame dropped for want of a buffer still uses up its place in the
+    // file, the way a camera frame would.
+    uint8_t* target = frame ? frame.View().planes[0].data : m_scratch.data();
+    if (ReadNext(target))
+        return true;
+    frame = BorrowedFrame();
+    return false;
+}
+
+bool YuvFileSource::ReadNext(uint8_t* nv12)
+{
+    for (;;)
+    {
+        bool endOfPass = m_config.maxFrames > 0 && m_frameInLoop >= m_config.maxFrames;
+        if (!endOfPass)
+        {
+            if (m_config.preload && m_frameInLoop < m_frames.size())
+            {
+                std::copy(m_frames[m_frameInLoop].begin(), m_frames[m_frameInLoop].end(), nv12);
+                m_frameInLoop++;
+                return true;
+            }
+            if (!m_config.preload && m_reader.ReadFrame(nv12, m_reader.FrameSize()))
+            {
+                m_frameInLoop++;
+                return true;
+            }
+        }
+
+        // An empty pass would loop forever.
+        if (m_frameInLoop == 0 || (m_config.loops > 0 && m_loop + 1 >= m_config.loops))
+            return false;
+        m_loop++;
+        m_frameInLoop = 0;
+        if (!m_config.preload && !m_reader.Rewind())
+            return false;
+    }
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "FrameSource.h"
+#include "YuvFileReader.h"
+
+// Plays a raw NV12/I420 or Y4M file as NV12 frames at the file's size and
+// frame rate, any number of times over.
+class YuvFileSource : public PacedFrameSource
+{
+public:
+    struct Config
+    {
+        std::string path;
+        YuvFileReader::Options input;
+        // Frames per pass; zero plays the whole file.
+        uint32_t maxFrames = 0;
+        // Passes over the file; zero loops until stopped.
+        uint32_t loops = 1;
+        bool realtime = false;
+        uint32_t bufferCount = 3;
+        // Reads every frame into memory on Open, so that the source costs
+        // a copy per frame rather than a disk read.
+        bool preload = false;
+    };
+
+    explicit YuvFileSource(const Config& config);
+    ~YuvFileSource() override;
+
+    // Fails when the file can't be read or is empty.
+    bool Open();
+
+    // The size is the file's; only a request for that size, or none,
+    // succeeds.
+    bool Negotiate(const FrameSourceFormat& requested, FrameSourceFormat& negotiated) override;
+
+protected:
+    bool NextFrame(uint64_t index, BorrowedFrame& frame) override;
+    FrameSourceFormat Format() const override;
+
+private:
+    bool ReadNext(uint8_t* nv12);
+
+    Config m_config;
+    YuvFileReader m_reader;
+    std::vector<std::vector<uint8_t>> m_frames;
+    // Source thread.
+    std::vector<uint8_t> m_scratch;
+    uint32_t m_loop = 0;
+    uint32_t m_frameInLoop = 0;
+};
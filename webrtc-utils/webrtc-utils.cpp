@@ -1,184 +1,624 @@
 ﻿#include "pch.h"
 #include "webrtc-utils.h"
-#include "MediaFoundationEncoder.h"
+#include "CaptureSession.h"
+#include "FrameHandleTracker.h"
+#include "Trace.h"
 
-#include <sstream>
-#include <mutex>
+static FrameHandleTracker s_frameHandles;
 
-using namespace winrt;
-using namespace winrt::Windows::Media::Capture;
-using namespace winrt::Windows::Media::Capture;
-using namespace winrt::Windows::Storage;
-using namespace winrt::Windows::Media::Capture::Frames;
-using namespace winrt::Windows::Media::Effects;
-using namespace winrt::Windows::Foundation::Collections;
-using namespace winrt::Windows::Media::MediaProperties;
-using namespace winrt::Windows::Graphics::DirectX::Direct3D11;
-using namespace winrt::Windows::Graphics::Imaging;
+// State behind the original single-camera exports. They drive one default
+// session configured through the legacy setters.
+static std::atomic<FrameEncodedCallback> s_frameEncodedCallback = nullptr;
+static std::atomic<EncodedFrameHandleCallback> s_encodedFrameHandleCallback = nullptr;
+static EncodePipeline::Config s_pipelineConfig;
+static uint32_t s_pullCapacity = 0;
+static VideoEncoderSettings s_encoderSettings;
+static uint32_t s_replaySeconds = 0;
+static uint32_t s_replayMemoryBudget = 0;
+static DownscaleFilter s_downscaleFilter = DownscaleFilter_None;
+static bool s_adaptToCpu = false;
+static bool s_skipStaticFrames = false;
+static std::shared_ptr<CaptureSession> s_defaultSession;
 
-static FrameEncodedCallback s_frameEncodedCallback = nullptr;
-static MediaCapture s_mediaCapture = nullptr;
-static MediaFrameReader s_mediaReader = nullptr;
-static MediaFoundationEncoder s_encoder;
-static std::mutex s_encoderMutex;
+// What a SessionHandle stands for. The app's frame callback is called
+// through DeliverToSessionCallback, which lends it a tracked handle rather
+// than the frame itself.
+struct ExportedSession
+{
+	std::unique_ptr<CaptureSession> session;
+	SessionFrameCallback frameCallback = nullptr;
+	void* frameCallbackContext = nullptr;
+};
+
+// Session handles are tokens into s_sessions, never reused. Every export
+// holds the session it looked up for the length of the call, so
+// DestroySession can't free it under a call still running on another
+// thread; the last call out frees it.
+static std::mutex s_sessionsMutex;
+static std::unordered_map<uintptr_t, std::shared_ptr<ExportedSession>> s_sessions;
+static uintptr_t s_nextSession = 1;
 
-void OnMediaCaptureFailed(MediaCapture const& sender, MediaCaptureFailedEventArgs const& errorEventArgs)
+static std::shared_ptr<ExportedSession> FindExportedSession(SessionHandle session)
 {
-	OutputDebugString(L"MediaCapture Failed");
-	OutputDebugString(errorEventArgs.Message().c_str());
+	std::lock_guard lock(s_sessionsMutex);
+	auto it = s_sessions.find(reinterpret_cast<uintptr_t>(session));
+	return it != s_sessions.end() ? it->second : nullptr;
 }
 
-static hstring ToLower(const hstring& str)
+static std::shared_ptr<CaptureSession> FindSession(SessionHandle session)
 {
-	std::wstring lower_str;
-	lower_str = str;
-	std::transform(lower_str.begin(), lower_str.end(), lower_str.begin(),
-		[](unsigned char c) { return std::tolower(c); });
-	return hstring(lower_str);
+	std::shared_ptr<ExportedSession> exported = FindExportedSession(session);
+	if (exported == nullptr)
+		return nullptr;
+	return std::shared_ptr<CaptureSession>(exported, exported->session.get());
 }
 
-static bool CaseInsensitiveCompare(const hstring& str1, const hstring& str2)
+static DropPolicy ToDropPolicy(CaptureDropPolicy policy)
 {
-	return ToLower(str1) == ToLower(str2);
+	return policy == CaptureDropPolicy_LatestOnly ? DropPolicy::LatestOnly : DropPolicy::DropOldest;
 }
 
-static void OnFrameArrived(MediaFrameReader sender, const MediaFrameArrivedEventArgs& args) {
-    try {
-    	auto start = std::chrono::high_resolution_clock::now();
-        MediaFrameReference reference = sender.TryAcquireLatestFrame();
-        if (reference == nullptr) 
-            return;
-        VideoMediaFrame videoFrame = reference.VideoMediaFrame();
-        if (videoFrame == nullptr)
-            return;
+static void ApplyDownscaleFilter(DownscaleFilter filter, CaptureSession::Config& config)
+{
+	config.scaleOnReconfigure = filter == DownscaleFilter_Bilinear || filter == DownscaleFilter_Box;
+	config.scaling.filter = filter == DownscaleFilter_Bilinear ? ScaleFilter::Bilinear : ScaleFilter::Box;
+}
 
-    	SoftwareBitmap source = videoFrame.SoftwareBitmap();
-		if (videoFrame.SoftwareBitmap() == nullptr) {
-			source = SoftwareBitmap::CreateCopyFromSurfaceAsync(videoFrame.Direct3DSurface()).get();
-		}
+static BitstreamRecorder::SyncPolicy ToSyncPolicy(RecordingSync sync)
+{
+	switch (sync)
+	{
+	case RecordingSync_None:
+		return BitstreamRecorder::SyncPolicy::None;
+	case RecordingSync_EveryWrite:
+		return BitstreamRecorder::SyncPolicy::EveryWrite;
+	default:
+		return BitstreamRecorder::SyncPolicy::OnStop;
+	}
+}
 
-    	if (source == nullptr)
-    	{
-    		OutputDebugString(L"Could not get SoftwareBitmap");
-    		return;
-    	}
-
-    	BitmapBuffer lockedBuffer = source.LockBuffer(BitmapBufferAccessMode::Read);
-        Windows::Foundation::IMemoryBufferReference referenceBuff = lockedBuffer.CreateReference();
-    	uint8_t* buffer;
-    	uint32_t capacity;
-    	referenceBuff.as<impl::IMemoryBufferByteAccess>()->GetBuffer(&buffer, &capacity);
-
-    	if (s_frameEncodedCallback != nullptr)
-    	{
-    		{
-    			std::lock_guard lock(s_encoderMutex);
-    			
-    			std::vector<uint8_t> data = s_encoder.ProcessFrame(buffer, capacity, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
-    			if (data.size() > 0)
-    				s_frameEncodedCallback(3000, data.data(), data.size());
-    		}
-    	}
-    	lockedBuffer.Close();
-    	source.Close();
-    	
-    	auto end = std::chrono::high_resolution_clock::now();
-    	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-
-    	std::wstringstream ss;
-    	ss << L"Frame processed in " << duration.count() << L" miliseconds\n";
-		OutputDebugString(ss.str().c_str()); 
-    }
-    catch (hresult_error const& ex)
-    {
-		hstring message = ex.message();
-		
-		OutputDebugString(L"Deu errorrrr!!!\n");
-		OutputDebugString(message.c_str());
-    }
+static bool ToEncoderSettings(const EncoderConfig* config, VideoEncoderSettings& settings)
+{
+	if (config == nullptr || config->width == 0 || config->height == 0 || config->frameRate == 0 || config->bitrate == 0)
+		return false;
+
+	settings.width = config->width;
+	settings.height = config->height;
+	settings.frameRate = config->frameRate;
+	settings.bitrate = config->bitrate;
+	settings.profile = config->profile == EncoderProfile_Baseline ? H264Profile::Baseline
+		: config->profile == EncoderProfile_High ? H264Profile::High : H264Profile::Main;
+	settings.level = config->level;
+	return true;
 }
 
-static void SetupMediaCapture() 
+// The first layer is the main stream; the rest run in the simulcast encoder.
+static bool ApplySimulcastLayers(const SimulcastLayer* layers, uint32_t count, CaptureSession::Config& config)
 {
-	try {
-		MediaCaptureInitializationSettings settings;
-		settings.SharingMode(MediaCaptureSharingMode::ExclusiveControl);
-		settings.MemoryPreference(MediaCaptureMemoryPreference::Auto);
-		settings.StreamingCaptureMode(StreamingCaptureMode::Video);
+	if (layers == nullptr)
+		return false;
 
-		s_mediaCapture = MediaCapture();
-		s_mediaCapture.InitializeAsync(settings).get();
-		s_mediaCapture.Failed(OnMediaCaptureFailed);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (layers[i].width == 0 || layers[i].height == 0 || layers[i].bitrate == 0)
+			return false;
+		if (i > 0 && (layers[i].width > layers[i - 1].width || layers[i].height > layers[i - 1].height))
+			return false;
+		if (layers[i].rid != nullptr && strlen(layers[i].rid) > EncodedFrame::MaxRidLength)
+			return false;
+	}
+
+	config.encoder.width = layers[0].width;
+	config.encoder.height = layers[0].height;
+	config.encoder.bitrate = layers[0].bitrate;
+	config.rid = layers[0].rid != nullptr ? layers[0].rid : "";
+	for (uint32_t i = 1; i < count; i++)
+	{
+		SimulcastEncoder::Layer layer;
+		layer.encoder = config.encoder;
+		layer.encoder.width = layers[i].width;
+		layer.encoder.height = layers[i].height;
+		layer.encoder.bitrate = layers[i].bitrate;
+		layer.rid = layers[i].rid != nullptr ? layers[i].rid : "";
+		config.simulcast.push_back(std::move(layer));
+	}
+	return true;
+}
 
-		//auto definition = winrt::make<MrcEffectDefinitions::MrcVideoEffectDefinition>();
-		//g_MediaCapture.AddVideoEffectAsync(definition, MediaStreamType::VideoRecord);
+static bool ApplyEncoderConfig(CaptureSession* session, const EncoderConfig* config)
+{
+	VideoEncoderSettings settings;
+	if (session == nullptr || !ToEncoderSettings(config, settings))
+		return false;
+	return session->Reconfigure(settings);
+}
 
-		MediaFrameSource colorSource(nullptr);
-		for (IKeyValuePair<hstring, MediaFrameSource> item : s_mediaCapture.FrameSources()) {
-			if (item.Value().Info().MediaStreamType() == MediaStreamType::VideoRecord || item.Value().Info().MediaStreamType() == MediaStreamType::VideoPreview
-				&& item.Value().Info().SourceKind() == MediaFrameSourceKind::Color) {
-					colorSource = item.Value();
-			}
-		}
+// The default session's handles have no owning session.
+static void DeliverToLegacyCallbacks(void*, int rtpDuration, void* frame)
+{
+	// Subscribers read straight out of the bitstream arena.
+	EncodedFrame* encoded = static_cast<EncodedFrame*>(frame);
+	FrameEncodedCallback callback = s_frameEncodedCallback;
+	if (callback != nullptr)
+		callback(rtpDuration, const_cast<uint8_t*>(encoded->Data()), static_cast<uint32_t>(encoded->Size()));
 
-		for (MediaFrameFormat format : colorSource.SupportedFormats()) {
-			float framerate = format.FrameRate().Numerator() / format.FrameRate().Denominator();
+	EncodedFrameHandleCallback handleCallback = s_encodedFrameHandleCallback;
+	if (handleCallback != nullptr)
+	{
+		FrameHandleTracker::Loan loan(s_frameHandles, encoded, nullptr);
+		handleCallback(rtpDuration, loan.Handle());
+	}
+}
 
-			if (framerate >= 30 && CaseInsensitiveCompare(format.Subtype(), MediaEncodingSubtypes::Nv12()) && format.VideoFormat().Width() == 640 && format.VideoFormat().Height() == 480) {
-				colorSource.SetFormatAsync(format).get();
-				break;
-			}
-		}
+static void DeliverToSessionCallback(void* context, int rtpDuration, void* frame)
+{
+	ExportedSession* exported = static_cast<ExportedSession*>(context);
+	FrameHandleTracker::Loan loan(s_frameHandles, static_cast<EncodedFrame*>(frame), exported->session.get());
+	exported->frameCallback(exported->frameCallbackContext, rtpDuration, loan.Handle());
+}
+
+static uint32_t PullFrames(CaptureSession* session, const void* owner, EncodedFrameHandle* frames, uint32_t maxFrames, uint32_t timeoutMs)
+{
+	if (session == nullptr || frames == nullptr)
+		return 0;
 
-		s_mediaReader = s_mediaCapture.CreateFrameReaderAsync(colorSource).get();
-		s_mediaReader.AcquisitionMode(MediaFrameReaderAcquisitionMode::Realtime);
-		s_mediaReader.FrameArrived(OnFrameArrived);
+	// Frames come off the ring a batch at a time until it runs dry or the
+	// caller's array is full; only the first batch waits.
+	constexpr uint32_t BatchSize = 32;
+	EncodedFrameRef batch[BatchSize];
+	std::chrono::milliseconds timeout(timeoutMs);
+	uint32_t total = 0;
+	while (total < maxFrames)
+	{
+		uint32_t wanted = maxFrames - total < BatchSize ? maxFrames - total : BatchSize;
+		uint32_t count = session->PullFrames(batch, wanted, timeout);
+		for (uint32_t i = 0; i < count; i++)
+			frames[total + i] = s_frameHandles.Adopt(std::move(batch[i]), owner);
+		total += count;
+		if (count < wanted)
+			break;
+		timeout = std::chrono::milliseconds(0);
 	}
-	catch (hresult_error const& ex)
+	return total;
+}
+
+static bool FillQueueStats(const CaptureSession* session, QueueStats* stats)
+{
+	if (stats == nullptr || session == nullptr)
+		return false;
+
+	EncodePipeline::Stats pipelineStats = session->GetQueueStats();
+	stats->captureQueueDepth = pipelineStats.captureQueueDepth;
+	stats->deliveryQueueDepth = pipelineStats.deliveryQueueDepth;
+	stats->framesCaptured = pipelineStats.framesPosted;
+	stats->captureDrops = pipelineStats.captureDrops;
+	stats->framesEncoded = pipelineStats.framesEncoded;
+	stats->deliveryDrops = pipelineStats.deliveryDrops;
+	stats->framesDelivered = pipelineStats.framesDelivered;
+	return true;
+}
+
+static bool BeginRecording(CaptureSession* session, const wchar_t* fileName, const RecordingConfig* config)
+{
+	if (session == nullptr || fileName == nullptr || fileName[0] == L'\0')
+		return false;
+
+	BitstreamRecorder::Config recording;
+	if (config != nullptr)
 	{
-		hstring message = ex.message();
-		
-		OutputDebugString(L"Deu errorrrr!!!\n");
-		OutputDebugString(message.c_str());
+		if (config->memoryBudget > 0)
+			recording.memoryBudget = config->memoryBudget;
+		recording.sync = ToSyncPolicy(config->sync);
+		if (config->container == RecordingContainer_FragmentedMp4)
+			recording.container = BitstreamRecorder::Container::FragmentedMp4;
 	}
+	session->StopRecording();
+	return session->StartRecording(fileName, recording);
+}
+
+static bool FillRecordingStats(const CaptureSession* session, RecordingStats* stats)
+{
+	if (session == nullptr || stats == nullptr)
+		return false;
+
+	BitstreamRecorder::Stats recording = session->GetRecordingStats();
+	stats->framesRecorded = recording.framesRecorded;
+	stats->bytesWritten = recording.bytesWritten;
+	stats->writes = recording.writes;
+	stats->framesDropped = recording.framesDropped;
+	stats->writeErrors = recording.writeErrors;
+	stats->recording = recording.recording;
+	return true;
+}
+
+static LatencyPercentiles ToLatencyPercentiles(const LatencyHistogram::Percentiles& percentiles)
+{
+	return { percentiles.count, percentiles.p50, percentiles.p95, percentiles.p99, percentiles.max };
+}
+
+static bool FillPipelineStats(CaptureSession* session, PipelineStats* stats)
+{
+	if (stats == nullptr || session == nullptr)
+		return false;
+
+	using DropReason = PipelineMetrics::DropReason;
+	CaptureSession::PipelineStats sessionStats = session->GetPipelineStats();
+	const PipelineMetrics::Snapshot& metrics = sessionStats.metrics;
+	stats->captureFps = metrics.captureFps;
+	stats->encodedFps = metrics.encodedFps;
+	stats->encodedBitrate = metrics.encodedBitrate;
+	stats->framesCaptured = metrics.framesCaptured;
+	stats->framesEncoded = metrics.framesEncoded;
+	stats->keyFrames = metrics.keyFrames;
+	stats->bytesEncoded = metrics.bytesEncoded;
+	stats->dropsNoConsumer = metrics.drops[static_cast<size_t>(DropReason::NoConsumer)];
+	stats->dropsCaptureQueue = metrics.drops[static_cast<size_t>(DropReason::CaptureQueue)];
+	stats->dropsFormatChange = metrics.drops[static_cast<size_t>(DropReason::FormatChange)];
+	stats->dropsDeliveryQueue = metrics.drops[static_cast<size_t>(DropReason::DeliveryQueue)];
+	stats->dropsPullQueue = metrics.drops[static_cast<size_t>(DropReason::PullQueue)];
+	stats->dropsConversion = metrics.drops[static_cast<size_t>(DropReason::Conversion)];
+	stats->dropsAdaptation = metrics.drops[static_cast<size_t>(DropReason::Adaptation)];
+	stats->dropsStaticScene = metrics.drops[static_cast<size_t>(DropReason::StaticScene)];
+	stats->captureQueueDepth = sessionStats.queues.captureQueueDepth;
+	stats->deliveryQueueDepth = sessionStats.queues.deliveryQueueDepth;
+	stats->pullQueueDepth = sessionStats.pullQueueDepth;
+	stats->captureToEncoded = ToLatencyPercentiles(metrics.captureToEncoded);
+	stats->encodeLatency = ToLatencyPercentiles(metrics.encodeLatency);
+	stats->adaptationLevel = sessionStats.adaptation.level;
+	stats->adaptedWidth = sessionStats.adaptation.width;
+	stats->adaptedHeight = sessionStats.adaptation.height;
+	stats->adaptedFrameRate = sessionStats.adaptation.frameRate;
+	stats->encodeUsage = sessionStats.adaptation.usage;
+	stats->changeRatio = sessionStats.staticScene.changeRatio;
+	stats->framesUnchanged = sessionStats.staticScene.framesUnchanged;
+	return true;
 }
 
 extern "C" 
 {
-	WEBRTCUTILS_API bool Setup()
+	WEBRTCUTILS_API SessionHandle CreateSession(const SessionConfig* config)
+	{
+		static std::atomic<uint32_t> s_sessionCount = 0;
+
+		CaptureSession::Config sessionConfig;
+		if (config != nullptr)
+		{
+			if (config->videoDeviceId != nullptr)
+				sessionConfig.videoDeviceId = config->videoDeviceId;
+			if (config->captureQueueCapacity > 0)
+				sessionConfig.pipeline.captureQueueCapacity = config->captureQueueCapacity;
+			sessionConfig.pipeline.captureDropPolicy = ToDropPolicy(config->captureDropPolicy);
+			sessionConfig.pullCapacity = config->pullCapacity;
+			sessionConfig.encoderBackend = config->encoderBackend == EncoderBackend_OpenH264
+				? VideoEncoderBackendType::OpenH264 : VideoEncoderBackendType::MediaFoundation;
+			if (config->encoder != nullptr && !ToEncoderSettings(config->encoder, sessionConfig.encoder))
+				return nullptr;
+			sessionConfig.replaySeconds = config->replaySeconds;
+			if (config->replayMemoryBudget > 0)
+				sessionConfig.replayMemoryBudget = config->replayMemoryBudget;
+			ApplyDownscaleFilter(config->downscaleFilter, sessionConfig);
+			sessionConfig.crop = { config->crop.x, config->crop.y, config->crop.width, config->crop.height };
+			if (config->simulcastLayerCount > 0 && !ApplySimulcastLayers(config->simulcastLayers, config->simulcastLayerCount, sessionConfig))
+				return nullptr;
+			sessionConfig.adaptToCpu = config->adaptToCpu;
+			sessionConfig.skipStaticFrames = config->skipStaticFrames;
+			if (config->staticKeepAliveMs > 0)
+				sessionConfig.staticScene.keepAlive = std::chrono::milliseconds(config->staticKeepAliveMs);
+		}
+		sessionConfig.recordFileName = L"output-" + std::to_wstring(++s_sessionCount) + L".h264";
+
+		auto exported = std::make_shared<ExportedSession>();
+		exported->session = std::make_unique<CaptureSession>(std::move(sessionConfig));
+		if (!exported->session->Initialize())
+			return nullptr;
+
+		std::lock_guard lock(s_sessionsMutex);
+		uintptr_t handle = s_nextSession++;
+		s_sessions[handle] = std::move(exported);
+		return reinterpret_cast<SessionHandle>(handle);
+	}
+
+	WEBRTCUTILS_API bool StartSession(SessionHandle session)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		return captureSession != nullptr && captureSession->Start();
+	}
+
+	WEBRTCUTILS_API void DestroySession(SessionHandle session)
 	{
-		SetupMediaCapture();
-		s_encoder.Initialize();
+		std::shared_ptr<ExportedSession> exported;
+		{
+			std::lock_guard lock(s_sessionsMutex);
+			auto it = s_sessions.find(reinterpret_cast<uintptr_t>(session));
+			if (it == s_sessions.end())
+				return;
+			exported = std::move(it->second);
+			s_sessions.erase(it);
+		}
+		// Wakes a caller blocked in GetSessionEncodedFrames, which then
+		// returns and lets go of the session.
+		exported->session->Shutdown();
+	}
+
+	WEBRTCUTILS_API void SetSessionFrameCallback(SessionHandle session, SessionFrameCallback callback, void* context)
+	{
+		std::shared_ptr<ExportedSession> exported = FindExportedSession(session);
+		if (exported == nullptr)
+			return;
+
+		// Unhooking first waits out a callback in flight, so the new pair is
+		// never seen half written.
+		exported->session->SetFrameCallback(nullptr, nullptr);
+		exported->frameCallback = callback;
+		exported->frameCallbackContext = context;
+		if (callback != nullptr)
+			exported->session->SetFrameCallback(DeliverToSessionCallback, exported.get());
+	}
+
+	WEBRTCUTILS_API uint32_t GetSessionEncodedFrames(SessionHandle session, EncodedFrameHandle* frames, uint32_t maxFrames, uint32_t timeoutMs)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		return PullFrames(captureSession.get(), captureSession.get(), frames, maxFrames, timeoutMs);
+	}
+
+	WEBRTCUTILS_API bool GetSessionQueueStats(SessionHandle session, QueueStats* stats)
+	{
+		return FillQueueStats(FindSession(session).get(), stats);
+	}
+
+	WEBRTCUTILS_API bool ReconfigureSession(SessionHandle session, const EncoderConfig* config)
+	{
+		return ApplyEncoderConfig(FindSession(session).get(), config);
+	}
+
+	WEBRTCUTILS_API void RequestSessionKeyFrame(SessionHandle session)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		if (captureSession != nullptr)
+			captureSession->RequestKeyFrame();
+	}
+
+	WEBRTCUTILS_API bool RequestSessionLayerKeyFrame(SessionHandle session, uint32_t layer)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		return captureSession != nullptr && captureSession->RequestKeyFrame(layer);
+	}
+
+	WEBRTCUTILS_API bool GetSessionLayerStats(SessionHandle session, uint32_t layer, LayerStats* stats)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		SimulcastEncoder::LayerStats layerStats;
+		if (captureSession == nullptr || stats == nullptr || !captureSession->GetLayerStats(layer, layerStats))
+			return false;
+
+		stats->framesEncoded = layerStats.queues.framesEncoded;
+		stats->bytesEncoded = layerStats.bytesEncoded;
+		stats->keyFrames = layerStats.keyFrames;
+		stats->captureDrops = layerStats.queues.captureDrops;
+		stats->scaleDrops = layerStats.scaleDrops;
+		stats->captureQueueDepth = layerStats.queues.captureQueueDepth;
+		stats->deliveryQueueDepth = layerStats.queues.deliveryQueueDepth;
 		return true;
 	}
 
+	WEBRTCUTILS_API bool GetSessionPipelineStats(SessionHandle session, PipelineStats* stats)
+	{
+		return FillPipelineStats(FindSession(session).get(), stats);
+	}
+
+	WEBRTCUTILS_API bool StartSessionRecording(SessionHandle session, const wchar_t* fileName, const RecordingConfig* config)
+	{
+		return BeginRecording(FindSession(session).get(), fileName, config);
+	}
+
+	WEBRTCUTILS_API void StopSessionRecording(SessionHandle session)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		if (captureSession != nullptr)
+			captureSession->StopRecording();
+	}
+
+	WEBRTCUTILS_API bool GetSessionRecordingStats(SessionHandle session, RecordingStats* stats)
+	{
+		return FillRecordingStats(FindSession(session).get(), stats);
+	}
+
+	WEBRTCUTILS_API bool DumpSessionReplay(SessionHandle session, const wchar_t* fileName, uint32_t seconds)
+	{
+		std::shared_ptr<CaptureSession> captureSession = FindSession(session);
+		if (captureSession == nullptr || fileName == nullptr)
+			return false;
+		return captureSession->DumpReplay(fileName, seconds);
+	}
+
+	WEBRTCUTILS_API bool Setup()
+	{
+		CaptureSession::Config config;
+		config.pipeline = s_pipelineConfig;
+		config.pullCapacity = s_pullCapacity;
+		config.encoder = s_encoderSettings;
+		config.replaySeconds = s_replaySeconds;
+		if (s_replayMemoryBudget > 0)
+			config.replayMemoryBudget = s_replayMemoryBudget;
+		ApplyDownscaleFilter(s_downscaleFilter, config);
+		config.adaptToCpu = s_adaptToCpu;
+		config.skipStaticFrames = s_skipStaticFrames;
+
+		auto session = std::make_shared<CaptureSession>(std::move(config));
+		bool initialized = session->Initialize();
+		session->SetFrameCallback(DeliverToLegacyCallbacks, nullptr);
+		std::atomic_store(&s_defaultSession, session);
+		return initialized;
+	}
+
 	WEBRTCUTILS_API bool StartVideo()
 	{
-		if (s_mediaCapture == nullptr || s_mediaReader == nullptr)
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		if (session == nullptr)
 			return false;
-			
-		MediaFrameReaderStartStatus status = s_mediaReader.StartAsync().get();
-		return status == MediaFrameReaderStartStatus::Success;
+		return session->Start();
 	}
 	
 	WEBRTCUTILS_API void SetFrameEncodedCallback(FrameEncodedCallback callback)
 	{
 		s_frameEncodedCallback = callback;
 	}
+
+	WEBRTCUTILS_API void SetEncodedFrameHandleCallback(EncodedFrameHandleCallback callback)
+	{
+		s_encodedFrameHandleCallback = callback;
+	}
+
+	WEBRTCUTILS_API void AcquireEncodedFrame(EncodedFrameHandle frame)
+	{
+		s_frameHandles.Acquire(frame);
+	}
+
+	WEBRTCUTILS_API void ReleaseEncodedFrame(EncodedFrameHandle frame)
+	{
+		s_frameHandles.Release(frame);
+	}
+
+	WEBRTCUTILS_API bool GetEncodedFrameInfo(EncodedFrameHandle frame, EncodedFrameInfo* info)
+	{
+		if (frame == nullptr || info == nullptr)
+			return false;
+
+		EncodedFrameRef encoded = s_frameHandles.Find(frame);
+		if (!encoded)
+			return false;
+
+		info->data = encoded->Data();
+		info->size = static_cast<uint32_t>(encoded->Size());
+		info->timestamp = encoded->Timestamp();
+		info->keyFrame = encoded->IsKeyFrame();
+		info->layer = encoded->Layer();
+		info->rid = encoded->Rid();
+		return true;
+	}
+
+	WEBRTCUTILS_API uint32_t GetOutstandingEncodedFrames()
+	{
+		return s_frameHandles.Outstanding();
+	}
+
+	WEBRTCUTILS_API void SetEncodedFramePullCapacity(uint32_t capacity)
+	{
+		s_pullCapacity = capacity;
+	}
+
+	WEBRTCUTILS_API uint32_t GetEncodedFrames(EncodedFrameHandle* frames, uint32_t maxFrames, uint32_t timeoutMs)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		return PullFrames(session.get(), nullptr, frames, maxFrames, timeoutMs);
+	}
+
+	WEBRTCUTILS_API void SetCaptureQueuePolicy(uint32_t capacity, CaptureDropPolicy policy)
+	{
+		s_pipelineConfig.captureQueueCapacity = capacity;
+		s_pipelineConfig.captureDropPolicy = ToDropPolicy(policy);
+	}
+
+	WEBRTCUTILS_API bool GetQueueStats(QueueStats* stats)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		return FillQueueStats(session.get(), stats);
+	}
+
+	WEBRTCUTILS_API bool GetPipelineStats(PipelineStats* stats)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		return FillPipelineStats(session.get(), stats);
+	}
+
+	WEBRTCUTILS_API bool SetEncoderConfig(const EncoderConfig* config)
+	{
+		return ToEncoderSettings(config, s_encoderSettings);
+	}
+
+	WEBRTCUTILS_API bool Reconfigure(const EncoderConfig* config)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		return ApplyEncoderConfig(session.get(), config);
+	}
+
+	WEBRTCUTILS_API void RequestKeyFrame()
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		if (session != nullptr)
+			session->RequestKeyFrame();
+	}
+
+	WEBRTCUTILS_API uint32_t GetTraceJson(char* buffer, uint32_t capacity)
+	{
+#ifdef WEBRTCUTILS_TRACING
+		std::string json = Trace::ExportChromeJson();
+		if (buffer != nullptr && capacity > json.size())
+			memcpy(buffer, json.c_str(), json.size() + 1);
+		return static_cast<uint32_t>(json.size() + 1);
+#else
+		(void)buffer;
+		(void)capacity;
+		return 0;
+#endif
+	}
 	
+	WEBRTCUTILS_API bool StartRecording(const wchar_t* fileName, const RecordingConfig* config)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		return BeginRecording(session.get(), fileName, config);
+	}
+
+	WEBRTCUTILS_API void StopRecording()
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		if (session != nullptr)
+			session->StopRecording();
+	}
+
+	WEBRTCUTILS_API bool GetRecordingStats(RecordingStats* stats)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		return FillRecordingStats(session.get(), stats);
+	}
+
+	WEBRTCUTILS_API void SetReplayBuffer(uint32_t seconds, uint32_t memoryBudget)
+	{
+		s_replaySeconds = seconds;
+		s_replayMemoryBudget = memoryBudget;
+	}
+
+	WEBRTCUTILS_API bool DumpReplay(const wchar_t* fileName, uint32_t seconds)
+	{
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		if (session == nullptr || fileName == nullptr)
+			return false;
+		return session->DumpReplay(fileName, seconds);
+	}
+
+	WEBRTCUTILS_API void SetDownscaleFilter(DownscaleFilter filter)
+	{
+		s_downscaleFilter = filter;
+	}
+
+	WEBRTCUTILS_API void SetCpuAdaptation(bool enabled)
+	{
+		s_adaptToCpu = enabled;
+	}
+
+	WEBRTCUTILS_API void SetStaticFrameSkipping(bool enabled)
+	{
+		s_skipStaticFrames = enabled;
+	}
+
 	WEBRTCUTILS_API bool Shutdown()
 	{
-		if (s_mediaCapture == nullptr)
-		{
-			s_mediaCapture.Close();
-			s_mediaCapture = nullptr;
-		}
-		if (s_mediaReader != nullptr)
-		{
-			s_mediaReader.StopAsync().get();
-			s_mediaReader = nullptr;
-		}
-		s_encoder.Shutdown();
+		std::shared_ptr<CaptureSession> session = std::atomic_load(&s_defaultSession);
+		if (session != nullptr)
+			session->Shutdown();
+		std::atomic_store(&s_defaultSession, std::shared_ptr<CaptureSession>());
+		// Handles the app never gave back would pin their arenas forever.
+		s_frameHandles.ReleaseAll(nullptr);
 		
 		return true;
 	}
@@ -8,9 +8,354 @@
 
 using FrameEncodedCallback = void (*)(int rtpDuration, uint8_t* data, uint32_t size);
 
+// Opaque reference to a native encoded frame. The handle passed to an
+// EncodedFrameHandleCallback is only valid during the callback unless it is
+// kept with AcquireEncodedFrame, which must be balanced by ReleaseEncodedFrame.
+// Handles are never reused; calls with a stale or unknown handle are ignored.
+// Shutdown releases whatever the default session's handles still hold.
+using EncodedFrameHandle = void*;
+using EncodedFrameHandleCallback = void (*)(int rtpDuration, EncodedFrameHandle frame);
+
+struct EncodedFrameInfo
+{
+	const uint8_t* data;
+	uint32_t size;
+	// Capture media time in 100 ns units; the first frame is at zero. The
+	// RTP timestamp is timestamp * 9 / 1000 at the 90 kHz clock.
+	int64_t timestamp;
+	bool keyFrame;
+	// Simulcast layer, 0 for the main stream, and its rid; the rid lives as
+	// long as the frame and is empty when none was configured.
+	uint32_t layer;
+	const char* rid;
+};
+
+enum CaptureDropPolicy : int32_t
+{
+	CaptureDropPolicy_DropOldest = 0,
+	CaptureDropPolicy_LatestOnly = 1,
+};
+
+enum EncoderBackend : int32_t
+{
+	EncoderBackend_MediaFoundation = 0,
+	// Software encoder; only available in builds with WEBRTCUTILS_OPENH264.
+	EncoderBackend_OpenH264 = 1,
+};
+
+struct QueueStats
+{
+	uint32_t captureQueueDepth;
+	uint32_t deliveryQueueDepth;
+	uint64_t framesCaptured;
+	uint64_t captureDrops;
+	uint64_t framesEncoded;
+	uint64_t deliveryDrops;
+	uint64_t framesDelivered;
+};
+
+struct LatencyPercentiles
+{
+	uint64_t count;
+	// Microseconds.
+	uint64_t p50;
+	uint64_t p95;
+	uint64_t p99;
+	uint64_t max;
+};
+
+struct PipelineStats
+{
+	// Rates cover the time since the previous GetPipelineStats call.
+	double captureFps;
+	double encodedFps;
+	// Bits per second.
+	double encodedBitrate;
+	uint64_t framesCaptured;
+	uint64_t framesEncoded;
+	uint64_t keyFrames;
+	uint64_t bytesEncoded;
+	uint64_t dropsNoConsumer;
+	uint64_t dropsCaptureQueue;
+	uint64_t dropsFormatChange;
+	uint64_t dropsDeliveryQueue;
+	uint64_t dropsPullQueue;
+	uint64_t dropsConversion;
+	uint64_t dropsAdaptation;
+	uint64_t dropsStaticScene;
+	uint32_t captureQueueDepth;
+	uint32_t deliveryQueueDepth;
+	uint32_t pullQueueDepth;
+	// From frame arrival to encoded output.
+	LatencyPercentiles captureToEncoded;
+	// From encoder input to encoded output.
+	LatencyPercentiles encodeLatency;
+	// CPU adaptation; level 0 runs the configured settings.
+	uint32_t adaptationLevel;
+	uint32_t adaptedWidth;
+	uint32_t adaptedHeight;
+	uint32_t adaptedFrameRate;
+	// Smoothed share of the frame interval spent encoding.
+	double encodeUsage;
+	// Share of the luma tiles that changed in the last frame checked for a
+	// static scene, and how many frames showed no change.
+	double changeRatio;
+	uint64_t framesUnchanged;
+};
+
+enum EncoderProfile : int32_t
+{
+	EncoderProfile_Baseline = 0,
+	EncoderProfile_Main = 1,
+	EncoderProfile_High = 2,
+};
+
+struct EncoderConfig
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t frameRate;
+	// Bits per second.
+	uint32_t bitrate;
+	EncoderProfile profile;
+	// level_idc, e.g. 41 for level 4.1.
+	uint32_t level;
+};
+
+enum RecordingSync : int32_t
+{
+	RecordingSync_None = 0,
+	// Flushes to disk once, when the recording stops.
+	RecordingSync_OnStop = 1,
+	RecordingSync_EveryWrite = 2,
+};
+
+enum RecordingContainer : int32_t
+{
+	RecordingContainer_AnnexB = 0,
+	// Fragmented MP4 with per-frame timestamps, cut at every key frame.
+	RecordingContainer_FragmentedMp4 = 1,
+};
+
+enum DownscaleFilter : int32_t
+{
+	// Reconfigure to a new size always switches the camera format.
+	DownscaleFilter_None = 0,
+	DownscaleFilter_Bilinear = 1,
+	// Area average; sharper results below half size.
+	DownscaleFilter_Box = 2,
+};
+
+struct RecordingConfig
+{
+	// Bytes buffered between the encoder and the disk; zero keeps 8 MiB.
+	uint32_t memoryBudget;
+	RecordingSync sync;
+	RecordingContainer container;
+};
+
+struct RecordingStats
+{
+	uint64_t framesRecorded;
+	uint64_t bytesWritten;
+	uint64_t writes;
+	// Frames lost because the disk fell behind, including the ones skipped
+	// until the next key frame.
+	uint64_t framesDropped;
+	uint64_t writeErrors;
+	bool recording;
+};
+
+struct SimulcastLayer
+{
+	uint32_t width;
+	uint32_t height;
+	// Bits per second.
+	uint32_t bitrate;
+	// RTP stream id, at most 16 characters. May be null.
+	const char* rid;
+};
+
+struct LayerStats
+{
+	uint64_t framesEncoded;
+	uint64_t bytesEncoded;
+	uint64_t keyFrames;
+	uint64_t captureDrops;
+	// Frames the layer was skipped for because nothing larger was captured.
+	uint64_t scaleDrops;
+	uint32_t captureQueueDepth;
+	uint32_t deliveryQueueDepth;
+};
+
+struct VideoRect
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Independent capture session with its own camera, encoder and queues.
+using SessionHandle = void*;
+using SessionFrameCallback = void (*)(void* context, int rtpDuration, EncodedFrameHandle frame);
+
+struct SessionConfig
+{
+	// Null or empty selects the first color camera.
+	const wchar_t* videoDeviceId;
+	// Zero keeps the default capacity of one.
+	uint32_t captureQueueCapacity;
+	CaptureDropPolicy captureDropPolicy;
+	// Zero disables pull mode.
+	uint32_t pullCapacity;
+	EncoderBackend encoderBackend;
+	// Null keeps 640x480 at 30 fps and 1.5 Mbps.
+	const EncoderConfig* encoder;
+	// Seconds kept for DumpSessionReplay; zero disables instant replay.
+	uint32_t replaySeconds;
+	// Hard cap on replay memory in bytes; zero keeps 32 MiB.
+	uint32_t replayMemoryBudget;
+	// With a filter, reconfiguring to a size below the capture size scales
+	// frames instead of reopening the camera.
+	DownscaleFilter downscaleFilter;
+	// Part of the camera frame to encode, without copying; a zero width or
+	// height keeps the whole frame. Odd edges are widened to even ones, and
+	// the encoder size must match the result.
+	VideoRect crop;
+	// Largest first, each no larger than the one before. The first layer is
+	// the main stream and replaces the encoder's size and bitrate; the
+	// others share its frame rate, profile and level and are scaled from
+	// it. Zero layers encode a single stream.
+	const SimulcastLayer* simulcastLayers;
+	uint32_t simulcastLayerCount;
+	// Lowers the frame rate, then the size, while encoding falls behind.
+	bool adaptToCpu;
+	// Encodes frames that show no change only once per keep-alive interval,
+	// in milliseconds; zero keeps the default of one second.
+	bool skipStaticFrames;
+	uint32_t staticKeepAliveMs;
+};
+
 extern "C" {
 	WEBRTCUTILS_API void SetFrameEncodedCallback(FrameEncodedCallback callback);
+
+	WEBRTCUTILS_API void SetEncodedFrameHandleCallback(EncodedFrameHandleCallback callback);
+
+	WEBRTCUTILS_API void AcquireEncodedFrame(EncodedFrameHandle frame);
+
+	WEBRTCUTILS_API void ReleaseEncodedFrame(EncodedFrameHandle frame);
+
+	WEBRTCUTILS_API bool GetEncodedFrameInfo(EncodedFrameHandle frame, EncodedFrameInfo* info);
+
+	WEBRTCUTILS_API uint32_t GetOutstandingEncodedFrames();
+
+	// Must be called before Setup; a capacity of 0 disables pull mode.
+	WEBRTCUTILS_API void SetEncodedFramePullCapacity(uint32_t capacity);
+
+	// Fills frames with every pending encoded frame, up to maxFrames, waiting
+	// up to timeoutMs for the first one. Every returned handle is acquired and must
+	// be given back with ReleaseEncodedFrame. Call from one thread only.
+	WEBRTCUTILS_API uint32_t GetEncodedFrames(EncodedFrameHandle* frames, uint32_t maxFrames, uint32_t timeoutMs);
+
+	// Must be called before Setup.
+	WEBRTCUTILS_API void SetCaptureQueuePolicy(uint32_t capacity, CaptureDropPolicy policy);
+
+	WEBRTCUTILS_API bool GetQueueStats(QueueStats* stats);
+
+	WEBRTCUTILS_API bool GetPipelineStats(PipelineStats* stats);
+
+	// Must be called before Setup.
+	WEBRTCUTILS_API bool SetEncoderConfig(const EncoderConfig* config);
+
+	// Changes the running encoder. Bitrate and frame rate apply from the next
+	// frame; a new size or profile restarts the stream with an IDR frame.
+	WEBRTCUTILS_API bool Reconfigure(const EncoderConfig* config);
+
+	// Asks for an IDR frame, e.g. on a PLI or FIR from a receiver. Callable
+	// from any thread; requests arriving close together share one IDR, and
+	// forced IDRs are at least 500 ms apart.
+	WEBRTCUTILS_API void RequestKeyFrame();
+
+	// Copies the pipeline trace as Chrome trace JSON into buffer and returns
+	// the size it needs including the terminator; nothing is written when
+	// capacity is smaller. Returns 0 in builds without WEBRTCUTILS_TRACING.
+	WEBRTCUTILS_API uint32_t GetTraceJson(char* buffer, uint32_t capacity);
+
+	// Records the encoded stream of the default session to an H.264 file,
+	// replacing any recording in progress. Relative names are placed in the
+	// app's local folder. A null config keeps the defaults. Setup starts a
+	// recording to output.h264.
+	WEBRTCUTILS_API bool StartRecording(const wchar_t* fileName, const RecordingConfig* config);
+
+	WEBRTCUTILS_API void StopRecording();
+
+	WEBRTCUTILS_API bool GetRecordingStats(RecordingStats* stats);
+
+	// Must be called before Setup. Keeps the last seconds of encoded video
+	// in memory, never more than memoryBudget bytes (zero keeps 32 MiB);
+	// zero seconds disables instant replay.
+	WEBRTCUTILS_API void SetReplayBuffer(uint32_t seconds, uint32_t memoryBudget);
+
+	// Writes at least the last seconds of video, starting at the key frame
+	// before them, as H.264 or, for names ending in .mp4, fragmented MP4.
+	// Relative names are placed in the app's local folder.
+	WEBRTCUTILS_API bool DumpReplay(const wchar_t* fileName, uint32_t seconds);
+
+	// Must be called before Setup. With a filter, Reconfigure to a size no
+	// larger than the camera's scales frames before encoding instead of
+	// switching the camera format.
+	WEBRTCUTILS_API void SetDownscaleFilter(DownscaleFilter filter);
+
+	// Must be called before Setup. While encoding cannot keep up, the frame
+	// rate and then the size are lowered, and restored once it has caught
+	// up for a while; the adapted values are in PipelineStats.
+	WEBRTCUTILS_API void SetCpuAdaptation(bool enabled);
+
+	// Must be called before Setup. Frames that show nothing new are not
+	// encoded, apart from one a second; the change ratio is in PipelineStats.
+	WEBRTCUTILS_API void SetStaticFrameSkipping(bool enabled);
 	
+	// Returns null when the camera could not be opened. Sessions are
+	// independent of the default session driven by Setup/StartVideo.
+	WEBRTCUTILS_API SessionHandle CreateSession(const SessionConfig* config);
+
+	WEBRTCUTILS_API bool StartSession(SessionHandle session);
+
+	// Stops capture and frees the session. A GetSessionEncodedFrames blocked
+	// on another thread returns early, and the session is freed once it
+	// has; later calls with the handle do nothing. Frames still held through
+	// AcquireEncodedFrame stay valid until released.
+	WEBRTCUTILS_API void DestroySession(SessionHandle session);
+
+	WEBRTCUTILS_API void SetSessionFrameCallback(SessionHandle session, SessionFrameCallback callback, void* context);
+
+	// Same contract as GetEncodedFrames, per session.
+	WEBRTCUTILS_API uint32_t GetSessionEncodedFrames(SessionHandle session, EncodedFrameHandle* frames, uint32_t maxFrames, uint32_t timeoutMs);
+
+	WEBRTCUTILS_API bool GetSessionQueueStats(SessionHandle session, QueueStats* stats);
+
+	WEBRTCUTILS_API bool ReconfigureSession(SessionHandle session, const EncoderConfig* config);
+
+	// Forces an IDR on every simulcast layer.
+	WEBRTCUTILS_API void RequestSessionKeyFrame(SessionHandle session);
+
+	// For a PLI or FIR on one simulcast layer.
+	WEBRTCUTILS_API bool RequestSessionLayerKeyFrame(SessionHandle session, uint32_t layer);
+
+	// Layers from 1 up; the main stream is in GetSessionPipelineStats.
+	WEBRTCUTILS_API bool GetSessionLayerStats(SessionHandle session, uint32_t layer, LayerStats* stats);
+
+	WEBRTCUTILS_API bool GetSessionPipelineStats(SessionHandle session, PipelineStats* stats);
+
+	WEBRTCUTILS_API bool StartSessionRecording(SessionHandle session, const wchar_t* fileName, const RecordingConfig* config);
+
+	WEBRTCUTILS_API void StopSessionRecording(SessionHandle session);
+
+	WEBRTCUTILS_API bool GetSessionRecordingStats(SessionHandle session, RecordingStats* stats);
+
+	WEBRTCUTILS_API bool DumpSessionReplay(SessionHandle session, const wchar_t* fileName, uint32_t seconds);
+
 	WEBRTCUTILS_API bool Setup();
 	
 	WEBRTCUTILS_API bool StartVideo();